@@ -0,0 +1,183 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Support code for the headers generated by pi_gen_fe_cpp_builders. Every
+// property of a match field / action parameter (offset in the data buffer,
+// bitwidth, byte0 mask) is a template parameter, so setting a field does not
+// require any p4info lookup and the byte copies can be fully unrolled by the
+// compiler. Integral setters are checked at compile-time: using a C++ type
+// which is too narrow for the field is a compilation error.
+
+#ifndef PI_FRONTENDS_CPP_CODEGEN_H_
+#define PI_FRONTENDS_CPP_CODEGEN_H_
+
+#include <PI/pi.h>
+
+#include <PI/int/pi_int.h>
+#include <PI/int/serialize.h>
+
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace pi {
+
+namespace codegen {
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct FieldBase {
+  static constexpr pi_p4_id_t id = Id;
+  static constexpr size_t offset = Offset;
+  static constexpr size_t bitwidth = Bitwidth;
+  static constexpr size_t nbytes = (Bitwidth + 7) / 8;
+  static constexpr unsigned char byte0_mask =
+      (Bitwidth % 8 == 0) ? 0xff : ((1u << (Bitwidth % 8)) - 1);
+
+  // writes v in network byte order, truncated to the field's bitwidth
+  template <typename T>
+  static void write(char *dst, T v) {
+    static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value,
+                  "Only unsigned integral types are supported");
+    static_assert(Bitwidth <= sizeof(T) * 8,
+                  "Field is wider than the provided integral type");
+    for (size_t i = 0; i < nbytes; i++)
+      dst[i] = static_cast<char>(v >> (8 * (nbytes - 1 - i)));
+    dst[0] &= byte0_mask;
+  }
+
+  // src has to be exactly nbytes long
+  static void write(char *dst, const char *src) {
+    std::memcpy(dst, src, nbytes);
+    dst[0] &= byte0_mask;
+  }
+
+  static void write_repeated(char *dst, char c) {
+    std::memset(dst, c, nbytes);
+    dst[0] &= byte0_mask;
+  }
+};
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+constexpr pi_p4_id_t FieldBase<Id, Offset, Bitwidth>::id;
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+constexpr size_t FieldBase<Id, Offset, Bitwidth>::offset;
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+constexpr size_t FieldBase<Id, Offset, Bitwidth>::bitwidth;
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+constexpr size_t FieldBase<Id, Offset, Bitwidth>::nbytes;
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+constexpr unsigned char FieldBase<Id, Offset, Bitwidth>::byte0_mask;
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct ExactField : public FieldBase<Id, Offset, Bitwidth> {
+  using Base = FieldBase<Id, Offset, Bitwidth>;
+
+  template <typename T>
+  static void set(pi_match_key_t *mk, T key) {
+    Base::write(mk->data + Offset, key);
+  }
+
+  static void set(pi_match_key_t *mk, const char *key) {
+    Base::write(mk->data + Offset, key);
+  }
+};
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct LpmField : public FieldBase<Id, Offset, Bitwidth> {
+  using Base = FieldBase<Id, Offset, Bitwidth>;
+
+  template <typename T>
+  static void set(pi_match_key_t *mk, T key, int prefix_length) {
+    Base::write(mk->data + Offset, key);
+    emit_uint32(mk->data + Offset + Base::nbytes, prefix_length);
+  }
+
+  static void set(pi_match_key_t *mk, const char *key, int prefix_length) {
+    Base::write(mk->data + Offset, key);
+    emit_uint32(mk->data + Offset + Base::nbytes, prefix_length);
+  }
+};
+
+// also used for range fields, with key == start and mask == end
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct TernaryField : public FieldBase<Id, Offset, Bitwidth> {
+  using Base = FieldBase<Id, Offset, Bitwidth>;
+
+  template <typename T>
+  static void set(pi_match_key_t *mk, T key, T mask) {
+    Base::write(mk->data + Offset, key);
+    Base::write(mk->data + Offset + Base::nbytes, mask);
+  }
+
+  static void set(pi_match_key_t *mk, const char *key, const char *mask) {
+    Base::write(mk->data + Offset, key);
+    Base::write(mk->data + Offset + Base::nbytes, mask);
+  }
+};
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+using RangeField = TernaryField<Id, Offset, Bitwidth>;
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct OptionalField : public FieldBase<Id, Offset, Bitwidth> {
+  using Base = FieldBase<Id, Offset, Bitwidth>;
+
+  template <typename T>
+  static void set(pi_match_key_t *mk, T key, bool is_wildcard) {
+    Base::write(mk->data + Offset, key);
+    Base::write_repeated(mk->data + Offset + Base::nbytes,
+                         is_wildcard ? '\x00' : '\xff');
+  }
+
+  static void set(pi_match_key_t *mk, const char *key, bool is_wildcard) {
+    Base::write(mk->data + Offset, key);
+    Base::write_repeated(mk->data + Offset + Base::nbytes,
+                         is_wildcard ? '\x00' : '\xff');
+  }
+};
+
+template <pi_p4_id_t Id, size_t Offset>
+struct ValidField : public FieldBase<Id, Offset, 1> {
+  static void set(pi_match_key_t *mk, bool key) {
+    mk->data[Offset] = key ? 1 : 0;
+  }
+};
+
+template <pi_p4_id_t Id, size_t Offset, size_t Bitwidth>
+struct ActionParam : public FieldBase<Id, Offset, Bitwidth> {
+  using Base = FieldBase<Id, Offset, Bitwidth>;
+
+  template <typename T>
+  static void set(pi_action_data_t *ad, T arg) {
+    Base::write(ad->data + Offset, arg);
+  }
+
+  static void set(pi_action_data_t *ad, const char *arg) {
+    Base::write(ad->data + Offset, arg);
+  }
+};
+
+}  // namespace codegen
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_CPP_CODEGEN_H_
@@ -232,6 +232,7 @@ class ActionData {
 class ActionEntry {
  public:
   friend class MatchTable;
+  friend class MatchTableBatch;
 
   ActionEntry()
       : tag(Tag::NONE) {
@@ -360,6 +361,91 @@ class MatchTable {
   pi_p4_id_t table_id;
 };
 
+// Accumulates add / modify / delete operations for one table and applies them
+// all at once, in a single pi_batch_begin / pi_batch_end block. The match keys
+// and action data of all the operations are copied into one contiguous arena,
+// so the MatchKey / ActionEntry objects can be re-used (or destroyed) by the
+// caller as soon as the operation has been added to the batch. Note however
+// that direct resource configs are not copied: the caller still owns them and
+// they need to remain valid until execute() returns. The batch can be re-used
+// after calling clear(), in which case no memory allocation is required for
+// batches which are not larger than the previous ones.
+class MatchTableBatch {
+ public:
+  MatchTableBatch(pi_session_handle_t sess, pi_dev_tgt_t dev_tgt,
+                  const pi_p4info_t *p4info, pi_p4_id_t table_id);
+
+  pi_p4_id_t get_id() const { return table_id; }
+
+  // each of these methods returns the index of the operation in the batch,
+  // which can then be used to retrieve its status and entry handle once the
+  // batch has been executed
+  size_t entry_add(const MatchKey &match_key, const ActionEntry &action_entry,
+                   bool overwrite);
+  size_t entry_modify_wkey(const MatchKey &match_key,
+                           const ActionEntry &action_entry);
+  size_t entry_delete_wkey(const MatchKey &match_key);
+
+  size_t size() const { return ops.size(); }
+
+  void reserve(size_t num_ops);
+
+  // removes all operations and results, but keeps the allocated memory
+  void clear();
+
+  // Runs all the operations in order. Every operation is attempted, even if a
+  // previous one failed. The return value is the status of the batch itself
+  // (pi_batch_begin / pi_batch_end), per-operation statuses are available
+  // through status(). If pi_batch_begin fails, no operation is attempted and
+  // every per-operation status is set to the pi_batch_begin error.
+  pi_status_t execute(bool hw_sync = false);
+
+  pi_status_t status(size_t idx) const { return statuses.at(idx); }
+
+  // only meaningful for successful entry_add operations
+  pi_entry_handle_t entry_handle(size_t idx) const {
+    return entry_handles.at(idx);
+  }
+
+  // number of operations which did not return PI_STATUS_SUCCESS during the
+  // last execute() call
+  size_t num_errors() const { return errors; }
+
+ private:
+  enum class OpType { ADD, MODIFY, DELETE };
+
+  struct Op {
+    OpType type;
+    bool overwrite;
+    pi_priority_t priority;
+    size_t mk_offset;
+    pi_action_entry_type_t entry_type;
+    pi_p4_id_t action_id;
+    size_t ad_offset;
+    size_t ad_size;
+    pi_indirect_handle_t indirect_handle;
+    pi_entry_properties_t properties;
+    size_t res_offset;
+    size_t num_res;
+  };
+
+  Op &push_op(OpType type, const MatchKey &match_key);
+  void push_action_entry(Op *op, const ActionEntry &action_entry);
+  size_t push_bytes(const char *src, size_t size);
+
+  pi_session_handle_t sess;
+  pi_dev_tgt_t dev_tgt;
+  const pi_p4info_t *p4info;
+  pi_p4_id_t table_id;
+  size_t mk_size;
+  std::vector<Op> ops;
+  std::vector<char> arena;
+  std::vector<pi_direct_res_config_one_t> res_configs;
+  std::vector<pi_status_t> statuses;
+  std::vector<pi_entry_handle_t> entry_handles;
+  size_t errors{0};
+};
+
 // TODO(antonin): move to separate file
 class ActProf {
  public:
@@ -24,10 +24,13 @@
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <vector>
 
 #include "_assert.h"
 // auto-generated #define's
 #include "pi_fe_defines_p4.h"
+// auto-generated C++ builders
+#include "pi_fe_cpp_builders_p4.h"
 
 namespace {
 
@@ -82,6 +85,59 @@ int add_route_fast(uint32_t prefix, int pLen, uint32_t nhop, uint16_t port,
   return rc;
 }
 
+// generated builders: field offsets and widths are compile-time constants, no
+// p4info lookup when formatting the match key and the action data
+int add_route_codegen(uint32_t prefix, int pLen, uint32_t nhop, uint16_t port,
+                      pi_entry_handle_t *handle) {
+  using ipv4_lpm = pi_fe_p4::tables::ipv4_lpm;
+  using set_nhop = pi_fe_p4::actions::set_nhop;
+
+  // match key
+  thread_local pi::MatchKey match_key(p4info, ipv4_lpm::table_id);
+  match_key.reset();
+  ipv4_lpm::set_mf_ipv4_dstAddr(match_key.get(), prefix, pLen);
+
+  // action data
+  thread_local pi::ActionEntry action_entry;
+  if (!action_entry.is_initialized())
+    action_entry.init_action_data(p4info, set_nhop::action_id);
+  auto action_data = action_entry.mutable_action_data();
+  action_data->reset();
+  set_nhop::set_arg_nhop_ipv4(action_data->get(), nhop);
+  set_nhop::set_arg_port(action_data->get(), port);
+
+  pi::MatchTable mt(sess, dev_tgt, p4info, ipv4_lpm::table_id);
+  return mt.entry_add(match_key, action_entry, true, handle);
+}
+
+// all routes are programmed in a single PI batch
+int add_routes_batch(const std::vector<uint32_t> &prefixes, int pLen,
+                     uint32_t nhop, uint16_t port) {
+  pi::error_code_t rc = 0;
+
+  pi::MatchTableBatch batch(sess, dev_tgt, p4info, PI_P4_TABLE_IPV4_LPM);
+  batch.reserve(prefixes.size());
+
+  // the batch makes a copy, so the same objects can be re-used for all routes
+  pi::MatchKey match_key(p4info, PI_P4_TABLE_IPV4_LPM);
+  pi::ActionEntry action_entry;
+  action_entry.init_action_data(p4info, PI_P4_ACTION_SET_NHOP);
+  auto action_data = action_entry.mutable_action_data();
+  rc |= action_data->set_arg(PI_P4_ACTIONP_SET_NHOP_NHOP_IPV4, nhop);
+  rc |= action_data->set_arg(PI_P4_ACTIONP_SET_NHOP_PORT, port);
+
+  for (auto prefix : prefixes) {
+    match_key.reset();
+    rc |= match_key.set_lpm(PI_P4_MF_IPV4_LPM_IPV4_DSTADDR, prefix, pLen);
+    batch.entry_add(match_key, action_entry, true);
+  }
+
+  rc |= batch.execute();
+  rc |= static_cast<pi::error_code_t>(batch.num_errors());
+
+  return rc;
+}
+
 }  // namespace
 
 int main() {
@@ -110,6 +166,10 @@ int main() {
   uint16_t port_2 = 8;
   _PI_ASSERT(!add_route(ipv4_dstAddr, 8, ipv4_dstAddr, port_1, &handle));
   _PI_ASSERT(!add_route_fast(ipv4_dstAddr, 16, ipv4_dstAddr, port_2, &handle));
+  _PI_ASSERT(
+      !add_route_codegen(ipv4_dstAddr, 24, ipv4_dstAddr, port_2, &handle));
+  _PI_ASSERT(!add_routes_batch({0x0b000000, 0x0c000000, 0x0d000000}, 8,
+                               ipv4_dstAddr, port_1));
 
   pi_session_cleanup(sess);
 
@@ -202,7 +202,8 @@ MatchKey::~MatchKey() = default;
 void
 MatchKey::reset() {
   match_key->priority = 0;
-  memset(_data.data(), 0, _data.size());
+  // only the key data, the pi_match_key_t header needs to be preserved
+  memset(match_key->data, 0, mk_size);
 }
 
 void
@@ -574,7 +575,7 @@ ActionData::~ActionData() { }
 
 void
 ActionData::reset() {
-  memset(_data.data(), 0, _data.size());
+  memset(action_data->data, 0, ad_size);
 }
 
 pi_p4_id_t ActionData::get_action_id() const {
@@ -761,6 +762,182 @@ MatchTable::default_entry_set(const ActionData &action_data) {
   return pi_table_default_action_set(sess, dev_tgt, table_id, &entry);
 }
 
+MatchTableBatch::MatchTableBatch(pi_session_handle_t sess,
+                                 pi_dev_tgt_t dev_tgt,
+                                 const pi_p4info_t *p4info,
+                                 pi_p4_id_t table_id)
+    : sess(sess), dev_tgt(dev_tgt), p4info(p4info), table_id(table_id),
+      mk_size(pi_p4info_table_match_key_size(p4info, table_id)) { }
+
+void
+MatchTableBatch::reserve(size_t num_ops) {
+  ops.reserve(num_ops);
+  // reasonable guess, the arena will grow if needed
+  arena.reserve(num_ops * mk_size * 2);
+}
+
+void
+MatchTableBatch::clear() {
+  ops.clear();
+  arena.clear();
+  res_configs.clear();
+  statuses.clear();
+  entry_handles.clear();
+  errors = 0;
+}
+
+size_t
+MatchTableBatch::push_bytes(const char *src, size_t size) {
+  auto offset = arena.size();
+  arena.insert(arena.end(), src, src + size);
+  return offset;
+}
+
+MatchTableBatch::Op &
+MatchTableBatch::push_op(OpType type, const MatchKey &match_key) {
+  assert(match_key.get_table_id() == table_id);
+  const auto *mk = match_key.get();
+  assert(mk->data_size == mk_size);
+  ops.emplace_back();
+  auto &op = ops.back();
+  op.type = type;
+  op.overwrite = false;
+  op.priority = mk->priority;
+  op.mk_offset = push_bytes(mk->data, mk_size);
+  op.entry_type = PI_ACTION_ENTRY_TYPE_NONE;
+  op.action_id = 0;
+  op.ad_offset = 0;
+  op.ad_size = 0;
+  op.indirect_handle = 0;
+  pi_entry_properties_clear(&op.properties);
+  op.res_offset = 0;
+  op.num_res = 0;
+  return op;
+}
+
+void
+MatchTableBatch::push_action_entry(Op *op, const ActionEntry &action_entry) {
+  op->properties = action_entry.properties;
+  op->res_offset = res_configs.size();
+  op->num_res = action_entry._configs.size();
+  res_configs.insert(res_configs.end(), action_entry._configs.begin(),
+                     action_entry._configs.end());
+
+  switch (action_entry.type()) {
+    case ActionEntry::Tag::NONE:
+      assert(0);
+      break;
+    case ActionEntry::Tag::ACTION_DATA:
+      {
+        const auto *ad = action_entry.action_data().get();
+        op->entry_type = PI_ACTION_ENTRY_TYPE_DATA;
+        op->action_id = ad->action_id;
+        op->ad_size = ad->data_size;
+        op->ad_offset = push_bytes(ad->data, ad->data_size);
+      }
+      break;
+    case ActionEntry::Tag::INDIRECT_HANDLE:
+      op->entry_type = PI_ACTION_ENTRY_TYPE_INDIRECT;
+      op->indirect_handle = action_entry.indirect_handle();
+      break;
+  }
+}
+
+size_t
+MatchTableBatch::entry_add(const MatchKey &match_key,
+                           const ActionEntry &action_entry, bool overwrite) {
+  auto &op = push_op(OpType::ADD, match_key);
+  op.overwrite = overwrite;
+  push_action_entry(&op, action_entry);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_modify_wkey(const MatchKey &match_key,
+                                   const ActionEntry &action_entry) {
+  auto &op = push_op(OpType::MODIFY, match_key);
+  push_action_entry(&op, action_entry);
+  return ops.size() - 1;
+}
+
+size_t
+MatchTableBatch::entry_delete_wkey(const MatchKey &match_key) {
+  push_op(OpType::DELETE, match_key);
+  return ops.size() - 1;
+}
+
+pi_status_t
+MatchTableBatch::execute(bool hw_sync) {
+  entry_handles.assign(ops.size(), 0);
+
+  auto status = pi_batch_begin(sess);
+  if (status != PI_STATUS_SUCCESS) {
+    // none of the operations were attempted
+    statuses.assign(ops.size(), status);
+    errors = ops.size();
+    return status;
+  }
+
+  statuses.assign(ops.size(), PI_STATUS_SUCCESS);
+  errors = 0;
+
+  // the arena does not change while we execute the batch, so we can point
+  // directly into it
+  pi_match_key_t match_key;
+  match_key.p4info = p4info;
+  match_key.table_id = table_id;
+  match_key.data_size = mk_size;
+  pi_action_data_t action_data;
+  action_data.p4info = p4info;
+  pi_direct_res_config_t direct_config;
+  pi_table_entry_t entry;
+
+  for (size_t i = 0; i < ops.size(); i++) {
+    const auto &op = ops[i];
+    match_key.priority = op.priority;
+    match_key.data = arena.data() + op.mk_offset;
+
+    if (op.type != OpType::DELETE) {
+      entry.entry_type = op.entry_type;
+      entry.entry_properties = &op.properties;
+      if (op.num_res == 0) {
+        entry.direct_res_config = NULL;
+      } else {
+        direct_config.num_configs = op.num_res;
+        direct_config.configs = &res_configs[op.res_offset];
+        entry.direct_res_config = &direct_config;
+      }
+      if (op.entry_type == PI_ACTION_ENTRY_TYPE_DATA) {
+        action_data.action_id = op.action_id;
+        action_data.data_size = op.ad_size;
+        action_data.data = arena.data() + op.ad_offset;
+        entry.entry.action_data = &action_data;
+      } else {
+        entry.entry.indirect_handle = op.indirect_handle;
+      }
+    }
+
+    switch (op.type) {
+      case OpType::ADD:
+        statuses[i] = pi_table_entry_add(sess, dev_tgt, table_id, &match_key,
+                                         &entry, op.overwrite,
+                                         &entry_handles[i]);
+        break;
+      case OpType::MODIFY:
+        statuses[i] = pi_table_entry_modify_wkey(sess, dev_tgt, table_id,
+                                                 &match_key, &entry);
+        break;
+      case OpType::DELETE:
+        statuses[i] = pi_table_entry_delete_wkey(sess, dev_tgt, table_id,
+                                                 &match_key);
+        break;
+    }
+    if (statuses[i] != PI_STATUS_SUCCESS) errors++;
+  }
+
+  return pi_batch_end(sess, hw_sync);
+}
+
 ActProf::ActProf(pi_session_handle_t sess, pi_dev_tgt_t dev_tgt,
                  const pi_p4info_t *p4info, pi_p4_id_t act_prof_id)
     : sess(sess), dev_tgt(dev_tgt), p4info(p4info), act_prof_id(act_prof_id) { }
@@ -0,0 +1,393 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Sibling of fe_defines.c: instead of plain #define's, generates a C++ header
+// with one struct per table and per action. Offsets, bitwidths and masks are
+// baked into the types (see PI/frontends/cpp/codegen.h) and each struct
+// exposes typed setters which write directly into a pi_match_key_t /
+// pi_action_data_t buffer, without any p4info lookup.
+
+#include "PI/p4info.h"
+#include "read_file.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static void print_help() {
+  fprintf(stderr,
+          "Usage: pi_gen_fe_cpp_builders [OPTIONS]...\n"
+          "Generate C++ match key & action data builders from P4 config\n\n"
+          "-c          path to P4 config\n"
+          "-d          path to destination dir (where .h will be generated)\n"
+          "-n          P4 name to use (for generated fname and namespace)\n");
+}
+
+static char *config_path = NULL;
+static char *dest_dir = NULL;
+static char *p4_name = NULL;
+
+static int parse_opts(int argc, char *const argv[]) {
+  int c;
+
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, "c:d:n:h")) != -1) {
+    switch (c) {
+      case 'c':
+        config_path = optarg;
+        break;
+      case 'd':
+        dest_dir = optarg;
+        break;
+      case 'h':
+        print_help();
+        exit(0);
+      case 'n':
+        p4_name = optarg;
+        break;
+      case '?':
+        if (optopt == 'c' || optopt == 'd' || optopt == 'n') {
+          fprintf(stderr, "Option -%c requires an argument.\n\n", optopt);
+          print_help();
+        } else if (isprint(optopt)) {
+          fprintf(stderr, "Unknown option `-%c'.\n\n", optopt);
+          print_help();
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+          print_help();
+        }
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!config_path || !dest_dir || !p4_name) {
+    fprintf(stderr, "Options -c, -d and -n are ALL required.\n\n");
+    print_help();
+    return 1;
+  }
+
+  return 0;
+}
+
+static void to_upper(char *s) {
+  for (; *s != '\0'; s++) *s = toupper(*s);
+}
+
+// returns a valid C++ identifier, case is preserved; caller has to free
+static char *to_identifier(const char *name) {
+  const char *valid_before = "$valid$";
+  const char *valid_after = "valid";
+  // one extra char in case we need to prepend an underscore
+  char *s = malloc(strlen(name) + 2);
+  char *dst = s;
+  if (isdigit(name[0])) *dst++ = '_';
+  while (*name != '\0') {
+    if (!strncmp(name, valid_before, strlen(valid_before))) {
+      strcpy(dst, valid_after);
+      dst += strlen(valid_after);
+      name += strlen(valid_before);
+      continue;
+    }
+    *dst++ = (isalnum(*name)) ? *name : '_';
+    name++;
+  }
+  *dst = '\0';
+  return s;
+}
+
+// smallest unsigned integral type which can hold a value of the given
+// bitwidth, or NULL if the field is too wide (byte array setters only)
+static const char *int_type_for_bitwidth(size_t bitwidth) {
+  if (bitwidth <= 8) return "uint8_t";
+  if (bitwidth <= 16) return "uint16_t";
+  if (bitwidth <= 32) return "uint32_t";
+  if (bitwidth <= 64) return "uint64_t";
+  return NULL;
+}
+
+static const char prelude[] =
+    "/* This file was auto-generated, do not edit !!!\n"
+    " */\n\n";
+
+static void gen_action(FILE *f, const pi_p4info_t *p4info, pi_p4_id_t id) {
+  char *name_ = to_identifier(pi_p4info_action_name_from_id(p4info, id));
+  fprintf(f, "struct %s {\n", name_);
+  fprintf(f, "  static constexpr pi_p4_id_t action_id = %#x;\n", id);
+  fprintf(f, "  static constexpr size_t data_size = %zu;\n",
+          pi_p4info_action_data_size(p4info, id));
+  size_t num_params = 0;
+  const pi_p4_id_t *params =
+      pi_p4info_action_get_params(p4info, id, &num_params);
+  for (size_t i = 0; i < num_params; i++) {
+    pi_p4_id_t p_id = params[i];
+    char *p_name_ = to_identifier(
+        pi_p4info_action_param_name_from_id(p4info, id, p_id));
+    size_t bitwidth = pi_p4info_action_param_bitwidth(p4info, id, p_id);
+    size_t offset = pi_p4info_action_param_offset(p4info, id, p_id);
+    const char *int_type = int_type_for_bitwidth(bitwidth);
+    fprintf(f, "\n");
+    fprintf(f,
+            "  using param_%s = "
+            "pi::codegen::ActionParam<%#x, %zu, %zu>;\n",
+            p_name_, p_id, offset, bitwidth);
+    if (int_type) {
+      fprintf(f,
+              "  static void set_arg_%s(pi_action_data_t *ad, %s arg) {\n"
+              "    param_%s::set(ad, arg);\n"
+              "  }\n",
+              p_name_, int_type, p_name_);
+    }
+    fprintf(f,
+            "  static void set_arg_%s(pi_action_data_t *ad,\n"
+            "      const char *arg) {\n"
+            "    param_%s::set(ad, arg);\n"
+            "  }\n",
+            p_name_, p_name_);
+    free(p_name_);
+  }
+  fprintf(f, "};\n\n");
+  free(name_);
+}
+
+static void gen_match_field(FILE *f, const char *mf_name_, pi_p4_id_t mf_id,
+                            pi_p4info_match_type_t match_type, size_t offset,
+                            size_t bitwidth) {
+  const char *int_type = int_type_for_bitwidth(bitwidth);
+  fprintf(f, "\n");
+  switch (match_type) {
+    case PI_P4INFO_MATCH_TYPE_VALID:
+      fprintf(f, "  using mf_%s = pi::codegen::ValidField<%#x, %zu>;\n",
+              mf_name_, mf_id, offset);
+      fprintf(f,
+              "  static void set_mf_%s(pi_match_key_t *mk, bool key) {\n"
+              "    mf_%s::set(mk, key);\n"
+              "  }\n",
+              mf_name_, mf_name_);
+      return;
+    case PI_P4INFO_MATCH_TYPE_EXACT:
+      fprintf(f, "  using mf_%s = pi::codegen::ExactField<%#x, %zu, %zu>;\n",
+              mf_name_, mf_id, offset, bitwidth);
+      if (int_type) {
+        fprintf(f,
+                "  static void set_mf_%s(pi_match_key_t *mk, %s key) {\n"
+                "    mf_%s::set(mk, key);\n"
+                "  }\n",
+                mf_name_, int_type, mf_name_);
+      }
+      fprintf(f,
+              "  static void set_mf_%s(pi_match_key_t *mk,\n"
+              "      const char *key) {\n"
+              "    mf_%s::set(mk, key);\n"
+              "  }\n",
+              mf_name_, mf_name_);
+      return;
+    case PI_P4INFO_MATCH_TYPE_LPM:
+      fprintf(f, "  using mf_%s = pi::codegen::LpmField<%#x, %zu, %zu>;\n",
+              mf_name_, mf_id, offset, bitwidth);
+      if (int_type) {
+        fprintf(f,
+                "  static void set_mf_%s(pi_match_key_t *mk, %s key,\n"
+                "      int prefix_length) {\n"
+                "    mf_%s::set(mk, key, prefix_length);\n"
+                "  }\n",
+                mf_name_, int_type, mf_name_);
+      }
+      fprintf(f,
+              "  static void set_mf_%s(pi_match_key_t *mk, const char *key,\n"
+              "      int prefix_length) {\n"
+              "    mf_%s::set(mk, key, prefix_length);\n"
+              "  }\n",
+              mf_name_, mf_name_);
+      return;
+    case PI_P4INFO_MATCH_TYPE_TERNARY:
+    case PI_P4INFO_MATCH_TYPE_RANGE: {
+      int is_range = (match_type == PI_P4INFO_MATCH_TYPE_RANGE);
+      const char *arg1 = is_range ? "start" : "key";
+      const char *arg2 = is_range ? "end" : "mask";
+      fprintf(f, "  using mf_%s = pi::codegen::%s<%#x, %zu, %zu>;\n", mf_name_,
+              is_range ? "RangeField" : "TernaryField", mf_id, offset,
+              bitwidth);
+      if (int_type) {
+        fprintf(f,
+                "  static void set_mf_%s(pi_match_key_t *mk, %s %s, %s %s) {\n"
+                "    mf_%s::set(mk, %s, %s);\n"
+                "  }\n",
+                mf_name_, int_type, arg1, int_type, arg2, mf_name_, arg1,
+                arg2);
+      }
+      fprintf(f,
+              "  static void set_mf_%s(pi_match_key_t *mk, const char *%s,\n"
+              "      const char *%s) {\n"
+              "    mf_%s::set(mk, %s, %s);\n"
+              "  }\n",
+              mf_name_, arg1, arg2, mf_name_, arg1, arg2);
+      return;
+    }
+    case PI_P4INFO_MATCH_TYPE_OPTIONAL:
+      fprintf(f,
+              "  using mf_%s = pi::codegen::OptionalField<%#x, %zu, %zu>;\n",
+              mf_name_, mf_id, offset, bitwidth);
+      if (int_type) {
+        fprintf(f,
+                "  static void set_mf_%s(pi_match_key_t *mk, %s key,\n"
+                "      bool is_wildcard) {\n"
+                "    mf_%s::set(mk, key, is_wildcard);\n"
+                "  }\n",
+                mf_name_, int_type, mf_name_);
+      }
+      fprintf(f,
+              "  static void set_mf_%s(pi_match_key_t *mk, const char *key,\n"
+              "      bool is_wildcard) {\n"
+              "    mf_%s::set(mk, key, is_wildcard);\n"
+              "  }\n",
+              mf_name_, mf_name_);
+      return;
+    case PI_P4INFO_MATCH_TYPE_END:
+      break;
+  }
+  assert(0 && "Invalid match type");
+}
+
+static void gen_table(FILE *f, const pi_p4info_t *p4info, pi_p4_id_t id) {
+  char *name_ = to_identifier(pi_p4info_table_name_from_id(p4info, id));
+  fprintf(f, "struct %s {\n", name_);
+  fprintf(f, "  static constexpr pi_p4_id_t table_id = %#x;\n", id);
+  fprintf(f, "  static constexpr size_t match_key_size = %zu;\n",
+          pi_p4info_table_match_key_size(p4info, id));
+  size_t num_match_fields = pi_p4info_table_num_match_fields(p4info, id);
+  for (size_t i = 0; i < num_match_fields; i++) {
+    const pi_p4info_match_field_info_t *finfo =
+        pi_p4info_table_match_field_info(p4info, id, i);
+    char *mf_name_ = to_identifier(finfo->name);
+    size_t offset =
+        pi_p4info_table_match_field_offset(p4info, id, finfo->mf_id);
+    gen_match_field(f, mf_name_, finfo->mf_id, finfo->match_type, offset,
+                    finfo->bitwidth);
+    free(mf_name_);
+  }
+  fprintf(f, "};\n\n");
+  free(name_);
+}
+
+int main(int argc, char *const argv[]) {
+  int rc;
+  if ((rc = parse_opts(argc, argv)) != 0) return rc;
+
+  char *config = read_file(config_path);
+  if (!config) {
+    fprintf(stderr, "File '%s' does not exist or cannot be accessed.\n",
+            config_path);
+    return 1;
+  }
+
+  struct stat info;
+  if (stat(dest_dir, &info) != 0) {
+    fprintf(stderr, "Cannot access '%s'.\n", dest_dir);
+    return 1;
+  } else if (!(info.st_mode & S_IFDIR)) {
+    // S_ISDIR() may not exist on windows
+    fprintf(stderr, "'%s' is not a directory.\n", dest_dir);
+    return 1;
+  }
+
+  char fname[256];
+  if (strnlen(p4_name, sizeof(fname)) + strlen("pi_fe_cpp_builders_") +
+          strlen(".h") >=
+      sizeof(fname)) {
+    fprintf(stderr, "Provided P4 name (with -n) is too long.\n");
+    return 1;
+  }
+  sprintf(fname, "pi_fe_cpp_builders_%s.h", p4_name);
+
+  char gen_path[512];
+  if (strnlen(dest_dir, sizeof(gen_path)) + strlen("/") + strlen(fname) >=
+      sizeof(gen_path)) {
+    fprintf(stderr, "Full path of generated file is too long.\n");
+    return 1;
+  }
+  sprintf(gen_path, "%s/%s", dest_dir, fname);
+
+  printf("Generating header file '%s' ...\n", gen_path);
+
+  FILE *gen_fptr = fopen(gen_path, "w");
+  if (!gen_fptr) {
+    fprintf(stderr, "Unexpected error when opening file.\n");
+    return 1;
+  }
+
+  pi_status_t status;
+  pi_p4info_t *p4info;
+  status = pi_add_config(config, PI_CONFIG_TYPE_BMV2_JSON, &p4info);
+  if (status != PI_STATUS_SUCCESS) {
+    fprintf(stderr, "Error while loading config.\n");
+    return 1;
+  }
+
+  fprintf(gen_fptr, prelude);
+
+  char inc_guard[384];
+  // static assert
+  assert(sizeof(inc_guard) >= sizeof(fname) + 128);
+  sprintf(inc_guard, "__AUTOGEN_PI_FE_CPP_BUILDERS_%s_H_", p4_name);
+  to_upper(inc_guard);
+
+  fprintf(gen_fptr, "#ifndef %s\n", inc_guard);
+  fprintf(gen_fptr, "#define %s\n\n", inc_guard);
+
+  fprintf(gen_fptr, "#include <PI/frontends/cpp/codegen.h>\n\n");
+
+  char *ns_ = to_identifier(p4_name);
+  fprintf(gen_fptr, "namespace pi_fe_%s {\n\n", ns_);
+
+  fprintf(gen_fptr, "// ACTIONS AND ACTION PARAMETERS\n\n");
+  fprintf(gen_fptr, "namespace actions {\n\n");
+  for (pi_p4_id_t id = pi_p4info_action_begin(p4info);
+       id != pi_p4info_action_end(p4info);
+       id = pi_p4info_action_next(p4info, id)) {
+    gen_action(gen_fptr, p4info, id);
+  }
+  fprintf(gen_fptr, "}  // namespace actions\n\n");
+
+  fprintf(gen_fptr, "// TABLES AND MATCH FIELDS\n\n");
+  fprintf(gen_fptr, "namespace tables {\n\n");
+  for (pi_p4_id_t id = pi_p4info_table_begin(p4info);
+       id != pi_p4info_table_end(p4info);
+       id = pi_p4info_table_next(p4info, id)) {
+    gen_table(gen_fptr, p4info, id);
+  }
+  fprintf(gen_fptr, "}  // namespace tables\n\n");
+
+  fprintf(gen_fptr, "}  // namespace pi_fe_%s\n\n", ns_);
+  free(ns_);
+
+  fprintf(gen_fptr, "#endif  // %s\n", inc_guard);
+
+  free(config);
+  pi_destroy_config(p4info);
+  fclose(gen_fptr);
+}
@@ -116,6 +116,22 @@ struct pi_table_fetch_res_s {
   size_t data_size_per_entry;
   size_t num_direct_resources;
   size_t max_size_of_direct_resources;
+  // set if entries points to memory owned by a pi_table_fetch_cursor_t, in
+  // which case the target does not need to release it
+  bool borrowed;
+};
+
+struct pi_table_fetch_cursor_s {
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t table_id;
+  // can be used by targets which implement the cursor API natively
+  void *target_state;
+  // if the target does not implement the cursor API, the whole table is
+  // fetched with _pi_table_entries_fetch when the cursor is created and each
+  // chunk borrows a slice of the fetched entries
+  pi_table_fetch_res_t *full_res;
+  size_t num_remaining;
+  size_t offset;
 };
 
 struct pi_act_prof_fetch_res_s {
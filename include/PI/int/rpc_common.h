@@ -48,6 +48,10 @@ typedef enum {
   PI_RPC_TABLE_ENTRY_MODIFY_WKEY,
   PI_RPC_TABLE_ENTRIES_FETCH,
   /* PI_RPC_TABLE_ENTRIES_FETCH_DONE, */
+  PI_RPC_TABLE_ENTRIES_GET_REMAINING_TTL,
+  PI_RPC_TABLE_ENTRIES_FETCH_BEGIN,
+  PI_RPC_TABLE_ENTRIES_FETCH_NEXT,
+  PI_RPC_TABLE_ENTRIES_FETCH_END,
 
   // act profs
   PI_RPC_ACT_PROF_MBR_CREATE,
@@ -77,6 +81,7 @@ typedef enum {
 
   // packet in/out
   PI_RPC_PACKETOUT_SEND,
+  PI_RPC_PACKETOUT_SEND_BATCH,
 
   // rpc management
   // retrieve state for sync-up when rpc client is started
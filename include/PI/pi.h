@@ -117,6 +117,21 @@ pi_status_t pi_packetin_deregister_default_cb();
 //! Inject a packet in the specified device.
 pi_status_t pi_packetout_send(pi_dev_id_t dev_id, const char *pkt, size_t size);
 
+//! A packet for pi_packetout_send_batch. The packet data is not copied and only
+//! needs to remain valid for the duration of the call.
+typedef struct {
+  const char *pkt;
+  size_t size;
+} pi_packet_t;
+
+//! Inject several packets in the specified device, in order. This is more
+//! efficient than successive calls to pi_packetout_send for targets which
+//! support it, and equivalent otherwise. Stops at the first packet which cannot
+//! be sent, in which case the corresponding error is returned. If \p num_sent
+//! is not NULL, it is set to the number of packets successfully sent.
+pi_status_t pi_packetout_send_batch(pi_dev_id_t dev_id, const pi_packet_t *pkts,
+                                    size_t num_pkts, size_t *num_sent);
+
 //! Callback type for port status events.
 typedef void (*PIPortStatusCb)(pi_dev_id_t dev_id, pi_port_t port,
                                pi_port_status_t status, void *cb_cookie);
@@ -135,6 +150,19 @@ pi_status_t pi_port_status_deregister_default_cb();
 pi_status_t pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                pi_port_status_t *status);
 
+//! Callback type for thread start events.
+typedef void (*PIThreadStartCb)(const char *thread_class, void *cb_cookie);
+//! Register a callback which is invoked by every internal thread spawned by PI,
+//! by a PI target or by a PI frontend, from that thread, when it starts. It
+//! lets the application name and place (CPU affinity, scheduling policy) these
+//! threads. To cover target threads, the callback should be registered before
+//! calling pi_init. Use NULL to de-register the callback.
+pi_status_t pi_thread_start_register_cb(PIThreadStartCb cb, void *cb_cookie);
+//! To be called by internal threads when they start. \p thread_class
+//! identifies the role of the thread (e.g. "digest"); several threads may
+//! share the same class.
+void pi_thread_start(const char *thread_class);
+
 // TODO(antonin): move this to pi_tables?
 // When adding a table entry, the configuration for direct resources associated
 // with the entry can be provided. The config is then passed as a generic void *
@@ -116,6 +116,20 @@ pi_status_t pi_act_prof_grp_fetch(pi_session_handle_t session_handle,
                                   pi_indirect_handle_t grp_handle,
                                   pi_act_prof_fetch_res_t **res);
 
+//! Callback type for pi_act_prof_entries_fetch_async. If \p status is
+//! PI_STATUS_SUCCESS, the callback owns \p res and needs to release it with
+//! pi_act_prof_entries_fetch_done; otherwise \p res is NULL.
+typedef void (*PIActProfFetchCb)(pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
+                                 pi_status_t status,
+                                 pi_act_prof_fetch_res_t *res, void *cb_cookie);
+
+//! Asynchronous version of pi_act_prof_entries_fetch, see PI/pi_async.h.
+pi_status_t pi_act_prof_entries_fetch_async(pi_session_handle_t session_handle,
+                                            pi_dev_tgt_t dev_tgt,
+                                            pi_p4_id_t act_prof_id,
+                                            PIActProfFetchCb cb,
+                                            void *cb_cookie);
+
 //! Need to be called after a pi_act_prof_entries_fetch, pi_act_prof_mbr_fetch
 //! or pi_act_prof_grp_fetch, once you wish the memory to be released.
 pi_status_t pi_act_prof_entries_fetch_done(pi_session_handle_t session_handle,
@@ -0,0 +1,64 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file
+//! Asynchronous execution of long-running PI operations. Operations are queued
+//! per device and executed in submission order by a bounded pool of PI threads
+//! (thread class "async"), so that at most one operation per device is
+//! in-flight at any given time. Completion callbacks are invoked from these
+//! threads and may not call pi_async_flush for their own device. The typed
+//! async variants (e.g. pi_table_entries_fetch_async) are built on top of
+//! pi_async_submit; the session passed to them must remain valid and must not
+//! be used concurrently until the completion callback has been invoked.
+
+#ifndef PI_INC_PI_PI_ASYNC_H_
+#define PI_INC_PI_PI_ASYNC_H_
+
+#include "pi_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Default maximum number of threads in the pool.
+#define PI_ASYNC_DEFAULT_MAX_THREADS 4
+
+//! Function executed asynchronously by pi_async_submit.
+typedef void (*PIAsyncFn)(pi_dev_id_t dev_id, void *cookie);
+
+//! Sets the maximum number of threads in the pool (at least 1); threads are
+//! only spawned when needed. Has no effect on the threads which are already
+//! running.
+pi_status_t pi_async_set_max_threads(size_t max_threads);
+
+//! Queues \p fn for execution, after all the operations previously submitted
+//! for the same device. This can be used to run any sequence of PI calls in
+//! the background, e.g. a batch of table writes.
+pi_status_t pi_async_submit(pi_dev_id_t dev_id, PIAsyncFn fn, void *cookie);
+
+//! Waits for all the operations submitted for the device before the call to
+//! complete.
+pi_status_t pi_async_flush(pi_dev_id_t dev_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PI_INC_PI_PI_ASYNC_H_
@@ -100,6 +100,8 @@ typedef enum {
 
   PI_STATUS_NOT_IMPLEMENTED_BY_TARGET,
 
+  PI_STATUS_INVALID_FETCH_CURSOR,
+
   //! everything above 1000 is reserved for targets
   PI_STATUS_TARGET_ERROR = 1000
 } pi_status_t;
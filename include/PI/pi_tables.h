@@ -214,6 +214,45 @@ pi_status_t pi_table_entries_fetch_wkey(pi_session_handle_t session_handle,
 pi_status_t pi_table_entries_fetch_done(pi_session_handle_t session_handle,
                                         pi_table_fetch_res_t *res);
 
+//! Callback type for pi_table_entries_fetch_async. If \p status is
+//! PI_STATUS_SUCCESS, the callback owns \p res and needs to release it with
+//! pi_table_entries_fetch_done; otherwise \p res is NULL.
+typedef void (*PITableFetchCb)(pi_dev_id_t dev_id, pi_p4_id_t table_id,
+                               pi_status_t status, pi_table_fetch_res_t *res,
+                               void *cb_cookie);
+
+//! Asynchronous version of pi_table_entries_fetch, see PI/pi_async.h. An error
+//! is returned if the operation cannot be submitted, in which case the callback
+//! is not invoked.
+pi_status_t pi_table_entries_fetch_async(pi_session_handle_t session_handle,
+                                         pi_dev_tgt_t dev_tgt,
+                                         pi_p4_id_t table_id, PITableFetchCb cb,
+                                         void *cb_cookie);
+
+typedef struct pi_table_fetch_cursor_s pi_table_fetch_cursor_t;
+
+//! Start iterating over all the entries in the table, in chunks of bounded
+//! size. This should be preferred to pi_table_entries_fetch for large tables,
+//! as the memory required by the whole table does not need to be allocated at
+//! once (if supported by the target).
+pi_status_t pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                         pi_dev_tgt_t dev_tgt,
+                                         pi_p4_id_t table_id,
+                                         pi_table_fetch_cursor_t **cursor);
+
+//! Retrieve the next chunk of at most max_entries entries, which can be
+//! iterated over with pi_table_entries_next. When all entries have been
+//! retrieved, the returned chunk is empty (pi_table_entries_num returns 0). Each
+//! chunk needs to be released with pi_table_entries_fetch_done before the
+//! cursor is released with pi_table_entries_fetch_end.
+pi_status_t pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor,
+                                        size_t max_entries,
+                                        pi_table_fetch_res_t **res);
+
+pi_status_t pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                       pi_table_fetch_cursor_t *cursor);
+
 //! Returns the number of entries obtained with pi_table_entries_fetch.
 size_t pi_table_entries_num(pi_table_fetch_res_t *res);
 
@@ -238,6 +277,16 @@ pi_status_t pi_table_entry_get_remaining_ttl(pi_session_handle_t session_handle,
                                              pi_entry_handle_t entry_handle,
                                              uint64_t *ttl_ns);
 
+//! Retrieves the remaining TTL for several entries of the same table with a
+//! single call, which is more efficient than calling
+//! pi_table_entry_get_remaining_ttl for each entry when reading many entries.
+//! \p ttls_ns must have room for \p num_entries values. Fails if the remaining
+//! TTL cannot be retrieved for one of the entries.
+pi_status_t pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns);
+
 #ifdef __cplusplus
 }
 #endif
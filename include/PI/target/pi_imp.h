@@ -54,6 +54,13 @@ pi_status_t _pi_destroy();
 pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
                                size_t size);
 
+// Targets which cannot do better than sending packets one at a time may return
+// PI_STATUS_NOT_IMPLEMENTED_BY_TARGET, in which case _pi_packetout_send is
+// called for each packet.
+pi_status_t _pi_packetout_send_batch(pi_dev_id_t dev_id,
+                                     const pi_packet_t *pkts, size_t num_pkts,
+                                     size_t *num_sent);
+
 pi_status_t _pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                 pi_port_status_t *status);
 
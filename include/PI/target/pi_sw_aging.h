@@ -0,0 +1,132 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file
+//! Software entry ageing, for targets which cannot age table entries natively.
+//! The target tracks its ageing entries with this module (add / set TTL /
+//! remove) and provides a way to query the hit state of a batch of entries
+//! (e.g. by sampling direct counters or scanning hit bits). Entries are kept in
+//! a timer wheel and the hit state of an entry is only queried when its TTL is
+//! about to expire, so the cost of a sweep is proportional to the number of
+//! expiring entries and not to the total number of entries.
+
+#ifndef PI_INC_PI_TARGET_PI_SW_AGING_H_
+#define PI_INC_PI_TARGET_PI_SW_AGING_H_
+
+#include "PI/pi_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  //! hit state is a sticky hit bit, cleared by the target when it is read;
+  //! the entry was hit iff the value is non-zero
+  PI_SW_AGING_HIT_BITS = 0,
+  //! hit state is a monotonic counter (e.g. direct packet counter); the entry
+  //! was hit iff the value changed since the previous query
+  PI_SW_AGING_COUNTERS,
+} pi_sw_aging_hit_mode_t;
+
+//! Queries the current hit state of @p num_entries entries of table
+//! @p table_id. Never called with the module lock held, so the target is free
+//! to call back into the module.
+typedef pi_status_t (*PISwAgingHitQueryFn)(
+    pi_dev_id_t dev_id, pi_p4_id_t table_id, size_t num_entries,
+    const pi_entry_handle_t *entry_handles, uint64_t *hit_states,
+    void *cookie);
+
+//! Called when an entry has not been hit for its TTL duration, typically to
+//! call pi_table_idle_timeout_notify. As long as the entry is not hit, it is
+//! reported again every TTL. Never called with the module lock held.
+typedef void (*PISwAgingExpireFn)(pi_dev_id_t dev_id, pi_p4_id_t table_id,
+                                  pi_entry_handle_t entry_handle, void *cookie);
+
+//! Returns the current time in nanoseconds; the clock must be monotonic.
+typedef uint64_t (*PISwAgingClockFn)(void *cookie);
+
+typedef struct {
+  //! granularity of the timer wheel, i.e. the sweep interval
+  uint64_t tick_ns;
+  //! number of slots in the timer wheel, rounded up to a power of 2; entries
+  //! with a TTL larger than tick_ns * num_slots are simply visited more than
+  //! once before expiring
+  size_t num_slots;
+  pi_sw_aging_hit_mode_t hit_mode;
+  PISwAgingHitQueryFn hit_query_fn;
+  PISwAgingExpireFn expire_fn;
+  //! if NULL, CLOCK_MONOTONIC is used
+  PISwAgingClockFn clock_fn;
+  void *cookie;
+} pi_sw_aging_config_t;
+
+typedef struct pi_sw_aging_s pi_sw_aging_t;
+
+//! Returns NULL in case of error (invalid config).
+pi_sw_aging_t *pi_sw_aging_create(pi_dev_id_t dev_id,
+                                  const pi_sw_aging_config_t *config);
+
+//! Stops the sweeper thread if needed.
+void pi_sw_aging_destroy(pi_sw_aging_t *aging);
+
+//! Starts a thread which calls pi_sw_aging_sweep every tick. Targets which
+//! already have a suitable periodic task can call pi_sw_aging_sweep themselves
+//! instead.
+pi_status_t pi_sw_aging_start(pi_sw_aging_t *aging);
+
+//! Processes all the timer wheel slots up to the current time, queries the hit
+//! state of the entries which are due to expire (with one hit_query_fn call
+//! per table) and reports the ones which were not hit.
+pi_status_t pi_sw_aging_sweep(pi_sw_aging_t *aging);
+
+//! A TTL of 0 means that ageing is disabled for the entry. Adding an entry
+//! which is already tracked is equivalent to
+//! pi_sw_aging_entry_set_ttl.
+pi_status_t pi_sw_aging_entry_add(pi_sw_aging_t *aging, pi_p4_id_t table_id,
+                                  pi_entry_handle_t entry_handle,
+                                  uint64_t ttl_ns);
+
+//! Resets the last hit time of the entry to the current time.
+pi_status_t pi_sw_aging_entry_set_ttl(pi_sw_aging_t *aging,
+                                      pi_p4_id_t table_id,
+                                      pi_entry_handle_t entry_handle,
+                                      uint64_t ttl_ns);
+
+pi_status_t pi_sw_aging_entry_remove(pi_sw_aging_t *aging,
+                                     pi_p4_id_t table_id,
+                                     pi_entry_handle_t entry_handle);
+
+//! Removes all the entries of the table, e.g. when the table is cleared or the
+//! P4 program is changed.
+pi_status_t pi_sw_aging_table_clear(pi_sw_aging_t *aging, pi_p4_id_t table_id);
+
+//! Refreshes the hit state of the entries (one hit_query_fn call) before
+//! computing the remaining TTLs, which makes it a suitable implementation for
+//! _pi_table_entries_get_remaining_ttl. Returns PI_STATUS_TARGET_ERROR if one
+//! of the entries is not tracked.
+pi_status_t pi_sw_aging_entries_get_remaining_ttl(
+    pi_sw_aging_t *aging, pi_p4_id_t table_id, size_t num_entries,
+    const pi_entry_handle_t *entry_handles, uint64_t *ttls_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PI_INC_PI_TARGET_PI_SW_AGING_H_
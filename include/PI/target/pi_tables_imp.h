@@ -92,6 +92,24 @@ pi_status_t _pi_table_entries_fetch_wkey(pi_session_handle_t session_handle,
 pi_status_t _pi_table_entries_fetch_done(pi_session_handle_t session_handle,
                                          pi_table_fetch_res_t *res);
 
+// Targets may return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET, in which case PI
+// fetches the whole table with _pi_table_entries_fetch and returns it in
+// chunks. cursor->target_state is reserved for the target. Each chunk returned
+// by _pi_table_entries_fetch_next is released with
+// _pi_table_entries_fetch_done.
+pi_status_t _pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                          pi_dev_tgt_t dev_tgt,
+                                          pi_p4_id_t table_id,
+                                          pi_table_fetch_cursor_t *cursor);
+
+pi_status_t _pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                         pi_table_fetch_cursor_t *cursor,
+                                         size_t max_entries,
+                                         pi_table_fetch_res_t *res);
+
+pi_status_t _pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor);
+
 pi_status_t _pi_table_idle_timeout_config_set(
     pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
     const pi_idle_timeout_config_t *config);
@@ -100,6 +118,13 @@ pi_status_t _pi_table_entry_get_remaining_ttl(
     pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
     pi_entry_handle_t entry_handle, uint64_t *ttl_ns);
 
+// Targets may return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET, in which case
+// _pi_table_entry_get_remaining_ttl is called for each entry.
+pi_status_t _pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns);
+
 //! To be called by target to notify application when an entry's TLL expires.
 //! Target owns the memory for match_key and can free it after the function
 //! returns.
@@ -93,7 +93,7 @@ void vector_remove(vector_t *v, size_t index) {
 
 void vector_remove_e(vector_t *v, void *e) {
   assert(e >= v->data);
-  size_t index = (char *)e - (char *)v->data;
+  size_t index = ((char *)e - (char *)v->data) / v->e_size;
   vector_remove(v, index);
 }
 
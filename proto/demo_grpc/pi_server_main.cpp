@@ -24,6 +24,7 @@
 #include <PI/proto/pi_server.h>
 
 #include <iostream>
+#include <string>
 
 #include <csignal>
 
@@ -31,13 +32,32 @@ using pi::fe::proto::DeviceMgr;
 
 int main(int argc, char** argv) {
   const char *server_address = "0.0.0.0:9559";
-  if (argc > 2) {
-    std::cerr << "Two many arguments.\n";
+  const char *replication_socket = nullptr;
+  bool standby = false;
+  auto usage = [argv, server_address]() {
     std::cerr << "Usage: " << argv[0]
+              << " [--replication-socket <path> [--standby]]"
               << " [address (default " << server_address << ")].\n";
+  };
+  int positional_args = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--replication-socket" && i + 1 < argc) {
+      replication_socket = argv[++i];
+    } else if (arg == "--standby") {
+      standby = true;
+    } else if (positional_args++ == 0) {
+      server_address = argv[i];
+    } else {
+      std::cerr << "Two many arguments.\n";
+      usage();
+      return 1;
+    }
+  }
+  if (standby && replication_socket == nullptr) {
+    std::cerr << "--standby requires --replication-socket.\n";
+    usage();
     return 1;
-  } else if (argc == 2) {
-    server_address = argv[1];
   }
 
   PIGrpcServerInit();
@@ -69,7 +89,14 @@ int main(int argc, char** argv) {
     LoggerConfig::set_writer(std::make_shared<P4RuntimeLogger>());
   }
 
-  PIGrpcServerRunAddr(server_address);
+  if (standby) {
+    // returns once the primary is gone and we have taken over
+    PIGrpcServerRunStandby(replication_socket, server_address);
+  } else {
+    if (replication_socket != nullptr)
+      PIGrpcServerEnableReplication(replication_socket);
+    PIGrpcServerRunAddr(server_address);
+  }
 
   // TODO(antonin): use sigaction?
   std::signal(SIGINT, handler);
@@ -0,0 +1,245 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures the aggregate write throughput of the P4Runtime frontend (without
+// gRPC) when writing to 1, 2, 4, ... devices concurrently, with one writer
+// thread per device. Meant to be linked with the dummy target, in which case
+// the throughput should scale linearly with the number of devices, as long as
+// there are enough cores.
+
+#include <PI/frontends/proto/device_mgr.h>
+
+#include <google/protobuf/text_format.h>
+
+#include <ctype.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "google/rpc/code.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4v1 = ::p4::v1;
+namespace p4configv1 = ::p4::config::v1;
+
+using pi::fe::proto::DeviceMgr;
+
+namespace {
+
+char *opt_p4info_path = NULL;
+size_t opt_max_devices = 16;
+size_t opt_num_updates = 100000;
+size_t opt_batch_size = 100;
+
+void print_help(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS]...\n"
+          "Multi-device write throughput benchmark\n\n"
+          "-p          P4Info (text format) for simple_router\n"
+          "-n          Max number of devices (default 16)\n"
+          "-u          Number of updates per device (default 100000)\n"
+          "-b          Number of updates per WriteRequest (default 100)\n",
+          name);
+}
+
+int parse_opts(int argc, char *const argv[]) {
+  int c;
+
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, "p:n:u:b:h")) != -1) {
+    switch (c) {
+      case 'p':
+        opt_p4info_path = optarg;
+        break;
+      case 'n':
+        opt_max_devices = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'u':
+        opt_num_updates = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'b':
+        opt_batch_size = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'h':
+        print_help(argv[0]);
+        exit(0);
+      case '?':
+        if (isprint(optopt)) {
+          fprintf(stderr, "Unknown option or missing argument `-%c'.\n\n",
+                  optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        print_help(argv[0]);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!opt_p4info_path) {
+    fprintf(stderr, "Option -p is required.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+  if (opt_max_devices == 0 || opt_num_updates == 0 || opt_batch_size == 0) {
+    fprintf(stderr, "Options -n, -u and -b must be positive.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+
+  return 0;
+}
+
+template <typename T>
+uint32_t find_id(const T &objects, const std::string &name) {
+  for (const auto &object : objects) {
+    if (object.preamble().name() == name) return object.preamble().id();
+  }
+  std::cerr << "Cannot find '" << name << "' in P4Info\n";
+  exit(1);
+}
+
+std::string uint32_to_string(uint32_t i) {
+  std::string s(4, '\x00');
+  for (int j = 0; j < 4; j++) s[3 - j] = static_cast<char>(i >> (j * 8));
+  return s;
+}
+
+class DeviceWriter {
+ public:
+  DeviceWriter(DeviceMgr::device_id_t device_id,
+               const p4configv1::P4Info &p4info)
+      : mgr(device_id) {
+    p4v1::ForwardingPipelineConfig config;
+    config.mutable_p4info()->CopyFrom(p4info);
+    auto status = mgr.pipeline_config_set(
+        p4v1::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT, config);
+    if (status.code() != ::google::rpc::Code::OK) {
+      std::cerr << "Error when setting pipeline config: "
+                << status.message() << "\n";
+      exit(1);
+    }
+
+    // "forward" is an exact match table, which we fill with set_dmac entries
+    auto t_id = find_id(p4info.tables(), "forward");
+    auto a_id = find_id(p4info.actions(), "set_dmac");
+    for (size_t i = 0; i < opt_num_updates; i += opt_batch_size) {
+      p4v1::WriteRequest request;
+      request.set_device_id(device_id);
+      for (size_t j = i; j < i + opt_batch_size && j < opt_num_updates; j++) {
+        auto update = request.add_updates();
+        update->set_type(p4v1::Update::INSERT);
+        auto entry = update->mutable_entity()->mutable_table_entry();
+        entry->set_table_id(t_id);
+        auto mf = entry->add_match();
+        mf->set_field_id(1);
+        mf->mutable_exact()->set_value(
+            uint32_to_string(static_cast<uint32_t>(j)));
+        auto action = entry->mutable_action()->mutable_action();
+        action->set_action_id(a_id);
+        auto param = action->add_params();
+        param->set_param_id(1);
+        param->set_value(std::string(6, '\x00'));
+      }
+      requests.push_back(std::move(request));
+    }
+  }
+
+  void run() {
+    for (const auto &request : requests) {
+      auto status = mgr.write(request);
+      if (status.code() != ::google::rpc::Code::OK) {
+        std::cerr << "Error when writing to device: "
+                  << status.message() << "\n";
+        exit(1);
+      }
+    }
+  }
+
+ private:
+  DeviceMgr mgr;
+  std::vector<p4v1::WriteRequest> requests;
+};
+
+// returns the aggregate throughput, in updates per second
+double run_test(size_t num_devices, const p4configv1::P4Info &p4info) {
+  using Clock = std::chrono::steady_clock;
+  // requests are generated before we start the clock
+  std::vector<std::unique_ptr<DeviceWriter> > writers;
+  for (size_t i = 0; i < num_devices; i++)
+    writers.emplace_back(new DeviceWriter(i, p4info));
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (auto &writer : writers)
+    threads.emplace_back(&DeviceWriter::run, writer.get());
+  for (auto &thread : threads) thread.join();
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  return (num_devices * opt_num_updates) / elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (parse_opts(argc, argv) != 0) return 1;
+
+  p4configv1::P4Info p4info;
+  {
+    std::ifstream is(opt_p4info_path);
+    std::stringstream buffer;
+    buffer << is.rdbuf();
+    if (!is ||
+        !google::protobuf::TextFormat::ParseFromString(buffer.str(), &p4info)) {
+      std::cerr << "Cannot parse P4Info from " << opt_p4info_path << "\n";
+      return 1;
+    }
+  }
+
+  auto status = DeviceMgr::init();
+  if (status.code() != ::google::rpc::Code::OK) return 1;
+
+  std::cout << "hardware concurrency: " << std::thread::hardware_concurrency()
+            << ", updates per device: " << opt_num_updates
+            << ", batch size: " << opt_batch_size << "\n";
+  double base_throughput = 0;
+  for (size_t num_devices = 1; num_devices <= opt_max_devices;
+       num_devices *= 2) {
+    auto throughput = run_test(num_devices, p4info);
+    if (num_devices == 1) base_throughput = throughput;
+    printf("%2zu devices: %12.0f updates/s (x%.2f)\n",
+           num_devices, throughput, throughput / base_throughput);
+  }
+
+  DeviceMgr::destroy();
+  return 0;
+}
@@ -0,0 +1,278 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures how many action profile group MODIFY operations per second the
+// P4Runtime frontend (without gRPC) can process for large groups, when each
+// MODIFY replaces a single member of the group. Meant to be linked with the
+// dummy target, so that the cost of the membership bookkeeping in the frontend
+// is what is measured.
+
+#include <PI/frontends/proto/device_mgr.h>
+
+#include <google/protobuf/text_format.h>
+
+#include <ctype.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "google/rpc/code.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+namespace p4v1 = ::p4::v1;
+namespace p4configv1 = ::p4::config::v1;
+
+using pi::fe::proto::DeviceMgr;
+
+namespace {
+
+char *opt_p4info_path = NULL;
+char *opt_act_prof_name = NULL;
+size_t opt_group_size = 4096;
+size_t opt_iterations = 1000;
+
+void print_help(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS]...\n"
+          "Action profile group modify benchmark\n\n"
+          "-p          P4Info (text format)\n"
+          "-a          Action profile name (default: first action profile\n"
+          "            with a selector in P4Info)\n"
+          "-s          Number of members in the group (default 4096)\n"
+          "-i          Number of iterations (default 1000)\n",
+          name);
+}
+
+int parse_opts(int argc, char *const argv[]) {
+  int c;
+
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, "p:a:s:i:h")) != -1) {
+    switch (c) {
+      case 'p':
+        opt_p4info_path = optarg;
+        break;
+      case 'a':
+        opt_act_prof_name = optarg;
+        break;
+      case 's':
+        opt_group_size = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        opt_iterations = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'h':
+        print_help(argv[0]);
+        exit(0);
+      case '?':
+        if (isprint(optopt)) {
+          fprintf(stderr, "Unknown option or missing argument `-%c'.\n\n",
+                  optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        print_help(argv[0]);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!opt_p4info_path) {
+    fprintf(stderr, "Option -p is required.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+  if (opt_group_size == 0 || opt_iterations == 0) {
+    fprintf(stderr, "Options -s and -i must be positive.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+
+  return 0;
+}
+
+template <typename T>
+const T *find_by_id(const google::protobuf::RepeatedPtrField<T> &objects,
+                    uint32_t id) {
+  for (const auto &object : objects) {
+    if (object.preamble().id() == id) return &object;
+  }
+  return nullptr;
+}
+
+const p4configv1::ActionProfile *find_act_prof(
+    const p4configv1::P4Info &p4info) {
+  for (const auto &act_prof : p4info.action_profiles()) {
+    if (opt_act_prof_name == NULL) {
+      if (act_prof.with_selector()) return &act_prof;
+    } else if (act_prof.preamble().name() == opt_act_prof_name) {
+      return &act_prof;
+    }
+  }
+  return nullptr;
+}
+
+// builds an action of the first table using the action profile, with all
+// parameters set to 0
+bool make_action(const p4configv1::P4Info &p4info,
+                 const p4configv1::ActionProfile &act_prof,
+                 p4v1::Action *action) {
+  if (act_prof.table_ids().empty()) return false;
+  auto *table = find_by_id(p4info.tables(), act_prof.table_ids(0));
+  if (table == nullptr) return false;
+  for (const auto &action_ref : table->action_refs()) {
+    if (action_ref.scope() == p4configv1::ActionRef::DEFAULT_ONLY) continue;
+    auto *action_info = find_by_id(p4info.actions(), action_ref.id());
+    if (action_info == nullptr) return false;
+    action->set_action_id(action_ref.id());
+    for (const auto &param_info : action_info->params()) {
+      auto *param = action->add_params();
+      param->set_param_id(param_info.id());
+      param->set_value(std::string((param_info.bitwidth() + 7) / 8, '\x00'));
+    }
+    return true;
+  }
+  return false;
+}
+
+void write_or_die(DeviceMgr *mgr, const p4v1::WriteRequest &request) {
+  auto status = mgr->write(request);
+  if (status.code() != ::google::rpc::Code::OK) {
+    std::cerr << "Error when writing to device: " << status.message() << "\n";
+    exit(1);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (parse_opts(argc, argv) != 0) return 1;
+
+  p4configv1::P4Info p4info;
+  {
+    std::ifstream is(opt_p4info_path);
+    std::stringstream buffer;
+    buffer << is.rdbuf();
+    if (!is ||
+        !google::protobuf::TextFormat::ParseFromString(buffer.str(), &p4info)) {
+      std::cerr << "Cannot parse P4Info from " << opt_p4info_path << "\n";
+      return 1;
+    }
+  }
+
+  auto *act_prof = find_act_prof(p4info);
+  if (act_prof == nullptr) {
+    std::cerr << "Cannot find action profile in P4Info\n";
+    return 1;
+  }
+  if (act_prof->max_group_size() != 0 &&
+      static_cast<size_t>(act_prof->max_group_size()) < opt_group_size) {
+    std::cerr << "Group size exceeds max_group_size for action profile\n";
+    return 1;
+  }
+  p4v1::Action action;
+  if (!make_action(p4info, *act_prof, &action)) {
+    std::cerr << "Cannot find an action for action profile\n";
+    return 1;
+  }
+  auto act_prof_id = act_prof->preamble().id();
+
+  auto status = DeviceMgr::init();
+  if (status.code() != ::google::rpc::Code::OK) return 1;
+
+  {
+    DeviceMgr::device_id_t device_id = 0;
+    DeviceMgr mgr(device_id);
+    p4v1::ForwardingPipelineConfig config;
+    config.mutable_p4info()->CopyFrom(p4info);
+    status = mgr.pipeline_config_set(
+        p4v1::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT, config);
+    if (status.code() != ::google::rpc::Code::OK) {
+      std::cerr << "Error when setting pipeline config: "
+                << status.message() << "\n";
+      return 1;
+    }
+
+    // one more member than the group size, which is swapped in and out of the
+    // group
+    const uint32_t group_id = 1;
+    const uint32_t spare_member_id = opt_group_size + 1;
+    {
+      p4v1::WriteRequest request;
+      request.set_device_id(device_id);
+      for (uint32_t member_id = 1; member_id <= spare_member_id; member_id++) {
+        auto *update = request.add_updates();
+        update->set_type(p4v1::Update::INSERT);
+        auto *member =
+            update->mutable_entity()->mutable_action_profile_member();
+        member->set_action_profile_id(act_prof_id);
+        member->set_member_id(member_id);
+        member->mutable_action()->CopyFrom(action);
+      }
+      write_or_die(&mgr, request);
+    }
+
+    // the 2 requests differ by a single member, the one in the middle of the
+    // group
+    p4v1::WriteRequest requests[2];
+    for (int i = 0; i < 2; i++) {
+      requests[i].set_device_id(device_id);
+      auto *update = requests[i].add_updates();
+      update->set_type(p4v1::Update::MODIFY);
+      auto *group = update->mutable_entity()->mutable_action_profile_group();
+      group->set_action_profile_id(act_prof_id);
+      group->set_group_id(group_id);
+      for (uint32_t member_id = 1; member_id <= opt_group_size; member_id++) {
+        if (i == 1 && member_id == opt_group_size / 2 + 1) continue;
+        group->add_members()->set_member_id(member_id);
+      }
+      if (i == 1) group->add_members()->set_member_id(spare_member_id);
+      for (auto &member : *group->mutable_members()) member.set_weight(1);
+    }
+    {
+      p4v1::WriteRequest request(requests[0]);
+      request.mutable_updates(0)->set_type(p4v1::Update::INSERT);
+      write_or_die(&mgr, request);
+    }
+
+    std::cout << "group size: " << opt_group_size
+              << ", iterations: " << opt_iterations << "\n";
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    for (size_t i = 0; i < opt_iterations; i++)
+      write_or_die(&mgr, requests[(i + 1) % 2]);
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    printf("%12.0f modifies/s, %8.1f us per modify\n",
+           opt_iterations / elapsed.count(),
+           elapsed.count() * 1e6 / opt_iterations);
+  }
+
+  DeviceMgr::destroy();
+  return 0;
+}
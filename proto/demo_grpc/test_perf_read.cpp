@@ -0,0 +1,302 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Measures how many table entries per second the P4Runtime frontend can
+// convert from the PI representation (match key + action data) to P4Runtime
+// TableEntry messages when serving a read. The compiled ReadConverter used by
+// DeviceMgr is compared with the generic conversion path (parse_match_key +
+// ActionDataReader). No target is involved: the PI entries are generated
+// in-memory for one table of the provided P4Info.
+
+#include <PI/frontends/cpp/tables.h>
+#include <PI/p4info.h>
+#include <PI/pi.h>
+#include <PI/proto/p4info_to_and_from_proto.h>
+
+#include <google/protobuf/text_format.h>
+
+#include <ctype.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/rpc/code.pb.h"
+#include "p4/config/v1/p4info.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+#include "src/common.h"
+#include "src/match_key_helpers.h"
+#include "src/read_converter.h"
+
+namespace p4v1 = ::p4::v1;
+namespace p4configv1 = ::p4::config::v1;
+
+using pi::fe::proto::ReadConverter;
+
+namespace {
+
+char *opt_p4info_path = NULL;
+char *opt_table_name = NULL;
+size_t opt_num_entries = 100000;
+size_t opt_iterations = 10;
+
+void print_help(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS]...\n"
+          "Table read conversion benchmark\n\n"
+          "-p          P4Info (text format)\n"
+          "-t          Table name (default: first table in P4Info)\n"
+          "-n          Number of entries (default 100000)\n"
+          "-i          Number of iterations (default 10)\n",
+          name);
+}
+
+int parse_opts(int argc, char *const argv[]) {
+  int c;
+
+  opterr = 0;
+
+  while ((c = getopt(argc, argv, "p:t:n:i:h")) != -1) {
+    switch (c) {
+      case 'p':
+        opt_p4info_path = optarg;
+        break;
+      case 't':
+        opt_table_name = optarg;
+        break;
+      case 'n':
+        opt_num_entries = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        opt_iterations = std::strtoul(optarg, NULL, 10);
+        break;
+      case 'h':
+        print_help(argv[0]);
+        exit(0);
+      case '?':
+        if (isprint(optopt)) {
+          fprintf(stderr, "Unknown option or missing argument `-%c'.\n\n",
+                  optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        print_help(argv[0]);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!opt_p4info_path) {
+    fprintf(stderr, "Option -p is required.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+  if (opt_num_entries == 0 || opt_iterations == 0) {
+    fprintf(stderr, "Options -n and -i must be positive.\n\n");
+    print_help(argv[0]);
+    return 1;
+  }
+
+  return 0;
+}
+
+// random bytestring of the appropriate width, with leading zeros in about half
+// of the cases, which exercises the canonicalization
+std::string random_bytes(std::mt19937 *gen, size_t bitwidth) {
+  size_t nbytes = (bitwidth + 7) / 8;
+  std::string s(nbytes, '\x00');
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+  for (auto &c : s) c = static_cast<char>(byte_dist(*gen));
+  if (byte_dist(*gen) < 128) s[0] = 0;
+  size_t zero_nbits = nbytes * 8 - bitwidth;
+  s[0] &= static_cast<char>(0xff >> zero_nbits);
+  return s;
+}
+
+struct PIEntry {
+  PIEntry(const pi_p4info_t *p4info, pi_p4_id_t t_id, pi_p4_id_t a_id)
+      : mk(p4info, t_id), ad(p4info, a_id) { }
+
+  pi::MatchKey mk;
+  pi::ActionData ad;
+};
+
+std::vector<std::unique_ptr<PIEntry> > make_entries(const pi_p4info_t *p4info,
+                                                    pi_p4_id_t t_id) {
+  std::mt19937 gen(0);
+  std::vector<std::unique_ptr<PIEntry> > entries;
+  size_t num_actions;
+  auto a_id = pi_p4info_table_get_actions(p4info, t_id, &num_actions)[0];
+  auto num_mfs = pi_p4info_table_num_match_fields(p4info, t_id);
+  size_t num_params;
+  auto param_ids = pi_p4info_action_get_params(p4info, a_id, &num_params);
+  for (size_t i = 0; i < opt_num_entries; i++) {
+    entries.emplace_back(new PIEntry(p4info, t_id, a_id));
+    auto &mk = entries.back()->mk;
+    for (size_t j = 0; j < num_mfs; j++) {
+      auto finfo = pi_p4info_table_match_field_info(p4info, t_id, j);
+      auto v = random_bytes(&gen, finfo->bitwidth);
+      switch (finfo->match_type) {
+        case PI_P4INFO_MATCH_TYPE_VALID:
+          mk.set_valid(finfo->mf_id, true);
+          break;
+        case PI_P4INFO_MATCH_TYPE_EXACT:
+          mk.set_exact(finfo->mf_id, v.data(), v.size());
+          break;
+        case PI_P4INFO_MATCH_TYPE_LPM:
+          mk.set_lpm(finfo->mf_id, v.data(), v.size(),
+                     static_cast<int>(finfo->bitwidth));
+          break;
+        case PI_P4INFO_MATCH_TYPE_TERNARY:
+          {
+            std::string mask(v.size(), '\xff');
+            mk.set_ternary(finfo->mf_id, v.data(), mask.data(), v.size());
+          }
+          break;
+        case PI_P4INFO_MATCH_TYPE_OPTIONAL:
+          mk.set_optional(finfo->mf_id, v.data(), v.size(), false);
+          break;
+        case PI_P4INFO_MATCH_TYPE_RANGE:
+          mk.set_range(finfo->mf_id, v.data(), v.data(), v.size());
+          break;
+        default:
+          break;
+      }
+    }
+    auto &ad = entries.back()->ad;
+    for (size_t j = 0; j < num_params; j++) {
+      auto v = random_bytes(
+          &gen, pi_p4info_action_param_bitwidth(p4info, a_id, param_ids[j]));
+      ad.set_arg(param_ids[j], v.data(), v.size());
+    }
+  }
+  return entries;
+}
+
+void convert_generic(const pi_p4info_t *p4info, pi_p4_id_t t_id,
+                     const PIEntry &pi_entry, p4v1::TableEntry *entry) {
+  pi::fe::proto::parse_match_key(p4info, t_id, pi_entry.mk, entry);
+  auto *action = entry->mutable_action()->mutable_action();
+  pi::ActionDataReader reader(pi_entry.ad.get());
+  auto action_id = reader.get_action_id();
+  action->set_action_id(action_id);
+  size_t num_params;
+  auto param_ids = pi_p4info_action_get_params(p4info, action_id, &num_params);
+  for (size_t j = 0; j < num_params; j++) {
+    auto param = action->add_params();
+    param->set_param_id(param_ids[j]);
+    std::string value;
+    reader.get_arg(param_ids[j], &value);
+    param->set_value(pi::fe::proto::common::bytestring_pi_to_p4rt(value));
+  }
+}
+
+void convert_compiled(const ReadConverter &converter,
+                      const ReadConverter::MatchKeyConverter &mk_converter,
+                      const PIEntry &pi_entry, p4v1::TableEntry *entry) {
+  mk_converter.parse(pi_entry.mk.get(), entry);
+  converter.parse_action_data(
+      pi_entry.ad.get(), entry->mutable_action()->mutable_action());
+}
+
+// returns the conversion throughput, in entries per second
+template <typename Fn>
+double run_test(const std::vector<std::unique_ptr<PIEntry> > &entries,
+                pi_p4_id_t t_id, Fn fn) {
+  using Clock = std::chrono::steady_clock;
+  std::chrono::duration<double> elapsed{0};
+  for (size_t i = 0; i < opt_iterations; i++) {
+    // a new response for each iteration, like for a real read
+    p4v1::ReadResponse response;
+    auto start = Clock::now();
+    for (const auto &pi_entry : entries) {
+      auto *entry = response.add_entities()->mutable_table_entry();
+      entry->set_table_id(t_id);
+      fn(*pi_entry, entry);
+    }
+    elapsed += Clock::now() - start;
+  }
+  return (opt_iterations * entries.size()) / elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (parse_opts(argc, argv) != 0) return 1;
+
+  p4configv1::P4Info p4info_proto;
+  {
+    std::ifstream is(opt_p4info_path);
+    std::stringstream buffer;
+    buffer << is.rdbuf();
+    if (!is || !google::protobuf::TextFormat::ParseFromString(
+            buffer.str(), &p4info_proto)) {
+      std::cerr << "Cannot parse P4Info from " << opt_p4info_path << "\n";
+      return 1;
+    }
+  }
+  pi_p4info_t *p4info;
+  if (!pi::p4info::p4info_proto_reader(p4info_proto, &p4info)) {
+    std::cerr << "Cannot convert P4Info\n";
+    return 1;
+  }
+
+  pi_p4_id_t t_id = opt_table_name ?
+      pi_p4info_table_id_from_name(p4info, opt_table_name) :
+      pi_p4info_table_begin(p4info);
+  if (t_id == PI_INVALID_ID || t_id == pi_p4info_table_end(p4info) ||
+      pi_p4info_table_num_actions(p4info, t_id) == 0) {
+    std::cerr << "Invalid table\n";
+    return 1;
+  }
+
+  auto entries = make_entries(p4info, t_id);
+  ReadConverter converter;
+  converter.p4_change(p4info);
+  const auto &mk_converter = *converter.match_key_converter(t_id);
+
+  std::cout << "table: " << pi_p4info_table_name_from_id(p4info, t_id)
+            << ", entries: " << opt_num_entries
+            << ", iterations: " << opt_iterations << "\n";
+  auto generic = run_test(
+      entries, t_id, [p4info, t_id](const PIEntry &e, p4v1::TableEntry *entry) {
+        convert_generic(p4info, t_id, e, entry);
+      });
+  printf("generic:  %12.0f entries/s\n", generic);
+  auto compiled = run_test(
+      entries, t_id, [&](const PIEntry &e, p4v1::TableEntry *entry) {
+        convert_compiled(converter, mk_converter, e, entry);
+      });
+  printf("compiled: %12.0f entries/s (x%.2f)\n", compiled, compiled / generic);
+
+  pi_destroy_config(p4info);
+  return 0;
+}
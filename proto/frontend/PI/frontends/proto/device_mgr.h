@@ -28,6 +28,7 @@
 
 #include "google/rpc/status.pb.h"
 #include "p4/config/v1/p4info.pb.h"
+#include "p4/server/v1/changes.pb.h"
 #include "p4/server/v1/config.pb.h"
 #include "p4/v1/p4runtime.pb.h"
 
@@ -50,6 +51,8 @@ namespace proto {
 // forward declaration for PIMPL class
 class DeviceMgrImp;
 
+class ReplicationPublisher;
+
 // the gRPC server will instantiate one DeviceMgr object per device
 class DeviceMgr {
  public:
@@ -74,14 +77,38 @@ class DeviceMgr {
 
   Status write(const p4::v1::WriteRequest &request);
 
+  // Same as write, but the request is always scheduled as a bulk write,
+  // regardless of its size (see p4::server::v1::SchedulingConfig).
+  Status bulk_write(const p4::v1::WriteRequest &request);
+
   Status read(const p4::v1::ReadRequest &request,
               p4::v1::ReadResponse *response) const;
   Status read_one(const p4::v1::Entity &entity,
                   p4::v1::ReadResponse *response) const;
 
+  // Same as read, but the response may be served from the read cache (see
+  // p4::server::v1::ReadCacheConfig), in which case it is shared with other
+  // callers.
+  Status read_cached(const p4::v1::ReadRequest &request,
+                     std::shared_ptr<const p4::v1::ReadResponse> *response)
+      const;
+
+  // Table entries changed since a given generation, see
+  // p4::server::v1::P4RuntimeChanges.
+  Status read_changes(const p4::server::v1::ReadChangesRequest &request,
+                      p4::server::v1::ReadChangesResponse *response) const;
+
   Status stream_message_request_handle(
       const p4::v1::StreamMessageRequest &request);
 
+  // Sends several packets to the target at once (see pi_packetout_send_batch),
+  // which has a lower per-packet overhead than one
+  // stream_message_request_handle call per packet. Packets are sent in order
+  // and processing stops at the first packet which is invalid or cannot be
+  // sent, for which a stream error is generated.
+  Status packet_out_send_batch(
+      const std::vector<const p4::v1::PacketOut *> &packets);
+
   void stream_message_response_register_cb(StreamMessageResponseCb cb,
                                            void *cookie);
 
@@ -89,6 +116,20 @@ class DeviceMgr {
 
   Status server_config_get(p4::server::v1::Config *config);
 
+  // Queueing delay statistics for each priority class.
+  Status scheduling_stats_get(p4::server::v1::SchedulingStats *stats) const;
+
+  // Memory used to keep track of the state of the P4 objects, for each action
+  // profile.
+  Status memory_usage_get(p4::server::v1::MemoryUsage *usage) const;
+
+  // Publishes all subsequent state changes (committed forwarding pipeline
+  // configs and successful write updates) to standby servers, see
+  // replication.h. The current state, if any, is published right away. Use
+  // nullptr to stop publishing.
+  void replication_publisher_set(
+      std::shared_ptr<ReplicationPublisher> publisher);
+
   _PI_DEPRECATED
   static void init(size_t max_devices);
 
@@ -0,0 +1,124 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_FRONTENDS_PROTO_REPLICATION_H_
+#define PI_FRONTENDS_PROTO_REPLICATION_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PI/frontends/proto/device_mgr.h"
+
+// State mirroring between a primary P4Runtime server and a hot-standby server
+// running on the same host. The primary publishes every state change applied
+// through its DeviceMgr instances (committed forwarding pipeline configs and
+// successful write updates) on a Unix domain socket. The standby mirrors that
+// state in software, without touching the target, and pushes it to the target
+// when the primary goes away, so that the controller does not have to.
+// Forwarding state which is not written by the controller (e.g. counter values
+// incremented by the dataplane) is not mirrored.
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// forward declarations for PIMPL classes
+class ReplicationPublisherImp;
+class ReplicationSubscriberImp;
+
+class ReplicationPublisher {
+ public:
+  using device_id_t = DeviceMgr::device_id_t;
+  using Status = DeviceMgr::Status;
+
+  explicit ReplicationPublisher(const std::string &socket_path);
+
+  ~ReplicationPublisher();
+
+  // Binds the socket (replacing any stale socket file left behind by a
+  // previous primary) and starts accepting standby connections.
+  Status start();
+
+  // Called by DeviceMgr, under its internal access arbitration, so that
+  // changes are published in the order in which they are applied.
+  void publish_config(device_id_t device_id,
+                      const p4::v1::ForwardingPipelineConfig &config,
+                      bool preserve_forwarding_state);
+
+  // The status is the one returned by DeviceMgr::write for the request; only
+  // the updates which were applied successfully are published.
+  void publish_write(device_id_t device_id,
+                     const p4::v1::WriteRequest &request,
+                     const Status &status);
+
+  size_t num_subscribers() const;
+
+ private:
+  // PIMPL design
+  std::unique_ptr<ReplicationPublisherImp> pimp;
+};
+
+class ReplicationSubscriber {
+ public:
+  using device_id_t = DeviceMgr::device_id_t;
+  using Status = DeviceMgr::Status;
+
+  explicit ReplicationSubscriber(const std::string &socket_path);
+
+  ~ReplicationSubscriber();
+
+  // Connects to the primary and mirrors its state. Blocks until the primary
+  // goes away, i.e. until the connection is lost and cannot be re-established.
+  // Returns UNAVAILABLE if the primary cannot be reached in the first place.
+  Status run();
+
+  // Unblocks run(), e.g. when the process is asked to exit.
+  void stop();
+
+  // Devices for which a forwarding pipeline config was mirrored.
+  std::vector<device_id_t> devices() const;
+
+  // Returns the mirrored config and forwarding state for the device, in the
+  // order in which the entities would be written to the target on takeover.
+  Status state_get(device_id_t device_id,
+                   p4::v1::ForwardingPipelineConfig *config,
+                   p4::v1::WriteRequest *state) const;
+
+  // Pushes the mirrored config and forwarding state for the device to the
+  // target through the provided DeviceMgr. The config is saved, the state is
+  // replayed and the config is committed last (VERIFY_AND_SAVE + COMMIT), so
+  // the dataplane is not reset.
+  Status takeover(device_id_t device_id, DeviceMgr *device_mgr) const;
+
+ private:
+  // PIMPL design
+  std::unique_ptr<ReplicationSubscriberImp> pimp;
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_PROTO_REPLICATION_H_
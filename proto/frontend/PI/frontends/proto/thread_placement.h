@@ -0,0 +1,73 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PI_FRONTENDS_PROTO_THREAD_PLACEMENT_H_
+#define PI_FRONTENDS_PROTO_THREAD_PLACEMENT_H_
+
+#include <memory>
+#include <string>
+
+#include "google/rpc/status.pb.h"
+#include "p4/server/v1/config.pb.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Naming and placement (CPU affinity, scheduling policy) of the internal
+// threads, by thread class, as configured by the "threads" field of
+// p4::server::v1::Config. Internal threads call pi_thread_start when they
+// start, and the effective placement of each thread is logged.
+class ThreadPlacement {
+ public:
+  using Status = ::google::rpc::Status;
+
+  // Validates the configuration and registers a PI thread start callback
+  // which applies it. This is a process-wide setting, which is called by
+  // DeviceMgr::init before pi_init, so that target threads are covered too.
+  static Status configure(const p4::server::v1::Config &config);
+
+  // Applies the CPU affinity and scheduling policy configured for a thread
+  // class to the calling thread, for as long as the object is alive. Threads
+  // spawned in the meantime inherit the placement, which is how threads
+  // created by third-party libraries (e.g. gRPC) can be placed.
+  class Scoped {
+   public:
+    explicit Scoped(const std::string &thread_class);
+    ~Scoped();
+
+    Scoped(const Scoped &) = delete;
+    Scoped &operator=(const Scoped &) = delete;
+
+   private:
+    struct SavedPlacement;
+    std::unique_ptr<SavedPlacement> saved;
+  };
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // PI_FRONTENDS_PROTO_THREAD_PLACEMENT_H_
@@ -162,6 +162,11 @@ AccessArbitration::write_access(WriteAccess *access,
   }
   p4_ids.insert(other_p4_ids.begin(), other_p4_ids.end());
 
+  acquire_write_access(p4_ids);
+}
+
+void
+AccessArbitration::acquire_write_access(const P4IdSet &p4_ids) {
   std::unique_lock<std::mutex> lock(mutex);
   cv.wait(lock, [this, &p4_ids]() -> bool {
       return (read_cnt == 0) &&
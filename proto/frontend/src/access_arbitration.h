@@ -98,6 +98,16 @@ class AccessArbitration {
 
     ~WriteAccess();
 
+    // Gives up access for the duration of fn, and re-acquires access to the
+    // same set of P4Info objects before returning. Used by long-running
+    // operations to let more urgent operations through.
+    template <typename Fn>
+    void yield(Fn fn) {
+      arbitrator->release_write_access(*this);
+      fn();
+      arbitrator->acquire_write_access(p4_ids);
+    }
+
    private:
     friend class AccessArbitration;
     std::set<common::p4_id_t> p4_ids;
@@ -159,6 +169,7 @@ class AccessArbitration {
                     const ::p4::v1::WriteRequest &request,
                     const pi_p4info_t *p4info);
   void write_access(WriteAccess *access, common::p4_id_t p4_id);
+  void acquire_write_access(const P4IdSet &p4_ids);
 
   void read_access(ReadAccess *access);
 
@@ -22,6 +22,7 @@
 #include "action_helpers.h"
 
 #include <PI/frontends/cpp/tables.h>
+#include <PI/int/pi_int.h>
 
 #include "google/rpc/code.pb.h"
 #include "google/rpc/status.pb.h"
@@ -57,8 +58,10 @@ Status construct_action_data(const pi_p4info_t *p4info,
     if (bitwidth == not_found) {
       RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT, "Unknown action parameter");
     }
-    ASSIGN_OR_RETURN(auto value, bytestring_p4rt_to_pi(p.value(), bitwidth));
-    action_data->set_arg(p.param_id(), value.data(), value.size());
+    // the value is validated and written directly to the action data buffer
+    auto *dst = action_data->get()->data + pi_p4info_action_param_offset(
+        p4info, action.action_id(), p.param_id());
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(p.value(), bitwidth, dst));
   }
   RETURN_OK_STATUS();
 }
@@ -19,9 +19,12 @@
  *
  */
 
+#include <PI/int/pi_int.h>
 #include <PI/proto/util.h>
 
 #include <algorithm>
+#include <cstring>  // for std::memcpy
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
@@ -41,6 +44,7 @@
 
 namespace p4v1 = ::p4::v1;
 namespace p4configv1 = ::p4::config::v1;
+namespace p4serverv1 = ::p4::server::v1;
 
 namespace pi {
 
@@ -82,6 +86,22 @@ pi_port_t watch_port_p4rt_to_pi(const std::string &watch) {
   return static_cast<pi_port_t>(v);
 }
 
+// Approximate memory used by a std::map / std::unordered_map, not including
+// the memory allocated by the keys and values themselves. The node overhead is
+// implementation-dependent, we use the libstdc++ one.
+template <typename K, typename V>
+size_t container_memory_usage(const std::map<K, V> &m) {
+  return m.size() * (sizeof(typename std::map<K, V>::value_type) +
+                     4 * sizeof(void *));
+}
+
+template <typename K, typename V>
+size_t container_memory_usage(const std::unordered_map<K, V> &m) {
+  return m.size() * (sizeof(typename std::unordered_map<K, V>::value_type) +
+                     2 * sizeof(void *)) +
+      m.bucket_count() * sizeof(void *);
+}
+
 }  // namespace
 
 void
@@ -114,50 +134,164 @@ ActionProfBiMap::empty() const {
   return bimap.empty();
 }
 
+size_t
+ActionProfBiMap::size() const {
+  return bimap.size();
+}
+
+size_t
+ActionProfBiMap::memory_usage() const {
+  return bimap.memory_usage();
+}
+
+constexpr size_t ActionDataArena::kAlignment;
+
+ActionDataArena::ActionDataArena(const pi_p4info_t *p4info)
+    : p4info(p4info) { }
+
+/* static */
+size_t
+ActionDataArena::block_size(size_t data_size) {
+  auto size = sizeof(BlockHeader) + data_size;
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+ActionDataArena::Ref
+ActionDataArena::add(const pi::ActionData &action_data) {
+  const auto *ad = action_data.get();
+  auto size = block_size(ad->data_size);
+  Ref ref;
+  auto free_it = free_blocks.find(size);
+  if (free_it != free_blocks.end() && !free_it->second.empty()) {
+    ref = free_it->second.back();
+    free_it->second.pop_back();
+  } else {
+    assert(buffer.size() / kAlignment <= std::numeric_limits<Ref>::max());
+    ref = static_cast<Ref>(buffer.size() / kAlignment);
+    buffer.resize(buffer.size() + size);
+  }
+  auto *block = buffer.data() + ref * kAlignment;
+  BlockHeader header{ad->action_id, static_cast<uint32_t>(ad->data_size)};
+  std::memcpy(block, &header, sizeof(header));
+  std::memcpy(block + sizeof(header), ad->data, ad->data_size);
+  return ref;
+}
+
+void
+ActionDataArena::remove(Ref ref) {
+  BlockHeader header;
+  std::memcpy(&header, buffer.data() + ref * kAlignment, sizeof(header));
+  free_blocks[block_size(header.data_size)].push_back(ref);
+}
+
+pi::ActionData
+ActionDataArena::get(Ref ref) const {
+  const auto *block = buffer.data() + ref * kAlignment;
+  BlockHeader header;
+  std::memcpy(&header, block, sizeof(header));
+  pi::ActionData action_data(p4info, header.action_id);
+  std::memcpy(action_data.get()->data, block + sizeof(header),
+              header.data_size);
+  return action_data;
+}
+
+size_t
+ActionDataArena::memory_usage() const {
+  size_t usage = buffer.capacity();
+  for (const auto &p : free_blocks)
+    usage += p.second.capacity() * sizeof(Ref);
+  return usage;
+}
+
+void
+ActionProfMemberMap::MemberState::add_weight(int weight) {
+  auto it = std::lower_bound(
+      weight_counts.begin(), weight_counts.end(), weight,
+      [](const WeightCount &wc, int w) { return wc.weight < w; });
+  if (it != weight_counts.end() && it->weight == weight)
+    it->count++;
+  else
+    weight_counts.insert(it, {weight, 1});
+}
+
+void
+ActionProfMemberMap::MemberState::remove_weight(int weight) {
+  auto it = std::lower_bound(
+      weight_counts.begin(), weight_counts.end(), weight,
+      [](const WeightCount &wc, int w) { return wc.weight < w; });
+  assert(it != weight_counts.end() && it->weight == weight);
+  if (it != weight_counts.end() && it->weight == weight) it->count--;
+}
+
+int
+ActionProfMemberMap::MemberState::purge_weight_counts() {
+  auto last_used = weight_counts.end();
+  while (last_used != weight_counts.begin() && (last_used - 1)->count == 0)
+    last_used--;
+  weight_counts.erase(last_used, weight_counts.end());
+  return weight_counts.empty() ? -1 : weight_counts.back().weight;
+}
+
+ActionProfMemberMap::ActionProfMemberMap(const pi_p4info_t *p4info)
+    : action_data_arena(p4info) { }
+
 bool
 ActionProfMemberMap::add(const Id &id, pi_indirect_handle_t h,
-                         // NOLINTNEXTLINE(whitespace/operators)
-                         pi::ActionData &&action_data) {
-  auto p = members.emplace(id, MemberState(std::move(action_data)));
-  if (!p.second) return false;
-  p.first->second.handles.push_back(h);
-  p.first->second.weight_counts[1] = 1;
+                         const pi::ActionData &action_data) {
+  if (members.find(id) != nullptr) return false;
+  MemberState member_state;
+  member_state.action_data = action_data_arena.add(action_data);
+  member_state.handles.push_back(h);
+  member_state.add_weight(1);
+  members.insert(id, std::move(member_state));
   return true;
 }
 
 ActionProfMemberMap::MemberState *
 ActionProfMemberMap::access_member_state(const Id &id) {
-  auto it = members.find(id);
-  return (it == members.end()) ? nullptr : &it->second;
+  return members.find(id);
+}
+
+pi::ActionData
+ActionProfMemberMap::get_action_data(const MemberState &member_state) const {
+  return action_data_arena.get(member_state.action_data);
+}
+
+void
+ActionProfMemberMap::set_action_data(MemberState *member_state,
+                                     const pi::ActionData &action_data) {
+  action_data_arena.remove(member_state->action_data);
+  member_state->action_data = action_data_arena.add(action_data);
 }
 
 const pi_indirect_handle_t *
 ActionProfMemberMap::get_first_handle(const Id &id) const {
-  auto it = members.find(id);
-  if (it == members.end()) return nullptr;
-  return &it->second.handles.front();
+  auto *member_state = members.find(id);
+  if (member_state == nullptr) return nullptr;
+  return &member_state->handles.front();
 }
 
 const Id *
 ActionProfMemberMap::retrieve_id(pi_indirect_handle_t h) const {
-  auto it = handle_to_id.find(h);
-  return (it == handle_to_id.end()) ? nullptr : &it->second;
+  return handle_to_id.find(h);
 }
 
 bool
 ActionProfMemberMap::remove(const Id &id) {
-  return (members.erase(id) > 0);
+  auto *member_state = members.find(id);
+  if (member_state == nullptr) return false;
+  action_data_arena.remove(member_state->action_data);
+  return members.erase(id);
 }
 
 bool
 ActionProfMemberMap::add_handle(pi_indirect_handle_t h, const Id &id) {
-  auto p = handle_to_id.emplace(h, id);
-  return p.second;
+  return handle_to_id.insert(h, id);
 }
 
 bool
 ActionProfMemberMap::remove_handle(pi_indirect_handle_t h) {
-  return (handle_to_id.erase(h) > 0);
+  return handle_to_id.erase(h);
 }
 
 bool
@@ -165,6 +299,26 @@ ActionProfMemberMap::empty() const {
   return members.empty();
 }
 
+size_t
+ActionProfMemberMap::size() const {
+  return members.size();
+}
+
+size_t
+ActionProfMemberMap::memory_usage() const {
+  size_t usage = members.memory_usage() + handle_to_id.memory_usage();
+  members.for_each([&usage](const Id &, const MemberState &member_state) {
+    usage += member_state.handles.heap_memory_usage() +
+        member_state.weight_counts.heap_memory_usage();
+  });
+  return usage;
+}
+
+size_t
+ActionProfMemberMap::action_data_memory_usage() const {
+  return action_data_arena.memory_usage();
+}
+
 ActionProfGroupMembership::ActionProfGroupMembership(size_t max_size_user)
     : max_size_user(max_size_user) { }
 
@@ -245,80 +399,16 @@ bool operator!=(const WatchPort &lhs, const WatchPort &rhs) {
   return !(lhs == rhs);
 }
 
-// The result is the union of all members (current and new) with current_weight
-// and new_weight set appropriately. For a new member, current_weight is 0 while
-// new_weight is > 0. For an old member that needs to be removed, new_weight is
-// 0 while current_weight is > 0. For an existing member whose weight we are
-// changing new_weight and current_weight are both > 0. If we are not changing
-// the weight, new_weight == current_weight. We also store the desired watch
-// port for the member as new_watch, which is set to -1 if the member needs to
-// be removed, along with the current watch port as current_watch.
-std::vector<ActionProfGroupMembership::MembershipUpdate>
-ActionProfGroupMembership::compute_membership_update(
-    const std::map<Id, MembershipInfo> &desired_membership) const {
-  std::vector<MembershipUpdate> update;
-
-  auto new_it = desired_membership.begin();
-  auto current_it = members.begin();
-  while (new_it != desired_membership.end() || current_it != members.end()) {
-    if (new_it == desired_membership.end()) {
-      for (; current_it != members.end(); current_it++)
-        update.emplace_back(current_it->first,
-                            current_it->second.weight, 0,
-                            current_it->second.watch,
-                            WatchPort::invalid_watch());
-      break;
-    }
-    if (current_it == members.end()) {
-      for (; new_it != desired_membership.end(); new_it++)
-        update.emplace_back(new_it->first,
-                            0, new_it->second.weight,
-                            WatchPort::invalid_watch(),
-                            new_it->second.watch);
-      break;
-    }
-    if (current_it->first < new_it->first) {
-      // member no longer exists
-      update.emplace_back(current_it->first,
-                          current_it->second.weight, 0,
-                          current_it->second.watch,
-                          WatchPort::invalid_watch());
-      current_it++;
-    } else if (current_it->first > new_it->first) {
-      // new member
-      update.emplace_back(new_it->first,
-                          0, new_it->second.weight,
-                          WatchPort::invalid_watch(),
-                          new_it->second.watch);
-      new_it++;
-    } else {
-      update.emplace_back(current_it->first,
-                          current_it->second.weight, new_it->second.weight,
-                          current_it->second.watch, new_it->second.watch);
-      current_it++;
-      new_it++;
-    }
-  }
-
-  return update;
-}
-
 void
-ActionProfGroupMembership::set_membership(
-    std::map<Id, MembershipInfo> &&new_members) {
+ActionProfGroupMembership::set_membership(Membership &&new_members) {
   members = std::move(new_members);
 }
 
-const std::map<Id, MembershipInfo> &
+const ActionProfGroupMembership::Membership &
 ActionProfGroupMembership::get_membership() const {
   return members;
 }
 
-std::map<Id, MembershipInfo> &
-ActionProfGroupMembership::get_membership() {
-  return members;
-}
-
 size_t
 ActionProfGroupMembership::get_max_size_user() const {
   return max_size_user;
@@ -327,8 +417,11 @@ ActionProfGroupMembership::get_max_size_user() const {
 bool
 ActionProfGroupMembership::get_member_info(
     const Id &member_id, int *weight, WatchPort *watch) const {
-  auto it = members.find(member_id);
-  if (it == members.end()) return false;
+  auto it = std::lower_bound(
+      members.begin(), members.end(), member_id,
+      [](const Membership::value_type &m, const Id &id) {
+        return m.first < id; });
+  if (it == members.end() || it->first != member_id) return false;
   *weight = it->second.weight;
   *watch = it->second.watch;
   return true;
@@ -383,7 +476,7 @@ ActionProfAccessManual::member_create(const p4v1::ActionProfileMember &member,
   auto pi_status = ap.member_create(action_data, &member_h);
   if (pi_status != PI_STATUS_SUCCESS)
     RETURN_ERROR_STATUS(Code::UNKNOWN, "Error when creating member on target");
-  if (!member_map.add(member.member_id(), member_h, std::move(action_data))) {
+  if (!member_map.add(member.member_id(), member_h, action_data)) {
     RETURN_ERROR_STATUS(
         Code::INTERNAL, "Error when add new member to member map");
   }
@@ -474,7 +567,7 @@ ActionProfAccessManual::member_modify(const p4v1::ActionProfileMember &member,
           Code::UNKNOWN, "Error when modifying member on target");
     }
   }
-  member_state->action_data = std::move(action_data);
+  member_map.set_action_data(member_state, action_data);
   RETURN_OK_STATUS();
 }
 
@@ -501,6 +594,14 @@ ActionProfAccessManual::group_modify(const p4v1::ActionProfileGroup &group,
   return group_update_members(ap, group);
 }
 
+Status
+ActionProfAccessManual::member_validate(
+    const p4v1::ActionProfileMember &member) {
+  RETURN_IF_ERROR(validate_action(member.action()));
+  pi::ActionData action_data(p4info, member.action().action_id());
+  return construct_action_data(p4info, member.action(), &action_data);
+}
+
 Status
 ActionProfAccessManual::member_delete(const p4v1::ActionProfileMember &member,
                                       const SessionTemp &session) {
@@ -558,7 +659,7 @@ ActionProfAccessManual::group_delete(const p4v1::ActionProfileGroup &group,
           m.first, group.group_id());
     }
     assert(m.second.weight > 0);
-    member_state->weight_counts[m.second.weight]--;
+    member_state->remove_weight(m.second.weight);
     for (int i = 0; i < m.second.weight; i++) {
       // no reason to fail, we are just updating the watch_port_enforcer
       // internal state
@@ -603,9 +704,11 @@ ActionProfAccessManual::create_missing_weighted_members(
     const ActionProfGroupMembership::MembershipUpdate &update) {
   auto handles_size = static_cast<int>(member_state->handles.size());
   assert(handles_size >= update.current_weight);
+  if (handles_size >= update.new_weight) RETURN_OK_STATUS();
+  auto action_data = member_map.get_action_data(*member_state);
   for (int i = handles_size; i < update.new_weight; i++) {
     pi_indirect_handle_t member_h;
-    auto pi_status = ap.member_create(member_state->action_data, &member_h);
+    auto pi_status = ap.member_create(action_data, &member_h);
     if (pi_status != PI_STATUS_SUCCESS) {
       RETURN_ERROR_STATUS(
           Code::UNKNOWN, "Error when creating member on target");
@@ -623,19 +726,7 @@ Status
 ActionProfAccessManual::purge_unused_weighted_members(
     pi::ActProf &ap,
     ActionProfMemberMap::MemberState *member_state) {
-  int new_max_weight = -1;
-  for (auto weight_count_rit = member_state->weight_counts.rbegin();
-       weight_count_rit != member_state->weight_counts.rend();
-       ++weight_count_rit) {
-    if (weight_count_rit->second == 0) continue;
-    new_max_weight = weight_count_rit->first;
-    // weight_count_rit.base() will return an iterator one element past the one
-    // we get when dereferencing weight_count_rit, which is exactly what we want
-    // for the erase call
-    member_state->weight_counts.erase(
-        weight_count_rit.base(), member_state->weight_counts.end());
-    break;
-  }
+  int new_max_weight = member_state->purge_weight_counts();
   assert(new_max_weight > 0);
 
   for (int i = static_cast<int>(member_state->handles.size()) - 1;
@@ -674,6 +765,9 @@ ActionProfAccessManual::purge_unused_weighted_members_wrapper(
 Status
 ActionProfAccessManual::group_update_members(
     pi::ActProf &ap, const p4v1::ActionProfileGroup &group) {
+  using Membership = ActionProfGroupMembership::Membership;
+  using MembershipUpdate = ActionProfGroupMembership::MembershipUpdate;
+
   size_t sum_of_weights = 0;
   for (const auto& member : group.members()) {
     if (member.weight() <= 0) {
@@ -695,74 +789,95 @@ ActionProfAccessManual::group_update_members(
                         "Sum of member weights exceeds maximum group size");
   }
 
-  std::map<Id, MembershipInfo> new_membership;
+  Membership new_membership;
+  new_membership.reserve(group.members_size());
   for (const auto &m : group.members()) {
     // check that member id exists
     if (!member_map.access_member_state(m.member_id())) {
       RETURN_ERROR_STATUS(
           Code::NOT_FOUND, "Member id does not exist: {}", m.member_id());
     }
-    // check if duplicate
-    if (new_membership.count(m.member_id()) > 0) {
-      RETURN_ERROR_STATUS(
-          Code::INVALID_ARGUMENT,
-          "Duplicate member id {} for group {}, use weights instead",
-          m.member_id(), group_id);
-    }
-    new_membership.emplace(m.member_id(),
-                           MembershipInfo{m.weight(), WatchPort::make(m)});
+    new_membership.emplace_back(
+        m.member_id(), MembershipInfo{m.weight(), WatchPort::make(m)});
   }
-
-  auto membership_update = membership.compute_membership_update(
-      new_membership);
-
-  auto cleanup_members = [&membership_update, &ap, this]() {
-    for (const auto &m : membership_update) {
-      auto member_state = member_map.access_member_state(m.id);
-      assert(member_state);
-      // TODO(antonin): try to purge subsequent members even if one fails
-      RETURN_IF_ERROR(purge_unused_weighted_members_wrapper(ap, member_state));
-    }
-    RETURN_OK_STATUS();
+  auto id_less = [](const Membership::value_type &m1,
+                    const Membership::value_type &m2) {
+    return m1.first < m2.first;
   };
+  // members are usually provided in order by the client
+  if (!std::is_sorted(new_membership.begin(), new_membership.end(), id_less))
+    std::sort(new_membership.begin(), new_membership.end(), id_less);
+  // check for duplicates
+  auto duplicate_it = std::adjacent_find(
+      new_membership.begin(), new_membership.end(),
+      [](const Membership::value_type &m1, const Membership::value_type &m2) {
+        return m1.first == m2.first; });
+  if (duplicate_it != new_membership.end()) {
+    RETURN_ERROR_STATUS(
+        Code::INVALID_ARGUMENT,
+        "Duplicate member id {} for group {}, use weights instead",
+        duplicate_it->first, group_id);
+  }
 
-  auto &current_membership = membership.get_membership();
+  // must be called before the membership is updated
+  auto cleanup_members = [&membership, &new_membership, &ap, this]() {
+    auto status = OK_STATUS();
+    membership.visit_membership_update(
+        new_membership, [&status, &ap, this](const MembershipUpdate &m) {
+          // unused member copies can only exist if the weight changed
+          if (IS_ERROR(status) || m.current_weight == m.new_weight) return;
+          auto member_state = member_map.access_member_state(m.id);
+          assert(member_state);
+          // TODO(antonin): try to purge subsequent members even if one fails
+          status = purge_unused_weighted_members_wrapper(ap, member_state);
+        });
+    return status;
+  };
 
   if (pi_api_choice == PiApiChoice::INDIVIDUAL_ADDS_AND_REMOVES) {
     // TODO(antonin): make this code smarter so that the group is never empty
     // and never too big at any given time.
 
-    for (auto &m : membership_update) {
-      auto member_state = member_map.access_member_state(m.id);
-      assert(member_state);  // checked previously
+    auto add_member = [&ap, group_h](pi_indirect_handle_t h) -> Status {
+      auto pi_status = ap.group_add_member(*group_h, h);
+      if (pi_status != PI_STATUS_SUCCESS) {
+        RETURN_ERROR_STATUS(
+            Code::UNKNOWN, "Error when adding member to group on target");
+      }
+      RETURN_OK_STATUS();
+    };
 
-      RETURN_IF_ERROR(create_missing_weighted_members(ap, member_state, m));
+    auto remove_member = [&ap, group_h](pi_indirect_handle_t h) -> Status {
+      auto pi_status = ap.group_remove_member(*group_h, h);
+      if (pi_status != PI_STATUS_SUCCESS) {
+        RETURN_ERROR_STATUS(
+            Code::UNKNOWN, "Error when removing member from group on target");
+      }
+      RETURN_OK_STATUS();
+    };
 
-      if (m.current_weight > 0) member_state->weight_counts[m.current_weight]--;
+    // Membership as programmed in the target, built in member id order as we
+    // go. If an error occurs, the remaining members are left unchanged.
+    Membership end_membership;
+    end_membership.reserve(
+        std::max(membership.get_membership().size(), new_membership.size()));
+    auto status = OK_STATUS();
 
-      auto add_member = [&ap, group_h](pi_indirect_handle_t h)
-          -> Status {
-        auto pi_status = ap.group_add_member(*group_h, h);
-        if (pi_status != PI_STATUS_SUCCESS) {
-          RETURN_ERROR_STATUS(
-              Code::UNKNOWN, "Error when adding member to group on target");
-        }
-        RETURN_OK_STATUS();
-      };
-
-      auto remove_member = [&ap, group_h](pi_indirect_handle_t h)
-          -> Status {
-        auto pi_status = ap.group_remove_member(*group_h, h);
-        if (pi_status != PI_STATUS_SUCCESS) {
-          RETURN_ERROR_STATUS(
-              Code::UNKNOWN, "Error when removing member from group on target");
-        }
-        RETURN_OK_STATUS();
-      };
+    auto update_member = [&](const MembershipUpdate &m) {
+      auto member_state = member_map.access_member_state(m.id);
+      assert(member_state);  // checked previously
 
       int end_weight = m.current_weight;
+      auto end_watch = m.current_watch;
 
-      Status status = OK_STATUS();
+      status = create_missing_weighted_members(ap, member_state, m);
+      if (IS_ERROR(status)) {
+        if (end_weight > 0) end_membership.emplace_back(
+            m.id, MembershipInfo{end_weight, end_watch});
+        return;
+      }
+
+      if (m.current_weight > 0) member_state->remove_weight(m.current_weight);
 
       // remove members as needed
       for (int i = m.current_weight - 1; i >= m.new_weight; i--) {
@@ -775,27 +890,17 @@ ActionProfAccessManual::group_update_members(
         status = remove_member(h);
         if (IS_ERROR(status)) break;
         end_weight--;
-        auto it = current_membership.find(m.id);
-        assert(it != current_membership.end());
-        if (it->second.weight == 1)
-          current_membership.erase(it);
-        else
-          it->second.weight--;
       }
 
       // add members as needed
-      for (int i = m.current_weight; i < m.new_weight; i++) {
+      for (int i = m.current_weight; i < m.new_weight && IS_OK(status); i++) {
         auto h = member_state->handles.at(i);
         status = add_member(h);
         if (IS_ERROR(status)) break;
         end_weight++;
-        // may construct and value-initialize MembershipInfo instance
-        auto &minfo = current_membership[m.id];
-        minfo.weight++;
-        minfo.watch = m.new_watch;
+        end_watch = m.new_watch;
         status = watch_port_enforcer->add_member_and_update_hw(
             &ap, *group_h, h, m.new_watch.pi_port);
-        if (IS_ERROR(status)) break;
       }
 
       // modify watch ports if needed
@@ -806,47 +911,66 @@ ActionProfAccessManual::group_update_members(
               &ap, *group_h, h, m.current_watch.pi_port, m.new_watch.pi_port);
           if (IS_ERROR(status)) break;
         }
-        current_membership.at(m.id).watch = m.new_watch;
+        end_watch = m.new_watch;
       }
 
-      if (end_weight > 0) member_state->weight_counts[end_weight]++;
-
-      if (IS_ERROR(status)) {
-        RETURN_IF_ERROR(cleanup_members());
-        return status;
+      if (IS_OK(status)) {
+        assert(end_weight == m.new_weight);
+        end_watch = m.new_watch;
       }
 
-      RETURN_IF_ERROR(status);
-      assert(end_weight == m.new_weight);
-    }
-
-    assert(current_membership == new_membership);
+      if (end_weight > 0) {
+        member_state->add_weight(end_weight);
+        end_membership.emplace_back(
+            m.id, MembershipInfo{end_weight, end_watch});
+      }
+    };
+
+    membership.visit_membership_update(
+        new_membership, [&](const MembershipUpdate &m) {
+          if (IS_OK(status) && !m.is_noop()) {
+            update_member(m);
+          } else if (IS_OK(status)) {
+            // the watch port may have been provided differently
+            end_membership.emplace_back(
+                m.id, MembershipInfo{m.new_weight, m.new_watch});
+          } else if (m.current_weight > 0) {
+            end_membership.emplace_back(
+                m.id, MembershipInfo{m.current_weight, m.current_watch});
+          }
+        });
+
+    auto cleanup_status = cleanup_members();
+    membership.set_membership(std::move(end_membership));
+    RETURN_IF_ERROR(cleanup_status);
+    RETURN_IF_ERROR(status);
+    assert(membership.get_membership() == new_membership);
   } else if (pi_api_choice == PiApiChoice::SET_MEMBERSHIP) {
     std::vector<pi_indirect_handle_t> members_to_set;
+    members_to_set.reserve(sum_of_weights);
     std::unique_ptr<bool[]> activate(new bool[sum_of_weights]);
 
     int activate_idx = 0;
-    for (const auto &m : membership_update) {
-      auto member_state = member_map.access_member_state(m.id);
-      if (!member_state) {
-        RETURN_ERROR_STATUS(
-            Code::NOT_FOUND, "Member id does not exist: {}", m.id);
-      }
-
-      RETURN_IF_ERROR(create_missing_weighted_members(ap, member_state, m));
-
-      if (m.new_weight > 0) {
-        members_to_set.insert(members_to_set.end(),
-                              member_state->handles.begin(),
-                              member_state->handles.begin() + m.new_weight);
-
-        auto port_status = watch_port_enforcer->get_port_status(
-            act_prof_id, m.new_watch.pi_port);
-        for (int i = 0; i < m.new_weight; i++) {
-          activate[activate_idx++] = (port_status == PI_PORT_STATUS_UP);
-        }
-      }
-    }
+    auto status = OK_STATUS();
+    membership.visit_membership_update(
+        new_membership, [&](const MembershipUpdate &m) {
+          if (IS_ERROR(status)) return;
+          auto member_state = member_map.access_member_state(m.id);
+          assert(member_state);  // checked previously
+
+          status = create_missing_weighted_members(ap, member_state, m);
+          if (IS_ERROR(status) || m.new_weight == 0) return;
+
+          members_to_set.insert(members_to_set.end(),
+                                member_state->handles.begin(),
+                                member_state->handles.begin() + m.new_weight);
+
+          auto port_status = watch_port_enforcer->get_port_status(
+              act_prof_id, m.new_watch.pi_port);
+          for (int i = 0; i < m.new_weight; i++)
+            activate[activate_idx++] = (port_status == PI_PORT_STATUS_UP);
+        });
+    RETURN_IF_ERROR(status);
 
     auto pi_status = ap.group_set_members(
         *group_h, members_to_set.size(), members_to_set.data(), activate.get());
@@ -857,39 +981,48 @@ ActionProfAccessManual::group_update_members(
     }
 
     size_t watch_port_errors = 0;
-    for (const auto &m : membership_update) {
-      auto member_state = member_map.access_member_state(m.id);
-      assert(member_state);
-      if (m.current_weight > 0) member_state->weight_counts[m.current_weight]--;
-      if (m.new_weight > 0) member_state->weight_counts[m.new_weight]++;
-
-      // no reasons for any of these to fail, we are not touching the HW
-      for (int i = m.current_weight - 1; i >= m.new_weight; i--) {
-        auto h = member_state->handles.at(i);
-        auto status = watch_port_enforcer->delete_member(
-            act_prof_id, *group_h, h, m.current_watch.pi_port);
-        if (IS_ERROR(status)) watch_port_errors++;
-      }
-
-      for (int i = m.current_weight; i < m.new_weight; i++) {
-        auto h = member_state->handles.at(i);
-        auto status = watch_port_enforcer->add_member(
-            act_prof_id, *group_h, h, m.new_watch.pi_port);
-        if (IS_ERROR(status)) watch_port_errors++;
-      }
-
-      if (m.new_watch != m.current_watch) {
-        for (int i = 0; i < std::min(m.current_weight, m.new_weight); i++) {
-          auto h = member_state->handles.at(i);
-          auto status = watch_port_enforcer->modify_member(
-              act_prof_id, *group_h, h,
-              m.current_watch.pi_port, m.new_watch.pi_port);
-          if (IS_ERROR(status)) watch_port_errors++;
-        }
-      }
-    }
-
+    membership.visit_membership_update(
+        new_membership, [&](const MembershipUpdate &m) {
+          if (m.is_noop()) return;
+          auto member_state = member_map.access_member_state(m.id);
+          assert(member_state);
+          if (m.current_weight != m.new_weight) {
+            if (m.current_weight > 0)
+              member_state->remove_weight(m.current_weight);
+            if (m.new_weight > 0) member_state->add_weight(m.new_weight);
+          }
+
+          // no reasons for any of these to fail, we are not touching the HW
+          for (int i = m.current_weight - 1; i >= m.new_weight; i--) {
+            auto h = member_state->handles.at(i);
+            auto status = watch_port_enforcer->delete_member(
+                act_prof_id, *group_h, h, m.current_watch.pi_port);
+            if (IS_ERROR(status)) watch_port_errors++;
+          }
+
+          for (int i = m.current_weight; i < m.new_weight; i++) {
+            auto h = member_state->handles.at(i);
+            auto status = watch_port_enforcer->add_member(
+                act_prof_id, *group_h, h, m.new_watch.pi_port);
+            if (IS_ERROR(status)) watch_port_errors++;
+          }
+
+          if (m.new_watch != m.current_watch) {
+            for (int i = 0; i < std::min(m.current_weight, m.new_weight);
+                 i++) {
+              auto h = member_state->handles.at(i);
+              auto status = watch_port_enforcer->modify_member(
+                  act_prof_id, *group_h, h,
+                  m.current_watch.pi_port, m.new_watch.pi_port);
+              if (IS_ERROR(status)) watch_port_errors++;
+            }
+          }
+        });
+
+    // cleanup members which are not used anymore
+    auto cleanup_status = cleanup_members();
     membership.set_membership(std::move(new_membership));
+    RETURN_IF_ERROR(cleanup_status);
 
     if (watch_port_errors > 0) {
       RETURN_ERROR_STATUS(
@@ -902,9 +1035,6 @@ ActionProfAccessManual::group_update_members(
     RETURN_ERROR_STATUS(Code::INTERNAL, "Unknown PiApiChoice");
   }
 
-  // cleanup members which are not used anymore
-  RETURN_IF_ERROR(cleanup_members());
-
   RETURN_OK_STATUS();
 }
 
@@ -944,6 +1074,22 @@ ActionProfAccessManual::retrieve_group_id(
   return true;
 }
 
+void
+ActionProfAccessManual::memory_usage_get(
+    p4serverv1::MemoryUsage::ActionProfileUsage *usage) const {
+  usage->set_num_members(member_map.size());
+  usage->set_num_groups(group_bimap.size());
+  size_t bytes = member_map.memory_usage() + group_bimap.memory_usage() +
+      container_memory_usage(group_members);
+  for (const auto &p : group_members) {
+    bytes += p.second.get_membership().capacity() *
+        sizeof(ActionProfGroupMembership::Membership::value_type);
+  }
+  auto action_data_bytes = member_map.action_data_memory_usage();
+  usage->set_bytes(bytes + action_data_bytes);
+  usage->set_action_data_bytes(action_data_bytes);
+}
+
 struct ActionProfAccessOneshot::OneShotGroupCleanupTask
     : common::LocalCleanupIface {
   OneShotGroupCleanupTask(ActionProfAccessOneshot *action_prof_access_oneshot,
@@ -1093,10 +1239,41 @@ ActionProfAccessOneshot::group_create_helper(
   RETURN_OK_STATUS();
 }
 
+namespace {
+
+template <typename T>
+void append_to_key(std::string *key, const T &v) {
+  key->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// Canonical representation of a one-shot group, used to find identical groups
+// when sharing is enabled. The action parameters are compared in their PI
+// representation, which is canonical. The watch port is compared as provided
+// by the client, which is what is returned when reading the group.
+std::string make_group_key(const p4v1::ActionProfileActionSet &action_set,
+                           const std::vector<pi::ActionData> &actions_data) {
+  std::string key;
+  for (int i = 0; i < action_set.action_profile_actions_size(); i++) {
+    const auto &action = action_set.action_profile_actions(i);
+    const auto *action_data = actions_data[i].get();
+    append_to_key(&key, action_data->action_id);
+    key.append(action_data->data, action_data->data_size);
+    append_to_key(&key, action.weight());
+    auto watch = WatchPort::make(action);
+    append_to_key(&key, watch.watch_kind_case);
+    append_to_key(&key, watch.watch);
+    append_to_key(&key, watch.watch_port.size());
+    key.append(watch.watch_port);
+  }
+  return key;
+}
+
+}  // namespace
+
 Status
 ActionProfAccessOneshot::group_create(
     const p4::v1::ActionProfileActionSet &action_set,
-    pi_indirect_handle_t *group_h, SessionTemp *session) {
+    bool share, pi_indirect_handle_t *group_h, SessionTemp *session) {
   if (action_set.action_profile_actions().empty()) {
     RETURN_ERROR_STATUS(
         Code::UNIMPLEMENTED, "No support for empty action profile groups");
@@ -1119,18 +1296,36 @@ ActionProfAccessOneshot::group_create(
         "Sum of weights exceeds static max_group_size (from P4Info)");
   }
 
+  // the action data is the same for all the copies of a weighted member
+  std::vector<pi::ActionData> actions_data;
+  actions_data.reserve(action_set.action_profile_actions_size());
+  for (const auto &action : action_set.action_profile_actions()) {
+    actions_data.emplace_back(p4info, action.action().action_id());
+    RETURN_IF_ERROR(
+        construct_action_data(p4info, action.action(), &actions_data.back()));
+  }
+
+  std::string key;
+  if (share) {
+    key = make_group_key(action_set, actions_data);
+    auto key_it = shared_group_keys.find(key);
+    if (key_it != shared_group_keys.end()) {
+      *group_h = key_it->second;
+      shared_groups.at(*group_h).ref_count++;
+      RETURN_OK_STATUS();
+    }
+  }
+
   session->cleanup_scope_push();
   pi::ActProf ap(session->get(), device_tgt, p4info, act_prof_id);
   std::vector<OneShotMember> members;
   std::vector<pi_indirect_handle_t> members_h;
   std::vector<pi_port_t> members_watch_port;
-  for (const auto &action : action_set.action_profile_actions()) {
+  for (int j = 0; j < action_set.action_profile_actions_size(); j++) {
+    const auto &action = action_set.action_profile_actions(j);
     for (int i = 0; i < action.weight(); i++) {
       pi_indirect_handle_t member_h;
-      pi::ActionData action_data(p4info, action.action().action_id());
-      RETURN_IF_ERROR(
-          construct_action_data(p4info, action.action(), &action_data));
-      auto pi_status = ap.member_create(action_data, &member_h);
+      auto pi_status = ap.member_create(actions_data[j], &member_h);
       if (pi_status != PI_STATUS_SUCCESS) {
         RETURN_ERROR_STATUS(
             Code::UNKNOWN, "Error when creating member on target");
@@ -1160,6 +1355,10 @@ ActionProfAccessOneshot::group_create(
   auto p = group_members.emplace(*group_h, members);
   assert(p.second);
   (void)p;
+  if (share) {
+    shared_group_keys.emplace(key, *group_h);
+    shared_groups.emplace(*group_h, SharedGroup{std::move(key), 1});
+  }
   RETURN_OK_STATUS();
 }
 
@@ -1168,13 +1367,22 @@ ActionProfAccessOneshot::group_delete(pi_indirect_handle_t group_h,
                                       const SessionTemp &session) {
   auto members_it = group_members.find(group_h);
   assert(members_it != group_members.end());
+  auto shared_it = shared_groups.find(group_h);
+  if (shared_it != shared_groups.end() && --shared_it->second.ref_count > 0)
+    RETURN_OK_STATUS();
   pi::ActProf ap(session.get(), device_tgt, p4info, act_prof_id);
   // Group needs to be deleted first, otherwise target may complain about group
   // referencing members which no longer exist.
   {
     auto pi_status = ap.group_delete(group_h);
-    if (pi_status != PI_STATUS_SUCCESS)
+    if (pi_status != PI_STATUS_SUCCESS) {
+      if (shared_it != shared_groups.end()) shared_it->second.ref_count++;
       RETURN_ERROR_STATUS(Code::UNKNOWN, "Error when deleting group on target");
+    }
+  }
+  if (shared_it != shared_groups.end()) {
+    shared_group_keys.erase(shared_it->second.key);
+    shared_groups.erase(shared_it);
   }
   for (const auto &member : members_it->second) {
     auto pi_status = ap.member_delete(member.member_h);
@@ -1201,6 +1409,24 @@ ActionProfAccessOneshot::group_get_members(
   return true;
 }
 
+void
+ActionProfAccessOneshot::memory_usage_get(
+    p4serverv1::MemoryUsage::ActionProfileUsage *usage) const {
+  size_t num_members = 0;
+  size_t bytes = container_memory_usage(group_members) +
+      container_memory_usage(shared_groups) +
+      container_memory_usage(shared_group_keys);
+  for (const auto &p : group_members) {
+    num_members += p.second.size();
+    bytes += p.second.capacity() * sizeof(OneShotMember);
+  }
+  // the key is stored twice
+  for (const auto &p : shared_groups) bytes += 2 * p.second.key.capacity();
+  usage->set_num_members(num_members);
+  usage->set_num_groups(group_members.size());
+  usage->set_bytes(bytes);
+}
+
 ActionProfMgr::ActionProfMgr(pi_dev_tgt_t device_tgt, pi_p4_id_t act_prof_id,
                              pi_p4info_t *p4info, PiApiChoice pi_api_choice,
                              WatchPortEnforcer *watch_port_enforcer)
@@ -1251,6 +1477,13 @@ ActionProfMgr::manual() {
   return static_cast<ActionProfAccessManual *>(pimp.get());
 }
 
+void
+ActionProfMgr::memory_usage_get(
+    p4serverv1::MemoryUsage::ActionProfileUsage *usage) const {
+  usage->set_action_profile_id(act_prof_id);
+  if (pimp != nullptr) pimp->memory_usage_get(usage);
+}
+
 /* static */
 StatusOr<ActionProfMgr::PiApiChoice>
 ActionProfMgr::choose_pi_api(pi_dev_id_t device_id) {
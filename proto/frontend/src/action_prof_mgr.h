@@ -34,11 +34,14 @@
 
 #include "google/rpc/code.pb.h"
 #include "google/rpc/status.pb.h"
+#include "p4/server/v1/config.pb.h"
 #include "p4/v1/p4runtime.pb.h"
 
 #include "bimap.h"
 #include "common.h"
+#include "dense_id_map.h"
 #include "report_error.h"
+#include "small_vector.h"
 #include "statusor.h"
 
 namespace pi {
@@ -65,17 +68,59 @@ class ActionProfBiMap {
 
   bool empty() const;
 
+  size_t size() const;
+
+  size_t memory_usage() const;
+
  private:
   BiMap<Id, pi_indirect_handle_t> bimap;
 };
 
+// Stores the action data of the members of an action profile. Instead of one
+// heap allocation (and one pi::ActionData object) per member, the data for all
+// members is kept in a single buffer; blocks freed when a member is deleted or
+// modified are reused for action data of the same size. The action data is
+// only needed to create member copies for weighted members, so reconstructing
+// a pi::ActionData object on demand is cheap enough.
+class ActionDataArena {
+ public:
+  // offset of the block in the buffer, in units of kAlignment bytes
+  using Ref = uint32_t;
+
+  explicit ActionDataArena(const pi_p4info_t *p4info);
+
+  Ref add(const pi::ActionData &action_data);
+
+  void remove(Ref ref);
+
+  pi::ActionData get(Ref ref) const;
+
+  // memory used by the buffer, including free blocks
+  size_t memory_usage() const;
+
+ private:
+  static constexpr size_t kAlignment = 8;
+
+  struct BlockHeader {
+    pi_p4_id_t action_id;
+    uint32_t data_size;
+  };
+
+  static size_t block_size(size_t data_size);
+
+  const pi_p4info_t *p4info;
+  std::vector<char> buffer{};
+  // indexed by block size
+  std::unordered_map<size_t, std::vector<Ref> > free_blocks{};
+};
+
 using ActionProfMemberId = ActionProfBiMap::Id;
 using ActionProfGroupId = ActionProfBiMap::Id;
 
 // Support for weighted members assume that the underlying PI implementation has
 // no native support for weights.
 // - for each member_id, we keep track of the maximum weight for that member
-//   (across all groups), this is done with the MemberState::weight_counts map.
+//   (across all groups), this is done with the MemberState::weight_counts list.
 // - if the maximum weight is W, maintain W copies of the member (created by
 //   calling pi_act_prof_mbr_create W times with the same parameters) with W
 //   different handles. Those handles are stored in the MemberState::handles
@@ -89,22 +134,45 @@ class ActionProfMemberMap {
  public:
   using Id = ActionProfBiMap::Id;
 
+  // A member is used with a weight greater than 1 very rarely, and the
+  // per-member state is kept as small as possible: in the common case, it
+  // requires no heap allocation beside the action data.
   struct MemberState {
-    // NOLINTNEXTLINE(whitespace/operators)
-    explicit MemberState(pi::ActionData &&action_data)
-        : action_data(std::move(action_data)) { }
-
-    pi::ActionData action_data;
-    std::vector<pi_indirect_handle_t> handles;
-    std::map<int, int> weight_counts;
+    struct WeightCount {
+      int weight;
+      int count;
+    };
+
+    // Increments / decrements the number of groups in which the member is used
+    // with the given weight.
+    void add_weight(int weight);
+    void remove_weight(int weight);
+
+    // Returns the maximum weight with which the member is still used, or -1 if
+    // the member is not used with any weight (including 1). Weights greater
+    // than the returned value are dropped from weight_counts.
+    int purge_weight_counts();
+
+    ActionDataArena::Ref action_data{0};
+    SmallVector<pi_indirect_handle_t, 1> handles{};
+    // sorted by weight
+    SmallVector<WeightCount, 1> weight_counts{};
   };
 
-  // NOLINTNEXTLINE(whitespace/operators)
-  bool add(const Id &id, pi_indirect_handle_t h, pi::ActionData &&action_data);
+  explicit ActionProfMemberMap(const pi_p4info_t *p4info);
 
-  // returns nullptr if no matching id
+  bool add(const Id &id, pi_indirect_handle_t h,
+           const pi::ActionData &action_data);
+
+  // returns nullptr if no matching id; the pointer is invalidated by the next
+  // call to add
   MemberState *access_member_state(const Id &id);
 
+  pi::ActionData get_action_data(const MemberState &member_state) const;
+
+  void set_action_data(MemberState *member_state,
+                       const pi::ActionData &action_data);
+
   // returns nullptr if no matching handle
   const Id *retrieve_id(pi_indirect_handle_t h) const;
 
@@ -118,9 +186,17 @@ class ActionProfMemberMap {
 
   bool empty() const;
 
+  size_t size() const;
+
+  // member state and handle maps only
+  size_t memory_usage() const;
+
+  size_t action_data_memory_usage() const;
+
  private:
-  std::unordered_map<Id, MemberState> members;
-  std::unordered_map<pi_indirect_handle_t, Id> handle_to_id;
+  DenseIdMap<Id, MemberState> members{};
+  DenseIdMap<pi_indirect_handle_t, Id> handle_to_id{};
+  ActionDataArena action_data_arena;
 };
 
 struct WatchPort {
@@ -162,9 +238,13 @@ class ActionProfGroupMembership {
                            const MembershipInfo &rhs);
   };
 
-  // Represents an update (insertion, deletion, change of weight) to group. A
-  // list of such updates is generated by compute_membership_update. If the
-  // member is unchanged (same weight), current_weight == new_weight.
+  // sorted by member id, with no duplicates; groups can have thousands of
+  // members, a flat vector is much cheaper to build and to diff than a map
+  using Membership = std::vector<std::pair<Id, MembershipInfo> >;
+
+  // Represents an update (insertion, deletion, change of weight) to group. The
+  // updates are generated by visit_membership_update. If the member is
+  // unchanged (same weight), current_weight == new_weight.
   struct MembershipUpdate {
     MembershipUpdate(Id id, int current_weight, int new_weight,
                      const WatchPort &current_watch,
@@ -172,6 +252,10 @@ class ActionProfGroupMembership {
         : id(id), current_weight(current_weight), new_weight(new_weight),
           current_watch(current_watch), new_watch(new_watch) { }
 
+    bool is_noop() const {
+      return current_weight == new_weight && current_watch == new_watch;
+    }
+
     Id id;
     int current_weight;
     int new_weight;
@@ -181,27 +265,69 @@ class ActionProfGroupMembership {
 
   explicit ActionProfGroupMembership(size_t max_size_user);
 
-  // desired membership must be sorted, with no duplicates (same member id)
-  std::vector<MembershipUpdate> compute_membership_update(
-      const std::map<Id, MembershipInfo> &desired_membership) const;
+  // Calls fn(const MembershipUpdate &) for each member of the union of the
+  // current and desired memberships, in member id order. The updates are
+  // computed on the fly by merging both memberships, which avoids allocating
+  // memory. Desired membership must be sorted, with no duplicates.
+  template <typename F>
+  void visit_membership_update(const Membership &desired_membership,
+                               F fn) const;
 
   size_t get_max_size_user() const;
 
-  void set_membership(std::map<Id, MembershipInfo> &&new_members);
-
-  const std::map<Id, MembershipInfo> &get_membership() const;
+  void set_membership(Membership &&new_members);
 
-  std::map<Id, MembershipInfo> &get_membership();
+  const Membership &get_membership() const;
 
   bool get_member_info(
       const Id &member_id, int *weight, WatchPort *watch) const;
 
  private:
-  std::map<Id, MembershipInfo> members{};
+  Membership members{};
 
   size_t max_size_user{0};
 };
 
+// For a new member, current_weight is 0 while new_weight is > 0. For an old
+// member that needs to be removed, new_weight is 0 while current_weight is > 0.
+// For an existing member whose weight we are changing new_weight and
+// current_weight are both > 0. If we are not changing the weight, new_weight ==
+// current_weight. We also pass the desired watch port for the member as
+// new_watch, which is set to an invalid watch port if the member needs to be
+// removed, along with the current watch port as current_watch.
+template <typename F>
+void
+ActionProfGroupMembership::visit_membership_update(
+    const Membership &desired_membership, F fn) const {
+  auto new_it = desired_membership.begin();
+  auto current_it = members.begin();
+  while (new_it != desired_membership.end() || current_it != members.end()) {
+    if (new_it == desired_membership.end() ||
+        (current_it != members.end() && current_it->first < new_it->first)) {
+      // member no longer exists
+      fn(MembershipUpdate(current_it->first,
+                          current_it->second.weight, 0,
+                          current_it->second.watch,
+                          WatchPort::invalid_watch()));
+      current_it++;
+    } else if (current_it == members.end() ||
+               current_it->first > new_it->first) {
+      // new member
+      fn(MembershipUpdate(new_it->first,
+                          0, new_it->second.weight,
+                          WatchPort::invalid_watch(),
+                          new_it->second.watch));
+      new_it++;
+    } else {
+      fn(MembershipUpdate(current_it->first,
+                          current_it->second.weight, new_it->second.weight,
+                          current_it->second.watch, new_it->second.watch));
+      current_it++;
+      new_it++;
+    }
+  }
+}
+
 class WatchPortEnforcer;
 
 class ActionProfAccessBase {
@@ -233,6 +359,10 @@ class ActionProfAccessBase {
 
   virtual bool empty() const = 0;
 
+  // Does not set the action profile id.
+  virtual void memory_usage_get(
+      p4::server::v1::MemoryUsage::ActionProfileUsage *usage) const = 0;
+
  protected:
   bool check_p4_action_id(pi_p4_id_t p4_id) const;
 
@@ -271,6 +401,10 @@ class ActionProfAccessManual : public ActionProfAccessBase {
   Status member_delete(const p4::v1::ActionProfileMember &member,
                        const SessionTemp &session);
 
+  // Performs the checks done by member_create and member_modify which do not
+  // depend on the existing members.
+  Status member_validate(const p4::v1::ActionProfileMember &member);
+
   Status group_delete(const p4::v1::ActionProfileGroup &group,
                       const SessionTemp &session);
 
@@ -294,6 +428,9 @@ class ActionProfAccessManual : public ActionProfAccessBase {
   bool retrieve_member_id(pi_indirect_handle_t member_h, Id *member_id) const;
   bool retrieve_group_id(pi_indirect_handle_t group_h, Id *group_id) const;
 
+  void memory_usage_get(
+      p4::server::v1::MemoryUsage::ActionProfileUsage *usage) const override;
+
  private:
   bool empty() const override;
 
@@ -316,7 +453,7 @@ class ActionProfAccessManual : public ActionProfAccessBase {
       pi::ActProf &ap,  // NOLINT(runtime/references)
       ActionProfMemberMap::MemberState *member_state);
 
-  ActionProfMemberMap member_map;
+  ActionProfMemberMap member_map{p4info};
   ActionProfBiMap group_bimap{};
   std::map<Id, ActionProfGroupMembership> group_members{};
 };
@@ -326,8 +463,14 @@ class ActionProfAccessOneshot : public ActionProfAccessBase {
   // inheriting base constructor to reduce boilerplate code
   using ActionProfAccessBase::ActionProfAccessBase;
 
+  // If share is true, the group is shared with the existing one-shot groups
+  // created with the same actions, weights and watch ports (if any) and the
+  // handle of the existing group is returned. Shared groups are reference
+  // counted: group_delete only deletes the group and its members from the
+  // target when the last reference is released.
   Status group_create(const p4::v1::ActionProfileActionSet &action_set,
-                      pi_indirect_handle_t *group_h, SessionTemp *session);
+                      bool share, pi_indirect_handle_t *group_h,
+                      SessionTemp *session);
   Status group_delete(pi_indirect_handle_t group_h, const SessionTemp &session);
 
   struct OneShotMember {
@@ -345,6 +488,9 @@ class ActionProfAccessOneshot : public ActionProfAccessBase {
   bool group_get_members(pi_indirect_handle_t group_h,
                          std::vector<OneShotMember> *members) const;
 
+  void memory_usage_get(
+      p4::server::v1::MemoryUsage::ActionProfileUsage *usage) const override;
+
  private:
   // nested classes so they have access to private data members and can create a
   // pi::ActProf instance.
@@ -361,8 +507,17 @@ class ActionProfAccessOneshot : public ActionProfAccessBase {
 
   bool empty() const override;
 
+  struct SharedGroup {
+    // canonical representation of the ActionProfileActionSet
+    std::string key;
+    size_t ref_count;
+  };
+
   std::unordered_map<pi_indirect_handle_t, std::vector<OneShotMember> >
   group_members{};
+  // only includes the groups created with share set to true
+  std::unordered_map<pi_indirect_handle_t, SharedGroup> shared_groups{};
+  std::unordered_map<std::string, pi_indirect_handle_t> shared_group_keys{};
 };
 
 class ActionProfMgr {
@@ -386,6 +541,9 @@ class ActionProfMgr {
   // membership) for the target.
   static StatusOr<PiApiChoice> choose_pi_api(pi_dev_id_t device_id);
 
+  void memory_usage_get(
+      p4::server::v1::MemoryUsage::ActionProfileUsage *usage) const;
+
  private:
   template <typename T>
   Status check_selector_usage();
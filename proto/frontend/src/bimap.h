@@ -21,7 +21,7 @@
 #ifndef SRC_BIMAP_H_
 #define SRC_BIMAP_H_
 
-#include <unordered_map>
+#include "dense_id_map.h"
 
 namespace pi {
 
@@ -29,23 +29,22 @@ namespace fe {
 
 namespace proto {
 
+// Both types must be unsigned integers (ids or handles), see DenseIdMap.
 template <typename T1, typename T2>
 class BiMap {
  public:
   void add_mapping_1_2(const T1 &t1, const T2 &t2) {
-    map_1_2.emplace(t1, t2);
-    map_2_1.emplace(t2, t1);
+    map_1_2.insert(t1, t2);
+    map_2_1.insert(t2, t1);
   }
 
   // returns nullptr if no matching entry
   const T2 *get_from_1(const T1 &t1) const {
-    auto it = map_1_2.find(t1);
-    return (it == map_1_2.end()) ? nullptr : &it->second;
+    return map_1_2.find(t1);
   }
 
   const T1 *get_from_2(const T2 &t2) const {
-    auto it = map_2_1.find(t2);
-    return (it == map_2_1.end()) ? nullptr : &it->second;
+    return map_2_1.find(t2);
   }
 
   void remove_from_1(const T1 &t1) {
@@ -58,9 +57,15 @@ class BiMap {
 
   bool empty() const { return map_1_2.empty(); }
 
+  size_t size() const { return map_1_2.size(); }
+
+  size_t memory_usage() const {
+    return map_1_2.memory_usage() + map_2_1.memory_usage();
+  }
+
  private:
-  std::unordered_map<T1, T2> map_1_2{};
-  std::unordered_map<T2, T1> map_2_1{};
+  DenseIdMap<T1, T2> map_1_2{};
+  DenseIdMap<T2, T1> map_2_1{};
 };
 
 }  // namespace proto
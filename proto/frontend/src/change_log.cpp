@@ -0,0 +1,146 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "change_log.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+void
+ChangeLog::set_config(const p4::server::v1::ChangeLogConfig &config) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (config.max_changes_per_table() == max_changes_per_table) return;
+  max_changes_per_table = config.max_changes_per_table();
+  clear();
+}
+
+bool
+ChangeLog::enabled() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return max_changes_per_table > 0;
+}
+
+void
+ChangeLog::record(UpdateType type, const p4::v1::TableEntry &table_entry) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (max_changes_per_table == 0) return;
+  auto &log = tables.emplace(
+      table_entry.table_id(), max_changes_per_table).first->second;
+  size_t idx;
+  if (log.size < log.ring.size()) {
+    idx = (log.start + log.size++) % log.ring.size();
+  } else {
+    idx = log.start;
+    log.start = (log.start + 1) % log.ring.size();
+    log.dropped_generation = log.ring[idx].generation;
+  }
+  auto &change = log.ring[idx];
+  change.generation = ++current_generation;
+  change.type = type;
+  auto &key = change.key;
+  key.Clear();
+  key.set_table_id(table_entry.table_id());
+  key.mutable_match()->CopyFrom(table_entry.match());
+  key.set_priority(table_entry.priority());
+  key.set_is_default_action(table_entry.is_default_action());
+}
+
+void
+ChangeLog::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  clear();
+}
+
+void
+ChangeLog::clear() {
+  // the generation is bumped so that a client synchronized right before the
+  // reset is also told to do a full read
+  reset_generation = ++current_generation;
+  tables.clear();
+}
+
+uint64_t
+ChangeLog::generation() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return current_generation;
+}
+
+void
+ChangeLog::table_changes_since(uint64_t since, const TableLog &log,
+                               std::vector<EntryChange> *changes) const {
+  // index in changes, by canonical key (the same entry may have been written
+  // with different encodings of the match)
+  std::unordered_map<std::string, size_t> entries;
+  // newest to oldest, so that the first change seen for an entry is its last
+  // one
+  for (size_t i = log.size; i-- > 0;) {
+    const auto &change = log.ring[(log.start + i) % log.ring.size()];
+    if (change.generation <= since) break;
+    auto inserted = (change.type == p4::v1::Update::INSERT);
+    auto p = entries.emplace(
+        common::table_entry_key(change.key), changes->size());
+    if (p.second) {
+      changes->push_back(
+          {change.generation, change.type, inserted, &change.key});
+    } else {
+      (*changes)[p.first->second].inserted = inserted;
+    }
+  }
+}
+
+bool
+ChangeLog::changes_since(uint64_t since, const std::vector<p4_id_t> &table_ids,
+                         std::vector<EntryChange> *changes) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (since < reset_generation) return false;
+  auto check_and_collect = [this, since, changes](const TableLog &log) {
+    if (since < log.dropped_generation) return false;
+    table_changes_since(since, log, changes);
+    return true;
+  };
+  if (table_ids.empty()) {
+    for (const auto &p : tables)
+      if (!check_and_collect(p.second)) return false;
+  } else {
+    for (auto table_id : table_ids) {
+      auto it = tables.find(table_id);
+      if (it != tables.end() && !check_and_collect(it->second)) return false;
+    }
+  }
+  std::sort(changes->begin(), changes->end(),
+            [](const EntryChange &c1, const EntryChange &c2) {
+              return c1.generation < c2.generation; });
+  return true;
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
@@ -0,0 +1,120 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_CHANGE_LOG_H_
+#define SRC_CHANGE_LOG_H_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "p4/server/v1/config.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+#include "common.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Bounded log of the changes to table entries, see
+// p4::server::v1::ChangeLogConfig. Each table has its own ring buffer, so that
+// a busy table does not push the changes to other tables out of the log. All
+// changes share a single, device-wide generation counter.
+class ChangeLog {
+ public:
+  using p4_id_t = common::p4_id_t;
+  using UpdateType = p4::v1::Update::Type;
+
+  struct Change {
+    uint64_t generation;
+    UpdateType type;
+    // only the key fields (table_id, match, priority, is_default_action) are
+    // set
+    p4::v1::TableEntry key;
+  };
+
+  // Last change to a table entry since a given generation.
+  struct EntryChange {
+    uint64_t generation;
+    UpdateType last_type;
+    // true if the entry was inserted by the first change since the generation
+    bool inserted;
+    const p4::v1::TableEntry *key;
+  };
+
+  // Clears the log if the size changes.
+  void set_config(const p4::server::v1::ChangeLogConfig &config);
+
+  bool enabled() const;
+
+  // To be called after a table entry has been successfully written to, by a
+  // writer with exclusive access to the table.
+  void record(UpdateType type, const p4::v1::TableEntry &table_entry);
+
+  // Clears the log, e.g. when the P4 program changes. Clients need to do a full
+  // read after this.
+  void reset();
+
+  uint64_t generation() const;
+
+  // Returns false if some of the changes to the tables since generation \p
+  // since are no longer in the log. table_ids can be empty for all tables. The
+  // changes are ordered by generation and the keys remain valid until the next
+  // call to record or reset, so the caller needs exclusive access to the
+  // tables.
+  bool changes_since(uint64_t since, const std::vector<p4_id_t> &table_ids,
+                     std::vector<EntryChange> *changes) const;
+
+ private:
+  struct TableLog {
+    explicit TableLog(size_t capacity) : ring(capacity) { }
+
+    std::vector<Change> ring;
+    size_t start{0};
+    size_t size{0};
+    // generation of the last change pushed out of the ring buffer
+    uint64_t dropped_generation{0};
+  };
+
+  // acquire mutex first
+  void clear();
+  void table_changes_since(uint64_t since, const TableLog &log,
+                           std::vector<EntryChange> *changes) const;
+
+  mutable std::mutex mutex{};
+  uint32_t max_changes_per_table{0};
+  uint64_t current_generation{0};
+  // clients need to do a full read if they were synchronized before this
+  uint64_t reset_generation{0};
+  std::unordered_map<p4_id_t, TableLog> tables{};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_CHANGE_LOG_H_
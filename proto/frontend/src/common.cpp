@@ -21,7 +21,10 @@
 
 #include "common.h"
 
+#include <algorithm>
+#include <cstring>  // for std::memcpy, std::memset
 #include <string>
+#include <vector>
 
 #include "report_error.h"
 #include "statusor.h"
@@ -56,34 +59,49 @@ uint8_t ctz(uint8_t b) {
       (4 + ctz_table[half_byte_hi]) : ctz_table[half_byte_lo];
 }
 
+constexpr size_t kWordSize = sizeof(uint64_t);
+
+uint64_t load_word(const char *data) {
+  uint64_t w;
+  std::memcpy(&w, data, sizeof(w));
+  return w;
+}
+
 }  // namespace
 
 StatusOr<std::string> bytestring_p4rt_to_pi(const std::string &str,
                                             size_t nbits) {
+  std::string pi_str((nbits + 7) / 8, 0);
+  auto status = bytestring_p4rt_to_pi(str, nbits, &pi_str[0]);
+  if (IS_ERROR(status)) return status;
+  return pi_str;
+}
+
+Status bytestring_p4rt_to_pi(const std::string &str, size_t nbits, char *dst) {
   size_t nbytes = (nbits + 7) / 8;
-  if (str.size() < nbytes) {
-    auto pi_str = str;
-    pi_str.insert(0, nbytes - str.size(), 0);
-    return pi_str;
-  }
-  size_t leading_zeros = 0;
-  size_t i = 0;
-  for (; i < str.size(); i++) {
-    if (str[i] != 0) break;
-    leading_zeros += 8;
+  size_t n = str.size();
+  if (n < nbytes) {
+    std::memset(dst, 0, nbytes - n);
+    std::memcpy(dst + nbytes - n, str.data(), n);
+    RETURN_OK_STATUS();
   }
-  if (i == str.size()) {
-    return std::string(nbytes, 0);
+  // the extra leading bytes must be 0, as well as the extra bits of the first
+  // byte which is copied
+  size_t extra = n - nbytes;
+  bool fits = bytes_all_equal(str.data(), extra, 0);
+  if (fits && nbytes > 0) {
+    size_t zero_nbits = (nbytes * 8) - nbits;
+    fits = (static_cast<size_t>(clz(static_cast<uint8_t>(str[extra]))) >=
+            zero_nbits);
   }
-  leading_zeros += static_cast<size_t>(clz(static_cast<uint8_t>(str[i])));
-  auto nbits_set = static_cast<size_t>(str.size() * 8 - leading_zeros);
-  if (nbits_set > nbits) {
+  if (!fits) {
     RETURN_ERROR_STATUS(
         Code::INVALID_ARGUMENT,
         "Bytestring provided does not fit within {} bits",
         nbits);
   }
-  return str.substr(str.size() - nbytes);
+  std::memcpy(dst, str.data() + extra, nbytes);
+  RETURN_OK_STATUS();
 }
 
 std::string bytestring_pi_to_p4rt(const std::string &str) {
@@ -91,12 +109,79 @@ std::string bytestring_pi_to_p4rt(const std::string &str) {
 }
 
 std::string bytestring_pi_to_p4rt(const char *str, size_t n) {
+  std::string out;
+  bytestring_pi_to_p4rt(str, n, &out);
+  return out;
+}
+
+void bytestring_pi_to_p4rt(const char *str, size_t n, std::string *out) {
   size_t i = 0;
   for (; i < n; i++) {
     if (str[i] != 0) break;
   }
-  if (i == n) return std::string(1, 0);
-  return std::string(str + i, n - i);
+  if (i == n)
+    out->assign(1, 0);
+  else
+    out->assign(str + i, n - i);
+}
+
+namespace {
+
+void append_u32(std::string *s, uint32_t v) {
+  s->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// Empty bytestrings are invalid and are kept as is, so that they do not
+// compare equal to a valid zero value.
+void append_bytestring(std::string *s, const std::string &str) {
+  size_t i = 0;
+  while (i + 1 < str.size() && str[i] == 0) i++;
+  append_u32(s, static_cast<uint32_t>(str.size() - i));
+  s->append(str, i, std::string::npos);
+}
+
+}  // namespace
+
+std::string table_entry_key(const p4::v1::TableEntry &table_entry) {
+  using p4::v1::FieldMatch;
+  std::string key;
+  append_u32(&key, table_entry.table_id());
+  append_u32(&key, static_cast<uint32_t>(table_entry.priority()));
+  key.push_back(table_entry.is_default_action() ? 1 : 0);
+  std::vector<const FieldMatch *> fields;
+  fields.reserve(table_entry.match_size());
+  for (const auto &mf : table_entry.match()) fields.push_back(&mf);
+  std::stable_sort(fields.begin(), fields.end(),
+                   [](const FieldMatch *mf1, const FieldMatch *mf2) {
+                     return mf1->field_id() < mf2->field_id(); });
+  for (const auto *mf : fields) {
+    append_u32(&key, mf->field_id());
+    append_u32(&key, static_cast<uint32_t>(mf->field_match_type_case()));
+    switch (mf->field_match_type_case()) {
+      case FieldMatch::kExact:
+        append_bytestring(&key, mf->exact().value());
+        break;
+      case FieldMatch::kTernary:
+        append_bytestring(&key, mf->ternary().value());
+        append_bytestring(&key, mf->ternary().mask());
+        break;
+      case FieldMatch::kLpm:
+        append_bytestring(&key, mf->lpm().value());
+        append_u32(&key, static_cast<uint32_t>(mf->lpm().prefix_len()));
+        break;
+      case FieldMatch::kRange:
+        append_bytestring(&key, mf->range().low());
+        append_bytestring(&key, mf->range().high());
+        break;
+      case FieldMatch::kOptional:
+        append_bytestring(&key, mf->optional().value());
+        break;
+      default:
+        append_bytestring(&key, mf->SerializeAsString());
+        break;
+    }
+  }
+  return key;
 }
 
 Code check_proto_bytestring(const std::string &str, size_t nbits) {
@@ -109,17 +194,41 @@ Code check_proto_bytestring(const std::string &str, size_t nbits) {
 }
 
 bool check_prefix_trailing_zeros(const std::string &str, int pLen) {
-  size_t bitwidth = str.size() * 8;
+  return check_prefix_trailing_zeros(str.data(), str.size(), pLen);
+}
+
+bool check_prefix_trailing_zeros(const char *data, size_t n, int pLen) {
+  size_t bitwidth = n * 8;
   // must be guaranteed by caller
   assert(pLen >= 0 && static_cast<size_t>(pLen) <= bitwidth);
   size_t trailing_zeros = bitwidth - pLen;
-  size_t pos = str.size() - 1;
-  for (; trailing_zeros >= 8; trailing_zeros -= 8) {
-    if (str[pos] != 0) return false;
-    pos--;
-  }
+  size_t zero_nbytes = trailing_zeros / 8;
+  if (!bytes_all_equal(data + n - zero_nbytes, zero_nbytes, 0)) return false;
+  trailing_zeros -= zero_nbytes * 8;
   return (trailing_zeros == 0) ||
-      (ctz(static_cast<uint8_t>(str[pos])) >= trailing_zeros);
+      (ctz(static_cast<uint8_t>(data[n - zero_nbytes - 1])) >= trailing_zeros);
+}
+
+bool bytes_all_equal(const char *data, size_t n, char c) {
+  size_t i = 0;
+  if (n >= kWordSize) {
+    auto pattern = static_cast<uint64_t>(static_cast<uint8_t>(c)) *
+        0x0101010101010101ULL;
+    for (; i + kWordSize <= n; i += kWordSize)
+      if (load_word(data + i) != pattern) return false;
+  }
+  for (; i < n; i++)
+    if (data[i] != c) return false;
+  return true;
+}
+
+bool bytes_within_mask(const char *value, const char *mask, size_t n) {
+  size_t i = 0;
+  for (; i + kWordSize <= n; i += kWordSize)
+    if ((load_word(value + i) & ~load_word(mask + i)) != 0) return false;
+  for (; i < n; i++)
+    if ((value[i] & ~mask[i]) != 0) return false;
+  return true;
 }
 
 std::string range_default_lo(size_t nbits) {
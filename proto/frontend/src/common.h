@@ -31,6 +31,7 @@
 
 #include "google/rpc/code.pb.h"
 #include "google/rpc/status.pb.h"
+#include "p4/v1/p4runtime.pb.h"
 
 #include "report_error.h"
 #include "statusor.h"
@@ -145,15 +146,36 @@ class SessionTemp final
 // first.
 StatusOr<std::string> bytestring_p4rt_to_pi(const std::string &str,
                                             size_t nbits);
+// Same as above, but the bytestring is validated and written to dst ((nbits +
+// 7) / 8 bytes, e.g. the field's location in a PI match key or action data
+// buffer) in a single pass, without temporaries. The contents of dst are
+// unspecified in case of error.
+Status bytestring_p4rt_to_pi(const std::string &str, size_t nbits, char *dst);
 
 // bytestring_pi_to_p4rt converts the PI bytestring to a canonical P4Runtime
 // bytestring.
 std::string bytestring_pi_to_p4rt(const std::string &str);
 std::string bytestring_pi_to_p4rt(const char *, size_t n);
+// Same as above, but assigns to an existing string (e.g. the one returned by
+// mutable_value() for a Protobuf message), which avoids any temporary.
+void bytestring_pi_to_p4rt(const char *str, size_t n, std::string *out);
 
 Code check_proto_bytestring(const std::string &str, size_t nbits);
 
+// Returns a string identifying a table entry (table id, match fields, priority
+// and default entry flag), independently of how the client encoded the match:
+// match fields are ordered by id and bytestrings are stripped of their leading
+// zeros. Used as a map key, does not validate the entry.
+std::string table_entry_key(const p4::v1::TableEntry &table_entry);
+
 bool check_prefix_trailing_zeros(const std::string &str, int pLen);
+bool check_prefix_trailing_zeros(const char *data, size_t n, int pLen);
+
+// The following operate in place on PI bytestrings of n bytes. Wide values
+// (e.g. IPv6 addresses) are processed 8 bytes at a time.
+bool bytes_all_equal(const char *data, size_t n, char c);
+// returns true iff (value & mask) == value
+bool bytes_within_mask(const char *value, const char *mask, size_t n);
 
 std::string range_default_lo(size_t nbits);
 std::string range_default_hi(size_t nbits);
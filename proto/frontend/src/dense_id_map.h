@@ -0,0 +1,141 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_DENSE_ID_MAP_H_
+#define SRC_DENSE_ID_MAP_H_
+
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>  // std::move
+#include <vector>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Map with an unsigned integer key, such as a P4Runtime id or a PI handle.
+// These are often allocated densely starting from 0 or 1, by the controller or
+// by the target. Keys which are small compared to the number of elements in the
+// map are stored in a vector of slots indexed by the key, which only costs
+// sizeof(V) + 1 bytes per element (instead of a hash table node per element)
+// and for which a lookup is a single array access. Other keys are stored in an
+// unordered_map. The vector of slots is at most about 4 times the largest
+// number of elements the map has held, and is never shrunk.
+// Inserting a new key may invalidate pointers to the values.
+template <typename K, typename V>
+class DenseIdMap {
+  static_assert(std::is_unsigned<K>::value,
+                "DenseIdMap requires an unsigned integer key");
+
+ public:
+  // returns false if the key is already present
+  bool insert(K key, V value) {
+    if (find(key) != nullptr) return false;
+    if (use_slot(key)) {
+      if (key >= slots.size())
+        slots.resize(std::max(static_cast<size_t>(key) + 1, 2 * slots.size()));
+      auto &slot = slots[key];
+      slot.used = true;
+      slot.value = std::move(value);
+      num_slots_used++;
+    } else {
+      sparse.emplace(key, std::move(value));
+    }
+    return true;
+  }
+
+  // returns nullptr if no matching key
+  V *find(K key) {
+    if (key < slots.size() && slots[key].used) return &slots[key].value;
+    if (sparse.empty()) return nullptr;
+    auto it = sparse.find(key);
+    return (it == sparse.end()) ? nullptr : &it->second;
+  }
+
+  const V *find(K key) const {
+    return const_cast<DenseIdMap *>(this)->find(key);
+  }
+
+  // returns false if no matching key
+  bool erase(K key) {
+    if (key < slots.size() && slots[key].used) {
+      auto &slot = slots[key];
+      slot.used = false;
+      slot.value = V();  // release the resources held by the value
+      num_slots_used--;
+      return true;
+    }
+    return sparse.erase(key) > 0;
+  }
+
+  size_t size() const { return num_slots_used + sparse.size(); }
+
+  bool empty() const { return size() == 0; }
+
+  // Calls fn(K, const V &) for each element, in no particular order.
+  template <typename F>
+  void for_each(F fn) const {
+    for (size_t i = 0; i < slots.size(); i++)
+      if (slots[i].used) fn(static_cast<K>(i), slots[i].value);
+    for (const auto &p : sparse) fn(p.first, p.second);
+  }
+
+  // Approximate memory used by the map, in bytes, not including sizeof(*this)
+  // and the memory allocated by the values themselves.
+  size_t memory_usage() const {
+    // the node size is implementation-dependent, we assume a single "next"
+    // pointer and a cached hash value (libstdc++)
+    constexpr size_t node_size = sizeof(typename decltype(sparse)::value_type) +
+        2 * sizeof(void *);
+    return slots.capacity() * sizeof(Slot) +
+        sparse.size() * node_size +
+        sparse.bucket_count() * sizeof(void *);
+  }
+
+ private:
+  static constexpr size_t kMinSlots = 1024;
+
+  struct Slot {
+    bool used{false};
+    V value{};
+  };
+
+  bool use_slot(K key) const {
+    return key < std::max(kMinSlots, std::max(slots.size(), 2 * (size() + 1)));
+  }
+
+  std::vector<Slot> slots{};
+  size_t num_slots_used{0};
+  std::unordered_map<K, V> sparse{};
+};
+
+template <typename K, typename V>
+constexpr size_t DenseIdMap<K, V>::kMinSlots;
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_DENSE_ID_MAP_H_
@@ -21,10 +21,21 @@
 
 #include <PI/frontends/cpp/tables.h>
 #include <PI/frontends/proto/device_mgr.h>
+#include <PI/frontends/proto/replication.h>
+#include <PI/frontends/proto/thread_placement.h>
+#include <PI/int/pi_int.h>
 #include <PI/pi.h>
 #include <PI/proto/util.h>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstring>  // for std::memcpy, std::memset
+#include <functional>  // for std::hash
+#include <future>
 #include <limits>
 #include <map>
 #include <memory>
@@ -40,6 +51,7 @@
 #include "access_arbitration.h"
 #include "action_helpers.h"
 #include "action_prof_mgr.h"
+#include "change_log.h"
 #include "common.h"
 #include "digest_mgr.h"
 #include "idle_timeout_buffer.h"
@@ -47,10 +59,14 @@
 #include "packet_io_mgr.h"
 #include "pre_clone_mgr.h"
 #include "pre_mc_mgr.h"
+#include "read_cache.h"
+#include "read_converter.h"
 #include "report_error.h"
+#include "scheduler.h"
 #include "status_macros.h"
 #include "statusor.h"
 #include "table_info_store.h"
+#include "update_coalescer.h"
 #include "watch_port_enforcer.h"
 
 #include "p4/tmp/p4config.pb.h"
@@ -75,6 +91,7 @@ using common::SessionTemp;
 using common::bytestring_p4rt_to_pi;
 using common::bytestring_pi_to_p4rt;
 using common::make_invalid_p4_id_status;
+using SchedulingConfig = p4::server::v1::SchedulingConfig;
 using action_profile_set_map =
   std::unordered_map<pi_indirect_handle_t, p4v1::ActionProfileActionSet>;
 
@@ -241,6 +258,79 @@ struct ConfigFile {
   size_t size{0};
 };
 
+// Identifies the forwarding pipeline config currently applied to the device
+// (P4Info + target-specific device config). Controllers typically re-push the
+// same config every time they (re)connect, and the fingerprint lets us detect
+// this case without going through p4info_proto_reader and a full rebuild of the
+// frontend state.
+class ConfigFingerprint {
+ public:
+  ConfigFingerprint() { }
+
+  explicit ConfigFingerprint(const p4v1::ForwardingPipelineConfig &config)
+      : valid(true),
+        p4info_hash(hash_message(config.p4info(), &p4info_size)),
+        device_config_hash(std::hash<std::string>()(
+            config.p4_device_config())),
+        device_config_size(config.p4_device_config().size()) { }
+
+  bool same_p4info(const ConfigFingerprint &other) const {
+    return valid && other.valid &&
+        p4info_size == other.p4info_size && p4info_hash == other.p4info_hash;
+  }
+
+  bool same_device_config(const ConfigFingerprint &other) const {
+    return valid && other.valid &&
+        device_config_size == other.device_config_size &&
+        device_config_hash == other.device_config_hash;
+  }
+
+ private:
+  // P4Info includes map fields (in P4TypeInfo), which is why we need to request
+  // deterministic serialization.
+  static size_t hash_message(const google::protobuf::Message &msg,
+                             size_t *size) {
+    std::string buffer;
+    {
+      google::protobuf::io::StringOutputStream raw_output(&buffer);
+      google::protobuf::io::CodedOutputStream output(&raw_output);
+      output.SetSerializationDeterministic(true);
+      msg.SerializeToCodedStream(&output);
+    }
+    *size = buffer.size();
+    return std::hash<std::string>()(buffer);
+  }
+
+  bool valid{false};
+  size_t p4info_size{0};
+  size_t p4info_hash{0};
+  size_t device_config_hash{0};
+  size_t device_config_size{0};
+};
+
+// Runs the initialization function of one frontend component when the P4
+// pipeline changes and logs how long it took.
+template <typename F>
+Status timed_p4_change(const char *component, const F &init_fn) {
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  auto status = init_fn();
+  auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start).count();
+  Logger::get()->info("p4_change: {} initialized in {}us",
+                      component, elapsed_us);
+  return status;
+}
+
+// Same as timed_p4_change, but the initialization is performed in a separate
+// thread.
+template <typename F>
+std::future<Status> timed_p4_change_async(const char *component, F init_fn) {
+  return std::async(std::launch::async, [component, init_fn]() {
+    return timed_p4_change(component, init_fn);
+  });
+}
+
 // RAII wrapper around pi_table_fetch_res_t to enable proper cleanup in case of
 // failure.
 struct PIEntries {
@@ -251,10 +341,10 @@ struct PIEntries {
     if (_init) pi_table_entries_fetch_done(session.get(), res);
   }
 
-  Status fetch(pi_dev_tgt_t device_tgt, pi_p4_id_t table_id) {
+  Status fetch_next(pi_table_fetch_cursor_t *cursor, size_t max_entries) {
     assert(!_init);
-    auto pi_status = pi_table_entries_fetch(
-        session.get(), device_tgt, table_id, &res);
+    auto pi_status = pi_table_entries_fetch_next(
+        session.get(), cursor, max_entries, &res);
     if (pi_status != PI_STATUS_SUCCESS) {
       RETURN_ERROR_STATUS(
           Code::UNKNOWN, "Error when reading table entries from target");
@@ -289,6 +379,47 @@ struct PIEntries {
   pi_table_fetch_res_t *res{nullptr};
 };
 
+// RAII wrapper around pi_table_fetch_cursor_t, used to read all the entries of
+// a table in chunks of bounded size instead of retrieving the whole table at
+// once.
+struct PIEntriesCursor {
+  static constexpr size_t kChunkSize = 1024;
+
+  explicit PIEntriesCursor(const SessionTemp &session)
+      : session(session) { }
+
+  ~PIEntriesCursor() {
+    if (cursor) pi_table_entries_fetch_end(session.get(), cursor);
+  }
+
+  Status begin(pi_dev_tgt_t device_tgt, pi_p4_id_t table_id) {
+    assert(!cursor);
+    auto pi_status = pi_table_entries_fetch_begin(
+        session.get(), device_tgt, table_id, &cursor);
+    if (pi_status != PI_STATUS_SUCCESS) {
+      RETURN_ERROR_STATUS(
+          Code::UNKNOWN, "Error when reading table entries from target");
+    }
+    RETURN_OK_STATUS();
+  }
+
+  // Calls fn(pi_table_fetch_res_t *) for each chunk, until all entries have
+  // been read or fn returns an error. The chunk is released after fn returns.
+  template <typename F>
+  Status for_each_chunk(F fn) {
+    while (true) {
+      PIEntries entries(session);
+      RETURN_IF_ERROR(entries.fetch_next(cursor, kChunkSize));
+      if (pi_table_entries_num(entries) == 0) break;
+      RETURN_IF_ERROR(fn(entries));
+    }
+    RETURN_OK_STATUS();
+  }
+
+  const SessionTemp &session;
+  pi_table_fetch_cursor_t *cursor{nullptr};
+};
+
 // RAII wrapper around pi_act_prof_fetch_res_tt to enable proper cleanup in case
 // of failure.
 struct PIActProfEntries {
@@ -363,8 +494,12 @@ class DeviceMgrImp {
         server_config(default_server_config),
         packet_io(device_id, &server_config),
         digest_mgr(device_id),
-        idle_timeout_buffer(device_id),
-        watch_port_enforcer(device_tgt, &access_arbitration) { }
+        idle_timeout_buffer(device_id, &table_info_store),
+        watch_port_enforcer(device_tgt, &access_arbitration, &scheduler) {
+    scheduler.set_config(default_server_config.scheduling());
+    read_cache.set_config(default_server_config.read_cache());
+    change_log.set_config(default_server_config.change_log());
+  }
 
   ~DeviceMgrImp() {
     pi_remove_device(device_id);
@@ -375,16 +510,81 @@ class DeviceMgrImp {
   DeviceMgrImp(DeviceMgrImp &&) = delete;
   DeviceMgrImp &operator=(DeviceMgrImp &&) = delete;
 
+  // If p4info_new is the current p4info, only the target-specific device config
+  // has changed: the state derived exclusively from the P4Info is preserved and
+  // only the state which depends on the dataplane contents is reset.
   Status p4_change(const p4v1::ForwardingPipelineConfig &config_proto_new,
                    pi_p4info_t *p4info_new) {
     const auto &p4info_proto_new = config_proto_new.p4info();
+    bool p4info_changed = (p4info_new != p4info.get());
+
+    // The frontend components are independent from each other, so we
+    // initialize them concurrently. Each one of IdleTimeoutBuffer,
+    // WatchPortEnforcer and DigestMgr needs to synchronize with its own task
+    // queue thread, and DigestMgr also needs to build the type spec converters
+    // for all digests. This work overlaps with the table initialization below,
+    // which requires a round-trip to the target for each table. The exception
+    // is IdleTimeoutBuffer, which reads from the TableInfoStore when processing
+    // pending notifications, and therefore must be done before the store is
+    // reset.
 
     // the p4_change call will block until all pending notifications have been
     // processed; at this stage we assume no more notifications are received
     // from the target (since the pi_update_device_start call has returned)
     // until the pi_update_device_end call is made.
-    idle_timeout_buffer.p4_change(p4info_new);
+    auto idle_timeout_buffer_init = timed_p4_change_async(
+        "IdleTimeoutBuffer", [this, p4info_new]() {
+          return idle_timeout_buffer.p4_change(p4info_new);
+        });
+    auto watch_port_enforcer_init = timed_p4_change_async(
+        "WatchPortEnforcer", [this, p4info_new]() {
+          return watch_port_enforcer.p4_change(p4info_new);
+        });
+    auto digest_mgr_init = timed_p4_change_async(
+        "DigestMgr", [this, &p4info_proto_new]() {
+          return digest_mgr.p4_change(p4info_proto_new);
+        });
+    if (p4info_changed) {
+      timed_p4_change("PacketIOMgr", [this, &p4info_proto_new]() {
+        packet_io.p4_change(p4info_proto_new);
+        RETURN_OK_STATUS();
+      });
+    }
+
+    // Note that if we return early because of an error, the destructors of the
+    // futures above will wait for the asynchronous initialization to complete.
+    RETURN_IF_ERROR(idle_timeout_buffer_init.get());
+    RETURN_IF_ERROR(timed_p4_change("TableInfoStore", [this, p4info_new]() {
+      return init_tables(p4info_new);
+    }));
+
+    RETURN_IF_ERROR(timed_p4_change("ActionProfMgr", [this, p4info_new]() {
+      return init_action_profs(p4info_new);
+    }));
+
+    RETURN_IF_ERROR(watch_port_enforcer_init.get());
+    RETURN_IF_ERROR(digest_mgr_init.get());
+
+    auto *pre_mc_mgr_ = new PreMcMgr(device_id);
+    pre_clone_mgr.reset(new PreCloneMgr(device_tgt, pre_mc_mgr_));
+    pre_mc_mgr.reset(pre_mc_mgr_);
 
+    // we do this last, so that the ActProfMgr instances never point to an
+    // invalid p4info, even though this is not strictly required here
+    if (p4info_changed) {
+      p4info.reset(p4info_new);
+      p4info_proto.CopyFrom(p4info_proto_new);
+      read_converter.p4_change(p4info_new);
+    }
+    RETURN_IF_ERROR(saved_device_config.change_config(config_proto_new));
+    read_cache.reset();
+    change_log.reset();
+    is_p4_config_set = true;
+    set_config_cookie(config_proto_new);
+    RETURN_OK_STATUS();
+  }
+
+  Status init_tables(pi_p4info_t *p4info_new) {
     SessionTemp session(false  /* = batch */);
 
     table_info_store.reset();
@@ -434,9 +634,13 @@ class DeviceMgrImp {
         }
       }
     }
+    RETURN_OK_STATUS();
+  }
 
-    watch_port_enforcer.p4_change(p4info_new);
-
+  // The ActionProfMgr instances keep a pointer to watch_port_enforcer but do
+  // not use it until members are inserted, so they can be created while
+  // watch_port_enforcer is being reset.
+  Status init_action_profs(pi_p4info_t *p4info_new) {
     action_profs.clear();
     ASSIGN_OR_RETURN(
         auto pi_api_choice, ActionProfMgr::choose_pi_api(device_id));
@@ -448,29 +652,23 @@ class DeviceMgrImp {
           &watch_port_enforcer));
       action_profs.emplace(act_prof_id, std::move(mgr));
     }
+    RETURN_OK_STATUS();
+  }
 
-    auto *pre_mc_mgr_ = new PreMcMgr(device_id);
-    pre_clone_mgr.reset(new PreCloneMgr(device_tgt, pre_mc_mgr_));
-    pre_mc_mgr.reset(pre_mc_mgr_);
-
-    packet_io.p4_change(p4info_proto_new);
-
-    digest_mgr.p4_change(p4info_proto_new);
+  void publish_config(const p4v1::ForwardingPipelineConfig &config,
+                      bool preserve_forwarding_state) {
+    if (replication_publisher == nullptr) return;
+    replication_publisher->publish_config(
+        device_id, config, preserve_forwarding_state);
+  }
 
-    // we do this last, so that the ActProfMgr instances never point to an
-    // invalid p4info, even though this is not strictly required here
-    p4info.reset(p4info_new);
-    p4info_proto.CopyFrom(p4info_proto_new);
-    config_cookie.CopyFrom(config_proto_new.cookie());
-    RETURN_IF_ERROR(saved_device_config.change_config(config_proto_new));
-    is_p4_config_set = true;
-    if (config_proto_new.has_cookie()) {
-      config_cookie.CopyFrom(config_proto_new.cookie());
+  void set_config_cookie(const p4v1::ForwardingPipelineConfig &config) {
+    if (config.has_cookie()) {
+      config_cookie.CopyFrom(config.cookie());
       has_config_cookie = true;
     } else {
       has_config_cookie = false;
     }
-    RETURN_OK_STATUS();
   }
 
   Status pipeline_config_set(
@@ -484,16 +682,18 @@ class DeviceMgrImp {
     }
 
     pi_p4info_t *p4info_tmp = nullptr;
-    if (action == SetConfigRequest::VERIFY ||
-        action == SetConfigRequest::VERIFY_AND_SAVE ||
-        action == SetConfigRequest::VERIFY_AND_COMMIT ||
-        action == SetConfigRequest::RECONCILE_AND_COMMIT) {
+    if (action == SetConfigRequest::VERIFY) {
       if (!pi::p4info::p4info_proto_reader(config.p4info(), &p4info_tmp))
         RETURN_ERROR_STATUS(Code::UNKNOWN, "Error when importing p4info");
+      pi_destroy_config(p4info_tmp);
+      RETURN_OK_STATUS();
     }
 
-    if (action == SetConfigRequest::VERIFY)
-      RETURN_OK_STATUS();
+    bool is_update = (action == SetConfigRequest::VERIFY_AND_SAVE ||
+                      action == SetConfigRequest::VERIFY_AND_COMMIT ||
+                      action == SetConfigRequest::RECONCILE_AND_COMMIT);
+    ConfigFingerprint fingerprint;
+    if (is_update) fingerprint = ConfigFingerprint(config);
 
     p4::tmp::P4DeviceConfig p4_device_config;
     const std::string *device_data = nullptr;
@@ -511,10 +711,61 @@ class DeviceMgrImp {
     // check that p4info => device assigned
     assert(!p4info || pi_is_device_assigned(device_id));
 
+    // the matching VERIFY_AND_SAVE was a no-op, so there is nothing to commit
+    if (action == SetConfigRequest::COMMIT && skipped_device_update) {
+      skipped_device_update = false;
+      RETURN_OK_STATUS();
+    }
+    skipped_device_update = false;
+
+    bool force_reassign = uses_legacy_p4_device_config &&
+        p4_device_config.reassign();
+
+    // The config is identical to the one currently applied (and committed): we
+    // skip the p4info import, the device update and the frontend state rebuild
+    // altogether. Only the cookie may be different.
+    if (is_update && !force_reassign && !device_update_pending &&
+        fingerprint.same_p4info(config_fingerprint) &&
+        fingerprint.same_device_config(config_fingerprint)) {
+      Logger::get()->debug(
+          "Forwarding pipeline config is unchanged, skipping device update");
+      set_config_cookie(config);
+      config_fingerprint = fingerprint;
+      if (action == SetConfigRequest::VERIFY_AND_SAVE)
+        skipped_device_update = true;
+      publish_config(config, true);
+      RETURN_OK_STATUS();
+    }
+
+    // This is for legacy support of bmv2
+    bool legacy_assign = action == SetConfigRequest::VERIFY_AND_COMMIT &&
+        uses_legacy_p4_device_config &&
+        device_data->empty();
+
+    // If only the device config has changed, we keep using the current p4info.
+    if (is_update) {
+      if (!force_reassign && !legacy_assign &&
+          fingerprint.same_p4info(config_fingerprint)) {
+        p4info_tmp = p4info.get();
+      } else if (!pi::p4info::p4info_proto_reader(
+          config.p4info(), &p4info_tmp)) {
+        RETURN_ERROR_STATUS(Code::UNKNOWN, "Error when importing p4info");
+      }
+      // only valid again once the update has succeeded
+      config_fingerprint = ConfigFingerprint();
+    }
+
+    auto destroy_p4info_tmp = [this, &p4info_tmp]() {
+      if (p4info_tmp != p4info.get()) pi_destroy_config(p4info_tmp);
+    };
+
     auto remove_device = [this]() {
       pi_remove_device(device_id);
+      // wait for pending notifications before resetting the store
+      idle_timeout_buffer.p4_change(nullptr);
       table_info_store.reset();
       action_profs.clear();
+      read_converter.p4_change(nullptr);
       p4info.reset(nullptr);
     };
 
@@ -531,12 +782,10 @@ class DeviceMgrImp {
       return assign_options;
     };
 
-    // This is for legacy support of bmv2
-    if (action == SetConfigRequest::VERIFY_AND_COMMIT &&
-        uses_legacy_p4_device_config &&
-        device_data->empty()) {
+    if (legacy_assign) {
       if (pi_is_device_assigned(device_id)) remove_device();
       assert(!pi_is_device_assigned(device_id));
+      device_update_pending = false;
       auto assign_options = make_assign_options();
       pi_status = pi_assign_device(device_id, p4info_tmp,
                                    assign_options.data());
@@ -545,24 +794,23 @@ class DeviceMgrImp {
         RETURN_ERROR_STATUS(Code::UNKNOWN, "Error when assigning device");
       }
       RETURN_IF_ERROR(p4_change(config, p4info_tmp));
+      config_fingerprint = fingerprint;
+      publish_config(config, false);
       RETURN_OK_STATUS();
     }
 
     // assign device if needed, i.e. if device hasn't been assigned yet or if
     // the reassign flag is set
-    if (action == SetConfigRequest::VERIFY_AND_SAVE ||
-        action == SetConfigRequest::VERIFY_AND_COMMIT ||
-        action == SetConfigRequest::RECONCILE_AND_COMMIT) {
-      if (uses_legacy_p4_device_config &&
-          pi_is_device_assigned(device_id) &&
-          p4_device_config.reassign()) {
+    if (is_update) {
+      if (force_reassign && pi_is_device_assigned(device_id)) {
         remove_device();
+        device_update_pending = false;
       }
       if (!pi_is_device_assigned(device_id)) {
         auto assign_options = make_assign_options();
         pi_status = pi_assign_device(device_id, NULL, assign_options.data());
         if (pi_status != PI_STATUS_SUCCESS) {
-          pi_destroy_config(p4info_tmp);
+          destroy_p4info_tmp();
           RETURN_ERROR_STATUS(Code::UNKNOWN,
                               "Error when trying to assign device");
         }
@@ -576,23 +824,26 @@ class DeviceMgrImp {
     if (action == SetConfigRequest::RECONCILE_AND_COMMIT) {
       auto status = save_forwarding_state(&forwarding_state);
       if (IS_ERROR(status)) {
-        pi_destroy_config(p4info_tmp);
+        destroy_p4info_tmp();
         return status;
       }
     }
 
-    if (action == SetConfigRequest::VERIFY_AND_SAVE ||
-        action == SetConfigRequest::VERIFY_AND_COMMIT ||
-        action == SetConfigRequest::RECONCILE_AND_COMMIT) {
+    if (is_update) {
       pi_status = pi_update_device_start(device_id, p4info_tmp,
                                          device_data->data(),
                                          device_data->size());
       if (pi_status != PI_STATUS_SUCCESS) {
-        pi_destroy_config(p4info_tmp);
+        destroy_p4info_tmp();
         RETURN_ERROR_STATUS(Code::UNKNOWN,
                             "Error in first phase of device update");
       }
+      device_update_pending = true;
       RETURN_IF_ERROR(p4_change(config, p4info_tmp));
+      config_fingerprint = fingerprint;
+      // published before the reconcile replay below, which is not published
+      // itself
+      publish_config(config, action == SetConfigRequest::RECONCILE_AND_COMMIT);
     }
 
     // for reconcile, replay the state saved before the pi_update_device_start
@@ -619,6 +870,7 @@ class DeviceMgrImp {
         RETURN_ERROR_STATUS(Code::UNKNOWN,
                             "Error in second phase of device update");
       }
+      device_update_pending = false;
     }
 
     RETURN_OK_STATUS();
@@ -655,20 +907,124 @@ class DeviceMgrImp {
   }
 
   Status write(const p4v1::WriteRequest &request) {
+    return write(request, scheduler.write_class(request.updates_size()));
+  }
+
+  Status bulk_write(const p4v1::WriteRequest &request) {
+    return write(request, SchedulingConfig::BULK_WRITE);
+  }
+
+  Status write(const p4v1::WriteRequest &request,
+               Scheduler::PriorityClass priority_class) {
+    Scheduler::Ticket ticket(&scheduler, priority_class);
     AccessArbitration::WriteAccess write_access(
         &access_arbitration, request, p4info.get());
-    return write_(request);
+    ticket.admitted();
+    // Preempting the write would let conflicting updates be applied, and
+    // published, before the rest of this request.
+    auto status = (replication_publisher == nullptr) ?
+        write_(request, &ticket, &write_access) : write_(request);
+    // published while we still have write access, so that conflicting updates
+    // are published in the order in which they were applied
+    if (replication_publisher != nullptr)
+      replication_publisher->publish_write(device_id, request, status);
+    return status;
   }
 
   Status read(const p4v1::ReadRequest &request,
               p4v1::ReadResponse *response) const {
+    // reads are not preempted, as this would break the guarantee that all the
+    // entities in the request are read with the same forwarding state
+    Scheduler::Ticket ticket(&scheduler, SchedulingConfig::BULK_READ);
     AccessArbitration::ReadAccess read_access(&access_arbitration);
+    ticket.admitted();
     return read_(request, response);
   }
 
+  Status read_cached(const p4v1::ReadRequest &request,
+                     std::shared_ptr<const p4v1::ReadResponse> *response)
+      const {
+    Scheduler::Ticket ticket(&scheduler, SchedulingConfig::BULK_READ);
+    AccessArbitration::ReadAccess read_access(&access_arbitration);
+    ticket.admitted();
+    std::vector<p4_id_t> table_ids;
+    if (!read_cache.enabled() || !read_cache_deps(request, &table_ids)) {
+      auto *new_response = new p4v1::ReadResponse();
+      response->reset(new_response);
+      return read_(request, new_response);
+    }
+    // no write can happen while we have read access, so the response is
+    // consistent with the generations captured by the lookup
+    auto lookup = read_cache.lookup(request.SerializeAsString(), table_ids);
+    if (lookup.response() != nullptr) {
+      *response = lookup.response();
+      RETURN_OK_STATUS();
+    }
+    auto new_response = std::make_shared<p4v1::ReadResponse>();
+    auto status = read_(request, new_response.get());
+    if (IS_OK(status)) read_cache.insert(std::move(lookup), new_response);
+    *response = std::move(new_response);
+    return status;
+  }
+
+  Status read_changes(const p4::server::v1::ReadChangesRequest &request,
+                      p4::server::v1::ReadChangesResponse *response) const {
+    for (auto table_id : request.table_ids()) {
+      if (!check_p4_id(table_id, P4Ids::TABLE))
+        return make_invalid_p4_id_status();
+    }
+    if (!change_log.enabled()) {
+      RETURN_ERROR_STATUS(Code::FAILED_PRECONDITION,
+                          "Change log is disabled in server config");
+    }
+    Scheduler::Ticket ticket(&scheduler, SchedulingConfig::BULK_READ);
+    AccessArbitration::ReadAccess read_access(&access_arbitration);
+    ticket.admitted();
+    auto generation = change_log.generation();
+    if (request.since_generation() > generation) {
+      RETURN_ERROR_STATUS(Code::OUT_OF_RANGE,
+                          "Generation {} is greater than current generation {}",
+                          request.since_generation(), generation);
+    }
+    response->set_generation(generation);
+    std::vector<p4_id_t> table_ids(request.table_ids().begin(),
+                                   request.table_ids().end());
+    std::vector<ChangeLog::EntryChange> changes;
+    if (!change_log.changes_since(
+            request.since_generation(), table_ids, &changes)) {
+      response->set_overflowed(true);
+      RETURN_OK_STATUS();
+    }
+    p4v1::ReadResponse entry;
+    for (const auto &change : changes) {
+      auto *update = response->add_updates();
+      auto *table_entry = update->mutable_entity()->mutable_table_entry();
+      if (change.last_type == p4v1::Update::DELETE) {
+        update->set_type(p4v1::Update::DELETE);
+        table_entry->CopyFrom(*change.key);
+        continue;
+      }
+      update->set_type(change.inserted ?
+                       p4v1::Update::INSERT : p4v1::Update::MODIFY);
+      p4v1::Entity entity;
+      entity.mutable_table_entry()->CopyFrom(*change.key);
+      entry.Clear();
+      RETURN_IF_ERROR(read_one_(entity, &entry));
+      if (entry.entities_size() != 1) {
+        RETURN_ERROR_STATUS(Code::INTERNAL,
+                            "Cannot read changed entry in table {}",
+                            change.key->table_id());
+      }
+      table_entry->Swap(entry.mutable_entities(0)->mutable_table_entry());
+    }
+    RETURN_OK_STATUS();
+  }
+
   Status read_one(const p4v1::Entity &entity,
                   p4v1::ReadResponse *response) const {
+    Scheduler::Ticket ticket(&scheduler, SchedulingConfig::BULK_READ);
     AccessArbitration::ReadAccess read_access(&access_arbitration);
+    ticket.admitted();
     return read_one_(entity, response);
   }
 
@@ -677,6 +1033,7 @@ class DeviceMgrImp {
                      SessionTemp *session) {
     if (!check_p4_id(table_entry.table_id(), P4Ids::TABLE))
       return make_invalid_p4_id_status();
+    read_cache.bump(table_entry.table_id());
 
     if (table_entry.has_time_since_last_hit()) {
       RETURN_ERROR_STATUS(
@@ -772,6 +1129,8 @@ class DeviceMgrImp {
     const auto &table_entry = meter_entry.table_entry();
     if (!check_p4_id(table_entry.table_id(), P4Ids::TABLE))
       return make_invalid_p4_id_status();
+    // the meter config is included in table entry reads
+    read_cache.bump(table_entry.table_id());
 
     // also works for default entry, since the default entry is added to the
     // table info store (with the corect target-generated handle) in p4_change
@@ -906,46 +1265,49 @@ class DeviceMgrImp {
     // read all direct meters in table; in order to do that we choose to read
     // all the table entries first, then extract direct meter values. As a
     // result, a lot of this code is duplicated from table_read_one.
-    PIEntries entries(session);
-    RETURN_IF_ERROR(entries.fetch(device_tgt, table_id));
-    auto num_entries = pi_table_entries_num(entries);
     pi_table_ma_entry_t pi_entry;
     pi_entry_handle_t entry_handle;
-    pi::MatchKey mk(p4info.get(), table_id);
-    for (size_t i = 0; i < num_entries; i++) {
-      pi_table_entries_next(entries, &pi_entry, &entry_handle);
-
-      mk.from(pi_entry.match_key);
-
-      auto *entry = response->add_entities()->mutable_direct_meter_entry();
-      auto *tentry = entry->mutable_table_entry();
-      tentry->set_table_id(table_id);
-      RETURN_IF_ERROR(parse_match_key(p4info.get(), table_id, mk, tentry));
-
-      // direct resources
-      auto *direct_configs = pi_entry.entry.direct_res_config;
-      if (!direct_configs) {
-        RETURN_ERROR_STATUS(
-            Code::INTERNAL,
-            "Did not expect no direct resource for table entry");
-      }
-      bool meter_found = false;
-      for (size_t j = 0; j < direct_configs->num_configs; j++) {
-        const auto &config = direct_configs->configs[j];
-        if (config.res_id != table_direct_meter_id) continue;
-        meter_found = true;
-        auto meter_spec = static_cast<pi_meter_spec_t *>(config.config);
-        if (!meter_spec_is_default(*meter_spec)) {
-          meter_spec_pi_to_proto(*meter_spec, entry->mutable_config());
+    auto *mk_converter = read_converter.match_key_converter(table_id);
+    assert(mk_converter);
+    auto read_entries = [&](pi_table_fetch_res_t *entries) -> Status {
+      auto num_entries = pi_table_entries_num(entries);
+      for (size_t i = 0; i < num_entries; i++) {
+        pi_table_entries_next(entries, &pi_entry, &entry_handle);
+
+        auto *entry = response->add_entities()->mutable_direct_meter_entry();
+        auto *tentry = entry->mutable_table_entry();
+        tentry->set_table_id(table_id);
+        RETURN_IF_ERROR(mk_converter->parse(pi_entry.match_key, tentry));
+
+        // direct resources
+        auto *direct_configs = pi_entry.entry.direct_res_config;
+        if (!direct_configs) {
+          RETURN_ERROR_STATUS(
+              Code::INTERNAL,
+              "Did not expect no direct resource for table entry");
+        }
+        bool meter_found = false;
+        for (size_t j = 0; j < direct_configs->num_configs; j++) {
+          const auto &config = direct_configs->configs[j];
+          if (config.res_id != table_direct_meter_id) continue;
+          meter_found = true;
+          auto meter_spec = static_cast<pi_meter_spec_t *>(config.config);
+          if (!meter_spec_is_default(*meter_spec)) {
+            meter_spec_pi_to_proto(*meter_spec, entry->mutable_config());
+          }
+          break;
+        }
+        if (!meter_found) {
+          RETURN_ERROR_STATUS(
+              Code::INTERNAL,
+              "Did not expect no direct meter for table entry");
         }
-        break;
-      }
-      if (!meter_found) {
-        RETURN_ERROR_STATUS(
-            Code::INTERNAL,
-            "Did not expect no direct meter for table entry");
       }
-    }
+      RETURN_OK_STATUS();
+    };
+    PIEntriesCursor cursor(session);
+    RETURN_IF_ERROR(cursor.begin(device_tgt, table_id));
+    RETURN_IF_ERROR(cursor.for_each_chunk(read_entries));
     RETURN_OK_STATUS();
   }
 
@@ -966,24 +1328,6 @@ class DeviceMgrImp {
     return direct_meter_read_one(table_entry, session, response);
   }
 
-  Status parse_action_data(const pi_action_data_t *pi_action_data,
-                           p4v1::Action *action) const {
-    ActionDataReader reader(pi_action_data);
-    auto action_id = reader.get_action_id();
-    action->set_action_id(action_id);
-    size_t num_params;
-    auto param_ids = pi_p4info_action_get_params(
-        p4info.get(), action_id, &num_params);
-    for (size_t j = 0; j < num_params; j++) {
-      auto param = action->add_params();
-      param->set_param_id(param_ids[j]);
-      std::string value;
-      reader.get_arg(param_ids[j], &value);
-      param->set_value(bytestring_pi_to_p4rt(value));
-    }
-    RETURN_OK_STATUS();
-  }
-
   Status parse_action_entry(
       p4_id_t table_id,
       const pi_table_entry_t *pi_entry,
@@ -1032,8 +1376,8 @@ class DeviceMgrImp {
       }
     }
 
-    return parse_action_data(pi_entry->entry.action_data,
-                             table_action->mutable_action());
+    return read_converter.parse_action_data(pi_entry->entry.action_data,
+                                            table_action->mutable_action());
   }
 
   // Map group handles to an ActionProfileActionSet message. This is required
@@ -1071,7 +1415,8 @@ class DeviceMgrImp {
       auto p = mbr_h_to_action.emplace(member_h, p4v1::Action());
       if (!p.second)
         RETURN_ERROR_STATUS(Code::INTERNAL, "Duplicate member handle");
-      RETURN_IF_ERROR(parse_action_data(action_data, &p.first->second));
+      RETURN_IF_ERROR(
+          read_converter.parse_action_data(action_data, &p.first->second));
     }
 
     // then, iterate over groups and build the corresponding
@@ -1144,6 +1489,36 @@ class DeviceMgrImp {
     RETURN_OK_STATUS();
   }
 
+  // Same as set_time_since_last_hit, but for many entries of the same table at
+  // once: the remaining TTL values are retrieved from the target with a single
+  // call, which is much cheaper than one call per entry for wildcard reads.
+  Status set_time_since_last_hit_bulk(
+      p4_id_t table_id,
+      const std::vector<pi_entry_handle_t> &entry_handles,
+      const std::vector<p4v1::TableEntry *> &table_entries,
+      const std::vector<int64_t> &idle_timeouts_ns,
+      const SessionTemp &session) const {
+    assert(entry_handles.size() == table_entries.size() &&
+           entry_handles.size() == idle_timeouts_ns.size());
+    if (entry_handles.empty()) RETURN_OK_STATUS();
+    std::vector<uint64_t> remaining_ttls_ns(entry_handles.size(), 0);
+    auto pi_status = pi_table_entries_get_remaining_ttl(
+        session.get(), device_id, table_id, entry_handles.size(),
+        entry_handles.data(), remaining_ttls_ns.data());
+    if (pi_status != PI_STATUS_SUCCESS) {
+      RETURN_ERROR_STATUS(
+          Code::UNKNOWN, "Error when reading remaining entry TTLs from target");
+    }
+    for (size_t i = 0; i < entry_handles.size(); i++) {
+      auto idle_timeout_ns = idle_timeouts_ns[i];
+      auto remaining_ttl_ns = static_cast<int64_t>(remaining_ttls_ns[i]);
+      table_entries[i]->mutable_time_since_last_hit()->set_elapsed_ns(
+          (idle_timeout_ns >= remaining_ttl_ns) ?
+          (idle_timeout_ns - remaining_ttl_ns) : 0);
+    }
+    RETURN_OK_STATUS();
+  }
+
   Status parse_direct_resources(const p4v1::TableEntry &requested_entry,
                                 const pi_direct_res_config_t *direct_configs,
                                 p4v1::TableEntry *entry) const {
@@ -1272,73 +1647,100 @@ class DeviceMgrImp {
         table_id, &oneshot_map, session));
 
     pi::MatchKey expected_match_key(p4info.get(), table_id);
-    PIEntries entries(session);
+    pi_table_ma_entry_t entry;
+    pi_entry_handle_t entry_handle;
+    pi::MatchKey mk(p4info.get(), table_id);
+    auto *mk_converter = read_converter.match_key_converter(table_id);
+    assert(mk_converter);
+
+    // for wildcard reads, the remaining TTL values are queried in bulk once all
+    // entries have been processed
+    bool ttl_bulk = requested_entry.has_time_since_last_hit() &&
+        requested_entry.match().empty();
+    std::vector<pi_entry_handle_t> ttl_handles;
+    std::vector<p4v1::TableEntry *> ttl_entries;
+    std::vector<int64_t> ttl_idle_timeouts;
+
+    auto read_entries = [&](pi_table_fetch_res_t *entries) -> Status {
+      auto num_entries = pi_table_entries_num(entries);
+      for (size_t i = 0; i < num_entries; i++) {
+        pi_table_entries_next(entries, &entry, &entry_handle);
+
+        // TODO(antonin): what I really want to do here is a heterogeneous
+        // lookup / comparison; instead I make a copy of the match key in the
+        // right format and I use this for the lookup. If this is a performance
+        // issue, we can find a better solution.
+        mk.from(entry.match_key);
+
+        auto *table_entry = response->add_entities()->mutable_table_entry();
+        table_entry->set_table_id(table_id);
+        RETURN_IF_ERROR(mk_converter->parse(entry.match_key, table_entry));
+        RETURN_IF_ERROR(parse_action_entry(
+            table_id, &entry.entry, table_entry, oneshot_map));
+
+        // direct resources
+        auto *direct_configs = entry.entry.direct_res_config;
+        RETURN_IF_ERROR(parse_direct_resources(
+            requested_entry, direct_configs, table_entry));
+
+        // If table is const (immutable P4 table), it is possible that the
+        // entries were added out-of-band, i.e. without the P4Runtime service.
+        // In this case, the entries would not be found in the
+        // table_info_store, and anyway there would be no point in looking since
+        // there can be no controller metadata for these immutable entries.
+        bool table_is_const = pi_p4info_table_is_const(p4info.get(), table_id);
+        if (table_is_const) continue;
+        auto entry_data = table_info_store.get_entry(table_id, mk);
+        // this would point to a serious bug in the implementation, and
+        // shoudn't occur given that we keep the local state in sync with lower
+        // level state
+        if (entry_data == nullptr) {
+          RETURN_ERROR_STATUS(Code::INTERNAL,
+                              "Table state out-of-sync with target");
+        }
+        table_entry->set_controller_metadata(entry_data->controller_metadata);
+        table_entry->set_metadata(entry_data->metadata);
+        table_entry->set_idle_timeout_ns(entry_data->idle_timeout_ns);
+
+        if (ttl_bulk && entry_data->idle_timeout_ns != 0) {
+          ttl_handles.push_back(entry_handle);
+          ttl_entries.push_back(table_entry);
+          ttl_idle_timeouts.push_back(entry_data->idle_timeout_ns);
+        } else if (requested_entry.has_time_since_last_hit()) {
+          RETURN_IF_ERROR(set_time_since_last_hit(
+              table_id, entry_handle, table_entry, entry_data->idle_timeout_ns,
+              session));
+        }
+
+        // just a sanity check
+        assert(
+            entry_data->is_oneshot ==
+            (table_entry->action().type_case() ==
+             p4v1::TableAction::kActionProfileActionSet));
+      }
+      RETURN_OK_STATUS();
+    };
+
     if (requested_entry.match().empty()) {
       // we read all entries, PI doesn't provide any filtering capabilities
       // (you either read all entries or a single one)
       // TODO(antonin): implement filtering (action-based, priority-based) as
       // per the P4Runtime specification when iterating over entries below.
-      RETURN_IF_ERROR(entries.fetch(device_tgt, table_id));
+      PIEntriesCursor cursor(session);
+      RETURN_IF_ERROR(cursor.begin(device_tgt, table_id));
+      RETURN_IF_ERROR(cursor.for_each_chunk(read_entries));
     } else {
       RETURN_IF_ERROR(
           construct_match_key(requested_entry, &expected_match_key));
+      PIEntries entries(session);
       RETURN_IF_ERROR(
           entries.fetch_one(device_tgt, table_id, expected_match_key));
+      RETURN_IF_ERROR(read_entries(entries));
     }
 
-    auto num_entries = pi_table_entries_num(entries);
-    pi_table_ma_entry_t entry;
-    pi_entry_handle_t entry_handle;
-    pi::MatchKey mk(p4info.get(), table_id);
-    for (size_t i = 0; i < num_entries; i++) {
-      pi_table_entries_next(entries, &entry, &entry_handle);
-
-      // TODO(antonin): what I really want to do here is a heterogeneous lookup
-      // / comparison; instead I make a copy of the match key in the right
-      // format and I use this for the lookup. If this is a performance issue,
-      // we can find a better solution.
-      mk.from(entry.match_key);
-
-      auto *table_entry = response->add_entities()->mutable_table_entry();
-      table_entry->set_table_id(table_id);
-      RETURN_IF_ERROR(parse_match_key(p4info.get(), table_id, mk, table_entry));
-      RETURN_IF_ERROR(
-          parse_action_entry(table_id, &entry.entry, table_entry, oneshot_map));
-
-      // direct resources
-      auto *direct_configs = entry.entry.direct_res_config;
-      RETURN_IF_ERROR(
-          parse_direct_resources(requested_entry, direct_configs, table_entry));
-
-      // If table is const (immutable P4 table), it is possible that the entries
-      // were added out-of-band, i.e. without the P4Runtime service. In this
-      // case, the entries would not be found in the table_info_store, and
-      // anyway there would be no point in looking since there can be no
-      // controller metadata for these immutable entries.
-      bool table_is_const = pi_p4info_table_is_const(p4info.get(), table_id);
-      if (table_is_const) continue;
-      auto entry_data = table_info_store.get_entry(table_id, mk);
-      // this would point to a serious bug in the implementation, and shoudn't
-      // occur given that we keep the local state in sync with lower level state
-      if (entry_data == nullptr) {
-        RETURN_ERROR_STATUS(Code::INTERNAL,
-                            "Table state out-of-sync with target");
-      }
-      table_entry->set_controller_metadata(entry_data->controller_metadata);
-      table_entry->set_metadata(entry_data->metadata);
-      table_entry->set_idle_timeout_ns(entry_data->idle_timeout_ns);
-
-      if (requested_entry.has_time_since_last_hit()) {
-        RETURN_IF_ERROR(set_time_since_last_hit(
-            table_id, entry_handle, table_entry, entry_data->idle_timeout_ns,
-            session));
-      }
-
-      // just a sanity check
-      assert(
-          entry_data->is_oneshot ==
-          (table_entry->action().type_case() ==
-           p4v1::TableAction::kActionProfileActionSet));
+    if (ttl_bulk) {
+      RETURN_IF_ERROR(set_time_since_last_hit_bulk(
+          table_id, ttl_handles, ttl_entries, ttl_idle_timeouts, session));
     }
 
     RETURN_OK_STATUS();
@@ -1375,6 +1777,7 @@ class DeviceMgrImp {
                           member.action_profile_id());
     }
     ASSIGN_OR_RETURN(auto access_manual, action_prof_mgr->manual());
+    read_cache_bump_act_prof(member.action_profile_id());
     switch (update) {
       case p4v1::Update::UNSPECIFIED:
         RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT, "Update type is not set");
@@ -1403,6 +1806,7 @@ class DeviceMgrImp {
                           group.action_profile_id());
     }
     ASSIGN_OR_RETURN(auto access_manual, action_prof_mgr->manual());
+    read_cache_bump_act_prof(group.action_profile_id());
     switch (update) {
       case p4v1::Update::UNSPECIFIED:
         RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT, "Update type is not set");
@@ -1454,7 +1858,8 @@ class DeviceMgrImp {
       auto *member = response->add_entities()->mutable_action_profile_member();
       member->set_action_profile_id(action_profile_id);
       pi_act_prof_mbrs_next(entries, &action_data, &member_h);
-      RETURN_IF_ERROR(parse_action_data(action_data, member->mutable_action()));
+      RETURN_IF_ERROR(read_converter.parse_action_data(
+          action_data, member->mutable_action()));
       ActionProfMemberId member_id;
       if (!access_manual->retrieve_member_id(member_h, &member_id)) {
         RETURN_ERROR_STATUS(Code::INTERNAL,
@@ -1585,14 +1990,17 @@ class DeviceMgrImp {
       const p4v1::StreamMessageRequest &request) {
     p4v1::StreamError stream_error;
     auto status = stream_message_request_handle_(request, &stream_error);
-    // a canonical_code of 0 can either mean no error or that stream
-    // error-reporting was disabled.
-    if (stream_error.canonical_code() == Code::OK || !cb_) return status;
+    stream_error_send(&stream_error);
+    return status;
+  }
 
-    p4v1::StreamMessageResponse msg;
-    msg.unsafe_arena_set_allocated_error(&stream_error);
-    cb_(device_id, &msg, cookie_);
-    msg.unsafe_arena_release_error();
+  Status packet_out_send_batch(
+      const std::vector<const p4v1::PacketOut *> &packets) {
+    // packet-out does not access the P4 objects, so it does not need to go
+    // through the scheduler, which would delay other work for no benefit
+    p4v1::StreamError stream_error;
+    auto status = packet_io.packet_out_send_batch(packets, &stream_error);
+    stream_error_send(&stream_error);
     return status;
   }
 
@@ -1606,6 +2014,9 @@ class DeviceMgrImp {
   }
 
   Status server_config_set(const p4::server::v1::Config &config) {
+    RETURN_IF_ERROR(scheduler.set_config(config.scheduling()));
+    read_cache.set_config(config.read_cache());
+    change_log.set_config(config.change_log());
     server_config.set_config(config);
     RETURN_OK_STATUS();
   }
@@ -1615,6 +2026,54 @@ class DeviceMgrImp {
     RETURN_OK_STATUS();
   }
 
+  Status scheduling_stats_get(p4::server::v1::SchedulingStats *stats) const {
+    scheduler.stats_get(stats);
+    RETURN_OK_STATUS();
+  }
+
+  Status memory_usage_get(p4::server::v1::MemoryUsage *usage) const {
+    AccessArbitration::ReadAccess read_access(&access_arbitration);
+    std::vector<pi_p4_id_t> act_prof_ids;
+    act_prof_ids.reserve(action_profs.size());
+    for (const auto &p : action_profs) act_prof_ids.push_back(p.first);
+    std::sort(act_prof_ids.begin(), act_prof_ids.end());
+    for (auto act_prof_id : act_prof_ids) {
+      action_profs.at(act_prof_id)->memory_usage_get(
+          usage->add_action_profiles());
+    }
+    RETURN_OK_STATUS();
+  }
+
+  void replication_publisher_set(
+      std::shared_ptr<ReplicationPublisher> publisher) {
+    AccessArbitration::UpdateAccess update_access(&access_arbitration);
+    replication_publisher = std::move(publisher);
+    if (replication_publisher == nullptr || !is_p4_config_set) return;
+    // Only the entities which can be replayed with an INSERT are published;
+    // the server sets the publisher before any config is pushed anyway.
+    p4v1::ForwardingPipelineConfig config;
+    p4v1::ReadRequest read_request;
+    read_request.add_entities()->mutable_action_profile_member();
+    read_request.add_entities()->mutable_action_profile_group();
+    read_request.add_entities()->mutable_table_entry();
+    p4v1::ReadResponse forwarding_state;
+    if (IS_ERROR(pipeline_config_get(
+            p4v1::GetForwardingPipelineConfigRequest::ALL, &config)) ||
+        IS_ERROR(read_(read_request, &forwarding_state))) {
+      Logger::get()->error("Cannot publish current state of device {}",
+                           device_id);
+      return;
+    }
+    replication_publisher->publish_config(device_id, config, false);
+    p4v1::WriteRequest request;
+    for (auto &entity : *forwarding_state.mutable_entities()) {
+      auto *update = request.add_updates();
+      update->set_type(p4v1::Update::INSERT);
+      update->mutable_entity()->Swap(&entity);
+    }
+    replication_publisher->publish_write(device_id, request, OK_STATUS());
+  }
+
   Status counter_write(p4v1::Update::Type update,
                        const p4v1::CounterEntry &counter_entry,
                        const SessionTemp &session) {
@@ -1823,42 +2282,45 @@ class DeviceMgrImp {
     // read all direct counters in table; in order to do that we choose to read
     // all the table entries first, then extract direct counter values. As a
     // result, a lot of this code is duplicated from table_read_one.
-    PIEntries entries(session);
-    RETURN_IF_ERROR(entries.fetch(device_tgt, table_id));
-    auto num_entries = pi_table_entries_num(entries);
     pi_table_ma_entry_t pi_entry;
     pi_entry_handle_t entry_handle;
-    pi::MatchKey mk(p4info.get(), table_id);
-    for (size_t i = 0; i < num_entries; i++) {
-      pi_table_entries_next(entries, &pi_entry, &entry_handle);
-
-      mk.from(pi_entry.match_key);
-
-      auto *entry = response->add_entities()->mutable_direct_counter_entry();
-      auto *tentry = entry->mutable_table_entry();
-      tentry->set_table_id(table_id);
-      RETURN_IF_ERROR(parse_match_key(p4info.get(), table_id, mk, tentry));
-
-      // direct resources
-      auto *direct_configs = pi_entry.entry.direct_res_config;
-      if (!direct_configs) {
-        RETURN_ERROR_STATUS(
-            Code::INTERNAL,
-            "Did not expect no direct resource for table entry");
-      }
-      for (size_t j = 0; j < direct_configs->num_configs; j++) {
-        const auto &config = direct_configs->configs[j];
-        if (config.res_id != table_direct_counter_id) continue;
-        counter_data_pi_to_proto(
-            *static_cast<pi_counter_data_t *>(config.config),
-            entry->mutable_data());
-      }
-      if (!entry->has_data()) {
-        RETURN_ERROR_STATUS(
-            Code::INTERNAL,
-            "Did not expect no direct counter for table entry");
+    auto *mk_converter = read_converter.match_key_converter(table_id);
+    assert(mk_converter);
+    auto read_entries = [&](pi_table_fetch_res_t *entries) -> Status {
+      auto num_entries = pi_table_entries_num(entries);
+      for (size_t i = 0; i < num_entries; i++) {
+        pi_table_entries_next(entries, &pi_entry, &entry_handle);
+
+        auto *entry = response->add_entities()->mutable_direct_counter_entry();
+        auto *tentry = entry->mutable_table_entry();
+        tentry->set_table_id(table_id);
+        RETURN_IF_ERROR(mk_converter->parse(pi_entry.match_key, tentry));
+
+        // direct resources
+        auto *direct_configs = pi_entry.entry.direct_res_config;
+        if (!direct_configs) {
+          RETURN_ERROR_STATUS(
+              Code::INTERNAL,
+              "Did not expect no direct resource for table entry");
+        }
+        for (size_t j = 0; j < direct_configs->num_configs; j++) {
+          const auto &config = direct_configs->configs[j];
+          if (config.res_id != table_direct_counter_id) continue;
+          counter_data_pi_to_proto(
+              *static_cast<pi_counter_data_t *>(config.config),
+              entry->mutable_data());
+        }
+        if (!entry->has_data()) {
+          RETURN_ERROR_STATUS(
+              Code::INTERNAL,
+              "Did not expect no direct counter for table entry");
+        }
       }
-    }
+      RETURN_OK_STATUS();
+    };
+    PIEntriesCursor cursor(session);
+    RETURN_IF_ERROR(cursor.begin(device_tgt, table_id));
+    RETURN_IF_ERROR(cursor.for_each_chunk(read_entries));
     RETURN_OK_STATUS();
   }
 
@@ -1977,19 +2439,20 @@ class DeviceMgrImp {
   }
 
   static void init(size_t max_devices) {
+    ThreadPlacement::configure(p4::server::v1::Config());
     auto pi_status = pi_init(max_devices, NULL);
     (void) pi_status;
     assert(pi_status == PI_STATUS_SUCCESS);
   }
 
   static Status init() {
-    auto pi_status = pi_init(defaultMaxDevices, NULL);
-    if (pi_status != PI_STATUS_SUCCESS)
-      RETURN_ERROR_STATUS(Code::INTERNAL, "Error when initializing PI library");
-    RETURN_OK_STATUS()
+    return init(p4::server::v1::Config());
   }
 
+  // Thread placement must be configured before pi_init, as the target may
+  // start some threads in its init function.
   static Status init(const p4::server::v1::Config &config) {
+    RETURN_IF_ERROR(ThreadPlacement::configure(config));
     auto pi_status = pi_init(defaultMaxDevices, NULL);
     if (pi_status != PI_STATUS_SUCCESS)
       RETURN_ERROR_STATUS(Code::INTERNAL, "Error when initializing PI library");
@@ -1999,22 +2462,20 @@ class DeviceMgrImp {
 
   static Status init(const std::string &config_text,
                      const std::string &version) {
-    auto pi_status = pi_init(defaultMaxDevices, NULL);
-    if (pi_status != PI_STATUS_SUCCESS)
-      RETURN_ERROR_STATUS(Code::INTERNAL, "Error when initializing PI library");
     if (version != "v1") {
       RETURN_ERROR_STATUS(
           Code::INVALID_ARGUMENT,
           "Server config version {} not supported",
           version);
     }
+    p4::server::v1::Config config;
     if (!ServerConfigFromText<p4::server::v1::Config>::parse(
-            config_text, &default_server_config)) {
+            config_text, &config)) {
       RETURN_ERROR_STATUS(
           Code::INVALID_ARGUMENT,
           "Invalid text format for server config");
     }
-    RETURN_OK_STATUS();
+    return init(config);
   }
 
   static void destroy() {
@@ -2027,6 +2488,32 @@ class DeviceMgrImp {
   // provide a dummy value to pi_init.
   static constexpr size_t defaultMaxDevices = 256;
 
+  // Returns false if the response to the request cannot be cached, i.e. if it
+  // includes entities other than table entries, or data which can change
+  // without a write (counters, hit timestamps). Otherwise, the ids of the
+  // tables the response depends on are returned, with 0 for all tables.
+  bool read_cache_deps(const p4v1::ReadRequest &request,
+                       std::vector<p4_id_t> *table_ids) const {
+    for (const auto &entity : request.entities()) {
+      if (!entity.has_table_entry()) return false;
+      const auto &table_entry = entity.table_entry();
+      if (table_entry.has_counter_data() ||
+          table_entry.has_meter_counter_data() ||
+          table_entry.has_time_since_last_hit()) {
+        return false;
+      }
+      table_ids->push_back(table_entry.table_id());
+    }
+    return true;
+  }
+
+  void read_cache_bump_act_prof(p4_id_t action_profile_id) {
+    size_t num_tables = 0;
+    auto *table_ids = pi_p4info_act_prof_get_tables(
+        p4info.get(), action_profile_id, &num_tables);
+    for (size_t i = 0; i < num_tables; i++) read_cache.bump(table_ids[i]);
+  }
+
   // internal version of read, which does not request read access from
   // access_arbitration
   Status read_(const p4v1::ReadRequest &request,
@@ -2082,78 +2569,252 @@ class DeviceMgrImp {
   }
 
   // internal version of write, which does not request write access from
-  // access_arbitration
-  Status write_(const p4v1::WriteRequest &request) {
+  // access_arbitration; if ticket is not null, the write is preempted between
+  // chunks of updates as needed, by temporarily giving up access
+  Status write_(const p4v1::WriteRequest &request,
+                Scheduler::Ticket *ticket = nullptr,
+                AccessArbitration::WriteAccess *access = nullptr) {
     if (request.atomicity() != p4v1::WriteRequest::CONTINUE_ON_ERROR) {
       RETURN_ERROR_STATUS(
           Code::UNIMPLEMENTED,
           "Support for atomic write modes has not been implemented yet");
     }
-    Status status;
-    status.set_code(Code::OK);
-    SessionTemp session(true  /* = batch */);
     P4ErrorReporter error_reporter;
-    for (const auto &update : request.updates()) {
-      const auto &entity = update.entity();
-      switch (entity.entity_case()) {
-        case p4v1::Entity::kExternEntry:
-          Logger::get()->error("No extern support yet");
-          status.set_code(Code::UNIMPLEMENTED);
-          break;
-        case p4v1::Entity::kTableEntry:
-          status = table_write(update.type(), entity.table_entry(), &session);
-          break;
-        case p4v1::Entity::kActionProfileMember:
-          status = action_profile_member_write(
-              update.type(), entity.action_profile_member(), session);
-          break;
-        case p4v1::Entity::kActionProfileGroup:
-          status = action_profile_group_write(
-              update.type(), entity.action_profile_group(), session);
-          break;
-        case p4v1::Entity::kMeterEntry:
-          status = meter_write(update.type(), entity.meter_entry(), session);
-          break;
-        case p4v1::Entity::kDirectMeterEntry:
-          status = direct_meter_write(
-              update.type(), entity.direct_meter_entry(), session);
-          break;
-        case p4v1::Entity::kCounterEntry:
-          status = counter_write(
-              update.type(), entity.counter_entry(), session);
-          break;
-        case p4v1::Entity::kDirectCounterEntry:
-          status = direct_counter_write(
-              update.type(), entity.direct_counter_entry(), session);
-          break;
-        case p4v1::Entity::kPacketReplicationEngineEntry:
-          status = pre_write(update.type(),
-                             entity.packet_replication_engine_entry(),
-                             session);
-          break;
-        case p4v1::Entity::kValueSetEntry:  // TODO(antonin)
-          status = ERROR_STATUS(Code::UNIMPLEMENTED,
-                                "ValueSet writes are not supported yet");
-          break;
-        case p4v1::Entity::kRegisterEntry:
-          status = ERROR_STATUS(Code::UNIMPLEMENTED,
-                                "Register writes are not supported yet");
-          break;
-        case p4v1::Entity::kDigestEntry:
-          status = digest_mgr.config_write(
-              entity.digest_entry(), update.type(), session);
-          break;
-        default:
-          status = ERROR_STATUS(Code::UNKNOWN, "Incorrect entity type");
-          break;
+    const auto &updates = request.updates();
+    std::unique_ptr<UpdateCoalescer> coalescer;
+    if (updates.size() > 1 && server_config.get(
+            [](const p4::server::v1::Config &config) {
+              return config.write().coalesce_updates(); })) {
+      coalescer.reset(new UpdateCoalescer(request, [this](p4_id_t table_id) {
+        return pi_p4info_table_get_implementation(p4info.get(), table_id);
+      }));
+    }
+    // statuses of the grouped updates which have already been applied
+    std::unordered_map<int, Status> group_statuses;
+    int i = 0;
+    while (i < updates.size()) {
+      {
+        // the batch needs to be ended before giving up access
+        SessionTemp session(true  /* = batch */);
+        for (int chunk_start = i; i < updates.size(); i++) {
+          if (ticket != nullptr && i > chunk_start &&
+              (i - chunk_start) % ticket->chunk_size() == 0 &&
+              ticket->preempted()) {
+            break;
+          }
+          auto *group = (coalescer == nullptr) ?
+              nullptr : coalescer->group_starting_at(i);
+          if (group != nullptr) {
+            write_group_(
+                request, *coalescer, *group, &session, &group_statuses);
+          }
+          auto group_status_it = group_statuses.find(i);
+          if (group_status_it != group_statuses.end()) {
+            error_reporter.push_back(group_status_it->second);
+            group_statuses.erase(group_status_it);
+            continue;
+          }
+          auto status = write_update_(updates[i], &session);
+          auto cleanup_status = session.local_cleanup();
+          error_reporter.push_back(
+              IS_OK(cleanup_status) ? status : cleanup_status);
+        }
+      }
+      if (i < updates.size()) {
+        access->yield([ticket] { ticket->yield(); });
+        ticket->admitted();
       }
-      auto cleanup_status = session.local_cleanup();
-      error_reporter.push_back(
-          IS_OK(cleanup_status) ? status : cleanup_status);
     }
     return error_reporter.get_status();
   }
 
+  // Applies a group of updates found by UpdateCoalescer as a single update. If
+  // one of the updates is invalid, if the first update does not match the
+  // current state of the entity (e.g. INSERT of an existing table entry), or if
+  // the folded update fails, the updates are applied one by one instead, so
+  // that each one gets the same status as without coalescing. This relies on a
+  // failed update not modifying any state.
+  void write_group_(const p4v1::WriteRequest &request,
+                    const UpdateCoalescer &coalescer,
+                    const UpdateCoalescer::Group &group,
+                    SessionTemp *session,
+                    std::unordered_map<int, Status> *statuses) {
+    const auto &updates = request.updates();
+    const auto &first = updates[group.updates.front()];
+    bool can_fold = true;
+    for (auto i : group.updates) {
+      if (IS_ERROR(validate_update_(updates[i]))) {
+        can_fold = false;
+        break;
+      }
+    }
+    auto exists = (first.type() != p4v1::Update::INSERT);
+    if (can_fold && entity_exists_(first.entity()) == exists) {
+      p4v1::Update folded;
+      coalescer.fold(group, &folded);
+      auto status = OK_STATUS();
+      if (folded.type() != p4v1::Update::UNSPECIFIED) {
+        status = write_update_(folded, session);
+        auto cleanup_status = session->local_cleanup();
+        if (IS_OK(status)) status = cleanup_status;
+      }
+      if (IS_OK(status)) {
+        for (auto i : group.updates) (*statuses)[i] = status;
+        return;
+      }
+    }
+    for (auto i : group.updates) {
+      auto status = write_update_(updates[i], session);
+      auto cleanup_status = session->local_cleanup();
+      (*statuses)[i] = IS_OK(cleanup_status) ? status : cleanup_status;
+    }
+  }
+
+  // Performs the checks done by write_update_ which do not depend on the
+  // current state of the entity, for the updates grouped by UpdateCoalescer.
+  Status validate_update_(const p4v1::Update &update) {
+    const auto &entity = update.entity();
+    if (entity.has_action_profile_member()) {
+      const auto &member = entity.action_profile_member();
+      if (!check_p4_id(member.action_profile_id(), P4Ids::ACTION_PROFILE))
+        return make_invalid_p4_id_status();
+      auto action_prof_mgr = get_action_prof_mgr(member.action_profile_id());
+      if (action_prof_mgr == nullptr) {
+        RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                            "Not a valid action profile id: {}",
+                            member.action_profile_id());
+      }
+      ASSIGN_OR_RETURN(auto access_manual, action_prof_mgr->manual());
+      if (update.type() == p4v1::Update::DELETE) RETURN_OK_STATUS();
+      return access_manual->member_validate(member);
+    }
+
+    const auto &table_entry = entity.table_entry();
+    const auto table_id = table_entry.table_id();
+    if (!check_p4_id(table_id, P4Ids::TABLE))
+      return make_invalid_p4_id_status();
+    if (table_entry.has_time_since_last_hit()) {
+      RETURN_ERROR_STATUS(
+          Code::INVALID_ARGUMENT,
+          "has_time_since_last_hit must not be set in WriteRequest");
+    }
+    if (update.type() != p4v1::Update::MODIFY &&
+        table_entry.is_default_action()) {
+      RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                          "Cannot use INSERT or DELETE for default entry");
+    }
+    pi::MatchKey match_key(p4info.get(), table_id);
+    RETURN_IF_ERROR(construct_match_key(table_entry, &match_key));
+    if (update.type() == p4v1::Update::DELETE) RETURN_OK_STATUS();
+
+    if (!table_entry.has_action())
+      RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT, "'action' field must be set");
+    RETURN_IF_ERROR(validate_action(table_entry));
+    pi::ActionEntry action_entry;
+    pi_meter_spec_t _meter_spec_storage;
+    pi_counter_data_t _counter_data_storage;
+    RETURN_IF_ERROR(construct_action_entry(
+        table_id, table_entry.action(), &action_entry));
+    RETURN_IF_ERROR(construct_direct_resources(
+        table_entry, &action_entry,
+        &_meter_spec_storage, &_counter_data_storage));
+    return validate_entry_ttl(table_entry).status();
+  }
+
+  // only for entities which have been validated with validate_update_
+  bool entity_exists_(const p4v1::Entity &entity) {
+    if (entity.has_action_profile_member()) {
+      const auto &member = entity.action_profile_member();
+      auto access_manual = get_action_prof_mgr(
+          member.action_profile_id())->manual().ValueOrDie();
+      pi_indirect_handle_t member_h;
+      return access_manual->retrieve_member_handle(
+          member.member_id(), &member_h);
+    }
+    const auto &table_entry = entity.table_entry();
+    pi::MatchKey match_key(p4info.get(), table_entry.table_id());
+    construct_match_key(table_entry, &match_key);
+    return table_info_store.get_entry(
+        table_entry.table_id(), match_key) != nullptr;
+  }
+
+  Status write_update_(const p4v1::Update &update, SessionTemp *session) {
+    Status status;
+    status.set_code(Code::OK);
+    const auto &entity = update.entity();
+    switch (entity.entity_case()) {
+      case p4v1::Entity::kExternEntry:
+        Logger::get()->error("No extern support yet");
+        status.set_code(Code::UNIMPLEMENTED);
+        break;
+      case p4v1::Entity::kTableEntry:
+        status = table_write(update.type(), entity.table_entry(), session);
+        if (IS_OK(status))
+          change_log.record(update.type(), entity.table_entry());
+        break;
+      case p4v1::Entity::kActionProfileMember:
+        status = action_profile_member_write(
+            update.type(), entity.action_profile_member(), *session);
+        break;
+      case p4v1::Entity::kActionProfileGroup:
+        status = action_profile_group_write(
+            update.type(), entity.action_profile_group(), *session);
+        break;
+      case p4v1::Entity::kMeterEntry:
+        status = meter_write(update.type(), entity.meter_entry(), *session);
+        break;
+      case p4v1::Entity::kDirectMeterEntry:
+        status = direct_meter_write(
+            update.type(), entity.direct_meter_entry(), *session);
+        // the meter config is included in table entry reads
+        if (IS_OK(status)) {
+          change_log.record(p4v1::Update::MODIFY,
+                            entity.direct_meter_entry().table_entry());
+        }
+        break;
+      case p4v1::Entity::kCounterEntry:
+        status = counter_write(
+            update.type(), entity.counter_entry(), *session);
+        break;
+      case p4v1::Entity::kDirectCounterEntry:
+        status = direct_counter_write(
+            update.type(), entity.direct_counter_entry(), *session);
+        break;
+      case p4v1::Entity::kPacketReplicationEngineEntry:
+        status = pre_write(update.type(),
+                           entity.packet_replication_engine_entry(),
+                           *session);
+        break;
+      case p4v1::Entity::kValueSetEntry:  // TODO(antonin)
+        status = ERROR_STATUS(Code::UNIMPLEMENTED,
+                              "ValueSet writes are not supported yet");
+        break;
+      case p4v1::Entity::kRegisterEntry:
+        status = ERROR_STATUS(Code::UNIMPLEMENTED,
+                              "Register writes are not supported yet");
+        break;
+      case p4v1::Entity::kDigestEntry:
+        status = digest_mgr.config_write(
+            entity.digest_entry(), update.type(), *session);
+        break;
+      default:
+        status = ERROR_STATUS(Code::UNKNOWN, "Incorrect entity type");
+        break;
+    }
+    return status;
+  }
+
+  void stream_error_send(p4v1::StreamError *stream_error) {
+    // a canonical_code of 0 can either mean no error or that stream
+    // error-reporting was disabled.
+    if (stream_error->canonical_code() == Code::OK || !cb_) return;
+
+    p4v1::StreamMessageResponse msg;
+    msg.unsafe_arena_set_allocated_error(stream_error);
+    cb_(device_id, &msg, cookie_);
+    msg.unsafe_arena_release_error();
+  }
+
   Status stream_message_request_handle_(
       const p4v1::StreamMessageRequest &request,
       p4v1::StreamError *stream_error) {
@@ -2215,20 +2876,30 @@ class DeviceMgrImp {
     RETURN_OK_STATUS();
   }
 
+  // The values are validated and written directly to the match key buffer,
+  // see common::bytestring_p4rt_to_pi. The byte0 mask applied by the
+  // pi::MatchKey setters is not needed since the values have been validated.
+  char *match_field_dst(pi::MatchKey *match_key, pi_p4_id_t mf_id) const {
+    auto *mk = match_key->get();
+    return mk->data + pi_p4info_table_match_field_offset(
+        p4info.get(), mk->table_id, mf_id);
+  }
+
   Status set_exact_match(pi::MatchKey *match_key,
                          pi_p4_id_t mf_id,
                          const p4v1::FieldMatch::Exact &mf,
                          size_t bitwidth) const {
-    ASSIGN_OR_RETURN(auto value, bytestring_p4rt_to_pi(mf.value(), bitwidth));
-    match_key->set_exact(mf_id, value.data(), value.size());
-    RETURN_OK_STATUS();
+    return bytestring_p4rt_to_pi(
+        mf.value(), bitwidth, match_field_dst(match_key, mf_id));
   }
 
   Status set_lpm_match(pi::MatchKey *match_key,
                        pi_p4_id_t mf_id,
                        const p4v1::FieldMatch::LPM &mf,
                        size_t bitwidth) const {
-    ASSIGN_OR_RETURN(auto value, bytestring_p4rt_to_pi(mf.value(), bitwidth));
+    auto *dst = match_field_dst(match_key, mf_id);
+    auto nbytes = (bitwidth + 7) / 8;
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.value(), bitwidth, dst));
     const auto pLen = mf.prefix_len();
     if (pLen < 0) {
       RETURN_ERROR_STATUS(
@@ -2245,12 +2916,13 @@ class DeviceMgrImp {
           "omit match field instead of using a prefix length of 0");
     }
     // makes sure that value ends with zeros
-    if (!common::check_prefix_trailing_zeros(value, pLen)) {
+    if (!common::check_prefix_trailing_zeros(dst, nbytes, pLen)) {
       RETURN_ERROR_STATUS(
           Code::INVALID_ARGUMENT,
           "Invalid LPM value, incorrect number of trailing zeros");
     }
-    match_key->set_lpm(mf_id, value.data(), value.size(), pLen);
+    auto pLen_u32 = static_cast<uint32_t>(pLen);
+    std::memcpy(dst + nbytes, &pLen_u32, sizeof(pLen_u32));
     RETURN_OK_STATUS();
   }
 
@@ -2258,26 +2930,24 @@ class DeviceMgrImp {
                            pi_p4_id_t mf_id,
                            const p4v1::FieldMatch::Ternary &mf,
                            size_t bitwidth) const {
-    ASSIGN_OR_RETURN(auto value, bytestring_p4rt_to_pi(mf.value(), bitwidth));
-    ASSIGN_OR_RETURN(auto mask, bytestring_p4rt_to_pi(mf.mask(), bitwidth));
+    auto *value = match_field_dst(match_key, mf_id);
+    auto nbytes = (bitwidth + 7) / 8;
+    auto *mask = value + nbytes;
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.value(), bitwidth, value));
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.mask(), bitwidth, mask));
     // makes sure that mask is not 0 (otherwise mf should be omitted)
-    if (ternary_match_is_dont_care(mf)) {
+    if (common::bytes_all_equal(mask, nbytes, 0)) {
       RETURN_ERROR_STATUS(
           Code::INVALID_ARGUMENT,
           "Invalid representation of 'don't care' ternary match, "
           "omit match field instead of using 0 mask");
     }
     // makes sure that value == value & mask
-    assert(value.size() == mask.size());
-    for (size_t i = 0; i < value.size(); i++) {
-      // parenthesis required because of C operator precedence
-      if ((value[i] & mask[i]) != value[i]) {
-        RETURN_ERROR_STATUS(
-            Code::INVALID_ARGUMENT,
-            "Invalid ternary value, make sure value & mask == value");
-      }
+    if (!common::bytes_within_mask(value, mask, nbytes)) {
+      RETURN_ERROR_STATUS(
+          Code::INVALID_ARGUMENT,
+          "Invalid ternary value, make sure value & mask == value");
     }
-    match_key->set_ternary(mf_id, value.data(), mask.data(), value.size());
     RETURN_OK_STATUS();
   }
 
@@ -2285,9 +2955,11 @@ class DeviceMgrImp {
                          pi_p4_id_t mf_id,
                          const p4v1::FieldMatch::Range &mf,
                          size_t bitwidth) const {
-    ASSIGN_OR_RETURN(auto low, bytestring_p4rt_to_pi(mf.low(), bitwidth));
-    ASSIGN_OR_RETURN(auto high, bytestring_p4rt_to_pi(mf.high(), bitwidth));
-    assert(low.size() == high.size());
+    auto *low = match_field_dst(match_key, mf_id);
+    auto nbytes = (bitwidth + 7) / 8;
+    auto *high = low + nbytes;
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.low(), bitwidth, low));
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.high(), bitwidth, high));
     if (range_match_is_dont_care(mf)) {
       RETURN_ERROR_STATUS(
           Code::INVALID_ARGUMENT,
@@ -2295,11 +2967,10 @@ class DeviceMgrImp {
           "omit match field instead of using low=0 and high=2**bitwidth-1");
     }
     // makes sure that low <= high
-    if (std::memcmp(low.data(), high.data(), low.size()) > 0) {
+    if (std::memcmp(low, high, nbytes) > 0) {
         RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
                             "Invalid range value, make sure low <= high");
     }
-    match_key->set_range(mf_id, low.data(), high.data(), low.size());
     RETURN_OK_STATUS();
   }
 
@@ -2307,9 +2978,14 @@ class DeviceMgrImp {
                             pi_p4_id_t mf_id,
                             const p4v1::FieldMatch::Optional &mf,
                             size_t bitwidth) const {
-    ASSIGN_OR_RETURN(auto value, bytestring_p4rt_to_pi(mf.value(), bitwidth));
-    match_key->set_optional(
-        mf_id, value.data(), value.size(), false /* is_wildcard */);
+    auto *value = match_field_dst(match_key, mf_id);
+    auto nbytes = (bitwidth + 7) / 8;
+    RETURN_IF_ERROR(bytestring_p4rt_to_pi(mf.value(), bitwidth, value));
+    // not a wildcard: the mask is all ones
+    auto *mask = value + nbytes;
+    std::memset(mask, 0xff, nbytes);
+    if (nbytes > 0)
+      mask[0] = static_cast<char>(0xff >> (nbytes * 8 - bitwidth));
     RETURN_OK_STATUS();
   }
 
@@ -2572,9 +3248,11 @@ class DeviceMgrImp {
     assert(action_prof_mgr);
     ASSIGN_OR_RETURN(auto access_oneshot, action_prof_mgr->oneshot());
 
+    auto share = server_config.get([](const p4::server::v1::Config &config) {
+      return config.action_profile().share_oneshot_groups(); });
     pi_indirect_handle_t group_h;
     RETURN_IF_ERROR(access_oneshot->group_create(
-        action_set, &group_h, session));
+        action_set, share, &group_h, session));
     action_entry->init_indirect_handle(group_h);
     session->cleanup_task_push(std::unique_ptr<OneShotCleanup>(
         new OneShotCleanup(access_oneshot, group_h)));
@@ -2703,6 +3381,9 @@ class DeviceMgrImp {
                           "Error when adding match entry to target");
     }
 
+    // IdleTimeoutBuffer reads from the store concurrently
+    TableInfoStore::Lock lock;
+    if (supports_idle_timeout) lock = table_info_store.lock_table(table_id);
     if (table_entry.action().type_case() ==
         p4v1::TableAction::kActionProfileActionSet) {
       table_info_store.add_entry(
@@ -2722,9 +3403,6 @@ class DeviceMgrImp {
                                table_entry.idle_timeout_ns()));
     }
 
-    if (supports_idle_timeout)
-      RETURN_IF_ERROR(idle_timeout_buffer.insert_entry(match_key, table_entry));
-
     RETURN_OK_STATUS();
   }
 
@@ -2788,6 +3466,9 @@ class DeviceMgrImp {
                           "Error when modifying match entry in target");
     }
 
+    // IdleTimeoutBuffer reads from the store concurrently
+    TableInfoStore::Lock lock;
+    if (supports_idle_timeout) lock = table_info_store.lock_table(table_id);
     if (!table_entry.has_action()) {
       // cannot be false as the function returns early with an error otherwise
       assert(table_entry.is_default_action());
@@ -2810,9 +3491,6 @@ class DeviceMgrImp {
       }
     }
 
-    if (supports_idle_timeout)
-      RETURN_IF_ERROR(idle_timeout_buffer.modify_entry(match_key, table_entry));
-
     RETURN_OK_STATUS();
   }
 
@@ -2852,10 +3530,13 @@ class DeviceMgrImp {
               access_oneshot, entry_data->oneshot_group_handle)));
     }
 
-    table_info_store.remove_entry(table_id, match_key);
-
-    if (pi_p4info_table_supports_idle_timeout(p4info.get(), table_id))
-      RETURN_IF_ERROR(idle_timeout_buffer.delete_entry(match_key));
+    {
+      // IdleTimeoutBuffer reads from the store concurrently
+      TableInfoStore::Lock lock;
+      if (pi_p4info_table_supports_idle_timeout(p4info.get(), table_id))
+        lock = table_info_store.lock_table(table_id);
+      table_info_store.remove_entry(table_id, match_key);
+    }
 
     RETURN_OK_STATUS();
   }
@@ -3079,6 +3760,12 @@ class DeviceMgrImp {
   bool has_config_cookie{false};
   p4v1::ForwardingPipelineConfig::Cookie config_cookie;
   ConfigFile saved_device_config;
+  ConfigFingerprint config_fingerprint;
+  // true between pi_update_device_start and pi_update_device_end
+  bool device_update_pending{false};
+  // true if the last VERIFY_AND_SAVE was skipped because the config was
+  // unchanged, in which case the next COMMIT is also a no-op
+  bool skipped_device_update{false};
 
   P4InfoWrapper p4info{nullptr, p4info_deleter};
 
@@ -3098,7 +3785,17 @@ class DeviceMgrImp {
 
   mutable AccessArbitration access_arbitration;
 
+  mutable Scheduler scheduler;
+
   WatchPortEnforcer watch_port_enforcer;
+
+  ReadConverter read_converter;
+
+  mutable ReadCache read_cache;
+
+  ChangeLog change_log;
+
+  std::shared_ptr<ReplicationPublisher> replication_publisher{nullptr};
 };
 
 /* static */
@@ -3132,12 +3829,30 @@ DeviceMgr::write(const p4v1::WriteRequest &request) {
   return pimp->write(request);
 }
 
+Status
+DeviceMgr::bulk_write(const p4v1::WriteRequest &request) {
+  return pimp->bulk_write(request);
+}
+
 Status
 DeviceMgr::read(const p4v1::ReadRequest &request,
                 p4v1::ReadResponse *response) const {
   return pimp->read(request, response);
 }
 
+Status
+DeviceMgr::read_cached(
+    const p4v1::ReadRequest &request,
+    std::shared_ptr<const p4v1::ReadResponse> *response) const {
+  return pimp->read_cached(request, response);
+}
+
+Status
+DeviceMgr::read_changes(const p4::server::v1::ReadChangesRequest &request,
+                        p4::server::v1::ReadChangesResponse *response) const {
+  return pimp->read_changes(request, response);
+}
+
 Status
 DeviceMgr::read_one(const p4v1::Entity &entity,
                     p4v1::ReadResponse *response) const {
@@ -3150,6 +3865,12 @@ DeviceMgr::stream_message_request_handle(
   return pimp->stream_message_request_handle(request);
 }
 
+Status
+DeviceMgr::packet_out_send_batch(
+    const std::vector<const p4v1::PacketOut *> &packets) {
+  return pimp->packet_out_send_batch(packets);
+}
+
 void
 DeviceMgr::stream_message_response_register_cb(StreamMessageResponseCb cb,
                                                void *cookie) {
@@ -3166,6 +3887,22 @@ DeviceMgr::server_config_get(p4::server::v1::Config *config) {
   return pimp->server_config_get(config);
 }
 
+Status
+DeviceMgr::scheduling_stats_get(p4::server::v1::SchedulingStats *stats) const {
+  return pimp->scheduling_stats_get(stats);
+}
+
+Status
+DeviceMgr::memory_usage_get(p4::server::v1::MemoryUsage *usage) const {
+  return pimp->memory_usage_get(usage);
+}
+
+void
+DeviceMgr::replication_publisher_set(
+    std::shared_ptr<ReplicationPublisher> publisher) {
+  pimp->replication_publisher_set(std::move(publisher));
+}
+
 void
 DeviceMgr::init(size_t max_devices) {
   DeviceMgrImp::init(max_devices);
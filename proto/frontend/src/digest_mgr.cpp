@@ -559,6 +559,13 @@ class DigestData {
   bool timeout_bit{false};
 };
 
+// Leaked on purpose, since DigestMgr instances may outlive static objects.
+TaskQueuePool<std::chrono::steady_clock> *task_queue_pool() {
+  static auto *pool = new TaskQueuePool<std::chrono::steady_clock>(
+      "digest", TaskQueuePool<std::chrono::steady_clock>::default_size());
+  return pool;
+}
+
 }  // namespace
 
 // includes all the "state" for the DigestMgr instance
@@ -749,12 +756,13 @@ class DigestMgr::SweepTasks {
 
 DigestMgr::DigestMgr(device_id_t device_id)
     : device_id(device_id),
-      task_queue(new DigestTaskQueue()),
+      task_queue(new DigestTaskQueue(task_queue_pool()->get(device_id))),
       state(nullptr),
       sweep_tasks(nullptr) {
   // We use an asynchronous task queue for all tasks that need to touch the
-  // shared state. This task queue is served by a single dedicated thread which
-  // is why you won't see any mutex in this code. Because our task queue only
+  // shared state. This task queue is served by a single thread (shared with
+  // other devices, see TaskQueuePool) which is why you won't see any mutex in
+  // this code. Because our task queue only
   // accepts functors (which implement TaskIface) and not lambdas, some of the
   // task definitions are a bit verbose.
   // I make no claim that this design is better than a synchronous one. As it
@@ -762,14 +770,33 @@ DigestMgr::DigestMgr(device_id_t device_id)
   // to the stream. Maybe a better design would be to introduce another
   // asynchronous task queue for writing to the stream (in the server
   // code). Regardless, this code was fun to write.
-  task_queue_thread = std::thread(&DigestTaskQueue::execute, task_queue.get());
   pi_learn_register_cb(device_id, &DigestMgr::digest_cb, this);
 }
 
 DigestMgr::~DigestMgr() {
+  class TaskReleaseSweepTasks : public Task {
+   public:
+    TaskReleaseSweepTasks(DigestMgr *mgr,
+                          EmptyPromise &promise)  // NOLINT(runtime/references)
+        : Task(mgr), promise(promise) { }
+
+    void operator()() override {
+      mgr->sweep_tasks = nullptr;
+      promise.set_value();
+    }
+
+   private:
+    EmptyPromise &promise;
+  };
+
   pi_learn_deregister_cb(device_id);
-  task_queue->stop();
-  task_queue_thread.join();
+  // The sweep tasks keep pointers to periodic tasks owned by the task queue,
+  // which are released by purge(), so they need to be cancelled first.
+  EmptyPromise promise;
+  task_queue->execute_task(std::unique_ptr<TaskIface>(
+      new TaskReleaseSweepTasks(this, promise)));
+  promise.get_future().wait();
+  task_queue->purge();
 }
 
 // We assume that by the time the call to p4_change completes, we can no longer
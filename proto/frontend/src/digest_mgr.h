@@ -26,7 +26,6 @@
 
 #include <chrono>
 #include <memory>
-#include <thread>
 
 #include "google/rpc/status.pb.h"
 #include "p4/config/v1/p4info.pb.h"
@@ -44,8 +43,8 @@ namespace common {
 class SessionTemp;
 }  // namespace common
 
-template <typename Clock> class TaskQueue;
-using DigestTaskQueue = TaskQueue<std::chrono::steady_clock>;
+template <typename Clock> class TaskQueueHandle;
+using DigestTaskQueue = TaskQueueHandle<std::chrono::steady_clock>;
 
 class DigestMgr {
  public:
@@ -90,7 +89,6 @@ class DigestMgr {
   std::unique_ptr<SweepTasks> sweep_tasks;
   StreamMessageResponseCb cb;
   void *cookie;
-  std::thread task_queue_thread;
 };
 
 }  // namespace proto
@@ -27,7 +27,6 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
-#include <thread>
 
 #include "google/rpc/status.pb.h"
 #include "p4/v1/p4runtime.pb.h"
@@ -40,9 +39,15 @@ namespace fe {
 
 namespace proto {
 
-template <typename Clock> class TaskQueue;
-using IdleTimeoutTaskQueue = TaskQueue<std::chrono::steady_clock>;
+template <typename Clock> class TaskQueueHandle;
+using IdleTimeoutTaskQueue = TaskQueueHandle<std::chrono::steady_clock>;
 
+class TableInfoStore;
+
+// Notifications are resolved against the TableInfoStore owned by DeviceMgr,
+// which is where the controller metadata and the idle timeout of each entry
+// are stored. Writers must hold the table lock (TableInfoStore::lock_table)
+// when updating the entries of tables which support idle timeout.
 class IdleTimeoutBuffer {
  public:
   using device_id_t = DeviceMgr::device_id_t;
@@ -51,18 +56,16 @@ class IdleTimeoutBuffer {
   static constexpr int64_t kDefaultMaxBufferingNs = 100 * 1000 * 1000;  // 100ms
 
   IdleTimeoutBuffer(device_id_t device_id,
+                    const TableInfoStore *table_info_store,
                     int64_t max_buffering_ns = kDefaultMaxBufferingNs);
 
   ~IdleTimeoutBuffer();
 
+  // Pending notifications are processed before this call returns, after which
+  // the TableInfoStore can be reset. p4info can be nullptr when the device is
+  // removed.
   Status p4_change(const pi_p4info_t *p4info);
 
-  Status insert_entry(const pi::MatchKey &mk,
-                      const ::p4::v1::TableEntry &entry);
-  Status modify_entry(const pi::MatchKey &mk,
-                      const ::p4::v1::TableEntry &entry);
-  Status delete_entry(const pi::MatchKey &mk);
-
   void stream_message_response_register_cb(StreamMessageResponseCb cb,
                                            void *cookie);
 
@@ -75,16 +78,14 @@ class IdleTimeoutBuffer {
 
  private:
   class TaskSendNotifications;
-  class TableInfoStore;
 
   device_id_t device_id;
   const pi_p4info_t *p4info{nullptr};
-  std::unique_ptr<TableInfoStore> table_info_store;
+  const TableInfoStore *table_info_store;
   int64_t max_buffering_ns;
   std::unique_ptr<IdleTimeoutTaskQueue> task_queue;
   StreamMessageResponseCb cb{};
   void *cookie{nullptr};
-  std::thread task_queue_thread;
   p4::v1::IdleTimeoutNotification notifications;
   std::atomic<size_t> drop_count{0};
 
@@ -24,7 +24,6 @@
 #include <PI/frontends/cpp/tables.h>
 #include <PI/pi.h>
 
-#include <algorithm>  // for std::all_of
 #include <string>
 
 #include "google/rpc/code.pb.h"
@@ -48,19 +47,20 @@ using p4_id_t = common::p4_id_t;
 using common::bytestring_pi_to_p4rt;
 
 bool ternary_match_is_dont_care_(const std::string &mask) {
-  return std::all_of(mask.begin(), mask.end(),
-                     [](std::string::value_type c) { return c == 0; });
+  return common::bytes_all_equal(mask.data(), mask.size(), 0);
 }
 
 bool ternary_match_is_dont_care(const p4v1::FieldMatch::Ternary &mf) {
   return ternary_match_is_dont_care_(mf.mask());
 }
 
+// equivalent to comparing low and high with range_default_lo(low.size() * 8)
+// and range_default_hi(low.size() * 8), without the temporaries
 bool range_match_is_dont_care_(const std::string &low,
                                const std::string &high) {
-  auto bitwidth = static_cast<size_t>(low.size() * 8);
-  return low == common::range_default_lo(bitwidth) &&
-      high == common::range_default_hi(bitwidth);
+  return low.size() == high.size() &&
+      common::bytes_all_equal(low.data(), low.size(), 0) &&
+      common::bytes_all_equal(high.data(), high.size(), '\xff');
 }
 
 bool range_match_is_dont_care(const p4v1::FieldMatch::Range &mf) {
@@ -21,7 +21,8 @@
 
 #include "packet_io_mgr.h"
 
-#include <algorithm>  // for std::fill, std::copy
+#include <algorithm>  // for std::fill, std::copy, std::min
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>  // for std::move
@@ -242,6 +243,15 @@ class PacketOutMutate {
  public:
   static constexpr const char name[] = "packet_out";
 
+  struct Ptr {
+    Ptr() = default;
+    Ptr(const Id2Offset::Offset *offset, const std::string *value)
+        : offset(offset), value(value) { }
+
+    const Id2Offset::Offset *offset{nullptr};
+    const std::string *value{nullptr};
+  };
+
   explicit PacketOutMutate(const ControllerPacketMetadata &metadata_hdr)
       : metadata_hdr(metadata_hdr), metadata_cnt(metadata_hdr.metadata_size()),
         id2offset(metadata_hdr) {
@@ -252,23 +262,19 @@ class PacketOutMutate {
   // the PacketOut message if even one metadata field is missing. It may be a
   // good idea to make this behavior configurable since some clients may rely on
   // the current behavior.
+  // The header and payload are written to pkt, which is expected to be reused
+  // across calls so that no memory allocation is needed in the common case; ptrs
+  // is scratch space for the same reason.
   Status operator ()(const p4v1::PacketOut &packet_out,
-                     std::string *pkt) const {
-    struct Ptr {
-      Ptr() = default;
-      Ptr(const Id2Offset::Offset *offset, const std::string *value)
-          : offset(offset), value(value) { }
-
-      const Id2Offset::Offset *offset{nullptr};
-      const std::string *value{nullptr};
-    };
+                     std::string *pkt,
+                     std::vector<Ptr> *ptrs) const {
     // We need to do a first pass to order the metadata fields provided by the
     // P4Runtime client, as successive calls to generic_deparse must be done
     // according to the order in which fields are defined in the controller
     // header.
     // In the future, we may want to update the generic_deparse implementation
     // to lift this restriction (if it comes with a performance benefit).
-    std::vector<Ptr> ptrs(metadata_cnt);
+    ptrs->assign(metadata_cnt, Ptr());
     for (const auto &metadata : packet_out.metadata()) {
       auto offset_it = id2offset.find(metadata.metadata_id());
       if (offset_it == id2offset.end()) {
@@ -276,13 +282,13 @@ class PacketOutMutate {
                             "Unknown metadata id in PacketOut message");
       }
       const auto &offset = offset_it->second;
-      ptrs[offset.idx] = Ptr{&offset, &metadata.value()};
+      (*ptrs)[offset.idx] = Ptr{&offset, &metadata.value()};
     }
     pkt->clear();
     const auto &payload = packet_out.payload();
     pkt->reserve(nbytes + payload.size());
     pkt->append(nbytes, 0);
-    for (const auto &ptr : ptrs) {
+    for (const auto &ptr : *ptrs) {
       if (!ptr.offset) continue;  // missing field in PacketOut message
       ASSIGN_OR_RETURN(
           auto value, bytestring_p4rt_to_pi(*ptr.value, ptr.offset->bitwidth));
@@ -324,7 +330,9 @@ PacketIOMgr::p4_change(const p4configv1::P4Info &p4info) {
   }
   Lock lock(mutex);
   packet_in_mutate.reset(packet_in_mutate_new);
-  packet_out_mutate.reset(packet_out_mutate_new);
+  std::atomic_store(&packet_out_mutate,
+                    std::shared_ptr<const PacketOutMutate>(
+                        packet_out_mutate_new));
 }
 
 namespace {
@@ -358,43 +366,84 @@ void make_stream_error_if(p4serverv1::StreamConfig::ErrorReportingLevel level,
 
 }  // namespace
 
+namespace {
+
+// Buffers used to build the packets handed over to the target. The gRPC server
+// handles each StreamChannel RPC in its own thread, so using thread-local
+// buffers means that each stream gets its own set, which is reused for every
+// packet: PacketOut messages from independent streams do not need to be
+// serialized and the buffers do not need to be allocated for each packet.
+struct PacketOutBuffers {
+  void reserve(size_t num_pkts) {
+    if (batch.size() >= num_pkts) return;
+    pkts.resize(num_pkts);
+    batch.resize(num_pkts);
+  }
+
+  // one buffer per packet in the batch
+  std::vector<std::string> pkts;
+  std::vector<pi_packet_t> batch;
+  std::vector<PacketOutMutate::Ptr> ptrs;
+};
+
+PacketOutBuffers *packet_out_buffers() {
+  static thread_local PacketOutBuffers buffers;
+  return &buffers;
+}
+
+}  // namespace
+
 Status
 PacketIOMgr::packet_out_send(const p4v1::PacketOut &packet) const {
   p4v1::StreamError stream_error;
   return packet_out_send(packet, &stream_error);
 }
 
+// Sets the idx-th packet of the thread's batch; the buffers must already have
+// room for it, as growing them would invalidate the previous packets.
 Status
-PacketIOMgr::packet_out_send(const p4v1::PacketOut &packet,
-                             p4v1::StreamError *stream_error) const {
-  pi_status_t pi_status = PI_STATUS_SUCCESS;
+PacketIOMgr::packet_out_prepare(const PacketOutMutate *mutate,
+                                const p4v1::PacketOut &packet,
+                                size_t idx,
+                                p4v1::StreamError *stream_error) const {
+  auto *buffers = packet_out_buffers();
+  auto &pi_packet = buffers->batch.at(idx);
+  Status status;
   // TODO(antonin): unify both cases, we could have a mutator (no-op) even when
   // there is no metadata.
-  if (packet_out_mutate) {
-    std::string raw_packet;
-    auto status = (*packet_out_mutate)(packet, &raw_packet);
-    if (IS_ERROR(status)) {
-      auto error_reporting_level = error_reporting();
-      make_stream_error_if(
-          error_reporting_level, stream_error, packet, status,
-          error_reporting_level == p4serverv1::StreamConfig::DETAILED);
-      return status;
-    }
-    pi_status = pi_packetout_send(device_id, raw_packet.data(),
-                                  raw_packet.size());
+  if (mutate) {
+    auto &raw_packet = buffers->pkts.at(idx);
+    status = (*mutate)(packet, &raw_packet, &buffers->ptrs);
+    pi_packet.pkt = raw_packet.data();
+    pi_packet.size = raw_packet.size();
   } else if (packet.metadata_size() > 0) {  // unexpected metadata
-    auto status = ERROR_STATUS(
+    status = ERROR_STATUS(
         Code::INVALID_ARGUMENT, "Unexpected metadata in PacketOut message");
+  } else {
+    // no copy needed
+    const auto &payload = packet.payload();
+    pi_packet.pkt = payload.data();
+    pi_packet.size = payload.size();
+    status = OK_STATUS();
+  }
+  if (IS_ERROR(status)) {
     auto error_reporting_level = error_reporting();
     make_stream_error_if(
         error_reporting_level, stream_error, packet, status,
         error_reporting_level == p4serverv1::StreamConfig::DETAILED);
-    return status;
-  } else {
-    const auto &payload = packet.payload();
-    pi_status = pi_packetout_send(device_id, payload.data(),
-                                  payload.size());
   }
+  return status;
+}
+
+Status
+PacketIOMgr::packet_out_send(const p4v1::PacketOut &packet,
+                             p4v1::StreamError *stream_error) const {
+  auto mutate = std::atomic_load(&packet_out_mutate);
+  auto *buffers = packet_out_buffers();
+  buffers->reserve(1);
+  RETURN_IF_ERROR(packet_out_prepare(mutate.get(), packet, 0, stream_error));
+  const auto &pi_packet = buffers->batch[0];
+  auto pi_status = pi_packetout_send(device_id, pi_packet.pkt, pi_packet.size);
   if (pi_status != PI_STATUS_SUCCESS) {
     make_stream_error_if(
         error_reporting(), stream_error, packet, Code::UNKNOWN,
@@ -404,6 +453,40 @@ PacketIOMgr::packet_out_send(const p4v1::PacketOut &packet,
   RETURN_OK_STATUS();
 }
 
+Status
+PacketIOMgr::packet_out_send_batch(
+    const std::vector<const p4v1::PacketOut *> &packets,
+    p4v1::StreamError *stream_error) const {
+  auto mutate = std::atomic_load(&packet_out_mutate);
+  auto *buffers = packet_out_buffers();
+  buffers->reserve(packets.size());
+  // packets which precede an invalid one are still sent
+  Status prepare_status;
+  size_t num_pkts = 0;
+  for (; num_pkts < packets.size(); num_pkts++) {
+    prepare_status = packet_out_prepare(
+        mutate.get(), *packets[num_pkts], num_pkts, stream_error);
+    if (IS_ERROR(prepare_status)) break;
+  }
+  if (num_pkts > 0) {
+    size_t num_sent = 0;
+    auto pi_status = pi_packetout_send_batch(
+        device_id, buffers->batch.data(), num_pkts, &num_sent);
+    if (pi_status != PI_STATUS_SUCCESS) {
+      // overrides the stream error for the invalid packet, if any, since it
+      // comes later in the batch; we do not trust the target to report a
+      // num_sent smaller than num_pkts on error
+      stream_error->Clear();
+      auto failed_idx = std::min(num_sent, num_pkts - 1);
+      make_stream_error_if(
+          error_reporting(), stream_error, *packets[failed_idx], Code::UNKNOWN,
+          "Unknown error when target sending packet-out", false);
+      RETURN_ERROR_STATUS(Code::UNKNOWN);
+    }
+  }
+  return prepare_status;
+}
+
 void
 PacketIOMgr::packet_in_register_cb(StreamMessageResponseCb cb, void *cookie) {
   cb_ = std::move(cb);
@@ -26,6 +26,7 @@
 
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "google/rpc/status.pb.h"
 #include "p4/config/v1/p4info.pb.h"
@@ -60,6 +61,13 @@ class PacketIOMgr {
   Status packet_out_send(const p4::v1::PacketOut &packet,
                          p4::v1::StreamError *stream_error) const;
 
+  // Packets are handed over to the target with a single
+  // pi_packetout_send_batch call. Processing stops at the first packet which
+  // cannot be sent (or is invalid), and stream_error is set for that packet.
+  Status packet_out_send_batch(
+      const std::vector<const p4::v1::PacketOut *> &packets,
+      p4::v1::StreamError *stream_error) const;
+
   void packet_in_register_cb(StreamMessageResponseCb cb, void *cookie);
 
   PacketIOMgr(const PacketIOMgr &) = delete;
@@ -73,13 +81,19 @@ class PacketIOMgr {
 
   p4::server::v1::StreamConfig::ErrorReportingLevel error_reporting() const;
 
+  Status packet_out_prepare(const PacketOutMutate *mutate,
+                            const p4::v1::PacketOut &packet,
+                            size_t idx,
+                            p4::v1::StreamError *stream_error) const;
+
   using Mutex = std::mutex;
   using Lock = std::lock_guard<Mutex>;
   device_id_t device_id;
   ServerConfigAccessor *server_config;
   mutable Mutex mutex{};
   std::unique_ptr<PacketInMutate> packet_in_mutate;
-  std::unique_ptr<PacketOutMutate> packet_out_mutate;
+  // accessed atomically, so that sending packets does not require a lock
+  std::shared_ptr<const PacketOutMutate> packet_out_mutate;
 
   StreamMessageResponseCb cb_;
   void *cookie_;
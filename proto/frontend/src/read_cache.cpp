@@ -0,0 +1,148 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "read_cache.h"
+
+#include <iterator>  // for std::prev
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+/* static */ constexpr uint32_t ReadCache::kDefaultMaxEntries;
+/* static */ constexpr uint64_t ReadCache::kDefaultMaxBytes;
+
+void
+ReadCache::set_config(const p4::server::v1::ReadCacheConfig &config) {
+  std::lock_guard<std::mutex> lock(mutex);
+  is_enabled = config.enabled();
+  max_entries = (config.max_entries() == 0) ?
+      kDefaultMaxEntries : config.max_entries();
+  max_bytes = (config.max_bytes() == 0) ? kDefaultMaxBytes : config.max_bytes();
+  if (is_enabled) {
+    evict();
+  } else {
+    entries.clear();
+    index.clear();
+    total_bytes = 0;
+  }
+}
+
+bool
+ReadCache::enabled() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return is_enabled;
+}
+
+void
+ReadCache::bump(p4_id_t table_id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  generations[table_id]++;
+  generations[0]++;
+}
+
+void
+ReadCache::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  epoch++;
+  generations.clear();
+  entries.clear();
+  index.clear();
+  total_bytes = 0;
+}
+
+uint64_t
+ReadCache::generation(p4_id_t table_id) const {
+  auto it = generations.find(table_id);
+  return (it == generations.end()) ? 0 : it->second;
+}
+
+ReadCache::Lookup
+ReadCache::lookup(std::string key, const std::vector<p4_id_t> &table_ids) {
+  Lookup lookup;
+  std::lock_guard<std::mutex> lock(mutex);
+  lookup.epoch = epoch;
+  lookup.generations.reserve(table_ids.size());
+  for (auto table_id : table_ids)
+    lookup.generations.emplace_back(table_id, generation(table_id));
+
+  auto index_it = index.find(key);
+  if (index_it != index.end()) {
+    auto it = index_it->second;
+    if (it->epoch == lookup.epoch && it->generations == lookup.generations) {
+      entries.splice(entries.begin(), entries, it);
+      lookup.response_ = it->response;
+    } else {
+      erase(it);
+    }
+  }
+  lookup.key = std::move(key);
+  return lookup;
+}
+
+void
+ReadCache::insert(Lookup &&lookup, Response response) {
+  size_t bytes = lookup.key.size() + response->ByteSizeLong();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!is_enabled || bytes > max_bytes || lookup.epoch != epoch) return;
+  for (const auto &p : lookup.generations)
+    if (generation(p.first) != p.second) return;
+
+  auto index_it = index.find(lookup.key);
+  if (index_it != index.end()) erase(index_it->second);
+  entries.push_front(Entry{lookup.key, std::move(lookup.generations),
+                           lookup.epoch, std::move(response), bytes});
+  index.emplace(std::move(lookup.key), entries.begin());
+  total_bytes += bytes;
+  evict();
+}
+
+size_t
+ReadCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
+
+void
+ReadCache::erase(EntryList::iterator it) {
+  total_bytes -= it->bytes;
+  index.erase(it->key);
+  entries.erase(it);
+}
+
+void
+ReadCache::evict() {
+  while (!entries.empty() &&
+         (entries.size() > max_entries || total_bytes > max_bytes)) {
+    erase(std::prev(entries.end()));
+  }
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
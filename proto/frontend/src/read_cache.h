@@ -0,0 +1,128 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_READ_CACHE_H_
+#define SRC_READ_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "p4/server/v1/config.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+#include "common.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Cache of read responses, keyed by the serialized read request (see
+// p4::server::v1::ReadCacheConfig). Each table has a generation number, which
+// is bumped every time the table is written to; a cached response is only valid
+// as long as the generations of the tables it depends on are unchanged. Stale
+// responses are not removed eagerly, they are eventually evicted (LRU). The
+// generation of table id 0 is bumped every time any table is written to, which
+// is how wildcard reads over all tables are handled.
+class ReadCache {
+ public:
+  using p4_id_t = common::p4_id_t;
+  using Response = std::shared_ptr<const p4::v1::ReadResponse>;
+
+  static constexpr uint32_t kDefaultMaxEntries = 64;
+  static constexpr uint64_t kDefaultMaxBytes = 64 * 1024 * 1024;
+
+  // Result of a lookup; on a miss, it can be passed to insert once the response
+  // has been computed. The generations are captured at lookup time, so that a
+  // response computed concurrently with a write is never cached as current.
+  class Lookup {
+   public:
+    const Response &response() const { return response_; }
+
+   private:
+    friend class ReadCache;
+
+    std::string key;
+    std::vector<std::pair<p4_id_t, uint64_t> > generations;
+    uint64_t epoch{0};
+    Response response_{nullptr};
+  };
+
+  // Disabling the cache releases all the cached responses.
+  void set_config(const p4::server::v1::ReadCacheConfig &config);
+
+  bool enabled() const;
+
+  // To be called before the table is written to, by a writer with exclusive
+  // access to the table.
+  void bump(p4_id_t table_id);
+
+  // Invalidates all cached responses, e.g. when the P4 program changes.
+  void reset();
+
+  Lookup lookup(std::string key, const std::vector<p4_id_t> &table_ids);
+
+  void insert(Lookup &&lookup, Response response);
+
+  size_t size() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::vector<std::pair<p4_id_t, uint64_t> > generations;
+    uint64_t epoch;
+    Response response;
+    size_t bytes;
+  };
+  using EntryList = std::list<Entry>;
+
+  // acquire mutex first
+  uint64_t generation(p4_id_t table_id) const;
+  void erase(EntryList::iterator it);
+  void evict();
+
+  mutable std::mutex mutex{};
+  bool is_enabled{false};
+  uint32_t max_entries{kDefaultMaxEntries};
+  uint64_t max_bytes{kDefaultMaxBytes};
+  // bumped by reset, which is cheaper than clearing all the generations and
+  // ensures that generations are never reused
+  uint64_t epoch{0};
+  std::unordered_map<p4_id_t, uint64_t> generations{};
+  // most recently used first
+  EntryList entries{};
+  std::unordered_map<std::string, EntryList::iterator> index{};
+  uint64_t total_bytes{0};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_READ_CACHE_H_
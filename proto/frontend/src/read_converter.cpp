@@ -0,0 +1,204 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "read_converter.h"
+
+#include <PI/int/pi_int.h>
+#include <PI/pi.h>
+
+#include <cstdint>
+#include <cstring>  // for std::memcpy
+
+#include "google/rpc/code.pb.h"
+
+#include "report_error.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+namespace p4v1 = ::p4::v1;
+
+using Code = ::google::rpc::Code;
+using Status = ReadConverter::Status;
+
+using common::bytestring_pi_to_p4rt;
+
+namespace {
+
+bool is_all(const char *data, size_t n, char c) {
+  for (size_t i = 0; i < n; i++)
+    if (data[i] != c) return false;
+  return true;
+}
+
+}  // namespace
+
+Status
+ReadConverter::MatchKeyConverter::parse(const pi_match_key_t *match_key,
+                                        p4v1::TableEntry *entry) const {
+  auto priority = static_cast<int>(match_key->priority);
+  if (priority > 0) entry->set_priority(priority);
+  auto *match = entry->mutable_match();
+  match->Reserve(static_cast<int>(fields.size()));
+  for (const auto &field : fields) {
+    const char *src = match_key->data + field.offset;
+    auto nbytes = field.nbytes;
+    // don't care match fields are omitted, see parse_match_key
+    switch (field.match_type) {
+      case PI_P4INFO_MATCH_TYPE_VALID:
+        {
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          mf->mutable_exact()->mutable_value()->assign(
+              1, static_cast<char>((*src != 0) ? 1 : 0));
+        }
+        break;
+      case PI_P4INFO_MATCH_TYPE_EXACT:
+        {
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          bytestring_pi_to_p4rt(
+              src, nbytes, mf->mutable_exact()->mutable_value());
+        }
+        break;
+      case PI_P4INFO_MATCH_TYPE_LPM:
+        {
+          uint32_t pLen;
+          std::memcpy(&pLen, src + nbytes, sizeof(pLen));
+          if (pLen == 0) break;
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          auto *lpm = mf->mutable_lpm();
+          bytestring_pi_to_p4rt(src, nbytes, lpm->mutable_value());
+          lpm->set_prefix_len(static_cast<int32_t>(pLen));
+        }
+        break;
+      case PI_P4INFO_MATCH_TYPE_TERNARY:
+        {
+          const char *mask = src + nbytes;
+          if (is_all(mask, nbytes, 0)) break;
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          auto *ternary = mf->mutable_ternary();
+          bytestring_pi_to_p4rt(src, nbytes, ternary->mutable_value());
+          bytestring_pi_to_p4rt(mask, nbytes, ternary->mutable_mask());
+        }
+        break;
+      case PI_P4INFO_MATCH_TYPE_RANGE:
+        {
+          const char *high = src + nbytes;
+          if (is_all(src, nbytes, 0) && is_all(high, nbytes, '\xff')) break;
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          auto *range = mf->mutable_range();
+          bytestring_pi_to_p4rt(src, nbytes, range->mutable_low());
+          bytestring_pi_to_p4rt(high, nbytes, range->mutable_high());
+        }
+        break;
+      case PI_P4INFO_MATCH_TYPE_OPTIONAL:
+        {
+          // wildcard
+          if (src[nbytes] == 0) break;
+          auto *mf = match->Add();
+          mf->set_field_id(field.mf_id);
+          bytestring_pi_to_p4rt(
+              src, nbytes, mf->mutable_optional()->mutable_value());
+        }
+        break;
+      default:
+        RETURN_ERROR_STATUS(Code::INTERNAL, "Incorrect PI match type");
+    }
+  }
+  RETURN_OK_STATUS();
+}
+
+void
+ReadConverter::p4_change(const pi_p4info_t *p4info) {
+  tables.clear();
+  actions.clear();
+  if (p4info == nullptr) return;
+
+  for (auto t_id = pi_p4info_table_begin(p4info);
+       t_id != pi_p4info_table_end(p4info);
+       t_id = pi_p4info_table_next(p4info, t_id)) {
+    auto &converter = tables[t_id];
+    auto num_match_fields = pi_p4info_table_num_match_fields(p4info, t_id);
+    converter.fields.reserve(num_match_fields);
+    for (size_t j = 0; j < num_match_fields; j++) {
+      auto finfo = pi_p4info_table_match_field_info(p4info, t_id, j);
+      converter.fields.push_back(
+          {finfo->mf_id, finfo->match_type,
+           pi_p4info_table_match_field_offset(p4info, t_id, finfo->mf_id),
+           (finfo->bitwidth + 7) / 8});
+    }
+  }
+
+  for (auto a_id = pi_p4info_action_begin(p4info);
+       a_id != pi_p4info_action_end(p4info);
+       a_id = pi_p4info_action_next(p4info, a_id)) {
+    auto &converter = actions[a_id];
+    size_t num_params;
+    auto param_ids = pi_p4info_action_get_params(p4info, a_id, &num_params);
+    converter.params.reserve(num_params);
+    for (size_t j = 0; j < num_params; j++) {
+      auto bitwidth = pi_p4info_action_param_bitwidth(
+          p4info, a_id, param_ids[j]);
+      converter.params.push_back(
+          {param_ids[j],
+           pi_p4info_action_param_offset(p4info, a_id, param_ids[j]),
+           (bitwidth + 7) / 8});
+    }
+  }
+}
+
+const ReadConverter::MatchKeyConverter *
+ReadConverter::match_key_converter(p4_id_t table_id) const {
+  auto it = tables.find(table_id);
+  return (it == tables.end()) ? nullptr : &it->second;
+}
+
+Status
+ReadConverter::parse_action_data(const pi_action_data_t *action_data,
+                                 p4v1::Action *action) const {
+  auto action_id = action_data->action_id;
+  auto it = actions.find(action_id);
+  if (it == actions.end())
+    RETURN_ERROR_STATUS(Code::INTERNAL, "Unknown action id in action data");
+  action->set_action_id(action_id);
+  const auto &params = it->second.params;
+  auto *action_params = action->mutable_params();
+  action_params->Reserve(static_cast<int>(params.size()));
+  for (const auto &param : params) {
+    auto *p = action_params->Add();
+    p->set_param_id(param.param_id);
+    bytestring_pi_to_p4rt(action_data->data + param.offset, param.nbytes,
+                          p->mutable_value());
+  }
+  RETURN_OK_STATUS();
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
@@ -0,0 +1,104 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_READ_CONVERTER_H_
+#define SRC_READ_CONVERTER_H_
+
+#include <PI/pi.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "google/rpc/status.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+#include "common.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Converts the match keys and action data returned by the target to P4Runtime
+// messages when reading table entries and action profile members. This is
+// equivalent to parse_match_key (see match_key_helpers.h), but the layout of
+// each match key and action data (offset and size of each field) is computed
+// once when the P4 program is set, and the canonical P4Runtime bytestrings are
+// written directly to the Protobuf strings, without temporaries. This matters
+// for wildcard reads of large tables, for which the conversion used to dominate
+// the CPU usage.
+class ReadConverter {
+ public:
+  using p4_id_t = common::p4_id_t;
+  using Status = ::google::rpc::Status;
+
+  // Compiled converter for the match keys of one table.
+  class MatchKeyConverter {
+   public:
+    Status parse(const pi_match_key_t *match_key,
+                 p4::v1::TableEntry *entry) const;
+
+   private:
+    friend class ReadConverter;
+
+    struct Field {
+      p4_id_t mf_id;
+      pi_p4info_match_type_t match_type;
+      size_t offset;
+      size_t nbytes;
+    };
+
+    std::vector<Field> fields{};
+  };
+
+  // Builds the converters for all tables and actions in the P4 program;
+  // p4info can be nullptr.
+  void p4_change(const pi_p4info_t *p4info);
+
+  // Returns nullptr if the table does not exist. The returned pointer remains
+  // valid until the next call to p4_change.
+  const MatchKeyConverter *match_key_converter(p4_id_t table_id) const;
+
+  Status parse_action_data(const pi_action_data_t *action_data,
+                           p4::v1::Action *action) const;
+
+ private:
+  struct ActionDataConverter {
+    struct Param {
+      p4_id_t param_id;
+      size_t offset;
+      size_t nbytes;
+    };
+
+    std::vector<Param> params{};
+  };
+
+  std::unordered_map<p4_id_t, MatchKeyConverter> tables{};
+  std::unordered_map<p4_id_t, ActionDataConverter> actions{};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_READ_CONVERTER_H_
@@ -0,0 +1,806 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/frontends/proto/replication.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>  // std::move
+#include <vector>
+
+#include "google/rpc/code.pb.h"
+#include "p4/server/v1/replication.pb.h"
+
+#include "common.h"
+#include "logger.h"
+#include "report_error.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+namespace p4v1 = ::p4::v1;
+namespace p4serverv1 = ::p4::server::v1;
+
+using device_id_t = DeviceMgr::device_id_t;
+
+namespace {
+
+// max number of updates in a single WriteRequest when sending a snapshot to a
+// standby or when pushing the mirrored state to the target on takeover
+constexpr int max_updates_per_write = 1024;
+
+// Publishing blocks when that many bytes are waiting to be sent to the
+// standbys. Combined with the send timeout below, this bounds the memory used
+// for replication, as well as the time for which a stuck standby can stall the
+// primary.
+constexpr size_t max_pending_bytes = 64 * 1024 * 1024;
+constexpr int send_timeout_ms = 1000;
+
+// how many times the standby tries to reconnect to the primary after losing the
+// connection, before concluding that the primary is gone
+constexpr int reconnect_attempts = 3;
+constexpr std::chrono::milliseconds reconnect_interval(100);
+
+// Software copy of the state of a device, as written by the controller. Write
+// updates are applied to a journal which preserves the order in which entities
+// were first inserted, so that the state can be replayed in an order which
+// satisfies the dependencies between entities (e.g. action profile members are
+// inserted before the groups which refer to them).
+class StateMirror {
+ public:
+  void config_set(const p4serverv1::PipelineConfigUpdate &update) {
+    config.CopyFrom(update.config());
+    has_config = true;
+    if (!update.preserve_forwarding_state()) {
+      for (auto &journal : journals) journal.clear();
+    }
+  }
+
+  void write(const p4v1::WriteRequest &request) {
+    for (const auto &update : request.updates()) apply(update);
+  }
+
+  bool config_get(p4v1::ForwardingPipelineConfig *config_out) const {
+    if (!has_config) return false;
+    config_out->CopyFrom(config);
+    return true;
+  }
+
+  void updates_get(p4v1::WriteRequest *request) const {
+    for (const auto &journal : journals) {
+      for (const auto &update : journal.updates)
+        request->add_updates()->CopyFrom(update);
+    }
+  }
+
+  // appends the messages required to bring a new standby up-to-date
+  void snapshot(device_id_t device_id,
+                std::vector<p4serverv1::ReplicationMessage> *msgs) const {
+    if (!has_config) return;
+    msgs->emplace_back();
+    msgs->back().set_device_id(device_id);
+    auto *config_update = msgs->back().mutable_config();
+    config_update->mutable_config()->CopyFrom(config);
+    config_update->set_preserve_forwarding_state(false);
+    p4v1::WriteRequest *request = nullptr;
+    for (const auto &journal : journals) {
+      for (const auto &update : journal.updates) {
+        if (request == nullptr ||
+            request->updates_size() == max_updates_per_write) {
+          msgs->emplace_back();
+          msgs->back().set_device_id(device_id);
+          request = msgs->back().mutable_write();
+        }
+        request->add_updates()->CopyFrom(update);
+      }
+    }
+  }
+
+ private:
+  struct Journal {
+    void clear() {
+      updates.clear();
+      index.clear();
+    }
+
+    std::list<p4v1::Update> updates;
+    std::unordered_map<std::string, std::list<p4v1::Update>::iterator> index;
+  };
+
+  // Entities are replayed by increasing rank: a given entity can only refer to
+  // entities with a lower rank.
+  enum Rank {
+    RANK_INDEPENDENT = 0,
+    RANK_ACTION_PROFILE_MEMBER,
+    RANK_ACTION_PROFILE_GROUP,
+    RANK_TABLE_ENTRY,
+    RANK_RESOURCE,
+    NUM_RANKS
+  };
+
+  static Rank rank(const p4v1::Entity &entity) {
+    switch (entity.entity_case()) {
+      case p4v1::Entity::kActionProfileMember:
+        return RANK_ACTION_PROFILE_MEMBER;
+      case p4v1::Entity::kActionProfileGroup:
+        return RANK_ACTION_PROFILE_GROUP;
+      case p4v1::Entity::kTableEntry:
+        return RANK_TABLE_ENTRY;
+      case p4v1::Entity::kMeterEntry:
+      case p4v1::Entity::kDirectMeterEntry:
+      case p4v1::Entity::kCounterEntry:
+      case p4v1::Entity::kDirectCounterEntry:
+      case p4v1::Entity::kRegisterEntry:
+        return RANK_RESOURCE;
+      default:
+        return RANK_INDEPENDENT;
+    }
+  }
+
+  static std::string table_entry_key(const p4v1::TableEntry &table_entry) {
+    p4v1::TableEntry key;
+    key.set_table_id(table_entry.table_id());
+    key.set_priority(table_entry.priority());
+    key.set_is_default_action(table_entry.is_default_action());
+    // the order of match fields is not significant
+    std::vector<const p4v1::FieldMatch *> match;
+    for (const auto &mf : table_entry.match()) match.push_back(&mf);
+    std::sort(match.begin(), match.end(),
+              [](const p4v1::FieldMatch *m1, const p4v1::FieldMatch *m2) {
+                return m1->field_id() < m2->field_id();
+              });
+    for (const auto *mf : match) key.add_match()->CopyFrom(*mf);
+    return key.SerializeAsString();
+  }
+
+  // Identifies the entity, irrespective of the value written to it. The entity
+  // type is used as a prefix to avoid collisions between types.
+  static std::string entity_key(const p4v1::Entity &entity) {
+    std::string key(1, static_cast<char>(entity.entity_case()));
+    switch (entity.entity_case()) {
+      case p4v1::Entity::kTableEntry:
+        key.append(table_entry_key(entity.table_entry()));
+        break;
+      case p4v1::Entity::kActionProfileMember:
+        key.append(std::to_string(
+            entity.action_profile_member().action_profile_id()));
+        key.append(1, '/');
+        key.append(std::to_string(entity.action_profile_member().member_id()));
+        break;
+      case p4v1::Entity::kActionProfileGroup:
+        key.append(std::to_string(
+            entity.action_profile_group().action_profile_id()));
+        key.append(1, '/');
+        key.append(std::to_string(entity.action_profile_group().group_id()));
+        break;
+      case p4v1::Entity::kMeterEntry:
+        key.append(std::to_string(entity.meter_entry().meter_id()));
+        key.append(1, '/');
+        key.append(entity.meter_entry().index().SerializeAsString());
+        break;
+      case p4v1::Entity::kCounterEntry:
+        key.append(std::to_string(entity.counter_entry().counter_id()));
+        key.append(1, '/');
+        key.append(entity.counter_entry().index().SerializeAsString());
+        break;
+      case p4v1::Entity::kRegisterEntry:
+        key.append(std::to_string(entity.register_entry().register_id()));
+        key.append(1, '/');
+        key.append(entity.register_entry().index().SerializeAsString());
+        break;
+      case p4v1::Entity::kDirectMeterEntry:
+        key.append(table_entry_key(entity.direct_meter_entry().table_entry()));
+        break;
+      case p4v1::Entity::kDirectCounterEntry:
+        key.append(
+            table_entry_key(entity.direct_counter_entry().table_entry()));
+        break;
+      case p4v1::Entity::kPacketReplicationEngineEntry:
+        {
+          const auto &pre_entry = entity.packet_replication_engine_entry();
+          key.append(1, static_cast<char>(pre_entry.type_case()));
+          if (pre_entry.has_multicast_group_entry()) {
+            key.append(std::to_string(
+                pre_entry.multicast_group_entry().multicast_group_id()));
+          } else {
+            key.append(std::to_string(
+                pre_entry.clone_session_entry().session_id()));
+          }
+        }
+        break;
+      case p4v1::Entity::kValueSetEntry:
+        key.append(std::to_string(entity.value_set_entry().value_set_id()));
+        break;
+      case p4v1::Entity::kDigestEntry:
+        key.append(std::to_string(entity.digest_entry().digest_id()));
+        break;
+      case p4v1::Entity::kExternEntry:
+        key.append(std::to_string(entity.extern_entry().extern_type_id()));
+        key.append(1, '/');
+        key.append(std::to_string(entity.extern_entry().extern_id()));
+        break;
+      default:
+        break;
+    }
+    return key;
+  }
+
+  void erase(Journal *journal, const std::string &key) {
+    auto it = journal->index.find(key);
+    if (it == journal->index.end()) return;
+    journal->updates.erase(it->second);
+    journal->index.erase(it);
+  }
+
+  void apply(const p4v1::Update &update) {
+    const auto &entity = update.entity();
+    auto &journal = journals[rank(entity)];
+    auto key = entity_key(entity);
+    auto it = journal.index.find(key);
+    switch (update.type()) {
+      case p4v1::Update::INSERT:
+      case p4v1::Update::MODIFY:
+        // For a MODIFY, we keep the original position in the journal and the
+        // original update type, which is all that matters for the replay.
+        if (it != journal.index.end()) {
+          it->second->mutable_entity()->CopyFrom(entity);
+        } else {
+          journal.updates.push_back(update);
+          journal.index.emplace(std::move(key),
+                                std::prev(journal.updates.end()));
+        }
+        break;
+      case p4v1::Update::DELETE:
+        erase(&journal, key);
+        // direct resources go away with the table entry
+        if (entity.has_table_entry()) {
+          auto table_key = table_entry_key(entity.table_entry());
+          auto &resources = journals[RANK_RESOURCE];
+          erase(&resources,
+                std::string(1, static_cast<char>(
+                    p4v1::Entity::kDirectMeterEntry)) + table_key);
+          erase(&resources,
+                std::string(1, static_cast<char>(
+                    p4v1::Entity::kDirectCounterEntry)) + table_key);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  p4v1::ForwardingPipelineConfig config;
+  bool has_config{false};
+  std::array<Journal, NUM_RANKS> journals;
+};
+
+std::string make_frame(const p4serverv1::ReplicationMessage &msg) {
+  std::string frame(4, '\x00');
+  auto size = static_cast<uint32_t>(msg.ByteSizeLong());
+  for (int i = 0; i < 4; i++)
+    frame[3 - i] = static_cast<char>(size >> (i * 8));
+  msg.AppendToString(&frame);
+  return frame;
+}
+
+bool send_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    auto rc = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return false;
+    sent += static_cast<size_t>(rc);
+  }
+  return true;
+}
+
+bool recv_all(int fd, char *data, size_t size) {
+  size_t received = 0;
+  while (received < size) {
+    auto rc = recv(fd, data + received, size - received, 0);
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return false;
+    received += static_cast<size_t>(rc);
+  }
+  return true;
+}
+
+bool recv_frame(int fd, std::string *frame) {
+  unsigned char header[4];
+  if (!recv_all(fd, reinterpret_cast<char *>(header), sizeof(header)))
+    return false;
+  uint32_t size = 0;
+  for (int i = 0; i < 4; i++) size = (size << 8) | header[i];
+  frame->resize(size);
+  return recv_all(fd, &(*frame)[0], size);
+}
+
+bool make_sockaddr(const std::string &socket_path, struct sockaddr_un *addr) {
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr->sun_path)) return false;
+  std::strncpy(addr->sun_path, socket_path.c_str(), sizeof(addr->sun_path));
+  return true;
+}
+
+int connect_to(const std::string &socket_path) {
+  struct sockaddr_un addr;
+  if (!make_sockaddr(socket_path, &addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+class ReplicationPublisherImp {
+ public:
+  explicit ReplicationPublisherImp(const std::string &socket_path)
+      : socket_path(socket_path) { }
+
+  ~ReplicationPublisherImp() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    can_send.notify_one();
+    can_publish.notify_all();
+    if (listen_fd >= 0) shutdown(listen_fd, SHUT_RDWR);
+    if (accept_thread.joinable()) accept_thread.join();
+    if (sender_thread.joinable()) sender_thread.join();
+    for (auto fd : subscribers) close(fd);
+    if (listen_fd >= 0) {
+      close(listen_fd);
+      unlink(socket_path.c_str());
+    }
+  }
+
+  Status start() {
+    struct sockaddr_un addr;
+    if (!make_sockaddr(socket_path, &addr)) {
+      RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                          "Replication socket path '{}' is too long",
+                          socket_path);
+    }
+    // a previous primary may have left a stale socket file behind
+    unlink(socket_path.c_str());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(listen_fd, 4) != 0) {
+      auto error = errno;
+      if (listen_fd >= 0) close(listen_fd);
+      listen_fd = -1;
+      RETURN_ERROR_STATUS(Code::UNAVAILABLE,
+                          "Cannot listen on replication socket '{}': {}",
+                          socket_path, std::strerror(error));
+    }
+    accept_thread = std::thread(&ReplicationPublisherImp::accept_loop, this);
+    sender_thread = std::thread(&ReplicationPublisherImp::sender_loop, this);
+    Logger::get()->info("Publishing state on replication socket '{}'",
+                        socket_path);
+    RETURN_OK_STATUS();
+  }
+
+  void publish_config(device_id_t device_id,
+                      const p4v1::ForwardingPipelineConfig &config,
+                      bool preserve_forwarding_state) {
+    p4serverv1::ReplicationMessage msg;
+    msg.set_device_id(device_id);
+    auto *config_update = msg.mutable_config();
+    config_update->mutable_config()->CopyFrom(config);
+    config_update->set_preserve_forwarding_state(preserve_forwarding_state);
+    std::unique_lock<std::mutex> lock(mutex);
+    wait_for_room(&lock);
+    mirrors[device_id].config_set(*config_update);
+    broadcast(msg);
+  }
+
+  void publish_write(device_id_t device_id,
+                     const p4v1::WriteRequest &request,
+                     const Status &status) {
+    p4serverv1::ReplicationMessage msg;
+    msg.set_device_id(device_id);
+    auto *write = msg.mutable_write();
+    if (IS_OK(status)) {
+      write->mutable_updates()->CopyFrom(request.updates());
+    } else if (status.details_size() == request.updates_size()) {
+      // one p4v1::Error per update, see P4ErrorReporter
+      for (int i = 0; i < request.updates_size(); i++) {
+        p4v1::Error error;
+        if (status.details(i).UnpackTo(&error) &&
+            error.canonical_code() == Code::OK) {
+          write->add_updates()->CopyFrom(request.updates(i));
+        }
+      }
+    }
+    if (write->updates_size() == 0) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    wait_for_room(&lock);
+    mirrors[device_id].write(*write);
+    broadcast(msg);
+  }
+
+  size_t num_subscribers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return subscriber_count;
+  }
+
+ private:
+  struct Frame {
+    std::string data;
+    // if >= 0, the frame is the snapshot for this new subscriber, which is
+    // added to the list of subscribers once the snapshot has been sent
+    int new_subscriber_fd;
+  };
+
+  void wait_for_room(std::unique_lock<std::mutex> *lock) {
+    can_publish.wait(*lock, [this] {
+        return stopping || pending_bytes < max_pending_bytes; });
+  }
+
+  void enqueue(std::string data, int new_subscriber_fd) {
+    pending_bytes += data.size();
+    frames.push_back({std::move(data), new_subscriber_fd});
+    can_send.notify_one();
+  }
+
+  void broadcast(const p4serverv1::ReplicationMessage &msg) {
+    if (subscriber_count == 0) return;
+    enqueue(make_frame(msg), -1);
+  }
+
+  void accept_loop() {
+    pi_thread_start("replication");
+    while (true) {
+      int fd = accept(listen_fd, nullptr, nullptr);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        break;
+      }
+      struct timeval timeout;
+      timeout.tv_sec = send_timeout_ms / 1000;
+      timeout.tv_usec = (send_timeout_ms % 1000) * 1000;
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      std::vector<p4serverv1::ReplicationMessage> msgs;
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) {
+        close(fd);
+        break;
+      }
+      // The snapshot is taken under the lock, which guarantees that the
+      // subscriber will receive every update published after it.
+      for (const auto &p : mirrors) p.second.snapshot(p.first, &msgs);
+      msgs.emplace_back();
+      msgs.back().set_snapshot_end(true);
+      std::string data;
+      for (const auto &msg : msgs) data.append(make_frame(msg));
+      subscriber_count++;
+      enqueue(std::move(data), fd);
+      Logger::get()->info("New standby connected to replication socket");
+    }
+  }
+
+  void sender_loop() {
+    pi_thread_start("replication");
+    while (true) {
+      Frame frame;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        can_send.wait(lock, [this] { return stopping || !frames.empty(); });
+        if (frames.empty()) break;
+        frame = std::move(frames.front());
+        frames.pop_front();
+        pending_bytes -= frame.data.size();
+      }
+      can_publish.notify_all();
+      size_t num_dropped = 0;
+      if (frame.new_subscriber_fd >= 0) {
+        if (send_all(frame.new_subscriber_fd, frame.data)) {
+          subscribers.push_back(frame.new_subscriber_fd);
+        } else {
+          close(frame.new_subscriber_fd);
+          num_dropped++;
+        }
+      } else {
+        auto it = subscribers.begin();
+        while (it != subscribers.end()) {
+          if (send_all(*it, frame.data)) {
+            ++it;
+          } else {
+            close(*it);
+            it = subscribers.erase(it);
+            num_dropped++;
+          }
+        }
+      }
+      if (num_dropped > 0) {
+        Logger::get()->warn("Dropping {} unresponsive standby(s)", num_dropped);
+        std::lock_guard<std::mutex> lock(mutex);
+        subscriber_count -= num_dropped;
+      }
+    }
+  }
+
+  std::string socket_path;
+  int listen_fd{-1};
+  std::thread accept_thread;
+  std::thread sender_thread;
+
+  mutable std::mutex mutex{};
+  std::condition_variable can_send{};
+  std::condition_variable can_publish{};
+  std::unordered_map<device_id_t, StateMirror> mirrors{};
+  std::deque<Frame> frames{};
+  size_t pending_bytes{0};
+  // includes the subscribers for which the snapshot is still pending
+  size_t subscriber_count{0};
+  bool stopping{false};
+
+  // only accessed by the sender thread
+  std::vector<int> subscribers{};
+};
+
+class ReplicationSubscriberImp {
+ public:
+  explicit ReplicationSubscriberImp(const std::string &socket_path)
+      : socket_path(socket_path) { }
+
+  Status run() {
+    int fd = connect_();
+    if (fd < 0) {
+      RETURN_ERROR_STATUS(Code::UNAVAILABLE,
+                          "Cannot connect to primary on socket '{}'",
+                          socket_path);
+    }
+    while (true) {
+      receive(fd);
+      disconnect_(fd);
+      if (stopped) break;
+      fd = -1;
+      for (int i = 0; i < reconnect_attempts && fd < 0 && !stopped; i++) {
+        std::this_thread::sleep_for(reconnect_interval);
+        fd = connect_();
+      }
+      if (fd < 0) break;
+      Logger::get()->info("Reconnected to primary");
+    }
+    Logger::get()->info("Primary is gone, standby can take over");
+    RETURN_OK_STATUS();
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    if (current_fd >= 0) shutdown(current_fd, SHUT_RDWR);
+  }
+
+  std::vector<device_id_t> devices() const {
+    std::vector<device_id_t> device_ids;
+    std::lock_guard<std::mutex> lock(mutex);
+    p4v1::ForwardingPipelineConfig config;
+    for (const auto &p : mirrors) {
+      if (p.second.config_get(&config)) device_ids.push_back(p.first);
+    }
+    std::sort(device_ids.begin(), device_ids.end());
+    return device_ids;
+  }
+
+  Status state_get(device_id_t device_id,
+                   p4v1::ForwardingPipelineConfig *config,
+                   p4v1::WriteRequest *state) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = mirrors.find(device_id);
+    if (it == mirrors.end() || !it->second.config_get(config)) {
+      RETURN_ERROR_STATUS(Code::NOT_FOUND,
+                          "No mirrored state for device {}", device_id);
+    }
+    state->set_device_id(device_id);
+    it->second.updates_get(state);
+    RETURN_OK_STATUS();
+  }
+
+ private:
+  int connect_() {
+    int fd = connect_to(socket_path);
+    if (fd < 0) return fd;
+    std::lock_guard<std::mutex> lock(mutex);
+    current_fd = fd;
+    return fd;
+  }
+
+  void disconnect_(int fd) {
+    std::lock_guard<std::mutex> lock(mutex);
+    current_fd = -1;
+    close(fd);
+  }
+
+  // The state received before the end of the snapshot is applied to a staging
+  // copy, so that losing the connection in the middle of a resync does not
+  // leave us with a partial state.
+  void receive(int fd) {
+    std::unordered_map<device_id_t, StateMirror> staging;
+    bool synced = false;
+    std::string frame;
+    p4serverv1::ReplicationMessage msg;
+    while (recv_frame(fd, &frame)) {
+      if (!msg.ParseFromString(frame)) {
+        Logger::get()->error("Invalid message on replication socket");
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (msg.update_case() == p4serverv1::ReplicationMessage::kSnapshotEnd) {
+        mirrors.swap(staging);
+        staging.clear();
+        synced = true;
+        continue;
+      }
+      auto &mirror = synced ? mirrors[msg.device_id()]
+                            : staging[msg.device_id()];
+      if (msg.has_config())
+        mirror.config_set(msg.config());
+      else if (msg.has_write())
+        mirror.write(msg.write());
+    }
+  }
+
+  std::string socket_path;
+  mutable std::mutex mutex{};
+  std::unordered_map<device_id_t, StateMirror> mirrors{};
+  int current_fd{-1};
+  std::atomic<bool> stopped{false};
+};
+
+ReplicationPublisher::ReplicationPublisher(const std::string &socket_path)
+    : pimp(new ReplicationPublisherImp(socket_path)) { }
+
+ReplicationPublisher::~ReplicationPublisher() = default;
+
+Status
+ReplicationPublisher::start() {
+  return pimp->start();
+}
+
+void
+ReplicationPublisher::publish_config(
+    device_id_t device_id, const p4v1::ForwardingPipelineConfig &config,
+    bool preserve_forwarding_state) {
+  pimp->publish_config(device_id, config, preserve_forwarding_state);
+}
+
+void
+ReplicationPublisher::publish_write(device_id_t device_id,
+                                    const p4v1::WriteRequest &request,
+                                    const Status &status) {
+  pimp->publish_write(device_id, request, status);
+}
+
+size_t
+ReplicationPublisher::num_subscribers() const {
+  return pimp->num_subscribers();
+}
+
+ReplicationSubscriber::ReplicationSubscriber(const std::string &socket_path)
+    : pimp(new ReplicationSubscriberImp(socket_path)) { }
+
+ReplicationSubscriber::~ReplicationSubscriber() = default;
+
+Status
+ReplicationSubscriber::run() {
+  return pimp->run();
+}
+
+void
+ReplicationSubscriber::stop() {
+  pimp->stop();
+}
+
+std::vector<device_id_t>
+ReplicationSubscriber::devices() const {
+  return pimp->devices();
+}
+
+Status
+ReplicationSubscriber::state_get(device_id_t device_id,
+                                 p4v1::ForwardingPipelineConfig *config,
+                                 p4v1::WriteRequest *state) const {
+  return pimp->state_get(device_id, config, state);
+}
+
+Status
+ReplicationSubscriber::takeover(device_id_t device_id,
+                                DeviceMgr *device_mgr) const {
+  p4v1::ForwardingPipelineConfig config;
+  p4v1::WriteRequest state;
+  RETURN_IF_ERROR(state_get(device_id, &config, &state));
+  Logger::get()->info(
+      "Taking over device {}, replaying {} mirrored entities",
+      device_id, state.updates_size());
+  // The config is only saved and the mirrored state is written on top of it
+  // before the commit, so that the target keeps forwarding with its current
+  // state until the new one is fully loaded. VERIFY_AND_COMMIT would reset the
+  // dataplane, breaking forwarding until the replay completes.
+  using SetConfigRequest = p4v1::SetForwardingPipelineConfigRequest;
+  RETURN_IF_ERROR(device_mgr->pipeline_config_set(
+      SetConfigRequest::VERIFY_AND_SAVE, config));
+  // the updates are already sorted so that dependencies are satisfied
+  int num_errors = 0;
+  auto *updates = state.mutable_updates();
+  for (int start = 0; start < updates->size();
+       start += max_updates_per_write) {
+    auto end = std::min(start + max_updates_per_write, updates->size());
+    p4v1::WriteRequest request;
+    request.set_device_id(device_id);
+    for (int i = start; i < end; i++)
+      request.add_updates()->Swap(updates->Mutable(i));
+    auto status = device_mgr->write(request);
+    if (IS_OK(status)) continue;
+    if (status.details_size() != request.updates_size()) {
+      num_errors += request.updates_size();
+      continue;
+    }
+    for (const auto &detail : status.details()) {
+      p4v1::Error error;
+      if (!detail.UnpackTo(&error) || error.canonical_code() != Code::OK)
+        num_errors++;
+    }
+  }
+  // we commit even if some entities could not be replayed, so that the device
+  // is not left with a pending update
+  RETURN_IF_ERROR(device_mgr->pipeline_config_set(
+      SetConfigRequest::COMMIT, p4v1::ForwardingPipelineConfig()));
+  if (num_errors > 0) {
+    RETURN_ERROR_STATUS(Code::UNKNOWN,
+                        "{} mirrored entities could not be replayed on device "
+                        "{}", num_errors, device_id);
+  }
+  RETURN_OK_STATUS();
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
@@ -0,0 +1,194 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "scheduler.h"
+
+#include <array>
+#include <chrono>
+#include <mutex>
+
+#include "report_error.h"
+
+namespace p4serverv1 = ::p4::server::v1;
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+/* static */ constexpr size_t Scheduler::kNumClasses;
+/* static */ constexpr uint32_t Scheduler::kDefaultSmallWriteMaxUpdates;
+/* static */ constexpr uint32_t Scheduler::kDefaultBulkWriteChunkSize;
+/* static */ constexpr uint32_t Scheduler::kDefaultMaxPreemptionMs;
+
+Scheduler::Ticket::Ticket(Scheduler *scheduler, PriorityClass priority_class)
+    : scheduler((scheduler != nullptr && scheduler->enabled) ?
+                scheduler : nullptr),
+      priority_class(priority_class),
+      wait_start(Clock::now()) {
+  if (this->scheduler == nullptr) return;
+  this->scheduler->pending[priority_class]++;
+  this->scheduler->stats[priority_class].num_requests++;
+  this->scheduler->wait(priority_class);
+}
+
+Scheduler::Ticket::~Ticket() {
+  if (scheduler != nullptr) scheduler->release(priority_class);
+}
+
+bool
+Scheduler::Ticket::preempted() const {
+  return (scheduler != nullptr) &&
+      scheduler->more_urgent_pending(priority_class);
+}
+
+void
+Scheduler::Ticket::yield() {
+  if (scheduler == nullptr) return;
+  scheduler->stats[priority_class].num_preemptions++;
+  wait_start = Clock::now();
+  scheduler->wait(priority_class);
+}
+
+void
+Scheduler::Ticket::admitted() {
+  if (scheduler == nullptr) return;
+  scheduler->record_delay(priority_class, Clock::now() - wait_start);
+}
+
+size_t
+Scheduler::Ticket::chunk_size() const {
+  return (scheduler == nullptr) ?
+      kDefaultBulkWriteChunkSize : scheduler->bulk_write_chunk_size.load();
+}
+
+Scheduler::Scheduler() {
+  for (size_t i = 0; i < kNumClasses; i++) {
+    ranks[i] = static_cast<uint32_t>(i);
+    pending[i] = 0;
+  }
+}
+
+Status
+Scheduler::set_config(const SchedulingConfig &config) {
+  std::array<uint32_t, kNumClasses> new_ranks;
+  for (size_t i = 0; i < kNumClasses; i++)
+    new_ranks[i] = static_cast<uint32_t>(i);
+  for (const auto &class_config : config.classes()) {
+    if (!SchedulingConfig::PriorityClass_IsValid(
+            class_config.priority_class())) {
+      RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                          "Invalid priority class {} in scheduling config",
+                          class_config.priority_class());
+    }
+    new_ranks[class_config.priority_class()] = class_config.rank();
+  }
+
+  auto value_or = [](uint32_t v, uint32_t default_v) {
+    return (v == 0) ? default_v : v;
+  };
+  enabled = !config.disabled();
+  small_write_max_updates = value_or(
+      config.small_write_max_updates(), kDefaultSmallWriteMaxUpdates);
+  bulk_write_chunk_size = value_or(
+      config.bulk_write_chunk_size(), kDefaultBulkWriteChunkSize);
+  max_preemption_ms = value_or(
+      config.max_preemption_ms(), kDefaultMaxPreemptionMs);
+  for (size_t i = 0; i < kNumClasses; i++) ranks[i] = new_ranks[i];
+  // the ranks may have changed, in which case some waiters may be able to
+  // proceed
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_all();
+  }
+  RETURN_OK_STATUS();
+}
+
+Scheduler::PriorityClass
+Scheduler::write_class(size_t num_updates) const {
+  return (num_updates <= small_write_max_updates) ?
+      SchedulingConfig::SMALL_WRITE : SchedulingConfig::BULK_WRITE;
+}
+
+void
+Scheduler::stats_get(p4serverv1::SchedulingStats *stats_) const {
+  for (size_t i = 0; i < kNumClasses; i++) {
+    const auto &class_stats = stats[i];
+    auto entry = stats_->add_classes();
+    entry->set_priority_class(static_cast<PriorityClass>(i));
+    entry->set_num_requests(class_stats.num_requests);
+    entry->set_num_preemptions(class_stats.num_preemptions);
+    entry->set_total_queueing_delay_us(
+        class_stats.total_queueing_delay_ns / 1000);
+    entry->set_max_queueing_delay_us(class_stats.max_queueing_delay_ns / 1000);
+  }
+}
+
+bool
+Scheduler::more_urgent_pending(PriorityClass priority_class) const {
+  auto rank = ranks[priority_class].load(std::memory_order_relaxed);
+  for (size_t i = 0; i < kNumClasses; i++) {
+    if (ranks[i].load(std::memory_order_relaxed) < rank && pending[i] > 0)
+      return true;
+  }
+  return false;
+}
+
+void
+Scheduler::wait(PriorityClass priority_class) {
+  if (!more_urgent_pending(priority_class)) return;
+  auto deadline = Clock::now() + std::chrono::milliseconds(max_preemption_ms);
+  std::unique_lock<std::mutex> lock(mutex);
+  // waiters is incremented before the condition is checked with the mutex held,
+  // which guarantees that release() will not miss this waiter
+  waiters++;
+  cv.wait_until(lock, deadline, [this, priority_class]() -> bool {
+      return !more_urgent_pending(priority_class);
+  });
+  waiters--;
+}
+
+void
+Scheduler::release(PriorityClass priority_class) {
+  pending[priority_class]--;
+  if (waiters > 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_all();
+  }
+}
+
+void
+Scheduler::record_delay(PriorityClass priority_class, Clock::duration delay) {
+  auto &class_stats = stats[priority_class];
+  auto delay_ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count());
+  class_stats.total_queueing_delay_ns += delay_ns;
+  auto max_ns = class_stats.max_queueing_delay_ns.load();
+  while (delay_ns > max_ns &&
+         !class_stats.max_queueing_delay_ns.compare_exchange_weak(
+             max_ns, delay_ns)) { }
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
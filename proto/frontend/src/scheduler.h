@@ -0,0 +1,133 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_SCHEDULER_H_
+#define SRC_SCHEDULER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "p4/server/v1/config.pb.h"
+
+#include "common.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Prioritizes latency-sensitive operations (watch port failover, small writes)
+// over bulk operations, see p4::server::v1::SchedulingConfig.
+// Every operation holds a Ticket for its priority class, which is obtained
+// before requesting access from AccessArbitration. Obtaining a Ticket blocks as
+// long as there is pending work in a more urgent class. Long-running operations
+// check whether they have been preempted at regular intervals, in which case
+// they give up their access (see AccessArbitration::WriteAccess::yield) until
+// the more urgent work has completed.
+class Scheduler {
+ public:
+  using SchedulingConfig = p4::server::v1::SchedulingConfig;
+  using PriorityClass = SchedulingConfig::PriorityClass;
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kNumClasses =
+      SchedulingConfig::PriorityClass_ARRAYSIZE;
+
+  static constexpr uint32_t kDefaultSmallWriteMaxUpdates = 16;
+  static constexpr uint32_t kDefaultBulkWriteChunkSize = 128;
+  static constexpr uint32_t kDefaultMaxPreemptionMs = 500;
+
+  class Ticket {
+   public:
+    Ticket(Scheduler *scheduler, PriorityClass priority_class);
+    ~Ticket();
+
+    Ticket(const Ticket &) = delete;
+    Ticket &operator=(const Ticket &) = delete;
+
+    // Cheap check, which can be performed frequently.
+    bool preempted() const;
+
+    // Blocks until the more urgent work has completed, or until
+    // max_preemption_ms has elapsed. The caller must have given up its access
+    // first.
+    void yield();
+
+    // To be called once access has been obtained from AccessArbitration
+    // (initially and after each yield); records the queueing delay.
+    void admitted();
+
+    // Number of updates between calls to preempted() for bulk writes.
+    size_t chunk_size() const;
+
+   private:
+    Scheduler *scheduler;
+    PriorityClass priority_class;
+    Clock::time_point wait_start;
+  };
+
+  Scheduler();
+
+  // Leaves the current configuration unchanged if the new one is invalid.
+  Status set_config(const SchedulingConfig &config);
+
+  PriorityClass write_class(size_t num_updates) const;
+
+  void stats_get(p4::server::v1::SchedulingStats *stats) const;
+
+ private:
+  struct ClassStats {
+    std::atomic<uint64_t> num_requests{0};
+    std::atomic<uint64_t> num_preemptions{0};
+    std::atomic<uint64_t> total_queueing_delay_ns{0};
+    std::atomic<uint64_t> max_queueing_delay_ns{0};
+  };
+
+  bool more_urgent_pending(PriorityClass priority_class) const;
+  void wait(PriorityClass priority_class);
+  void release(PriorityClass priority_class);
+  void record_delay(PriorityClass priority_class, Clock::duration delay);
+
+  std::atomic<bool> enabled{true};
+  std::atomic<uint32_t> small_write_max_updates{kDefaultSmallWriteMaxUpdates};
+  std::atomic<uint32_t> bulk_write_chunk_size{kDefaultBulkWriteChunkSize};
+  std::atomic<uint32_t> max_preemption_ms{kDefaultMaxPreemptionMs};
+  std::array<std::atomic<uint32_t>, kNumClasses> ranks;
+  // number of tickets in each class, whether they are waiting or not
+  std::array<std::atomic<int>, kNumClasses> pending;
+  std::array<ClassStats, kNumClasses> stats;
+
+  mutable std::mutex mutex;
+  mutable std::condition_variable cv;
+  std::atomic<int> waiters{0};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_SCHEDULER_H_
@@ -0,0 +1,193 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_SMALL_VECTOR_H_
+#define SRC_SMALL_VECTOR_H_
+
+#include <cstdint>
+#include <cstring>  // for std::memcpy
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// A vector which stores up to N elements inline, without any heap
+// allocation. Only supports trivially copyable types, which are moved around
+// with memcpy. This is used for per-member state which almost always has a
+// single element (e.g. the handles of a member which is never used with a
+// weight greater than 1), where a std::vector would cost 24 bytes plus a heap
+// allocation.
+template <typename T, size_t N>
+class SmallVector {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SmallVector only supports trivially copyable types");
+  static_assert(N > 0, "SmallVector needs room for at least one element");
+
+ public:
+  using value_type = T;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  SmallVector() { }
+
+  SmallVector(const SmallVector &other) {
+    reserve(other.size_);
+    copy_elements(other.data(), other.size_);
+  }
+
+  SmallVector(SmallVector &&other) noexcept {
+    steal(&other);
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this == &other) return *this;
+    size_ = 0;
+    reserve(other.size_);
+    copy_elements(other.data(), other.size_);
+    return *this;
+  }
+
+  SmallVector &operator=(SmallVector &&other) noexcept {
+    if (this == &other) return *this;
+    release();
+    steal(&other);
+    return *this;
+  }
+
+  ~SmallVector() { release(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+
+  T *data() { return is_inline() ? inline_data : heap_data; }
+  const T *data() const { return is_inline() ? inline_data : heap_data; }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+
+  T &operator[](size_t i) { return data()[i]; }
+  const T &operator[](size_t i) const { return data()[i]; }
+
+  T &at(size_t i) {
+    if (i >= size_) throw std::out_of_range("SmallVector::at");
+    return data()[i];
+  }
+  const T &at(size_t i) const {
+    if (i >= size_) throw std::out_of_range("SmallVector::at");
+    return data()[i];
+  }
+
+  T &front() { return data()[0]; }
+  const T &front() const { return data()[0]; }
+  T &back() { return data()[size_ - 1]; }
+  const T &back() const { return data()[size_ - 1]; }
+
+  void push_back(const T &v) {
+    if (size_ == capacity_) reserve(2 * capacity_);
+    data()[size_++] = v;
+  }
+
+  void pop_back() { size_--; }
+
+  iterator insert(const_iterator pos, const T &v) {
+    auto idx = static_cast<size_t>(pos - begin());
+    T tmp = v;  // v may be an element of the vector
+    if (size_ == capacity_) reserve(2 * capacity_);
+    auto *d = data();
+    std::memmove(d + idx + 1, d + idx, (size_ - idx) * sizeof(T));
+    d[idx] = tmp;
+    size_++;
+    return d + idx;
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    auto idx = static_cast<size_t>(first - begin());
+    auto count = static_cast<size_t>(last - first);
+    auto *d = data();
+    std::memmove(d + idx, d + idx + count, (size_ - idx - count) * sizeof(T));
+    size_ -= count;
+    return d + idx;
+  }
+
+  void clear() { size_ = 0; }
+
+  void reserve(size_t new_capacity) {
+    if (new_capacity <= capacity_) return;
+    auto *new_data = static_cast<T *>(::operator new(new_capacity * sizeof(T)));
+    std::memcpy(new_data, data(), size_ * sizeof(T));
+    release();
+    heap_data = new_data;
+    capacity_ = static_cast<uint32_t>(new_capacity);
+  }
+
+  // memory allocated on the heap, not including sizeof(SmallVector)
+  size_t heap_memory_usage() const {
+    return is_inline() ? 0 : capacity_ * sizeof(T);
+  }
+
+ private:
+  bool is_inline() const { return capacity_ == N; }
+
+  void copy_elements(const T *src, size_t n) {
+    std::memcpy(data(), src, n * sizeof(T));
+    size_ = static_cast<uint32_t>(n);
+  }
+
+  void release() {
+    if (!is_inline()) ::operator delete(heap_data);
+    capacity_ = N;
+  }
+
+  // assumes that the current storage has been released
+  void steal(SmallVector *other) {
+    if (other->is_inline()) {
+      std::memcpy(inline_data, other->inline_data, other->size_ * sizeof(T));
+    } else {
+      heap_data = other->heap_data;
+      capacity_ = other->capacity_;
+      other->capacity_ = N;
+    }
+    size_ = other->size_;
+    other->size_ = 0;
+  }
+
+  union {
+    T inline_data[N];
+    T *heap_data;
+  };
+  uint32_t size_{0};
+  uint32_t capacity_{N};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_SMALL_VECTOR_H_
@@ -21,13 +21,18 @@
 #ifndef SRC_TASK_QUEUE_H_
 #define SRC_TASK_QUEUE_H_
 
+#include <PI/pi.h>
+
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <utility>  // for std::move
 #include <vector>
 
@@ -63,26 +68,51 @@ class CancellableTask : public TaskIface {
 template <typename Clock>
 class TaskQueue {
  public:
+  // Tasks can be tagged with an owner, which lets several components share the
+  // same queue (see TaskQueueHandle): purge(owner) drops the pending tasks of
+  // one owner without affecting the other ones.
+  using Owner = const void *;
+
   TaskQueue() = default;
 
   void execute() {
+    {
+      Lock lock(m);
+      executing_thread = std::this_thread::get_id();
+    }
     while (true) {
       std::unique_ptr<TaskIface> task;
       {
         Lock lock(m);
         while (!stop_processing &&
-               (queue.empty() || queue.top().execute_tp > Clock::now())) {
-          if (queue.empty())
+               (queue.empty() || queue.front().execute_tp > Clock::now())) {
+          if (queue.empty()) {
             cv.wait(lock);
-          else
-            cv.wait_until(lock, queue.top().execute_tp);
+          } else {
+            // the time point is copied as the first element may be purged
+            // while we are waiting
+            auto execute_tp = queue.front().execute_tp;
+            cv.wait_until(lock, execute_tp);
+          }
         }
         if (stop_processing) return;
-        // http://stackoverflow.com/questions/20149471/move-out-element-of-std-priority-queue-in-c11
-        task = std::move(const_cast<QueueE &>(queue.top()).task);
-        queue.pop();
+        std::pop_heap(queue.begin(), queue.end(), QueueEComp());
+        auto &e = queue.back();
+        task = std::move(e.task);
+        running_owner = e.owner;
+        if (e.owner != nullptr && --owner_sizes[e.owner] == 0)
+          owner_sizes.erase(e.owner);
+        queue.pop_back();
       }
       if (!task->cancelled()) (*task)();
+      // the task may reference resources of its owner, so it needs to be
+      // destroyed before we notify purge()
+      task.reset();
+      {
+        Lock lock(m);
+        running_owner = nullptr;
+        if (num_purging > 0) cv_idle.notify_all();
+      }
     }
   }
 
@@ -92,42 +122,66 @@ class TaskQueue {
     cv.notify_one();
   }
 
-  size_t execute_task(std::unique_ptr<TaskIface> task) {
-    return push_task(std::move(task), Clock::now());
+  // Drops all the pending tasks for owner and waits for the completion of the
+  // task currently being executed for owner, if any. Tasks pushed by that task
+  // (e.g. a periodic task re-arming itself) are dropped as well.
+  void purge(Owner owner) {
+    Lock lock(m);
+    remove_tasks(owner);
+    // a task may purge its own owner, in which case waiting would deadlock
+    if (std::this_thread::get_id() == executing_thread) return;
+    num_purging++;
+    cv_idle.wait(lock, [this, owner] { return running_owner != owner; });
+    num_purging--;
+    remove_tasks(owner);
+  }
+
+  size_t execute_task(std::unique_ptr<TaskIface> task,
+                      Owner owner = nullptr) {
+    return push_task(std::move(task), Clock::now(), owner);
   }
 
+  // max_size applies to the tasks of the given owner if one is provided, to
+  // the whole queue otherwise
   size_t execute_task_or_drop(std::unique_ptr<TaskIface> task,
-                              size_t max_size) {
-    return push_task_or_drop(std::move(task), Clock::now(), max_size);
+                              size_t max_size,
+                              Owner owner = nullptr) {
+    return push_task_or_drop(std::move(task), Clock::now(), max_size, owner);
   }
 
   size_t execute_task_at(std::unique_ptr<TaskIface> task,
-                         const typename Clock::time_point &tp) {
-    return push_task(std::move(task), tp);
+                         const typename Clock::time_point &tp,
+                         Owner owner = nullptr) {
+    return push_task(std::move(task), tp, owner);
   }
 
   template <typename Rep, typename Period>
   size_t execute_task_in(std::unique_ptr<TaskIface> task,
-                         const std::chrono::duration<Rep, Period> &duration) {
-    return push_task(std::move(task), Clock::now() + duration);
+                         const std::chrono::duration<Rep, Period> &duration,
+                         Owner owner = nullptr) {
+    return push_task(std::move(task), Clock::now() + duration, owner);
   }
 
   template <typename Rep, typename Period>
   size_t execute_periodic_task(
       std::unique_ptr<TaskIface> task,
       const std::chrono::duration<Rep, Period> &interval,
-      bool wait_first = false) {
+      bool wait_first = false,
+      Owner owner = nullptr) {
     struct PeriodicTask : public TaskIface {
       PeriodicTask(TaskQueue *tqueue,
                    std::unique_ptr<TaskIface> user_task,
-                   const std::chrono::duration<Rep, Period> &interval)
+                   const std::chrono::duration<Rep, Period> &interval,
+                   Owner owner)
           : tqueue(tqueue),
             user_task(std::move(user_task)),
-            interval(interval) { }
+            interval(interval),
+            owner(owner) { }
 
       void operator()() override {
         (*user_task)();
-        tqueue->execute_periodic_task(std::move(user_task), interval, true);
+        tqueue->execute_periodic_task(
+            std::move(user_task), interval, true, owner);
       }
 
       bool cancelled() override {
@@ -137,14 +191,15 @@ class TaskQueue {
       TaskQueue *tqueue;
       std::unique_ptr<TaskIface> user_task;
       const std::chrono::duration<Rep, Period> interval;
+      Owner owner;
     };
 
     std::unique_ptr<TaskIface> timer_task(new PeriodicTask(
-        this, std::move(task), interval));
+        this, std::move(task), interval, owner));
     if (wait_first)
-      return push_task(std::move(timer_task), Clock::now() + interval);
+      return push_task(std::move(timer_task), Clock::now() + interval, owner);
     else
-      return push_task(std::move(timer_task), Clock::now());
+      return push_task(std::move(timer_task), Clock::now(), owner);
   }
 
   TaskQueue(const TaskQueue &) = delete;
@@ -157,13 +212,17 @@ class TaskQueue {
 
   struct QueueE {
     QueueE(std::unique_ptr<TaskIface> task,
-           const typename Clock::time_point &execute_tp)
-        : task(std::move(task)), execute_tp(execute_tp) { }
+           const typename Clock::time_point &execute_tp,
+           Owner owner)
+        : task(std::move(task)), execute_tp(execute_tp), owner(owner) { }
 
     std::unique_ptr<TaskIface> task;
     typename Clock::time_point execute_tp;
+    Owner owner;
   };
 
+  // the queue is a min-heap, std::priority_queue is not used because purge()
+  // needs to remove arbitrary elements
   struct QueueEComp {
     bool operator()(const QueueE &lhs, const QueueE &rhs) const {
       return lhs.execute_tp > rhs.execute_tp;
@@ -172,28 +231,162 @@ class TaskQueue {
 
   template <typename Duration>
   size_t push_task(std::unique_ptr<TaskIface> task,
-                   const std::chrono::time_point<Clock, Duration> &tp) {
+                   const std::chrono::time_point<Clock, Duration> &tp,
+                   Owner owner) {
     Lock lock(m);
-    queue.emplace(std::move(task), tp);
-    cv.notify_one();
+    push_task_(std::move(task), tp, owner);
     return 1;
   }
 
   template <typename Duration>
   size_t push_task_or_drop(std::unique_ptr<TaskIface> task,
                            const std::chrono::time_point<Clock, Duration> &tp,
-                           size_t max_size) {
+                           size_t max_size,
+                           Owner owner) {
     Lock lock(m);
-    if (queue.size() >= max_size) return 0;
-    queue.emplace(std::move(task), tp);
-    cv.notify_one();
+    if (owner == nullptr && queue.size() >= max_size) return 0;
+    if (owner != nullptr) {
+      auto it = owner_sizes.find(owner);
+      if (it != owner_sizes.end() && it->second >= max_size) return 0;
+    }
+    push_task_(std::move(task), tp, owner);
     return 1;
   }
 
+  // must be called with the lock held
+  void push_task_(std::unique_ptr<TaskIface> task,
+                  const typename Clock::time_point &tp,
+                  Owner owner) {
+    queue.emplace_back(std::move(task), tp, owner);
+    std::push_heap(queue.begin(), queue.end(), QueueEComp());
+    if (owner != nullptr) owner_sizes[owner]++;
+    cv.notify_one();
+  }
+
+  // must be called with the lock held
+  void remove_tasks(Owner owner) {
+    if (owner_sizes.erase(owner) == 0) return;
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [owner](const QueueE &e) {
+                                 return e.owner == owner;
+                               }),
+                queue.end());
+    std::make_heap(queue.begin(), queue.end(), QueueEComp());
+  }
+
   bool stop_processing{false};
-  std::priority_queue<QueueE, std::vector<QueueE>, QueueEComp> queue;
+  std::vector<QueueE> queue;
+  // number of pending tasks for each (non-null) owner
+  std::unordered_map<Owner, size_t> owner_sizes;
+  Owner running_owner{nullptr};
+  int num_purging{0};
+  std::thread::id executing_thread;
   mutable std::mutex m;
   mutable std::condition_variable cv;
+  mutable std::condition_variable cv_idle;
+};
+
+// A component's view of a TaskQueue which may be shared with other components
+// (see TaskQueuePool). All tasks are tagged with the handle, and the component
+// must call purge() before it releases any resource used by its tasks.
+template <typename Clock>
+class TaskQueueHandle {
+ public:
+  explicit TaskQueueHandle(TaskQueue<Clock> *task_queue)
+      : task_queue(task_queue) { }
+
+  ~TaskQueueHandle() { purge(); }
+
+  void purge() { task_queue->purge(this); }
+
+  size_t execute_task(std::unique_ptr<TaskIface> task) {
+    return task_queue->execute_task(std::move(task), this);
+  }
+
+  size_t execute_task_or_drop(std::unique_ptr<TaskIface> task,
+                              size_t max_size) {
+    return task_queue->execute_task_or_drop(std::move(task), max_size, this);
+  }
+
+  size_t execute_task_at(std::unique_ptr<TaskIface> task,
+                         const typename Clock::time_point &tp) {
+    return task_queue->execute_task_at(std::move(task), tp, this);
+  }
+
+  template <typename Rep, typename Period>
+  size_t execute_task_in(std::unique_ptr<TaskIface> task,
+                         const std::chrono::duration<Rep, Period> &duration) {
+    return task_queue->execute_task_in(std::move(task), duration, this);
+  }
+
+  template <typename Rep, typename Period>
+  size_t execute_periodic_task(
+      std::unique_ptr<TaskIface> task,
+      const std::chrono::duration<Rep, Period> &interval,
+      bool wait_first = false) {
+    return task_queue->execute_periodic_task(
+        std::move(task), interval, wait_first, this);
+  }
+
+  TaskQueueHandle(const TaskQueueHandle &) = delete;
+  TaskQueueHandle &operator=(const TaskQueueHandle &) = delete;
+
+ private:
+  TaskQueue<Clock> *task_queue;
+};
+
+// A fixed number of TaskQueues, each one executed by its own thread, shared by
+// all devices instead of having one thread per device. The queue for a given
+// key (e.g. a device id) never changes, so tasks for a given key are still
+// executed in order. Threads are started lazily, so there are never more
+// threads than keys.
+template <typename Clock>
+class TaskQueuePool {
+ public:
+  TaskQueuePool(std::string thread_class, size_t size)
+      : thread_class(std::move(thread_class)),
+        entries(std::max<size_t>(size, 1)) { }
+
+  ~TaskQueuePool() {
+    for (auto &entry : entries) {
+      if (entry.task_queue == nullptr) continue;
+      entry.task_queue->stop();
+      entry.thread.join();
+    }
+  }
+
+  // one queue per core by default
+  static size_t default_size() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  TaskQueue<Clock> *get(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = entries[key % entries.size()];
+    if (entry.task_queue == nullptr) {
+      entry.task_queue.reset(new TaskQueue<Clock>());
+      auto task_queue = entry.task_queue.get();
+      const auto *thread_class_ = thread_class.c_str();
+      entry.thread = std::thread([task_queue, thread_class_] {
+          pi_thread_start(thread_class_);
+          task_queue->execute();
+      });
+    }
+    return entry.task_queue.get();
+  }
+
+  TaskQueuePool(const TaskQueuePool &) = delete;
+  TaskQueuePool &operator=(const TaskQueuePool &) = delete;
+
+ private:
+  struct Entry {
+    std::unique_ptr<TaskQueue<Clock> > task_queue;
+    std::thread thread;
+  };
+
+  const std::string thread_class;
+  std::vector<Entry> entries;
+  std::mutex mutex;
 };
 
 }  // namespace proto
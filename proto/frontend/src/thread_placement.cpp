@@ -0,0 +1,266 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/frontends/proto/thread_placement.h>
+#include <PI/pi.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstring>  // std::strerror
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common.h"
+#include "logger.h"
+#include "report_error.h"
+
+namespace p4serverv1 = ::p4::server::v1;
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+namespace {
+
+using ThreadConfig = p4serverv1::ThreadConfig;
+
+// pthread names are limited to 16 characters, including the null terminator
+constexpr size_t kMaxNameLen = 15;
+
+// returns -1 for DEFAULT, in which case the scheduling policy is left unchanged
+int sched_policy(ThreadConfig::SchedPolicy policy) {
+  switch (policy) {
+    case ThreadConfig::OTHER: return SCHED_OTHER;
+    case ThreadConfig::BATCH: return SCHED_BATCH;
+    case ThreadConfig::IDLE: return SCHED_IDLE;
+    case ThreadConfig::FIFO: return SCHED_FIFO;
+    case ThreadConfig::RR: return SCHED_RR;
+    default: return -1;
+  }
+}
+
+const char *sched_policy_name(int policy) {
+  switch (policy) {
+    case SCHED_OTHER: return "OTHER";
+    case SCHED_BATCH: return "BATCH";
+    case SCHED_IDLE: return "IDLE";
+    case SCHED_FIFO: return "FIFO";
+    case SCHED_RR: return "RR";
+    default: return "UNKNOWN";
+  }
+}
+
+// formats the CPU set as a list of ranges, e.g. "0-3,8"
+std::string cpus_to_string(const cpu_set_t &cpus) {
+  std::string s;
+  int cpu = 0;
+  while (cpu < CPU_SETSIZE) {
+    if (!CPU_ISSET(cpu, &cpus)) {
+      cpu++;
+      continue;
+    }
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) last++;
+    if (!s.empty()) s += ",";
+    s += std::to_string(cpu);
+    if (last > cpu) s += "-" + std::to_string(last);
+    cpu = last + 1;
+  }
+  return s;
+}
+
+class Registry {
+ public:
+  static Registry *get() {
+    static Registry registry;
+    return &registry;
+  }
+
+  void set(const google::protobuf::Map<std::string, ThreadConfig> &threads) {
+    std::lock_guard<std::mutex> lock(mutex);
+    configs.clear();
+    for (const auto &p : threads) configs.emplace(p.first, p.second);
+  }
+
+  bool get_config(const std::string &thread_class,
+                  ThreadConfig *config) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = configs.find(thread_class);
+    if (it == configs.end()) return false;
+    *config = it->second;
+    return true;
+  }
+
+ private:
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, ThreadConfig> configs;
+};
+
+// errors are logged but otherwise ignored: failing to place a thread (e.g.
+// because the process lacks CAP_SYS_NICE for real-time policies) should not
+// prevent the thread from running
+void apply(const std::string &thread_class, const ThreadConfig &config) {
+  auto self = pthread_self();
+  if (config.cpus_size() > 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto cpu : config.cpus()) CPU_SET(cpu, &cpus);
+    auto rc = pthread_setaffinity_np(self, sizeof(cpus), &cpus);
+    if (rc != 0) {
+      Logger::get()->error("Cannot set CPU affinity for thread class {}: {}",
+                           thread_class, std::strerror(rc));
+    }
+  }
+  auto policy = sched_policy(config.policy());
+  if (policy >= 0) {
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = config.priority();
+    auto rc = pthread_setschedparam(self, policy, &param);
+    if (rc != 0) {
+      Logger::get()->error(
+          "Cannot set scheduling policy for thread class {}: {}",
+          thread_class, std::strerror(rc));
+    }
+  }
+}
+
+// reads back the placement of the calling thread, which is what we log, since
+// the requested placement may have been ignored or only partially applied
+std::string effective_placement() {
+  auto self = pthread_self();
+  std::string s("CPUs ");
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (pthread_getaffinity_np(self, sizeof(cpus), &cpus) == 0)
+    s += cpus_to_string(cpus);
+  else
+    s += "?";
+  int policy;
+  struct sched_param param;
+  if (pthread_getschedparam(self, &policy, &param) == 0) {
+    s += ", policy ";
+    s += sched_policy_name(policy);
+    s += ", priority " + std::to_string(param.sched_priority);
+  }
+  return s;
+}
+
+void thread_start_cb(const char *thread_class, void *cb_cookie) {
+  (void) cb_cookie;
+  ThreadConfig config;
+  Registry::get()->get_config(thread_class, &config);
+  auto name = config.name().empty() ?
+      std::string("pi_") + thread_class : config.name();
+  if (name.size() > kMaxNameLen) name.resize(kMaxNameLen);
+  pthread_setname_np(pthread_self(), name.c_str());
+  apply(thread_class, config);
+  Logger::get()->info("Thread {} (class {}) started: {}",
+                      name, thread_class, effective_placement());
+}
+
+}  // namespace
+
+Status
+ThreadPlacement::configure(const p4serverv1::Config &config) {
+  for (const auto &p : config.threads()) {
+    const auto &thread_class = p.first;
+    const auto &thread_config = p.second;
+    if (thread_config.name().size() > kMaxNameLen) {
+      RETURN_ERROR_STATUS(
+          Code::INVALID_ARGUMENT,
+          "Name for thread class {} exceeds {} characters",
+          thread_class, kMaxNameLen);
+    }
+    for (auto cpu : thread_config.cpus()) {
+      if (cpu >= CPU_SETSIZE) {
+        RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                            "Invalid CPU {} for thread class {}",
+                            cpu, thread_class);
+      }
+    }
+    if (!ThreadConfig::SchedPolicy_IsValid(thread_config.policy())) {
+      RETURN_ERROR_STATUS(Code::INVALID_ARGUMENT,
+                          "Invalid scheduling policy for thread class {}",
+                          thread_class);
+    }
+    auto policy = sched_policy(thread_config.policy());
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+      auto min_priority = sched_get_priority_min(policy);
+      auto max_priority = sched_get_priority_max(policy);
+      if (thread_config.priority() < min_priority ||
+          thread_config.priority() > max_priority) {
+        RETURN_ERROR_STATUS(
+            Code::INVALID_ARGUMENT,
+            "Priority for thread class {} must be in the [{}, {}] range",
+            thread_class, min_priority, max_priority);
+      }
+    } else if (thread_config.priority() != 0) {
+      RETURN_ERROR_STATUS(
+          Code::INVALID_ARGUMENT,
+          "Priority for thread class {} requires the FIFO or RR policy",
+          thread_class);
+    }
+  }
+  Registry::get()->set(config.threads());
+  pi_thread_start_register_cb(&thread_start_cb, nullptr);
+  RETURN_OK_STATUS();
+}
+
+struct ThreadPlacement::Scoped::SavedPlacement {
+  cpu_set_t cpus;
+  int policy;
+  struct sched_param param;
+};
+
+ThreadPlacement::Scoped::Scoped(const std::string &thread_class) {
+  ThreadConfig config;
+  if (!Registry::get()->get_config(thread_class, &config)) return;
+  auto self = pthread_self();
+  saved.reset(new SavedPlacement());
+  if (pthread_getaffinity_np(self, sizeof(saved->cpus), &saved->cpus) != 0 ||
+      pthread_getschedparam(self, &saved->policy, &saved->param) != 0) {
+    Logger::get()->error("Cannot save placement of current thread, "
+                         "ignoring placement for thread class {}",
+                         thread_class);
+    saved.reset();
+    return;
+  }
+  apply(thread_class, config);
+  Logger::get()->info("Threads of class {} are created with: {}",
+                      thread_class, effective_placement());
+}
+
+ThreadPlacement::Scoped::~Scoped() {
+  if (saved == nullptr) return;
+  auto self = pthread_self();
+  pthread_setaffinity_np(self, sizeof(saved->cpus), &saved->cpus);
+  pthread_setschedparam(self, saved->policy, &saved->param);
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
@@ -0,0 +1,216 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "update_coalescer.h"
+
+#include <string>
+#include <utility>  // for std::move
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+namespace p4v1 = ::p4::v1;
+
+namespace {
+
+void append_u32(std::string *s, uint32_t v) {
+  s->append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// the match is canonicalized, otherwise a DELETE encoding the match fields
+// differently (e.g. in a different order) could be applied before a MODIFY of
+// the same entry which precedes it in the request
+std::string table_entry_key(const p4v1::TableEntry &table_entry) {
+  return 't' + common::table_entry_key(table_entry);
+}
+
+std::string member_key(const p4v1::ActionProfileMember &member) {
+  std::string key(1, 'm');
+  append_u32(&key, member.action_profile_id());
+  append_u32(&key, member.member_id());
+  return key;
+}
+
+bool can_be_grouped(const p4v1::Update &update) {
+  auto type = update.type();
+  if (type != p4v1::Update::INSERT && type != p4v1::Update::MODIFY &&
+      type != p4v1::Update::DELETE) {
+    return false;
+  }
+  const auto &entity = update.entity();
+  if (entity.has_action_profile_member()) return true;
+  if (!entity.has_table_entry()) return false;
+  const auto &table_entry = entity.table_entry();
+  // one-shot groups are created and deleted as part of the update
+  if (table_entry.action().type_case() ==
+      p4v1::TableAction::kActionProfileActionSet) {
+    return false;
+  }
+  // resetting the default entry
+  return type != p4v1::Update::MODIFY || table_entry.has_action();
+}
+
+// returns false if the updates cannot be folded
+bool fold_type(p4v1::Update::Type current, p4v1::Update::Type next,
+               p4v1::Update::Type *folded) {
+  using p4v1::Update;
+  if (current == Update::INSERT && next == Update::MODIFY)
+    *folded = Update::INSERT;
+  else if (current == Update::INSERT && next == Update::DELETE)
+    *folded = Update::UNSPECIFIED;
+  else if (current == Update::MODIFY && next == Update::MODIFY)
+    *folded = Update::MODIFY;
+  else if (current == Update::MODIFY && next == Update::DELETE)
+    *folded = Update::DELETE;
+  else if (current == Update::UNSPECIFIED && next == Update::INSERT)
+    *folded = Update::INSERT;
+  else
+    return false;
+  return true;
+}
+
+}  // namespace
+
+UpdateCoalescer::UpdateCoalescer(const p4v1::WriteRequest &request,
+                                 TableActProfFn table_act_prof)
+    : request(request), table_act_prof(std::move(table_act_prof)) {
+  const auto &updates = request.updates();
+  for (int i = 0; i < updates.size(); i++) process(i, updates[i]);
+  for (size_t idx = 0; idx < groups.size(); idx++) {
+    const auto &group = groups[idx];
+    if (group.updates.size() < 2) continue;
+    group_starts.emplace(group.updates.front(), idx);
+    num_grouped += group.updates.size();
+  }
+}
+
+void
+UpdateCoalescer::close(Keys *keys) {
+  for (const auto &key : *keys) open.erase(key);
+  keys->clear();
+}
+
+void
+UpdateCoalescer::close(std::unordered_map<p4_id_t, Keys> *keys_map,
+                       p4_id_t id) {
+  auto it = keys_map->find(id);
+  if (it != keys_map->end()) close(&it->second);
+}
+
+void
+UpdateCoalescer::process(int index, const p4v1::Update &update) {
+  const auto &entity = update.entity();
+  std::string key;
+  p4_id_t table_id = 0;
+  p4_id_t act_prof_id = 0;
+  switch (entity.entity_case()) {
+    case p4v1::Entity::kTableEntry:
+      table_id = entity.table_entry().table_id();
+      act_prof_id = table_act_prof(table_id);
+      // the entry may refer to a member
+      if (act_prof_id != 0) close(&open_members_by_act_prof, act_prof_id);
+      key = table_entry_key(entity.table_entry());
+      break;
+    case p4v1::Entity::kActionProfileMember:
+      act_prof_id = entity.action_profile_member().action_profile_id();
+      close(&open_entries_by_act_prof, act_prof_id);
+      key = member_key(entity.action_profile_member());
+      break;
+    case p4v1::Entity::kActionProfileGroup:
+      act_prof_id = entity.action_profile_group().action_profile_id();
+      close(&open_entries_by_act_prof, act_prof_id);
+      close(&open_members_by_act_prof, act_prof_id);
+      return;
+    case p4v1::Entity::kDirectMeterEntry:
+      close(&open_entries_by_table,
+            entity.direct_meter_entry().table_entry().table_id());
+      return;
+    case p4v1::Entity::kDirectCounterEntry:
+      close(&open_entries_by_table,
+            entity.direct_counter_entry().table_entry().table_id());
+      return;
+    default:
+      return;
+  }
+
+  if (!can_be_grouped(update)) {
+    open.erase(key);
+    return;
+  }
+  auto it = open.find(key);
+  if (it != open.end()) {
+    auto &group = groups[it->second];
+    if (fold_type(group.type, update.type(), &group.type)) {
+      group.updates.push_back(index);
+      return;
+    }
+    open.erase(it);
+  }
+  groups.push_back({{index}, update.type()});
+  open.emplace(key, groups.size() - 1);
+  if (entity.has_table_entry()) {
+    open_entries_by_table[table_id].push_back(key);
+    if (act_prof_id != 0) open_entries_by_act_prof[act_prof_id].push_back(key);
+  } else {
+    open_members_by_act_prof[act_prof_id].push_back(key);
+  }
+}
+
+const UpdateCoalescer::Group *
+UpdateCoalescer::group_starting_at(int index) const {
+  auto it = group_starts.find(index);
+  return (it == group_starts.end()) ? nullptr : &groups[it->second];
+}
+
+void
+UpdateCoalescer::fold(const Group &group, p4v1::Update *update) const {
+  const auto &updates = request.updates();
+  update->CopyFrom(updates[group.updates.front()]);
+  auto type = update->type();
+  for (size_t i = 1; i < group.updates.size(); i++) {
+    const auto &next = updates[group.updates[i]];
+    fold_type(type, next.type(), &type);
+    if (next.type() == p4v1::Update::MODIFY &&
+        next.entity().has_table_entry()) {
+      // a MODIFY leaves the direct resources unchanged if they are not set
+      const auto &current_entry = update->entity().table_entry();
+      p4v1::TableEntry table_entry(next.entity().table_entry());
+      if (!table_entry.has_meter_config() && current_entry.has_meter_config())
+        table_entry.mutable_meter_config()->CopyFrom(
+            current_entry.meter_config());
+      if (!table_entry.has_counter_data() && current_entry.has_counter_data())
+        table_entry.mutable_counter_data()->CopyFrom(
+            current_entry.counter_data());
+      update->mutable_entity()->mutable_table_entry()->Swap(&table_entry);
+    } else {
+      update->mutable_entity()->CopyFrom(next.entity());
+    }
+  }
+  update->set_type(type);
+}
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
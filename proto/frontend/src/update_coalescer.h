@@ -0,0 +1,108 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef SRC_UPDATE_COALESCER_H_
+#define SRC_UPDATE_COALESCER_H_
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "p4/v1/p4runtime.pb.h"
+
+#include "common.h"
+
+namespace pi {
+
+namespace fe {
+
+namespace proto {
+
+// Finds the updates of a WriteRequest which apply to the same table entry or
+// action profile member and which can be folded into a single equivalent
+// update (see p4::server::v1::WriteConfig):
+//   - INSERT + MODIFY -> INSERT
+//   - MODIFY + MODIFY -> MODIFY
+//   - MODIFY + DELETE -> DELETE
+//   - INSERT + DELETE -> no update, and a subsequent INSERT -> INSERT
+// The folded update is applied in place of the first update of the group, so
+// updates are only grouped if none of the updates in-between can interact with
+// them: for example, an action profile member update ends all the groups for
+// the table entries which may refer to the member. One-shot table entries,
+// action profile groups and MODIFY updates resetting the default entry are
+// never grouped.
+class UpdateCoalescer {
+ public:
+  using p4_id_t = common::p4_id_t;
+  using UpdateType = p4::v1::Update::Type;
+  // returns the action profile id for indirect tables and 0 otherwise
+  using TableActProfFn = std::function<p4_id_t(p4_id_t)>;
+
+  struct Group {
+    // indices in the request, in increasing order (at least 2)
+    std::vector<int> updates;
+    // type of the folded update, UNSPECIFIED if the updates cancel out
+    UpdateType type;
+  };
+
+  UpdateCoalescer(const p4::v1::WriteRequest &request,
+                  TableActProfFn table_act_prof);
+
+  // Returns the group starting with this update, or nullptr.
+  const Group *group_starting_at(int index) const;
+
+  // Builds the folded update for the group; the update is left unchanged if
+  // the group type is UNSPECIFIED.
+  void fold(const Group &group, p4::v1::Update *update) const;
+
+  size_t num_grouped_updates() const { return num_grouped; }
+
+ private:
+  using Keys = std::vector<std::string>;
+
+  void process(int index, const p4::v1::Update &update);
+  void close(Keys *keys);
+  void close(std::unordered_map<p4_id_t, Keys> *keys_map, p4_id_t id);
+
+  const p4::v1::WriteRequest &request;
+  TableActProfFn table_act_prof;
+  std::vector<Group> groups{};
+  // groups which can still be extended, by key
+  std::unordered_map<std::string, size_t> open{};
+  // keys of the open groups, by table id (table entries) and by action profile
+  // id (table entries of indirect tables and members); these may include keys
+  // for groups which have already been closed
+  std::unordered_map<p4_id_t, Keys> open_entries_by_table{};
+  std::unordered_map<p4_id_t, Keys> open_entries_by_act_prof{};
+  std::unordered_map<p4_id_t, Keys> open_members_by_act_prof{};
+  // index of the group starting at each update, only for groups of at least 2
+  // updates
+  std::unordered_map<int, size_t> group_starts{};
+  size_t num_grouped{0};
+};
+
+}  // namespace proto
+
+}  // namespace fe
+
+}  // namespace pi
+
+#endif  // SRC_UPDATE_COALESCER_H_
@@ -32,6 +32,7 @@
 #include "common.h"
 #include "logger.h"
 #include "report_error.h"
+#include "scheduler.h"
 #include "task_queue.h"
 
 namespace pi {
@@ -44,6 +45,14 @@ namespace {
 
 using EmptyPromise = std::promise<void>;
 
+// Leaked on purpose, since WatchPortEnforcer instances may outlive static
+// objects.
+TaskQueuePool<std::chrono::steady_clock> *task_queue_pool() {
+  static auto *pool = new TaskQueuePool<std::chrono::steady_clock>(
+      "watch_port", TaskQueuePool<std::chrono::steady_clock>::default_size());
+  return pool;
+}
+
 }  // namespace
 
 /* static */
@@ -86,20 +95,20 @@ WatchPortEnforcer::deactivate_member(pi::ActProf *ap,
 }
 
 WatchPortEnforcer::WatchPortEnforcer(pi_dev_tgt_t device_tgt,
-                                     AccessArbitration *access_arbitration)
+                                     AccessArbitration *access_arbitration,
+                                     Scheduler *scheduler)
     : device_tgt(device_tgt),
-      task_queue(new WatchPortTaskQueue()),
-      access_arbitration(access_arbitration) {
-  task_queue_thread = std::thread(
-      &WatchPortTaskQueue::execute, task_queue.get());
+      task_queue(new WatchPortTaskQueue(
+          task_queue_pool()->get(device_tgt.dev_id))),
+      access_arbitration(access_arbitration),
+      scheduler(scheduler) {
   pi_port_status_register_cb(device_tgt.dev_id,
                              &WatchPortEnforcer::port_status_event_cb,
                              static_cast<void *>(this));
 }
 
 WatchPortEnforcer::~WatchPortEnforcer() {
-  task_queue->stop();
-  task_queue_thread.join();
+  task_queue->purge();
 }
 
 Status
@@ -147,6 +156,10 @@ WatchPortEnforcer::set_port_status(pi_port_t port, pi_port_status_t status) {
   AccessArbitration::P4IdSet act_prof_ids;
   for (auto &p : members_by_action_prof) act_prof_ids.insert(p.first);
 
+  // bulk operations holding access to the action profiles are preempted
+  Scheduler::Ticket ticket(
+      scheduler, p4::server::v1::SchedulingConfig::CONTROL_CRITICAL);
+
   while (!act_prof_ids.empty()) {
     // prevent simultaneous writes (by the P4Runtime client) while we update the
     // status of each member
@@ -26,7 +26,6 @@
 #include <chrono>
 #include <memory>
 #include <set>
-#include <thread>
 #include <unordered_map>
 
 #include "common.h"
@@ -40,9 +39,10 @@ namespace fe {
 namespace proto {
 
 class AccessArbitration;
+class Scheduler;
 
-template <typename Clock> class TaskQueue;
-using WatchPortTaskQueue = TaskQueue<std::chrono::steady_clock>;
+template <typename Clock> class TaskQueueHandle;
+using WatchPortTaskQueue = TaskQueueHandle<std::chrono::steady_clock>;
 
 // Receives port notifications from PI and activate / deactivate group members
 // as needed (based on their watch port attribute). We use an asynchronous task
@@ -52,13 +52,16 @@ class WatchPortEnforcer {
  public:
   static constexpr pi_port_t INVALID_WATCH = -1;
 
+  // If scheduler is not null, updating member status after a port status
+  // change is scheduled as control-plane-critical work.
   WatchPortEnforcer(pi_dev_tgt_t device_tgt,
-                    AccessArbitration *access_arbitration);
+                    AccessArbitration *access_arbitration,
+                    Scheduler *scheduler = nullptr);
   ~WatchPortEnforcer();
 
   // all the public methods of WatchPortEnforcer assume that the caller has
   // write access to the action profile; these methods are synchronous and not
-  // executed by the task_queue_thread.
+  // executed by the task queue.
 
   // add_member and modify_member update the internal state of the
   // WatchPortEnforcer but do not do any PI calls, unlike the *_update_hw
@@ -177,8 +180,8 @@ class WatchPortEnforcer {
   // we clear the members_by_action_prof map, we use this cache to avoid
   // querying the state of every port again.
   std::unordered_map<pi_port_t, PortStatus> ports_status_cache;
-  std::thread task_queue_thread;
   AccessArbitration *access_arbitration;
+  Scheduler *scheduler;
 };
 
 }  // namespace proto
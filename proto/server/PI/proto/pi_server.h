@@ -48,6 +48,20 @@ void PIGrpcServerRunAddr(const char *server_address);
 // PIGrpcServerCleanup
 void PIGrpcServerRunAddrGnmi(const char *server_address, void *gnmi_service);
 
+// Publishes all the state changes applied by this server on a Unix domain
+// socket bound to the given path, for the benefit of standby servers (see
+// PIGrpcServerRunStandby). Must be called before the server is started.
+void PIGrpcServerEnableReplication(const char *socket_path);
+
+// Runs a hot-standby server, which mirrors the state published by the primary
+// server on the given Unix domain socket, without touching the target. When
+// the primary goes away, the mirrored state is pushed to the target, so that
+// the controller does not have to, and the server is started on the given
+// address (see PIGrpcServerRunAddr). The new primary publishes its own state on
+// the same socket. Blocks until the takeover is complete.
+void PIGrpcServerRunStandby(const char *socket_path,
+                            const char *server_address);
+
 // Get port number bound to the server
 int PIGrpcServerGetPort();
 
@@ -0,0 +1,386 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "gnmi_subscriptions.h"
+
+#include <PI/pi.h>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>  // std::move
+#include <vector>
+
+#include "log.h"
+
+using google::protobuf::util::MessageDifferencer;
+
+namespace pi {
+
+namespace server {
+
+namespace {
+
+using Clock = gNMISubscription::Clock;
+using TimePoint = gNMISubscription::TimePoint;
+using std::chrono::nanoseconds;
+
+// Returns the first multiple of interval (since the epoch) which is strictly
+// greater than now. Used to align the processing of subscriptions with the same
+// interval.
+TimePoint next_multiple(TimePoint now, nanoseconds interval) {
+  auto since_epoch = std::chrono::duration_cast<nanoseconds>(
+      now.time_since_epoch());
+  auto next = (since_epoch / interval + 1) * interval;
+  return TimePoint(std::chrono::duration_cast<Clock::duration>(next));
+}
+
+// checks if one of the xpaths is a prefix of the other one
+bool xpaths_overlap(const std::string &xpath_1, const std::string &xpath_2) {
+  auto size = std::min(xpath_1.size(), xpath_2.size());
+  return xpath_1.compare(0, size, xpath_2, 0, size) == 0;
+}
+
+}  // namespace
+
+constexpr size_t gNMICachingDataSource::kMaxEntries;
+
+gNMICachingDataSource::gNMICachingDataSource(gNMIDataSource *source,
+                                             Clock::duration ttl)
+    : source(source), ttl(ttl) { }
+
+bool
+gNMICachingDataSource::get_leaves(const std::string &xpath, Leaves *leaves) {
+  std::unique_lock<std::mutex> lock(m);
+  auto now = Clock::now();
+  auto it = entries.find(xpath);
+  if (it != entries.end()) {
+    if (now < it->second.expiration) {
+      const auto &cached_leaves = it->second.leaves;
+      leaves->insert(leaves->end(), cached_leaves.begin(), cached_leaves.end());
+      return true;
+    }
+    entries.erase(it);
+  }
+  auto read_generation = generation;
+  lock.unlock();
+
+  Leaves new_leaves;
+  if (!source->get_leaves(xpath, &new_leaves)) return false;
+  leaves->insert(leaves->end(), new_leaves.begin(), new_leaves.end());
+
+  lock.lock();
+  if (generation != read_generation) return true;
+  if (entries.size() >= kMaxEntries) {
+    for (auto entry_it = entries.begin(); entry_it != entries.end();) {
+      if (now < entry_it->second.expiration)
+        ++entry_it;
+      else
+        entry_it = entries.erase(entry_it);
+    }
+    if (entries.size() >= kMaxEntries) entries.clear();
+  }
+  entries[xpath] = {std::move(new_leaves), now + ttl};
+  return true;
+}
+
+void
+gNMICachingDataSource::invalidate(const std::string &xpath) {
+  std::lock_guard<std::mutex> lock(m);
+  generation++;
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (xpaths_overlap(it->first, xpath))
+      it = entries.erase(it);
+    else
+      ++it;
+  }
+}
+
+constexpr size_t gNMIBufferedSink::kDefaultMaxPending;
+
+gNMIBufferedSink::gNMIBufferedSink(size_t max_pending)
+    : max_pending(max_pending) { }
+
+gNMIBufferedSink::~gNMIBufferedSink() {
+  close();
+}
+
+void
+gNMIBufferedSink::write(gnmi::SubscribeResponse &&response) {
+  Lock lock(m);
+  if (stop || overflow) return;
+  if (responses.size() >= max_pending) {
+    overflow = true;
+    responses.clear();
+    lock.unlock();
+    on_overflow();
+    return;
+  }
+  // the thread is started on the first write, once the derived class is fully
+  // constructed; default-constructed thread is not-joinable
+  if (!t.joinable()) t = std::thread(&gNMIBufferedSink::run, this);
+  responses.push_back(std::move(response));
+  lock.unlock();
+  cv.notify_one();
+}
+
+void
+gNMIBufferedSink::close() {
+  Lock lock(m);
+  if (stop) return;
+  stop = true;
+  responses.clear();
+  lock.unlock();
+  cv.notify_one();
+  if (t.joinable()) t.join();
+}
+
+size_t
+gNMIBufferedSink::pending() const {
+  Lock lock(m);
+  return responses.size();
+}
+
+bool
+gNMIBufferedSink::overflowed() const {
+  Lock lock(m);
+  return overflow;
+}
+
+void
+gNMIBufferedSink::run() {
+  pi_thread_start("gnmi");
+  Lock lock(m);
+  while (true) {
+    cv.wait(lock, [this] { return stop || !responses.empty(); });
+    if (stop) break;
+    auto response = std::move(responses.front());
+    responses.pop_front();
+    lock.unlock();
+    send(response);
+    lock.lock();
+  }
+}
+
+gNMISubscription::gNMISubscription(const gnmi::Subscription &gnmi_sub,
+                                   const std::string &xpath,
+                                   std::shared_ptr<gNMISubscriptionSink> sink)
+    : gnmi_sub(gnmi_sub), xpath(xpath), sink(std::move(sink)) { }
+
+void
+gNMISubscription::process(const gNMIDataSource::Leaves &leaves, TimePoint now,
+                          bool send) {
+  const auto mode = gnmi_sub.mode();
+  const bool initial = (next_due == TimePoint());
+  const bool due = (now >= next_due);
+  // We use the scheduled time and not the actual time as the last time a value
+  // was sent, otherwise a small scheduling delay could cause a heartbeat to be
+  // pushed back by a full sample interval.
+  const auto send_time = (due && !initial) ? next_due : now;
+  const nanoseconds heartbeat_interval(gnmi_sub.heartbeat_interval());
+
+  // Just like for ONCE subscriptions we send an update for each individual
+  // leaf, we do not use any_val to aggregate in a ygot-generated protobuf
+  // message.
+  gnmi::SubscribeResponse response;
+  auto *notification = response.mutable_update();
+
+  for (const auto &leaf : leaves) {
+    auto it = values.find(leaf.xpath);
+    bool has_changed = (it == values.end()) ||
+        !MessageDifferencer::Equals(it->second.v, leaf.val);
+
+    bool needs_to_be_sent = false;
+    if (mode == gnmi::SAMPLE) {
+      // SAMPLE subscriptions are only processed at sample times
+      needs_to_be_sent = has_changed || !gnmi_sub.suppress_redundant() ||
+          (heartbeat_interval.count() > 0 &&
+           send_time >= it->second.last_sent + heartbeat_interval);
+    } else if (mode == gnmi::ON_CHANGE) {
+      // all values are sent when the heartbeat is due
+      needs_to_be_sent = has_changed || due;
+    }
+    if (!needs_to_be_sent) continue;
+
+    // we only update the stored value if we are sending it
+    auto &stored_v = values[leaf.xpath];
+    stored_v.v = leaf.val;
+    stored_v.last_sent = send_time;
+
+    if (!send) continue;
+    auto update = notification->add_update();
+    // TODO(antonin): use prefix for smaller messages
+    *update->mutable_path() = leaf.path;
+    *update->mutable_val() = leaf.val;
+  }
+
+  if (due) {
+    auto interval = (mode == gnmi::SAMPLE) ?
+        nanoseconds(gnmi_sub.sample_interval()) : heartbeat_interval;
+    next_due = (interval.count() > 0) ?
+        next_multiple(now, interval) : TimePoint::max();
+  }
+
+  if (send && notification->update_size() > 0) {
+    auto timestamp = std::chrono::duration_cast<nanoseconds>(
+        now.time_since_epoch()).count();
+    notification->set_timestamp(timestamp);
+    sink->write(std::move(response));
+  }
+}
+
+constexpr std::chrono::nanoseconds
+gNMISubscriptionScheduler::kDefaultPollInterval;
+
+gNMISubscriptionScheduler::gNMISubscriptionScheduler(
+    gNMIDataSource *source, nanoseconds poll_interval)
+    : source(source), poll_interval(poll_interval) { }
+
+gNMISubscriptionScheduler::~gNMISubscriptionScheduler() {
+  Lock lock(m);
+  if (!t.joinable()) return;
+  stop = true;
+  lock.unlock();
+  cv.notify_one();
+  t.join();
+}
+
+bool
+gNMISubscriptionScheduler::add_subscription(
+    std::shared_ptr<gNMISubscription> sub, bool updates_only) {
+  gNMIDataSource::Leaves leaves;
+  if (!source->get_leaves(sub->get_xpath(), &leaves)) return false;
+  sub->process(leaves, Clock::now(), !updates_only);
+  bool poll = (poll_interval.count() > 0 &&
+               source->needs_polling(sub->get_xpath()));
+
+  Lock lock(m);
+  // default-constructed thread is not-joinable
+  if (!t.joinable()) t = std::thread(&gNMISubscriptionScheduler::run, this);
+  auto &path_state = paths[sub->get_xpath()];
+  path_state.poll = poll;
+  path_state.subs.push_back(std::move(sub));
+  // we may have missed a change between the initial read and now, in which
+  // case the next read will catch it
+  path_state.changed = true;
+  wakeup = true;
+  lock.unlock();
+  cv.notify_one();
+  return true;
+}
+
+void
+gNMISubscriptionScheduler::remove_subscription(
+    const std::shared_ptr<gNMISubscription> &sub) {
+  Lock lock(m);
+  auto path_it = paths.find(sub->get_xpath());
+  if (path_it == paths.end()) return;
+  auto &subs = path_it->second.subs;
+  subs.erase(std::remove(subs.begin(), subs.end(), sub), subs.end());
+  if (subs.empty()) paths.erase(path_it);
+}
+
+void
+gNMISubscriptionScheduler::notify_change(const std::string &xpath) {
+  Lock lock(m);
+  bool any_changed = false;
+  for (auto &p : paths) {
+    if (!xpaths_overlap(p.first, xpath)) continue;
+    p.second.changed = true;
+    any_changed = true;
+  }
+  if (!any_changed) return;
+  wakeup = true;
+  lock.unlock();
+  cv.notify_one();
+}
+
+void
+gNMISubscriptionScheduler::run() {
+  pi_thread_start("gnmi");
+
+  struct PathWork {
+    std::string xpath;
+    std::vector<std::shared_ptr<gNMISubscription> > subs;
+  };
+
+  Lock lock(m);
+  while (!stop) {
+    auto now = Clock::now();
+    auto next_due = TimePoint::max();
+    std::vector<PathWork> work;
+    for (auto &p : paths) {
+      auto &path_state = p.second;
+      bool changed = path_state.changed;
+      if (path_state.poll && now >= path_state.next_poll) {
+        changed = true;
+        path_state.next_poll = next_multiple(now, poll_interval);
+      }
+      bool has_on_change = false;
+      std::vector<std::shared_ptr<gNMISubscription> > subs;
+      for (const auto &sub : path_state.subs) {
+        const bool on_change = (sub->get_mode() == gnmi::ON_CHANGE);
+        has_on_change |= on_change;
+        if (now >= sub->get_next_due() || (changed && on_change)) {
+          subs.push_back(sub);
+        } else {
+          next_due = std::min(next_due, sub->get_next_due());
+        }
+      }
+      path_state.changed = false;
+      if (path_state.poll && has_on_change)
+        next_due = std::min(next_due, path_state.next_poll);
+      if (!subs.empty()) work.push_back({p.first, std::move(subs)});
+    }
+
+    if (work.empty()) {
+      auto pred = [this] { return stop || wakeup; };
+      if (next_due == TimePoint::max())
+        cv.wait(lock, pred);
+      else
+        cv.wait_until(lock, next_due, pred);
+      wakeup = false;
+      continue;
+    }
+
+    // The subscriptions are only processed by this thread once they have been
+    // added, so we do not need to hold the lock. A subscription may be removed
+    // concurrently, in which case we may still send one last notification to
+    // the sink.
+    lock.unlock();
+    for (const auto &path_work : work) {
+      gNMIDataSource::Leaves leaves;
+      if (!source->get_leaves(path_work.xpath, &leaves)) {
+        SIMPLELOG << "Error while retrieving subscription items for "
+                  << path_work.xpath << "\n";
+        leaves.clear();
+      }
+      for (const auto &sub : path_work.subs) sub->process(leaves, now);
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace server
+
+}  // namespace pi
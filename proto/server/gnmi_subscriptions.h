@@ -0,0 +1,276 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef PROTO_SERVER_GNMI_SUBSCRIPTIONS_H_
+#define PROTO_SERVER_GNMI_SUBSCRIPTIONS_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gnmi/gnmi.grpc.pb.h"
+
+namespace pi {
+
+namespace server {
+
+// Provides the values of the leaves for gNMI subscriptions, e.g. by querying
+// the sysrepo datastore. The data source is expected to call
+// gNMISubscriptionScheduler::notify_change when the data changes.
+class gNMIDataSource {
+ public:
+  struct Leaf {
+    std::string xpath;
+    gnmi::Path path;
+    gnmi::TypedValue val;
+  };
+
+  using Leaves = std::vector<Leaf>;
+
+  virtual ~gNMIDataSource() { }
+
+  // Retrieves all the leaves (which have a value) under the given xpath. This
+  // method can be called concurrently from different threads.
+  virtual bool get_leaves(const std::string &xpath, Leaves *leaves) = 0;
+
+  // Returns true if the data under xpath may change without
+  // gNMISubscriptionScheduler::notify_change being called, e.g. operational
+  // state provided by another application. ON_CHANGE subscriptions to such an
+  // xpath are sampled periodically by the scheduler.
+  virtual bool needs_polling(const std::string &xpath) const {
+    (void)xpath;
+    return false;
+  }
+};
+
+// Caches the leaves retrieved from another data source for a short time. This
+// is used for Get requests and ONCE / POLL subscriptions, for which collectors
+// tend to request the same paths over and over again. The cached entries need
+// to be invalidated when the data changes (e.g. on Set), the TTL only bounds
+// the staleness of data for which we do not get change notifications.
+class gNMICachingDataSource : public gNMIDataSource {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  gNMICachingDataSource(gNMIDataSource *source, Clock::duration ttl);
+
+  bool get_leaves(const std::string &xpath, Leaves *leaves) override;
+
+  bool needs_polling(const std::string &xpath) const override {
+    return source->needs_polling(xpath);
+  }
+
+  // Invalidates the cached entries for which the xpath is a prefix of xpath (or
+  // the other way around).
+  void invalidate(const std::string &xpath);
+
+ private:
+  struct Entry {
+    Leaves leaves;
+    Clock::time_point expiration;
+  };
+
+  static constexpr size_t kMaxEntries = 1024;
+
+  gNMIDataSource *source;
+  Clock::duration ttl;
+  mutable std::mutex m{};
+  // key is xpath
+  std::unordered_map<std::string, Entry> entries{};
+  // incremented by invalidate, so that we do not insert data which may have
+  // been read before the invalidation
+  uint64_t generation{0};
+};
+
+// Receives the notifications for one Subscribe stream. write is called by the
+// scheduler thread and should not block, so that a slow client does not delay
+// notifications for the other clients.
+class gNMISubscriptionSink {
+ public:
+  virtual ~gNMISubscriptionSink() { }
+
+  virtual void write(gnmi::SubscribeResponse &&response) = 0;
+};
+
+// Sink which buffers the notifications and sends them from its own thread, so
+// that the scheduler thread never blocks on a slow client. The buffer is
+// bounded: if more than max_pending notifications are waiting to be sent
+// (e.g. the client stopped reading), the pending notifications are dropped,
+// on_overflow is called and the sink stops accepting notifications. The
+// stream is expected to be cancelled at this point, as the client can no
+// longer rely on the data it has received.
+class gNMIBufferedSink : public gNMISubscriptionSink {
+ public:
+  static constexpr size_t kDefaultMaxPending = 1024;
+
+  explicit gNMIBufferedSink(size_t max_pending = kDefaultMaxPending);
+
+  // derived classes need to call close() in their destructor, as the sink
+  // thread calls send()
+  ~gNMIBufferedSink() override;
+
+  void write(gnmi::SubscribeResponse &&response) override;
+
+  // Once this returns, send() will not be called anymore. Pending
+  // notifications are dropped.
+  void close();
+
+  size_t pending() const;
+
+  bool overflowed() const;
+
+ protected:
+  // called by the sink thread, may block
+  virtual void send(const gnmi::SubscribeResponse &response) = 0;
+
+  // called by the thread calling write(), without holding the sink lock
+  virtual void on_overflow() { }
+
+ private:
+  using Lock = std::unique_lock<std::mutex>;
+
+  void run();
+
+  size_t max_pending;
+  mutable std::mutex m{};
+  std::condition_variable cv{};
+  std::deque<gnmi::SubscribeResponse> responses{};
+  bool overflow{false};
+  bool stop{false};
+  std::thread t{};
+};
+
+// State for a single ON_CHANGE or SAMPLE gNMI Subscription message. Keeps track
+// of the last value sent for each leaf.
+class gNMISubscription {
+ public:
+  using Clock = std::chrono::system_clock;
+  using TimePoint = Clock::time_point;
+
+  gNMISubscription(const gnmi::Subscription &gnmi_sub, const std::string &xpath,
+                   std::shared_ptr<gNMISubscriptionSink> sink);
+
+  const std::string &get_xpath() const { return xpath; }
+
+  gnmi::SubscriptionMode get_mode() const { return gnmi_sub.mode(); }
+
+  // next time at which the subscription needs to be processed even if the data
+  // has not changed: next sample time for SAMPLE subscriptions, next heartbeat
+  // for ON_CHANGE subscriptions
+  TimePoint get_next_due() const { return next_due; }
+
+  // Sends the leaves which need to be sent given the subscription mode. now is
+  // the time at which the leaves were retrieved. If send is false, the values
+  // are recorded but not sent (used for updates_only).
+  void process(const gNMIDataSource::Leaves &leaves, TimePoint now,
+               bool send = true);
+
+ private:
+  struct StoredValue {
+    gnmi::TypedValue v;  // last value sent
+    TimePoint last_sent;  // initialized to epoch
+  };
+
+  gnmi::Subscription gnmi_sub;
+  std::string xpath;
+  std::shared_ptr<gNMISubscriptionSink> sink;
+  TimePoint next_due{};  // initialized to epoch
+  std::unordered_map<std::string, StoredValue> values{};
+};
+
+// Schedules the processing of the gNMI subscriptions for all the Subscribe
+// streams, using a single thread. Each distinct xpath is read from the data
+// source once and the result is used for all the subscriptions to that
+// xpath. Sample times are aligned on multiples of the sample interval, so
+// SAMPLE subscriptions with the same interval share the same reads even if
+// they were created at different times. ON_CHANGE subscriptions are processed
+// when the data source signals a change (or for heartbeats), and are also
+// sampled every poll_interval if the data source does not signal all the
+// changes for their xpath (see gNMIDataSource::needs_polling). Only the leaves
+// which have changed are sent, so polling is invisible to the client.
+class gNMISubscriptionScheduler {
+ public:
+  static constexpr std::chrono::nanoseconds kDefaultPollInterval =
+      std::chrono::seconds(1);
+
+  explicit gNMISubscriptionScheduler(
+      gNMIDataSource *source,
+      std::chrono::nanoseconds poll_interval = kDefaultPollInterval);
+
+  ~gNMISubscriptionScheduler();
+
+  // Retrieves the current values for the subscription, sends them to the sink
+  // unless updates_only is true, and schedules the subscription. Returns false
+  // if the initial values cannot be retrieved.
+  bool add_subscription(std::shared_ptr<gNMISubscription> sub,
+                        bool updates_only = false);
+
+  // Once this returns, the subscription will not be processed anymore, unless
+  // it is being processed concurrently by the scheduler thread.
+  void remove_subscription(const std::shared_ptr<gNMISubscription> &sub);
+
+  // Signals that the data under xpath may have changed. ON_CHANGE
+  // subscriptions for which the subscribed xpath is a prefix of xpath (or the
+  // other way around) are processed as soon as possible. The data source can
+  // use a module prefix (e.g. "/openconfig-interfaces:") for coarse-grained
+  // notifications.
+  void notify_change(const std::string &xpath);
+
+ private:
+  using Clock = gNMISubscription::Clock;
+  using TimePoint = gNMISubscription::TimePoint;
+  using Mutex = std::mutex;
+  using Lock = std::unique_lock<Mutex>;
+
+  struct PathState {
+    std::vector<std::shared_ptr<gNMISubscription> > subs{};
+    // the data has changed since the last read
+    bool changed{false};
+    // ON_CHANGE subscriptions need to be sampled, see needs_polling
+    bool poll{false};
+    TimePoint next_poll{};
+  };
+
+  void run();
+
+  gNMIDataSource *source;
+  std::chrono::nanoseconds poll_interval;
+  mutable Mutex m{};
+  std::condition_variable cv{};
+  // key is xpath
+  std::unordered_map<std::string, PathState> paths{};
+  bool wakeup{false};
+  bool stop{false};
+  std::thread t{};
+};
+
+}  // namespace server
+
+}  // namespace pi
+
+#endif  // PROTO_SERVER_GNMI_SUBSCRIPTIONS_H_
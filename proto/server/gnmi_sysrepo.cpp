@@ -29,20 +29,23 @@ extern "C" {
 
 }
 
-#include <google/protobuf/util/message_differencer.h>
 #include <grpcpp/grpcpp.h>
 
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>  // std::move
 #include <vector>
 
 #include "gnmi/gnmi.grpc.pb.h"
+#include "gnmi_subscriptions.h"
 #include "log.h"
 
 using grpc::ServerContext;
@@ -50,8 +53,6 @@ using grpc::ServerReaderWriter;
 using grpc::Status;
 using grpc::StatusCode;
 
-using google::protobuf::util::MessageDifferencer;
-
 namespace pi {
 
 namespace server {
@@ -519,21 +520,259 @@ class LeafTypeCache {
   LYContext *LY_ctx;
 };
 
-// Manages stream subscription lists for a given Subscribe RPC bidi
-// stream. Supports both ON_CHANGE and SAMPLE subscriptions. Each instance of
-// this class comes with its own thread which processes subscriptions
-// periodically. We hope that the "refresh interval" is small enough that we can
-// detect changes fast enough but large enough that we don't hog the CPU.
-class SubscriptionStreamMgr {
+// Pool of long-lived sysrepo sessions, which saves the cost of sr_connect and
+// sr_session_start for every request. A session is only used by one thread at
+// a time.
+class SysrepoSessionPool {
+ public:
+  // Returns the session to the pool when destroyed. Any uncommitted change made
+  // with the session is discarded.
+  class Handle {
+   public:
+    Handle(SysrepoSessionPool *pool, std::unique_ptr<SysrepoSession> session)
+        : pool(pool), session(std::move(session)) { }
+
+    Handle(Handle &&other) = default;
+
+    ~Handle() {
+      if (session != nullptr) pool->release(std::move(session));
+    }
+
+    // false if no session could be opened
+    bool valid() const { return session != nullptr; }
+
+    sr_session_ctx_t *get() const { return session->sess; }
+
+   private:
+    SysrepoSessionPool *pool;
+    std::unique_ptr<SysrepoSession> session;
+  };
+
+  Handle acquire() {
+    Lock lock(m);
+    if (!idle_sessions.empty()) {
+      auto session = std::move(idle_sessions.back());
+      idle_sessions.pop_back();
+      lock.unlock();
+      // important to refresh the session in case a Set request happened since
+      // the last time the session was used
+      sr_session_refresh(session->sess);
+      return Handle(this, std::move(session));
+    }
+    lock.unlock();
+    std::unique_ptr<SysrepoSession> session(new SysrepoSession());
+    if (!session->open()) session.reset();
+    return Handle(this, std::move(session));
+  }
+
+ private:
+  using Lock = std::unique_lock<std::mutex>;
+
+  static constexpr size_t kMaxIdleSessions = 8;
+
+  void release(std::unique_ptr<SysrepoSession> session) {
+    sr_discard_changes(session->sess);
+    Lock lock(m);
+    if (idle_sessions.size() < kMaxIdleSessions)
+      idle_sessions.push_back(std::move(session));
+  }
+
+  std::mutex m{};
+  std::vector<std::unique_ptr<SysrepoSession> > idle_sessions{};
+};
+
+constexpr size_t SysrepoSessionPool::kMaxIdleSessions;
+
+// returns true if the schema node or one of its descendants is config false
+bool LY_subtree_has_state(const struct lys_node *node) {
+  if (node->flags & LYS_CONFIG_R) return true;
+  const struct lys_node *child = nullptr;
+  while ((child = lys_getnext(child, node, nullptr, 0)) != nullptr) {
+    if (LY_subtree_has_state(child)) return true;
+  }
+  return false;
+}
+
+// removes the list predicates from a data xpath, e.g.
+// /interfaces/interface[name='eth0']/state -> /interfaces/interface/state
+std::string xpath_to_schema_path(const std::string &xpath) {
+  std::string schema_path;
+  char quote = 0;
+  int depth = 0;
+  for (auto c : xpath) {
+    if (quote != 0) {
+      if (c == quote) quote = 0;
+    } else if (depth > 0 && (c == '\'' || c == '"')) {
+      quote = c;
+    } else if (c == '[') {
+      depth++;
+    } else if (c == ']') {
+      depth--;
+    } else if (depth == 0) {
+      schema_path.push_back(c);
+    }
+  }
+  return schema_path;
+}
+
+// Retrieves the leaves from the running datastore.
+class SysrepoDataSource : public gNMIDataSource {
+ public:
+  SysrepoDataSource(SysrepoSessionPool *session_pool, const LYContext *LY_ctx)
+      : session_pool(session_pool), LY_ctx(LY_ctx) { }
+
+  bool get_leaves(const std::string &xpath, Leaves *leaves) override {
+    auto session = session_pool->acquire();
+    if (!session.valid()) return false;
+
+    sr_val_t *value = nullptr;
+    sr_val_iter_t *iter = nullptr;
+    int rc = SR_ERR_OK;
+
+    // get all list instances with their content (recursive)
+    rc = sr_get_items_iter(session.get(), xpath.c_str(), &iter);
+    if (rc != SR_ERR_OK) return false;
+
+    while (sr_get_item_next(session.get(), iter, &value) == SR_ERR_OK) {
+      if (!isLeaf(value)) {
+        sr_free_val(value);
+        continue;
+      }
+      if (value->dflt) {  // unset
+        sr_free_val(value);
+        continue;
+      }
+      Leaf leaf;
+      leaf.xpath = value->xpath;
+      convertToTypedValue(value, &leaf.val);
+      convertFromXPath(value->xpath, &leaf.path);
+      leaves->push_back(std::move(leaf));
+      sr_free_val(value);
+    }
+    sr_free_val_iter(iter);
+    return true;
+  }
+
+  // Operational data is provided by other applications through sysrepo and we
+  // do not get any notification when it changes, so subscriptions which
+  // include config false nodes need to be polled. When the schema nodes cannot
+  // be resolved (e.g. wildcards), we look at the whole module.
+  bool needs_polling(const std::string &xpath) const override {
+    const auto *module = LY_ctx->get_module(extractOrigin(xpath));
+    if (module == nullptr) return true;
+    auto schema_path = xpath_to_schema_path(xpath);
+    auto *LY_set = (schema_path.find('*') == std::string::npos) ?
+        lys_find_path(module, nullptr, schema_path.c_str()) : nullptr;
+    if (LY_set == nullptr || LY_set->number == 0) {
+      if (LY_set != nullptr) ly_set_free(LY_set);
+      const struct lys_node *node = nullptr;
+      while ((node = lys_getnext(node, nullptr, module, 0)) != nullptr) {
+        if (LY_subtree_has_state(node)) return true;
+      }
+      return false;
+    }
+    bool has_state = false;
+    for (unsigned int i = 0; i < LY_set->number && !has_state; i++)
+      has_state = LY_subtree_has_state(LY_set->set.s[i]);
+    ly_set_free(LY_set);
+    return has_state;
+  }
+
+ private:
+  SysrepoSessionPool *session_pool;
+  const LYContext *LY_ctx;
+};
+
+// Subscribes to the changes to the running datastore for all the openconfig
+// modules. This is how we implement ON_CHANGE subscriptions and how we
+// invalidate cached data when the datastore is modified by another
+// application. Changes are tracked at the module level: the callback receives
+// a module prefix (e.g. "/openconfig-interfaces:"). Changes to operational
+// data are not notified, see SysrepoDataSource::needs_polling.
+class SysrepoChangeSubscriber {
+ public:
+  using ChangeCb = std::function<void(const std::string &xpath)>;
+
+  SysrepoChangeSubscriber(const LYContext &LY_ctx, ChangeCb cb)
+      : cb(std::move(cb)) {
+    if (!session.open()) return;
+    for (const auto &p : LY_ctx) {
+      // SR_SUBSCR_PASSIVE: we are not the owner of the data and the
+      // subscription must not enable the module in the running datastore
+      sr_subscr_options_t opts = SR_SUBSCR_PASSIVE | SR_SUBSCR_APPLY_ONLY;
+      if (subscription != nullptr) opts |= SR_SUBSCR_CTX_REUSE;
+      int rc = sr_module_change_subscribe(
+          session.sess, p.first.c_str(), &module_change_cb,
+          static_cast<void *>(this), 0, opts, &subscription);
+      if (rc != SR_ERR_OK) {
+        SIMPLELOG << "Error when subscribing to changes for module "
+                  << p.first << "\n";
+      }
+    }
+  }
+
+  ~SysrepoChangeSubscriber() {
+    if (subscription != nullptr) sr_unsubscribe(session.sess, subscription);
+  }
+
+ private:
+  static int module_change_cb(sr_session_ctx_t *session,
+                              const char *module_name, sr_notif_event_t event,
+                              void *private_ctx) {
+    (void) session;
+    if (event != SR_EV_APPLY) return SR_ERR_OK;
+    auto *subscriber = static_cast<SysrepoChangeSubscriber *>(private_ctx);
+    subscriber->cb(std::string("/") + module_name + ":");
+    return SR_ERR_OK;
+  }
+
+  ChangeCb cb;
+  SysrepoSession session{};
+  sr_subscription_ctx_t *subscription{nullptr};
+};
+
+// Writes the notifications for a Subscribe RPC bidi stream. The stream is
+// cancelled if the client does not keep up with the notifications.
+class StreamSink : public gNMIBufferedSink {
  public:
   using Stream =
       ServerReaderWriter<gnmi::SubscribeResponse, gnmi::SubscribeRequest>;
 
-  SubscriptionStreamMgr(Stream *stream, const XPathBuilder &xpath_builder)
-      : stream(stream), xpath_builder(xpath_builder) {
-    session.open();
+  StreamSink(ServerContext *context, Stream *stream)
+      : context(context), stream(stream) { }
+
+  ~StreamSink() {
+    close();
+  }
+
+ private:
+  void send(const gnmi::SubscribeResponse &response) override {
+    stream->Write(response);
+  }
+
+  void on_overflow() override {
+    SIMPLELOG << "Too many pending notifications for gNMI Subscribe stream, "
+              << "cancelling it\n";
+    context->TryCancel();
   }
 
+  ServerContext *context;
+  Stream *stream;
+};
+
+// Manages stream subscription lists for a given Subscribe RPC bidi
+// stream. Supports both ON_CHANGE and SAMPLE subscriptions. The subscriptions
+// are processed by the gNMISubscriptionScheduler shared by all streams.
+class SubscriptionStreamMgr {
+ public:
+  using Stream = StreamSink::Stream;
+
+  SubscriptionStreamMgr(ServerContext *context, Stream *stream,
+                        const XPathBuilder &xpath_builder,
+                        gNMISubscriptionScheduler *scheduler)
+      : context(context), stream(stream), xpath_builder(xpath_builder),
+        scheduler(scheduler) { }
+
   ~SubscriptionStreamMgr() {
     shutdown();
   }
@@ -541,7 +780,8 @@ class SubscriptionStreamMgr {
   Status add_subscription_list(const gnmi::SubscriptionList &sub_list) {
     assert(sub_list.mode() == gnmi::SubscriptionList::STREAM);
     const auto &prefix = sub_list.prefix();
-    Lock lock(m);
+    if (sink == nullptr)
+      sink = std::make_shared<StreamSink>(context, stream);
     for (const auto &subscription : sub_list.subscription()) {
       // sanity-check Subscription message
       if (subscription.mode() == gnmi::TARGET_DEFINED) {
@@ -575,12 +815,13 @@ class SubscriptionStreamMgr {
         return Status(StatusCode::INVALID_ARGUMENT,
                       "Cannot convert gNMI path to XPath");
       }
-      subscriptions.emplace_back(subscription, xpath);
-      auto &new_sub = subscriptions.back();
-      if (!new_sub.process(session, stream, !sub_list.updates_only())) {
+      auto new_sub = std::make_shared<gNMISubscription>(
+          subscription, xpath, sink);
+      if (!scheduler->add_subscription(new_sub, sub_list.updates_only())) {
         return Status(StatusCode::UNKNOWN,
                       "Error while retrieving subscription items");
       }
+      subscriptions.push_back(std::move(new_sub));
     }
     // When the target has transmitted the initial updates for all paths
     // specified within the subscription, a SubscribeResponse message with the
@@ -591,173 +832,25 @@ class SubscriptionStreamMgr {
     // such messages are not required for subsequent updates.
     gnmi::SubscribeResponse SyncMessage;
     SyncMessage.set_sync_response(true);
-    stream->Write(SyncMessage);
+    sink->write(std::move(SyncMessage));
     return Status::OK;
   }
 
-  void start() {
-    Lock lock(m);
-    // default-constructed thread is not-joinable
-    if (t.joinable()) return;
-    t = std::thread(&SubscriptionStreamMgr::run, this);
-  }
-
   void shutdown() {
-    Lock lock(m);
-    if (!t.joinable()) return;
-    if (stop) return;
-    stop = true;
-    lock.unlock();
-    cv_stop.notify_one();
-    t.join();
+    for (const auto &sub : subscriptions) scheduler->remove_subscription(sub);
+    subscriptions.clear();
+    if (sink != nullptr) sink->close();
   }
 
  private:
-  using Mutex = std::mutex;
-  using Lock = std::unique_lock<Mutex>;
-
-  using Clock = std::chrono::system_clock;
-  using TimePoint = Clock::time_point;
-
-  void run() {
-    TimePoint next_process;  // initialized to epoch
-    Lock lock(m);
-    // while shutdown() has not been called...
-    while (!cv_stop.wait_until(lock, next_process, [this] { return stop; })) {
-      auto now = Clock::now();
-      if (now < next_process) continue;
-      // important to refresh the session in case a Set request happened since
-      // the last call to process()
-      sr_session_refresh(session.sess);
-      for (auto &subscription : subscriptions)
-        subscription.process(session, stream);
-      next_process = now + refresh_int;
-    }
-  }
-
-  class Subscription {
-   public:
-    Subscription(const gnmi::Subscription &gnmi_sub, const std::string &xpath)
-        : gnmi_sub(gnmi_sub), xpath(xpath) { }
-
-    bool process(const SysrepoSession &session, Stream *stream,
-                 bool send = true) {
-      sr_val_t *value = nullptr;
-      sr_val_iter_t *iter = nullptr;
-      int rc = SR_ERR_OK;
-
-      const auto now = Clock::now();
-      const auto mode = gnmi_sub.mode();
-
-      rc = sr_get_items_iter(session.sess, xpath.c_str(), &iter);
-      if (rc != SR_ERR_OK) return false;
-
-      // Just like for ONCE subscriptions we send an update for each individual
-      // leaf, we do not use any_val to aggregate in a ygot-generated protobuf
-      // message.
-      gnmi::SubscribeResponse response;
-      auto *notification = response.mutable_update();
-
-      while (sr_get_item_next(session.sess, iter, &value) == SR_ERR_OK) {
-        std::string update_xpath(value->xpath);
-        if (!isLeaf(value)) {
-          sr_free_val(value);
-          continue;
-        }
-        if (value->dflt) {  // unset
-          sr_free_val(value);
-          continue;
-        }
-
-        // check if value has changed and update map
-        gnmi::TypedValue typed_v;
-        convertToTypedValue(value, &typed_v);
-        auto it = values.find(update_xpath);
-        bool has_changed = false;
-        if (it == values.end()) {
-          values[update_xpath] = {typed_v, TimePoint()};
-          has_changed = true;
-        } else {
-          has_changed = !it->second.equals(typed_v);
-        }
-        auto &stored_v = values[update_xpath];
-        const auto &last_sent = stored_v.last_sent;
-
-        bool needs_to_be_sent = false;
-        using std::chrono::nanoseconds;
-        if (mode == gnmi::SAMPLE) {
-          if (has_changed || !gnmi_sub.suppress_redundant()) {
-            needs_to_be_sent =
-                now >= (last_sent + nanoseconds(gnmi_sub.sample_interval()));
-          } else {
-            needs_to_be_sent =
-                now >= (last_sent + nanoseconds(gnmi_sub.heartbeat_interval()));
-          }
-        } else if (mode == gnmi::ON_CHANGE) {
-          auto next_if_not_changed = (gnmi_sub.heartbeat_interval() > 0) ?
-              last_sent + nanoseconds(gnmi_sub.heartbeat_interval()) :
-              TimePoint::max();
-          needs_to_be_sent = has_changed || (now >= next_if_not_changed);
-        }
-
-        if (!needs_to_be_sent) {
-          sr_free_val(value);
-          continue;
-        }
-        stored_v.last_sent = now;
-        // we only update the stored value if we are sending it
-        stored_v.v = typed_v;
-
-        if (!send) {
-          sr_free_val(value);
-          continue;
-        }
-
-        auto update = notification->add_update();
-        // TODO(antonin): use prefix for smaller messages
-        convertFromXPath(value->xpath, update->mutable_path());
-        *update->mutable_val() = typed_v;
-        sr_free_val(value);
-      }
-      sr_free_val_iter(iter);
-
-      if (send && notification->update_size() > 0) {
-        auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
-            now.time_since_epoch()).count();
-        notification->set_timestamp(timestamp);
-        stream->Write(response);
-      }
-      return true;
-    }
-
-   private:
-    gnmi::Subscription gnmi_sub;
-    std::string xpath;
-    struct StoredValue {
-      gnmi::TypedValue v;  // last value sent
-      TimePoint last_sent;  // initialized to epoch
-
-      bool equals(const gnmi::TypedValue &other) {
-        return MessageDifferencer::Equals(v, other);
-      }
-    };
-    std::unordered_map<std::string, StoredValue> values{};
-  };
-
-  static constexpr std::chrono::nanoseconds refresh_int{50000000};  // 50 ms
-
-  SysrepoSession session{};
-  ServerReaderWriter<gnmi::SubscribeResponse, gnmi::SubscribeRequest> *stream;
+  ServerContext *context;
+  Stream *stream;
   const XPathBuilder &xpath_builder;
-  mutable Mutex m{};
-  std::thread t{};
-  std::vector<Subscription> subscriptions{};
-  bool stop{false};
-  std::condition_variable cv_stop{};
+  gNMISubscriptionScheduler *scheduler;
+  std::shared_ptr<StreamSink> sink{nullptr};
+  std::vector<std::shared_ptr<gNMISubscription> > subscriptions{};
 };
 
-constexpr std::chrono::nanoseconds SubscriptionStreamMgr::refresh_int;
-
 }  // namespace
 
 class gNMIServiceSysrepoImpl : public gnmi::gNMI::Service {
@@ -786,8 +879,19 @@ class gNMIServiceSysrepoImpl : public gnmi::gNMI::Service {
     return timestamp;
   }
 
+  // Data retrieved for Get requests and ONCE / POLL subscriptions is cached
+  // for that long. The cache is invalidated on Set and when the datastore is
+  // modified by another application, so the TTL only matters for data for
+  // which we do not get change notifications (e.g. operational state).
+  static constexpr std::chrono::milliseconds kGetCacheTtl{500};
+
+  // ON_CHANGE subscriptions which include operational state are sampled at
+  // this interval, see SysrepoDataSource::needs_polling. Reads are shared by
+  // all the subscriptions to the same path, so we can afford a short interval.
+  static constexpr std::chrono::milliseconds kStatePollInterval{50};
+
   Status set_notification_update_for_path(
-      gnmi::Notification *notification, const SysrepoSession &session,
+      gnmi::Notification *notification,
       const gnmi::Path &prefix, const gnmi::Path &path) {
     std::string xpath;
     xpath_builder.appendToXPath(prefix, &xpath);
@@ -798,47 +902,72 @@ class gNMIServiceSysrepoImpl : public gnmi::gNMI::Service {
     }
     SIMPLELOG << "Getting items for xpath: " << xpath << "\n";
 
-    sr_val_t *value = nullptr;
-    sr_val_iter_t *iter = nullptr;
-    int rc = SR_ERR_OK;
-
-    // get all list instances with their content (recursive)
-    rc = sr_get_items_iter(session.sess, xpath.c_str(), &iter);
-    if (rc != SR_ERR_OK) {
+    gNMIDataSource::Leaves leaves;
+    if (!cached_data_source.get_leaves(xpath, &leaves)) {
       return Status(StatusCode::UNKNOWN,
                     "Error while retrieving subscription items");
     }
 
-    while (sr_get_item_next(session.sess, iter, &value) == SR_ERR_OK) {
-      char *update_xpath = value->xpath;
-      if (!isLeaf(value)) {
-        sr_free_val(value);
-        continue;
-      }
-      if (value->dflt) {  // unset
-        sr_free_val(value);
-        continue;
-      }
-
-      SIMPLELOG << "Update XPath: " << update_xpath << "\n";
-      // sr_print_val(value);
-
+    for (auto &leaf : leaves) {
+      SIMPLELOG << "Update XPath: " << leaf.xpath << "\n";
       auto update = notification->add_update();
       // TODO(antonin): use prefix for smaller messages
-      convertFromXPath(update_xpath, update->mutable_path());
-      convertToTypedValue(value, update->mutable_val());
-      sr_free_val(value);
+      update->mutable_path()->Swap(&leaf.path);
+      update->mutable_val()->Swap(&leaf.val);
     }
-    sr_free_val_iter(iter);
 
     return Status::OK;
   }
 
+  // Used for ONCE and POLL subscriptions: sends the current values for all the
+  // paths in the subscription list, followed by a sync_response message.
+  Status write_subscription_list_updates(
+      const gnmi::SubscriptionList &sub,
+      ServerReaderWriter<gnmi::SubscribeResponse,
+                         gnmi::SubscribeRequest> *stream) {
+    gnmi::SubscribeResponse response;
+    auto *notification = response.mutable_update();
+    notification->set_timestamp(get_timestamp());
+
+    const auto &prefix = sub.prefix();
+    for (const auto &subscription : sub.subscription()) {
+      auto status = set_notification_update_for_path(
+          notification, prefix, subscription.path());
+      if (!status.ok()) return status;
+    }
+    // response.PrintDebugString();
+    stream->Write(response);
+    gnmi::SubscribeResponse EOM;
+    EOM.set_sync_response(true);
+    stream->Write(EOM);
+    return Status::OK;
+  }
+
+  void on_datastore_change(const std::string &xpath) {
+    subscription_scheduler.notify_change(xpath);
+    cached_data_source.invalidate(xpath);
+  }
+
   LYContext LY_ctx;
   XPathBuilder xpath_builder{&LY_ctx};
   LeafTypeCache leaf_type_cache{&LY_ctx};
+  // order matters for destruction: we need to unsubscribe from sysrepo changes
+  // before destroying the scheduler, and the scheduler needs to be stopped
+  // before the data sources are destroyed
+  SysrepoSessionPool session_pool{};
+  SysrepoDataSource data_source{&session_pool, &LY_ctx};
+  // subscriptions use the data source directly, as their sample interval may be
+  // smaller than the TTL
+  gNMICachingDataSource cached_data_source{&data_source, kGetCacheTtl};
+  gNMISubscriptionScheduler subscription_scheduler{
+    &data_source, kStatePollInterval};
+  SysrepoChangeSubscriber change_subscriber{
+    LY_ctx, [this](const std::string &xpath) { on_datastore_change(xpath); }};
 };
 
+constexpr std::chrono::milliseconds gNMIServiceSysrepoImpl::kGetCacheTtl;
+constexpr std::chrono::milliseconds gNMIServiceSysrepoImpl::kStatePollInterval;
+
 std::unique_ptr<gnmi::gNMI::Service> make_gnmi_service_sysrepo() {
   return std::unique_ptr<gnmi::gNMI::Service>(new gNMIServiceSysrepoImpl());
 }
@@ -867,12 +996,6 @@ gNMIServiceSysrepoImpl::Get(ServerContext *context,
                   "Only ALL data type supported for GetRequest");
   }
 
-  SysrepoSession session;
-  if (!session.open()) {
-    return Status(StatusCode::UNKNOWN,
-                  "Error when connecting to yang datastore");
-  }
-
   // gNMI spec: "The target MUST generate a Notification message for each path
   // specified in the client's GetRequest, and hence MUST NOT collapse data from
   // multiple paths into a single Notification within the response."
@@ -882,7 +1005,8 @@ gNMIServiceSysrepoImpl::Get(ServerContext *context,
     // TODO(antonin): should we return an aggregated value (e.g. using
     // ygot-generated protobuf messages once we support them), or return leaf
     // updates like we do for Subscribe/ONCE.
-    set_notification_update_for_path(notification, session, prefix, path);
+    auto status = set_notification_update_for_path(notification, prefix, path);
+    if (!status.ok()) return status;
   }
 
   return Status::OK;
@@ -901,8 +1025,9 @@ gNMIServiceSysrepoImpl::Set(ServerContext *context,
   if (!request->replace().empty())
     return Status(StatusCode::UNIMPLEMENTED, "'replace' not implemented yet");
 
-  SysrepoSession session;
-  if (!session.open()) {
+  // uncommitted changes are discarded when the session is returned to the pool
+  auto session = session_pool.acquire();
+  if (!session.valid()) {
     return Status(StatusCode::UNKNOWN,
                   "Error when connecting to yang datastore");
   }
@@ -915,13 +1040,16 @@ gNMIServiceSysrepoImpl::Set(ServerContext *context,
     return true;
   };
 
+  std::vector<std::string> modified_xpaths;
+
   for (const auto &path : request->delete_()) {
     std::string xpath;
     if (!make_xpath(path, &xpath)) {
       return Status(StatusCode::INVALID_ARGUMENT,
                     "Cannot convert gNMI path to XPath");
     }
-    rc = sr_delete_item(session.sess, xpath.c_str(), SR_EDIT_DEFAULT);
+    modified_xpaths.push_back(xpath);
+    rc = sr_delete_item(session.get(), xpath.c_str(), SR_EDIT_DEFAULT);
     if (rc != SR_ERR_OK)
       return Status(StatusCode::UNKNOWN, "Error when deleting item");
   }
@@ -933,6 +1061,7 @@ gNMIServiceSysrepoImpl::Set(ServerContext *context,
       return Status(StatusCode::INVALID_ARGUMENT,
                     "Cannot convert gNMI path to XPath");
     }
+    modified_xpaths.push_back(xpath);
     const auto &typedV = update.val();
     if (!isTypedValueLeaf(typedV)) {
       return Status(StatusCode::UNIMPLEMENTED,
@@ -945,7 +1074,7 @@ gNMIServiceSysrepoImpl::Set(ServerContext *context,
                         "Leaflist entry must be a scalar");
         }
         auto value_str = convertLeafTypedValueToStr(typedV_e);
-        rc = sr_set_item_str(session.sess, xpath.c_str(), value_str.c_str(),
+        rc = sr_set_item_str(session.get(), xpath.c_str(), value_str.c_str(),
                              SR_EDIT_DEFAULT);
         if (rc != SR_ERR_OK)
           return Status(StatusCode::UNKNOWN,
@@ -953,19 +1082,28 @@ gNMIServiceSysrepoImpl::Set(ServerContext *context,
       }
     } else {
       auto value_str = convertLeafTypedValueToStr(typedV);
-      rc = sr_set_item_str(session.sess, xpath.c_str(), value_str.c_str(),
+      rc = sr_set_item_str(session.get(), xpath.c_str(), value_str.c_str(),
                            SR_EDIT_DEFAULT);
       if (rc != SR_ERR_OK)
         return Status(StatusCode::UNKNOWN, "Error when setting item");
     }
   }
 
-  rc = sr_commit(session.sess);
+  rc = sr_commit(session.get());
   if (rc != SR_ERR_OK) {
     return Status(StatusCode::UNKNOWN, "Error when comitting changes");
     // TODO(antonin): call sr_get_last_errors
   }
 
+  // We will also be notified by sysrepo, but we need to make sure that cached
+  // data is not returned by a subsequent Get. We invalidate whole modules, like
+  // the sysrepo notifications: a cached xpath without keys or with wildcards
+  // may include the modified nodes without being a prefix of their xpath.
+  std::set<std::string> modified_modules;
+  for (const auto &xpath : modified_xpaths)
+    modified_modules.insert("/" + extractOrigin(xpath) + ":");
+  for (const auto &module : modified_modules) on_datastore_change(module);
+
   // TODO(antonin): other response fields
   response->set_timestamp(get_timestamp());
 
@@ -979,46 +1117,57 @@ gNMIServiceSysrepoImpl::Subscribe(
                        gnmi::SubscribeRequest> *stream) {
   SIMPLELOG << "gNMI Subscribe\n";
   gnmi::SubscribeRequest request;
-  SubscriptionStreamMgr subscription_streams(stream, xpath_builder);
+  SubscriptionStreamMgr subscription_streams(
+      context, stream, xpath_builder, &subscription_scheduler);
+  // a stream can only be used for a single subscription mode
+  bool has_mode = false;
+  auto mode = gnmi::SubscriptionList::STREAM;
+  gnmi::SubscriptionList poll_sub;
+  bool has_poll_sub = false;
   while (stream->Read(&request)) {
+    if (request.has_poll()) {
+      if (!has_mode || mode != gnmi::SubscriptionList::POLL) {
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Poll message received without a POLL subscription");
+      }
+      // When the target receives a Poll message, it MUST generate updates for
+      // all the corresponding paths within the SubscriptionList, followed by
+      // a sync_response.
+      auto status = write_subscription_list_updates(poll_sub, stream);
+      if (!status.ok()) return status;
+      continue;
+    }
     if (!request.has_subscribe()) {
       return Status(StatusCode::UNIMPLEMENTED,
-                    "Only subscription lists supported for now");
+                    "Only subscription lists and polls supported for now");
     }
     const auto &sub = request.subscribe();
+    if (has_mode && sub.mode() != mode) {
+      return Status(StatusCode::INVALID_ARGUMENT,
+                    "Cannot change subscription mode on existing stream");
+    }
+    has_mode = true;
+    mode = sub.mode();
     if (sub.mode() == gnmi::SubscriptionList::POLL) {
-      return Status(StatusCode::UNIMPLEMENTED,
-                    "POLL subscriptions not supported for now");
+      if (has_poll_sub) {
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Only one POLL subscription list per stream");
+      }
+      has_poll_sub = true;
+      poll_sub = sub;
+      auto status = write_subscription_list_updates(poll_sub, stream);
+      if (!status.ok()) return status;
     } else if (sub.mode() == gnmi::SubscriptionList::STREAM) {
-      subscription_streams.start();
       auto status = subscription_streams.add_subscription_list(sub);
       if (!status.ok()) return status;
     } else if (sub.mode() == gnmi::SubscriptionList::ONCE) {
-      gnmi::SubscribeResponse response;
-      auto *notification = response.mutable_update();
-      notification->set_timestamp(get_timestamp());
-
-      SysrepoSession session;
-      if (!session.open()) {
-        return Status(StatusCode::UNKNOWN,
-                      "Error when connecting to yang datastore");
-      }
-
-      const auto &prefix = sub.prefix();
-      for (const auto &subscription : sub.subscription()) {
-        set_notification_update_for_path(
-            notification, session, prefix, subscription.path());
-      }
-      // response.PrintDebugString();
-      stream->Write(response);
       // Following the transmission of all updates which correspond to data
       // items within the set of paths specified within the subscription list, a
       // SubscribeResponse message with the sync_response field set to true MUST
       // be transmitted, and the channel over which the SubscribeRequest was
       // received MUST be closed.
-      gnmi::SubscribeResponse EOM;
-      EOM.set_sync_response(true);
-      stream->Write(EOM);
+      auto status = write_subscription_list_updates(sub, stream);
+      if (!status.ok()) return status;
       break;
     } else {
       return Status(StatusCode::INVALID_ARGUMENT, "Invalid subscription mode");
@@ -19,20 +19,30 @@
  */
 
 #include <PI/frontends/proto/device_mgr.h>
+#include <PI/frontends/proto/replication.h>
+#include <PI/frontends/proto/thread_placement.h>
+#include <PI/pi.h>
 
 #include <grpcpp/grpcpp.h>
 // #include <grpcpp/support/error_details.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "gnmi.h"
 #include "gnmi/gnmi.grpc.pb.h"
 #include "google/rpc/code.pb.h"
 #include "log.h"
+#include "p4/server/v1/bulk_write.grpc.pb.h"
+#include "p4/server/v1/changes.grpc.pb.h"
 #include "p4/server/v1/config.grpc.pb.h"
 #include "p4/v1/p4runtime.grpc.pb.h"
 #include "pi_server_testing.h"
@@ -45,12 +55,15 @@
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
+using grpc::ServerReader;
 using grpc::ServerWriter;
 using grpc::ServerReaderWriter;
 using grpc::Status;
 using grpc::StatusCode;
 
 using pi::fe::proto::DeviceMgr;
+using pi::fe::proto::ReplicationPublisher;
+using pi::fe::proto::ReplicationSubscriber;
 
 namespace p4v1 = ::p4::v1;
 namespace p4serverv1 = ::p4::server::v1;
@@ -178,6 +191,8 @@ class DeviceState {
     auto lock = unique_lock();
     if (device_mgr == nullptr) {
       device_mgr.reset(new DeviceMgr(device_id));
+      if (replication_publisher != nullptr)
+        device_mgr->replication_publisher_set(replication_publisher);
       auto status = device_mgr->server_config_set(
           server_config.get_config());
       // Should not fail here since we accepted the config previously
@@ -189,6 +204,15 @@ class DeviceState {
   }
 
   Status set_server_config(const p4serverv1::Config &config) {
+    // validated here since the config may be set before the DeviceMgr instance
+    // is created
+    for (const auto &class_config : config.scheduling().classes()) {
+      if (!p4serverv1::SchedulingConfig::PriorityClass_IsValid(
+              class_config.priority_class())) {
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Invalid priority class in scheduling config");
+      }
+    }
     server_config.set_config(config);
     auto lock = unique_lock();
     if (device_mgr != nullptr) {
@@ -201,6 +225,18 @@ class DeviceState {
     return server_config.get_config();
   }
 
+  Status get_scheduling_stats(p4serverv1::SchedulingStats *stats) const {
+    auto lock = shared_lock();
+    if (device_mgr == nullptr) return no_pipeline_config_status();
+    return to_grpc_status(device_mgr->scheduling_stats_get(stats));
+  }
+
+  Status get_memory_usage(p4serverv1::MemoryUsage *usage) const {
+    auto lock = shared_lock();
+    if (device_mgr == nullptr) return no_pipeline_config_status();
+    return to_grpc_status(device_mgr->memory_usage_get(usage));
+  }
+
   void send_stream_message(p4v1::StreamMessageResponse *msg) {
     auto lock = shared_lock();
     auto primary = get_primary();
@@ -277,17 +313,17 @@ class DeviceState {
     auto lock = shared_lock();
     if (!is_primary(connection)) return;
     if (device_mgr == nullptr) return;
-    std::lock_guard<std::mutex> packetout_lock(packetout_mutex);
+    // DeviceMgr can handle packets from different streams concurrently, each
+    // stream using its own buffers, so there is no need to serialize them here
     device_mgr->stream_message_request_handle(request);
     if (request.update_case() == p4v1::StreamMessageRequest::kPacket) {
       SIMPLELOG << "PACKET OUT\n";
-      pkt_out_count++;
+      pkt_out_count.fetch_add(1, std::memory_order_relaxed);
     }
   }
 
   uint64_t get_pkt_out_count() {
-    std::lock_guard<std::mutex> packetout_lock(packetout_mutex);
-    return pkt_out_count;
+    return pkt_out_count.load(std::memory_order_relaxed);
   }
 
   bool is_primary(const Uint128 &election_id) const {
@@ -348,15 +384,15 @@ class DeviceState {
   }
 
   static p4serverv1::Config default_server_config;
+  // set on all DeviceMgr instances when replication is enabled
+  static std::shared_ptr<ReplicationPublisher> replication_publisher;
 
   // protects DeviceMgr, connections, ...
   mutable SharedMutex m{};
   // protects pkt_in_count and ensures sequential writes on the stream
   mutable std::mutex packetin_mutex;
-  // protects pkt_out_count
-  mutable std::mutex packetout_mutex;
   uint64_t pkt_in_count{0};
-  uint64_t pkt_out_count{0};
+  std::atomic<uint64_t> pkt_out_count{0};
   std::unique_ptr<DeviceMgr> device_mgr{nullptr};
   std::set<Connection *, CompareConnections> connections{};
   DeviceMgr::device_id_t device_id;
@@ -365,36 +401,59 @@ class DeviceState {
 
 /* static */
 p4serverv1::Config DeviceState::default_server_config;
+/* static */
+std::shared_ptr<ReplicationPublisher> DeviceState::replication_publisher;
 
+// Devices are never removed, which lets us publish immutable snapshots of the
+// device map through an atomic pointer: the lookup performed for every RPC is
+// lock-free, and only the creation of a new device takes the mutex (to copy
+// the map). Previous snapshots may still be in use by concurrent readers so
+// they are only released on destruction; there is one per device.
 class Devices {
  public:
   static DeviceState *get(DeviceMgr::device_id_t device_id) {
     auto &instance = get_instance();
+    auto device = instance.find(device_id);
+    if (device != nullptr) return device;
     std::lock_guard<std::mutex> lock(instance.m);
-    auto &map = instance.device_map;
-    auto it = map.find(device_id);
-    if (it != map.end()) return it->second.get();
-    auto device = new DeviceState(device_id);
-    map.emplace(device_id, std::unique_ptr<DeviceState>(device));
+    device = instance.find(device_id);
+    if (device != nullptr) return device;
+    device = new DeviceState(device_id);
+    instance.devices.emplace_back(device);
+    std::unique_ptr<DeviceMap> new_map(new DeviceMap(*instance.map.load()));
+    new_map->emplace(device_id, device);
+    instance.map.store(new_map.get(), std::memory_order_release);
+    instance.maps.push_back(std::move(new_map));
     return device;
   }
 
   static bool has_device(DeviceMgr::device_id_t device_id) {
-    auto &instance = get_instance();
-    std::lock_guard<std::mutex> lock(instance.m);
-    auto &map = instance.device_map;
-    return (map.find(device_id) != map.end());
+    return get_instance().find(device_id) != nullptr;
   }
 
  private:
+  using DeviceMap = std::unordered_map<DeviceMgr::device_id_t, DeviceState *>;
+
+  Devices() {
+    maps.emplace_back(new DeviceMap());
+    map.store(maps.back().get());
+  }
+
   static Devices &get_instance() {
     static Devices devices;
     return devices;
   }
 
+  DeviceState *find(DeviceMgr::device_id_t device_id) const {
+    const auto *snapshot = map.load(std::memory_order_acquire);
+    auto it = snapshot->find(device_id);
+    return (it == snapshot->end()) ? nullptr : it->second;
+  }
+
   mutable std::mutex m{};
-  std::unordered_map<DeviceMgr::device_id_t,
-                     std::unique_ptr<DeviceState> > device_map{};
+  std::vector<std::unique_ptr<DeviceState> > devices{};
+  std::vector<std::unique_ptr<DeviceMap> > maps{};
+  std::atomic<const DeviceMap *> map{nullptr};
 };
 
 void stream_message_response_cb(DeviceMgr::device_id_t device_id,
@@ -430,11 +489,11 @@ class P4RuntimeServiceImpl : public p4v1::P4Runtime::Service {
               ServerWriter<p4v1::ReadResponse> *writer) override {
     SIMPLELOG << "P4Runtime Read\n";
     SIMPLELOG << request->DebugString();
-    p4v1::ReadResponse response;
     auto device_mgr = Devices::get(request->device_id())->get_p4_mgr();
     if (device_mgr == nullptr) return no_pipeline_config_status();
-    auto status = device_mgr->read(*request, &response);
-    writer->Write(response);
+    std::shared_ptr<const p4v1::ReadResponse> response;
+    auto status = device_mgr->read_cached(*request, &response);
+    writer->Write(*response);
     return to_grpc_status(status);
   }
 
@@ -563,6 +622,174 @@ void stream_message_response_cb(DeviceMgr::device_id_t device_id,
   Devices::get(device_id)->send_stream_message(msg);
 }
 
+// Bounded queue used to hand over BulkWrite chunks from the RPC handler (which
+// reads them from the stream) to the thread which applies them. When the queue
+// is full the handler stops reading from the stream, which in turn lets gRPC
+// flow control push back on the client.
+class BulkWriteChunkQueue {
+ public:
+  explicit BulkWriteChunkQueue(size_t max_size)
+      : max_size(max_size) { }
+
+  // returns false if the consumer gave up
+  bool push(p4serverv1::BulkWriteRequest *chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    can_push.wait(lock, [this] { return aborted || q.size() < max_size; });
+    if (aborted) return false;
+    q.emplace_back();
+    q.back().Swap(chunk);
+    can_pop.notify_one();
+    return true;
+  }
+
+  // returns false if the producer is done and the queue is empty
+  bool pop(p4serverv1::BulkWriteRequest *chunk) {
+    std::unique_lock<std::mutex> lock(mutex);
+    can_pop.wait(lock, [this] { return closed || !q.empty(); });
+    if (q.empty()) return false;
+    chunk->Swap(&q.front());
+    q.pop_front();
+    can_push.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    can_pop.notify_one();
+  }
+
+  void abort() {
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+    q.clear();
+    can_push.notify_one();
+  }
+
+ private:
+  size_t max_size;
+  mutable std::mutex mutex{};
+  std::condition_variable can_push{};
+  std::condition_variable can_pop{};
+  std::deque<p4serverv1::BulkWriteRequest> q{};
+  bool closed{false};
+  bool aborted{false};
+};
+
+class P4RuntimeBulkServiceImpl : public p4serverv1::P4RuntimeBulk::Service {
+ public:
+  static constexpr size_t max_pending_chunks = 8;
+  static constexpr size_t max_error_details = 1024;
+
+ private:
+  Status BulkWrite(ServerContext *context,
+                   ServerReader<p4serverv1::BulkWriteRequest> *reader,
+                   p4serverv1::BulkWriteResponse *rep) override {
+    SIMPLELOG << "P4Runtime BulkWrite\n";
+    (void) context;
+    BulkWriteChunkQueue queue(max_pending_chunks);
+    Status status;
+    // Chunks are applied by a separate thread, so that the next chunks can be
+    // received while the target is busy.
+    std::thread apply_thread([&queue, &status, rep, this] {
+      pi_thread_start("bulk_write");
+      status = apply_chunks(&queue, rep);
+      if (!status.ok()) queue.abort();
+    });
+    p4serverv1::BulkWriteRequest chunk;
+    while (reader->Read(&chunk)) {
+      if (!queue.push(&chunk)) break;
+    }
+    queue.close();
+    apply_thread.join();
+    return status;
+  }
+
+  Status apply_chunks(BulkWriteChunkQueue *queue,
+                      p4serverv1::BulkWriteResponse *rep) {
+    p4serverv1::BulkWriteRequest chunk;
+    p4v1::WriteRequest request;
+    request.set_atomicity(p4v1::WriteRequest::CONTINUE_ON_ERROR);
+    bool first_chunk = true;
+    uint64_t num_updates = 0;
+    uint64_t num_errors = 0;
+    while (queue->pop(&chunk)) {
+      if (first_chunk) {
+        request.set_device_id(chunk.device_id());
+        if (chunk.has_election_id())
+          request.mutable_election_id()->CopyFrom(chunk.election_id());
+        first_chunk = false;
+      } else if (chunk.device_id() != request.device_id()) {
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "All chunks must target the same device");
+      } else if (chunk.has_election_id() != request.has_election_id() ||
+                 chunk.election_id().high() != request.election_id().high() ||
+                 chunk.election_id().low() != request.election_id().low()) {
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "All chunks must use the same election id");
+      }
+      // The primary status is re-checked for each chunk, as mastership may
+      // change during a long-lived stream.
+      auto device = Devices::get(chunk.device_id());
+      auto num_connections = device->connections_size();
+      if (num_connections == 0 && chunk.has_election_id())
+        return not_primary_status();
+      Uint128 election_id(chunk.election_id().high(),
+                          chunk.election_id().low());
+      if (num_connections > 0 && !device->is_primary(election_id))
+        return not_primary_status();
+      auto device_mgr = device->get_p4_mgr();
+      if (device_mgr == nullptr) return no_pipeline_config_status();
+
+      request.mutable_updates()->Swap(chunk.mutable_updates());
+      auto chunk_size = static_cast<uint64_t>(request.updates_size());
+      auto write_status = device_mgr->bulk_write(request);
+      request.clear_updates();
+      if (write_status.code() != ::google::rpc::Code::OK) {
+        // With CONTINUE_ON_ERROR, individual update failures are reported as
+        // one p4v1::Error per update; anything else is a fatal error.
+        if (static_cast<uint64_t>(write_status.details_size()) != chunk_size)
+          return to_grpc_status(write_status);
+        for (uint64_t i = 0; i < chunk_size; i++) {
+          p4v1::Error error;
+          if (!write_status.details(i).UnpackTo(&error))
+            return to_grpc_status(write_status);
+          if (error.canonical_code() == ::google::rpc::Code::OK) continue;
+          if (num_errors++ >= max_error_details) continue;
+          auto update_error = rep->add_errors();
+          update_error->set_index(num_updates + i);
+          update_error->mutable_error()->Swap(&error);
+        }
+      }
+      num_updates += chunk_size;
+    }
+    rep->set_num_updates(num_updates);
+    rep->set_num_errors(num_errors);
+    return Status::OK;
+  }
+};
+
+/* static */
+constexpr size_t P4RuntimeBulkServiceImpl::max_pending_chunks;
+/* static */
+constexpr size_t P4RuntimeBulkServiceImpl::max_error_details;
+
+class P4RuntimeChangesServiceImpl
+    : public p4serverv1::P4RuntimeChanges::Service {
+ private:
+  Status ReadChanges(ServerContext *context,
+                     const p4serverv1::ReadChangesRequest *request,
+                     p4serverv1::ReadChangesResponse *rep) override {
+    SIMPLELOG << "P4Runtime ReadChanges\n";
+    SIMPLELOG << request->DebugString();
+    (void) context;
+    auto device_mgr = Devices::get(request->device_id())->get_p4_mgr();
+    if (device_mgr == nullptr) return no_pipeline_config_status();
+    auto status = device_mgr->read_changes(*request, rep);
+    return to_grpc_status(status);
+  }
+};
+
 class ServerConfigServiceImpl : public p4serverv1::ServerConfig::Service {
  private:
   Status Set(ServerContext *context,
@@ -580,6 +807,22 @@ class ServerConfigServiceImpl : public p4serverv1::ServerConfig::Service {
     response->mutable_config()->CopyFrom(device->get_server_config());
     return Status::OK;
   }
+
+  Status GetSchedulingStats(
+      ServerContext *context,
+      const p4serverv1::GetSchedulingStatsRequest *request,
+      p4serverv1::GetSchedulingStatsResponse *response) override {
+    auto device = Devices::get(request->device_id());
+    return device->get_scheduling_stats(response->mutable_stats());
+  }
+
+  Status GetMemoryUsage(
+      ServerContext *context,
+      const p4serverv1::GetMemoryUsageRequest *request,
+      p4serverv1::GetMemoryUsageResponse *response) override {
+    auto device = Devices::get(request->device_id());
+    return device->get_memory_usage(response->mutable_usage());
+  }
 };
 
 struct ServerData {
@@ -588,6 +831,8 @@ struct ServerData {
   P4RuntimeServiceImpl pi_service;
   std::unique_ptr<gnmi::gNMI::Service> gnmi_service;
   ServerConfigServiceImpl server_config_service;
+  P4RuntimeBulkServiceImpl bulk_service;
+  P4RuntimeChangesServiceImpl changes_service;
   ServerBuilder builder;
   std::unique_ptr<Server> server;
 };
@@ -651,9 +896,16 @@ void PIGrpcServerRunAddrGnmi(const char *server_address, void *gnmi_service) {
   }
   builder.RegisterService(server_data->gnmi_service.get());
   builder.RegisterService(&server_data->server_config_service);
+  builder.RegisterService(&server_data->bulk_service);
+  builder.RegisterService(&server_data->changes_service);
   builder.SetMaxReceiveMessageSize(256*1024*1024);  // 256MB
 
-  server_data->server = builder.BuildAndStart();
+  {
+    // gRPC threads cannot be hooked, they inherit the placement of the thread
+    // which starts the server instead
+    ThreadPlacement::Scoped grpc_placement("grpc");
+    server_data->server = builder.BuildAndStart();
+  }
   std::cout << "Server listening on " << server_data->server_address << "\n";
 }
 
@@ -661,6 +913,39 @@ void PIGrpcServerRunAddr(const char *server_address) {
   PIGrpcServerRunAddrGnmi(server_address, nullptr);
 }
 
+void PIGrpcServerEnableReplication(const char *socket_path) {
+  auto publisher = std::make_shared<ReplicationPublisher>(socket_path);
+  auto status = publisher->start();
+  if (status.code() != ::google::rpc::Code::OK) {
+    std::cerr << "Cannot enable replication: " << status.message() << "\n";
+    return;
+  }
+  ::pi::server::DeviceState::replication_publisher = publisher;
+}
+
+void PIGrpcServerRunStandby(const char *socket_path,
+                            const char *server_address) {
+  ReplicationSubscriber subscriber(socket_path);
+  std::cout << "Standby mirroring primary on " << socket_path << "\n";
+  auto status = subscriber.run();
+  if (status.code() != ::google::rpc::Code::OK)
+    std::cout << "No primary found on " << socket_path << "\n";
+  // the former standby becomes the primary for the next standby
+  PIGrpcServerEnableReplication(socket_path);
+  for (auto device_id : subscriber.devices()) {
+    auto device_mgr =
+        ::pi::server::Devices::get(device_id)->get_or_add_p4_mgr();
+    status = subscriber.takeover(device_id, device_mgr);
+    if (status.code() != ::google::rpc::Code::OK) {
+      std::cerr << "Error when taking over device " << device_id << ": "
+                << status.message() << "\n";
+    }
+    device_mgr->stream_message_response_register_cb(
+        ::pi::server::stream_message_response_cb, NULL);
+  }
+  PIGrpcServerRunAddr(server_address);
+}
+
 void PIGrpcServerRun() {
   PIGrpcServerRunAddrGnmi("0.0.0.0:9559", nullptr);
 }
@@ -423,6 +423,47 @@ class DummyTable {
     return PI_STATUS_SUCCESS;
   }
 
+  // the cursor is a snapshot of the entry handles; entries deleted since the
+  // snapshot was taken are skipped
+  pi_status_t entries_fetch_begin(pi_table_fetch_cursor_t *cursor) {
+    auto *handles = new std::vector<pi_entry_handle_t>();
+    for (const auto &p : entries) handles->push_back(p.first);
+    cursor->target_state = handles;
+    return PI_STATUS_SUCCESS;
+  }
+
+  pi_status_t entries_fetch_next(pi_table_fetch_cursor_t *cursor,
+                                 size_t max_entries,
+                                 pi_table_fetch_res_t *res) {
+    auto *handles = static_cast<std::vector<pi_entry_handle_t> *>(
+        cursor->target_state);
+    res->num_entries = 0;
+    res->mkey_nbytes = 0;
+    char *buf = new char[16384];  // should be large enough for testing
+    char *buf_ptr = buf;
+    while (res->num_entries < max_entries && !handles->empty()) {
+      auto entry_handle = handles->back();
+      handles->pop_back();
+      auto it = entries.find(entry_handle);
+      if (it == entries.end()) continue;
+      res->num_entries++;
+      buf_ptr += emit_entry_handle(buf_ptr, entry_handle);
+      res->mkey_nbytes = it->second.mk.nbytes();
+      buf_ptr += it->second.mk.emit(buf_ptr);
+      buf_ptr += it->second.entry.emit(buf_ptr);
+      buf_ptr += emit_direct_configs(buf_ptr, entry_handle);
+    }
+    res->entries = buf;
+    res->entries_size = std::distance(buf, buf_ptr);
+    return PI_STATUS_SUCCESS;
+  }
+
+  pi_status_t entries_fetch_end(pi_table_fetch_cursor_t *cursor) {
+    delete static_cast<std::vector<pi_entry_handle_t> *>(cursor->target_state);
+    cursor->target_state = nullptr;
+    return PI_STATUS_SUCCESS;
+  }
+
   pi_status_t entries_fetch_wkey(const pi_match_key_t *match_key,
                                  pi_table_fetch_res_t *res) {
     res->mkey_nbytes = 0;
@@ -900,6 +941,28 @@ class DummySwitch {
     return get_table(table_id).entries_fetch_wkey(match_key, res);
   }
 
+  // by default, PI falls back to a full table fetch
+  pi_status_t table_entries_fetch_begin(pi_p4_id_t table_id,
+                                        pi_table_fetch_cursor_t *cursor) {
+    if (!fetch_cursor_supported) return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET;
+    return get_table(table_id).entries_fetch_begin(cursor);
+  }
+
+  pi_status_t table_entries_fetch_next(pi_table_fetch_cursor_t *cursor,
+                                       size_t max_entries,
+                                       pi_table_fetch_res_t *res) {
+    return get_table(cursor->table_id).entries_fetch_next(
+        cursor, max_entries, res);
+  }
+
+  pi_status_t table_entries_fetch_end(pi_table_fetch_cursor_t *cursor) {
+    return get_table(cursor->table_id).entries_fetch_end(cursor);
+  }
+
+  void set_fetch_cursor_support(bool supported) {
+    fetch_cursor_supported = supported;
+  }
+
   pi_status_t table_idle_timeout_config_set(
       pi_p4_id_t table_id, const pi_idle_timeout_config_t *config) {
     return get_table(table_id).idle_timeout_config_set(config);
@@ -911,6 +974,18 @@ class DummySwitch {
     return get_table(table_id).entry_get_remaining_ttl(entry_handle, ttl_ns);
   }
 
+  pi_status_t table_entries_get_remaining_ttl(
+      pi_p4_id_t table_id, size_t num_entries,
+      const pi_entry_handle_t *entry_handles, uint64_t *ttls_ns) {
+    auto &table = get_table(table_id);
+    for (size_t i = 0; i < num_entries; i++) {
+      auto status = table.entry_get_remaining_ttl(
+          entry_handles[i], &ttls_ns[i]);
+      if (status != PI_STATUS_SUCCESS) return status;
+    }
+    return PI_STATUS_SUCCESS;
+  }
+
   pi_status_t action_prof_member_create(pi_p4_id_t act_prof_id,
                                         const pi_action_data_t *action_data,
                                         pi_indirect_handle_t *mbr_handle) {
@@ -1045,6 +1120,11 @@ class DummySwitch {
     return PI_STATUS_SUCCESS;
   }
 
+  // by default, packets are sent one at a time by PI
+  pi_status_t packetout_send_batch(const pi_packet_t *, size_t, size_t *) {
+    return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET;
+  }
+
   pi_status_t packetin_inject(const std::string &packet) const {
     return pi_packetin_receive(device_id, packet.data(), packet.size());
   }
@@ -1192,6 +1272,7 @@ class DummySwitch {
   std::unordered_map<pi_port_t, pi_port_status_t> ports_status{};
   DummyPRE pre{};
   device_id_t device_id;
+  bool fetch_cursor_supported{false};
 };
 
 /* static */
@@ -1225,10 +1306,19 @@ DummySwitchMock::DummySwitchMock(device_id_t device_id)
       .WillByDefault(Invoke(sw_, &DummySwitch::table_entries_fetch));
   ON_CALL(*this, table_entries_fetch_wkey(_, _, _))
       .WillByDefault(Invoke(sw_, &DummySwitch::table_entries_fetch_wkey));
+  ON_CALL(*this, table_entries_fetch_begin(_, _))
+      .WillByDefault(Invoke(sw_, &DummySwitch::table_entries_fetch_begin));
+  ON_CALL(*this, table_entries_fetch_next(_, _, _))
+      .WillByDefault(Invoke(sw_, &DummySwitch::table_entries_fetch_next));
+  ON_CALL(*this, table_entries_fetch_end(_))
+      .WillByDefault(Invoke(sw_, &DummySwitch::table_entries_fetch_end));
   ON_CALL(*this, table_idle_timeout_config_set(_, _))
       .WillByDefault(Invoke(sw_, &DummySwitch::table_idle_timeout_config_set));
   ON_CALL(*this, table_entry_get_remaining_ttl(_, _, _))
       .WillByDefault(Invoke(sw_, &DummySwitch::table_entry_get_remaining_ttl));
+  ON_CALL(*this, table_entries_get_remaining_ttl(_, _, _, _))
+      .WillByDefault(Invoke(sw_,
+                            &DummySwitch::table_entries_get_remaining_ttl));
 
   // cannot use DoAll to combine 2 actions here (call to real object + handle
   // capture), because the handle needs to be captured after the delegated call,
@@ -1281,6 +1371,8 @@ DummySwitchMock::DummySwitchMock(device_id_t device_id)
 
   ON_CALL(*this, packetout_send(_, _))
       .WillByDefault(Invoke(sw_, &DummySwitch::packetout_send));
+  ON_CALL(*this, packetout_send_batch(_, _, _))
+      .WillByDefault(Invoke(sw_, &DummySwitch::packetout_send_batch));
 
   ON_CALL(*this, mc_grp_create(_, _))
       .WillByDefault(Invoke(this, &DummySwitchMock::_mc_grp_create));
@@ -1411,6 +1503,11 @@ DummySwitchMock::set_p4info(const pi_p4info_t *p4info) {
   sw->set_p4info(p4info);
 }
 
+void
+DummySwitchMock::set_fetch_cursor_support(bool supported) {
+  sw->set_fetch_cursor_support(supported);
+}
+
 void
 DummySwitchMock::reset() {
   sw->reset();
@@ -1586,6 +1683,28 @@ pi_status_t _pi_table_entries_fetch_wkey(pi_session_handle_t,
       table_id, match_key, res);
 }
 
+pi_status_t _pi_table_entries_fetch_begin(pi_session_handle_t,
+                                          pi_dev_tgt_t dev_tgt,
+                                          pi_p4_id_t table_id,
+                                          pi_table_fetch_cursor_t *cursor) {
+  return DeviceResolver::get_switch(dev_tgt.dev_id)->table_entries_fetch_begin(
+      table_id, cursor);
+}
+
+pi_status_t _pi_table_entries_fetch_next(pi_session_handle_t,
+                                         pi_table_fetch_cursor_t *cursor,
+                                         size_t max_entries,
+                                         pi_table_fetch_res_t *res) {
+  return DeviceResolver::get_switch(cursor->dev_tgt.dev_id)
+      ->table_entries_fetch_next(cursor, max_entries, res);
+}
+
+pi_status_t _pi_table_entries_fetch_end(pi_session_handle_t,
+                                        pi_table_fetch_cursor_t *cursor) {
+  return DeviceResolver::get_switch(cursor->dev_tgt.dev_id)
+      ->table_entries_fetch_end(cursor);
+}
+
 pi_status_t _pi_table_entries_fetch_done(pi_session_handle_t,
                                          pi_table_fetch_res_t *res) {
   delete[] res->entries;
@@ -1610,6 +1729,14 @@ pi_status_t _pi_table_entry_get_remaining_ttl(pi_session_handle_t,
       table_id, entry_handle, ttl_ns);
 }
 
+pi_status_t _pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns) {
+  return DeviceResolver::get_switch(dev_id)->table_entries_get_remaining_ttl(
+      table_id, num_entries, entry_handles, ttls_ns);
+}
+
 pi_status_t _pi_act_prof_mbr_create(pi_session_handle_t,
                                     pi_dev_tgt_t dev_tgt,
                                     pi_p4_id_t act_prof_id,
@@ -1817,6 +1944,13 @@ pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
   return DeviceResolver::get_switch(dev_id)->packetout_send(pkt, size);
 }
 
+pi_status_t _pi_packetout_send_batch(pi_dev_id_t dev_id,
+                                     const pi_packet_t *pkts, size_t num_pkts,
+                                     size_t *num_sent) {
+  return DeviceResolver::get_switch(dev_id)->packetout_send_batch(
+      pkts, num_pkts, num_sent);
+}
+
 pi_status_t _pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                 pi_port_status_t *status) {
   return DeviceResolver::get_switch(dev_id)->port_status_get(port, status);
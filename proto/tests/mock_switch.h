@@ -109,6 +109,10 @@ class DummySwitchMock {
 
   void set_p4info(const pi_p4info_t *p4info);
 
+  // by default, the table entries fetch cursor is not supported natively and
+  // PI falls back to fetching the whole table
+  void set_fetch_cursor_support(bool supported);
+
   void reset();
 
   MOCK_METHOD4(table_entry_add,
@@ -131,10 +135,20 @@ class DummySwitchMock {
   MOCK_METHOD3(table_entries_fetch_wkey,
                pi_status_t(pi_p4_id_t, const pi_match_key_t *,
                            pi_table_fetch_res_t *));
+  MOCK_METHOD2(table_entries_fetch_begin,
+               pi_status_t(pi_p4_id_t, pi_table_fetch_cursor_t *));
+  MOCK_METHOD3(table_entries_fetch_next,
+               pi_status_t(pi_table_fetch_cursor_t *, size_t,
+                           pi_table_fetch_res_t *));
+  MOCK_METHOD1(table_entries_fetch_end,
+               pi_status_t(pi_table_fetch_cursor_t *));
   MOCK_METHOD2(table_idle_timeout_config_set,
                pi_status_t(pi_p4_id_t, const pi_idle_timeout_config_t *));
   MOCK_METHOD3(table_entry_get_remaining_ttl,
                pi_status_t(pi_p4_id_t, pi_entry_handle_t, uint64_t *));
+  MOCK_METHOD4(table_entries_get_remaining_ttl,
+               pi_status_t(pi_p4_id_t, size_t, const pi_entry_handle_t *,
+                           uint64_t *));
 
   MOCK_METHOD3(action_prof_member_create,
                pi_status_t(pi_p4_id_t, const pi_action_data_t *,
@@ -196,6 +210,8 @@ class DummySwitchMock {
                            const pi_counter_data_t *));
 
   MOCK_METHOD2(packetout_send, pi_status_t(const char *, size_t));
+  MOCK_METHOD3(packetout_send_batch,
+               pi_status_t(const pi_packet_t *, size_t, size_t *));
 
   MOCK_METHOD2(mc_grp_create,
                pi_status_t(pi_mc_grp_id_t, pi_mc_grp_handle_t *));
@@ -0,0 +1,368 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <grpcpp/grpcpp.h>
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/text_format.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PI/frontends/proto/device_mgr.h"
+
+#include "google/rpc/code.pb.h"
+#include "p4/server/v1/bulk_write.grpc.pb.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+#include "mock_switch.h"
+#include "utils.h"
+
+namespace p4v1 = ::p4::v1;
+namespace p4configv1 = ::p4::config::v1;
+namespace p4serverv1 = ::p4::server::v1;
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using grpc::ClientContext;
+using grpc::Status;
+using grpc::StatusCode;
+
+using Code = ::google::rpc::Code;
+using pi::fe::proto::DeviceMgr;
+
+class TestBulkWrite : public ::testing::Test {
+ protected:
+  TestBulkWrite()
+      : channel(grpc::CreateChannel(
+            server->bind_addr(), grpc::InsecureChannelCredentials())),
+        stub(p4serverv1::P4RuntimeBulk::NewStub(channel)) { }
+
+  static void SetUpTestCase() {
+    server = new TestServer();
+  }
+
+  static void TearDownTestCase() {
+    delete server;
+  }
+
+  p4serverv1::BulkWriteRequest make_chunk(int num_updates) const {
+    p4serverv1::BulkWriteRequest chunk;
+    chunk.set_device_id(device_id);
+    for (int i = 0; i < num_updates; i++) {
+      auto update = chunk.add_updates();
+      update->set_type(p4v1::Update::INSERT);
+      update->mutable_entity()->mutable_table_entry()->set_table_id(1);
+    }
+    return chunk;
+  }
+
+  uint64_t device_id{0};
+  std::shared_ptr<grpc::Channel> channel;
+  std::unique_ptr<p4serverv1::P4RuntimeBulk::Stub> stub;
+
+  static TestServer *server;
+};
+
+TestServer *TestBulkWrite::server = nullptr;
+
+TEST_F(TestBulkWrite, EmptyStream) {
+  ClientContext context;
+  p4serverv1::BulkWriteResponse rep;
+  auto writer = stub->BulkWrite(&context, &rep);
+  writer->WritesDone();
+  auto status = writer->Finish();
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(0u, rep.num_updates());
+  EXPECT_EQ(0u, rep.num_errors());
+  EXPECT_EQ(0, rep.errors_size());
+}
+
+TEST_F(TestBulkWrite, NoPipelineConfig) {
+  ClientContext context;
+  p4serverv1::BulkWriteResponse rep;
+  auto writer = stub->BulkWrite(&context, &rep);
+  // the server may stop reading after the first chunk
+  for (int i = 0; i < 16; i++) {
+    if (!writer->Write(make_chunk(8))) break;
+  }
+  writer->WritesDone();
+  auto status = writer->Finish();
+  EXPECT_EQ(StatusCode::FAILED_PRECONDITION, status.error_code());
+}
+
+TEST_F(TestBulkWrite, NotPrimary) {
+  ClientContext context;
+  p4serverv1::BulkWriteResponse rep;
+  auto writer = stub->BulkWrite(&context, &rep);
+  auto chunk = make_chunk(1);
+  chunk.mutable_election_id()->set_low(1);
+  writer->Write(chunk);
+  writer->WritesDone();
+  auto status = writer->Finish();
+  // no primary client for the device, so a non-empty election id is rejected
+  EXPECT_EQ(StatusCode::PERMISSION_DENIED, status.error_code());
+}
+
+// Same as above, but with a P4 pipeline set on a DummySwitchMock device, so
+// that updates are actually applied and can be read back with P4Runtime.
+class TestBulkWriteWithPipeline : public TestBulkWrite {
+ protected:
+  TestBulkWriteWithPipeline()
+      : p4runtime_stub(p4v1::P4Runtime::NewStub(channel)),
+        mock(wrapper.sw()) {
+    device_id = wrapper.device_id();
+  }
+
+  static void SetUpTestCase() {
+    DeviceMgr::init();
+    TestBulkWrite::SetUpTestCase();
+    std::ifstream istream(input_path);
+    google::protobuf::io::IstreamInputStream istream_(&istream);
+    google::protobuf::TextFormat::Parse(&istream_, &p4info_proto);
+    for (const auto &table : p4info_proto.tables()) {
+      if (table.preamble().name() == "ExactOne") t_id = table.preamble().id();
+    }
+    for (const auto &action : p4info_proto.actions()) {
+      if (action.preamble().name() == "actionA") a_id = action.preamble().id();
+    }
+  }
+
+  // DeviceMgr::destroy is not called, as the server keeps the DeviceMgr
+  // instance for the device until the process exits.
+
+  void SetUp() override {
+    // the pipeline is set again for each test, as the mock device is not
+    // shared between tests
+    p4v1::SetForwardingPipelineConfigRequest request;
+    request.set_device_id(device_id);
+    request.set_action(
+        p4v1::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT);
+    auto config = request.mutable_config();
+    config->mutable_p4info()->CopyFrom(p4info_proto);
+    config->set_p4_device_config("This is a dummy device config");
+    ClientContext context;
+    p4v1::SetForwardingPipelineConfigResponse rep;
+    auto status = p4runtime_stub->SetForwardingPipelineConfig(
+        &context, request, &rep);
+    ASSERT_TRUE(status.ok());
+  }
+
+  // key is the 32-bit exact match value, param is the 48-bit actionA parameter
+  static void add_update(p4serverv1::BulkWriteRequest *chunk,
+                         p4v1::Update::Type type, uint32_t key,
+                         uint64_t param = 0) {
+    auto update = chunk->add_updates();
+    update->set_type(type);
+    auto table_entry = update->mutable_entity()->mutable_table_entry();
+    table_entry->set_table_id(t_id);
+    auto mf = table_entry->add_match();
+    mf->set_field_id(1);
+    mf->mutable_exact()->set_value(to_bytes(key, 4));
+    if (type == p4v1::Update::DELETE) return;
+    auto action = table_entry->mutable_action()->mutable_action();
+    action->set_action_id(a_id);
+    auto p = action->add_params();
+    p->set_param_id(1);
+    p->set_value(to_bytes(param, 6));
+  }
+
+  p4serverv1::BulkWriteRequest new_chunk() const {
+    p4serverv1::BulkWriteRequest chunk;
+    chunk.set_device_id(device_id);
+    return chunk;
+  }
+
+  Status bulk_write(const std::vector<p4serverv1::BulkWriteRequest> &chunks,
+                    p4serverv1::BulkWriteResponse *rep) {
+    ClientContext context;
+    auto writer = stub->BulkWrite(&context, rep);
+    for (const auto &chunk : chunks) {
+      if (!writer->Write(chunk)) break;
+    }
+    writer->WritesDone();
+    return writer->Finish();
+  }
+
+  // returns a map from match key to action parameter for all the entries in
+  // the table
+  std::map<uint32_t, uint64_t> read_entries() {
+    std::map<uint32_t, uint64_t> entries;
+    p4v1::ReadRequest request;
+    request.set_device_id(device_id);
+    request.add_entities()->mutable_table_entry()->set_table_id(t_id);
+    ClientContext context;
+    auto reader = p4runtime_stub->Read(&context, request);
+    p4v1::ReadResponse rep;
+    while (reader->Read(&rep)) {
+      for (const auto &entity : rep.entities()) {
+        const auto &table_entry = entity.table_entry();
+        entries[from_bytes(table_entry.match(0).exact().value())] =
+            from_bytes(table_entry.action().action().params(0).value());
+      }
+    }
+    EXPECT_TRUE(reader->Finish().ok());
+    return entries;
+  }
+
+  static std::string to_bytes(uint64_t v, size_t width) {
+    std::string bytes(width, '\x00');
+    for (size_t i = 0; i < width; i++) {
+      bytes[width - 1 - i] = static_cast<char>(v & 0xff);
+      v >>= 8;
+    }
+    return bytes;
+  }
+
+  static uint64_t from_bytes(const std::string &bytes) {
+    uint64_t v = 0;
+    for (auto c : bytes) v = (v << 8) | static_cast<unsigned char>(c);
+    return v;
+  }
+
+  static void check_error(const p4serverv1::UpdateError &error,
+                          uint64_t index, Code code) {
+    EXPECT_EQ(index, error.index());
+    EXPECT_EQ(code, error.error().canonical_code());
+  }
+
+  static constexpr const char *input_path =
+           TESTDATADIR "/" "unittest.p4info.txt";
+  static p4configv1::P4Info p4info_proto;
+  static uint32_t t_id;
+  static uint32_t a_id;
+
+  std::unique_ptr<p4v1::P4Runtime::Stub> p4runtime_stub;
+  DummySwitchWrapper wrapper{};
+  DummySwitchMock *mock;
+};
+
+p4configv1::P4Info TestBulkWriteWithPipeline::p4info_proto;
+uint32_t TestBulkWriteWithPipeline::t_id = 0;
+uint32_t TestBulkWriteWithPipeline::a_id = 0;
+
+TEST_F(TestBulkWriteWithPipeline, Insert) {
+  const uint32_t num_chunks = 4;
+  const uint32_t chunk_size = 16;
+  std::vector<p4serverv1::BulkWriteRequest> chunks;
+  for (uint32_t i = 0; i < num_chunks; i++) {
+    chunks.push_back(new_chunk());
+    for (uint32_t j = 0; j < chunk_size; j++) {
+      auto key = i * chunk_size + j;
+      add_update(&chunks.back(), p4v1::Update::INSERT, key, key + 100);
+    }
+  }
+  p4serverv1::BulkWriteResponse rep;
+  auto status = bulk_write(chunks, &rep);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(num_chunks * chunk_size, rep.num_updates());
+  EXPECT_EQ(0u, rep.num_errors());
+  EXPECT_EQ(0, rep.errors_size());
+
+  auto entries = read_entries();
+  ASSERT_EQ(num_chunks * chunk_size, entries.size());
+  for (const auto &p : entries) EXPECT_EQ(p.first + 100, p.second);
+}
+
+TEST_F(TestBulkWriteWithPipeline, MixedUpdates) {
+  {
+    std::vector<p4serverv1::BulkWriteRequest> chunks(1, new_chunk());
+    for (uint32_t key = 0; key < 4; key++)
+      add_update(&chunks.back(), p4v1::Update::INSERT, key, key);
+    p4serverv1::BulkWriteResponse rep;
+    ASSERT_TRUE(bulk_write(chunks, &rep).ok());
+    ASSERT_EQ(0u, rep.num_errors());
+  }
+
+  std::vector<p4serverv1::BulkWriteRequest> chunks(2, new_chunk());
+  add_update(&chunks[0], p4v1::Update::MODIFY, 0, 10);
+  add_update(&chunks[0], p4v1::Update::DELETE, 1);
+  add_update(&chunks[0], p4v1::Update::INSERT, 4, 4);
+  add_update(&chunks[1], p4v1::Update::INSERT, 2, 20);  // already exists
+  add_update(&chunks[1], p4v1::Update::MODIFY, 5, 50);  // does not exist
+  add_update(&chunks[1], p4v1::Update::DELETE, 1);  // deleted in chunk 0
+  p4serverv1::BulkWriteResponse rep;
+  auto status = bulk_write(chunks, &rep);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(6u, rep.num_updates());
+  EXPECT_EQ(3u, rep.num_errors());
+  ASSERT_EQ(3, rep.errors_size());
+  check_error(rep.errors(0), 3, Code::ALREADY_EXISTS);
+  check_error(rep.errors(1), 4, Code::NOT_FOUND);
+  check_error(rep.errors(2), 5, Code::NOT_FOUND);
+
+  std::map<uint32_t, uint64_t> expected_entries{
+    {0, 10}, {2, 2}, {3, 3}, {4, 4}};
+  EXPECT_EQ(expected_entries, read_entries());
+}
+
+TEST_F(TestBulkWriteWithPipeline, PartialFailure) {
+  std::vector<p4serverv1::BulkWriteRequest> chunks(3, new_chunk());
+  for (uint32_t key = 0; key < 4; key++) {
+    add_update(&chunks[0], p4v1::Update::INSERT, key, key);
+    // the second update of the second chunk is a duplicate of an update in the
+    // first chunk
+    add_update(&chunks[1], p4v1::Update::INSERT, (key == 1) ? 0 : key + 4,
+               key + 4);
+    add_update(&chunks[2], p4v1::Update::INSERT, key + 8, key + 8);
+  }
+  p4serverv1::BulkWriteResponse rep;
+  auto status = bulk_write(chunks, &rep);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(12u, rep.num_updates());
+  EXPECT_EQ(1u, rep.num_errors());
+  ASSERT_EQ(1, rep.errors_size());
+  check_error(rep.errors(0), 5, Code::ALREADY_EXISTS);
+
+  // all the other updates, including the ones following the failed one, are
+  // applied
+  auto entries = read_entries();
+  EXPECT_EQ(11u, entries.size());
+  for (uint32_t key = 0; key < 12; key++) {
+    if (key == 5) {
+      EXPECT_EQ(0u, entries.count(key));
+      continue;
+    }
+    ASSERT_EQ(1u, entries.count(key));
+    EXPECT_EQ(key, entries[key]);
+  }
+}
+
+TEST_F(TestBulkWriteWithPipeline, DifferentElectionId) {
+  std::vector<p4serverv1::BulkWriteRequest> chunks(2, new_chunk());
+  add_update(&chunks[0], p4v1::Update::INSERT, 0, 0);
+  add_update(&chunks[1], p4v1::Update::INSERT, 1, 1);
+  chunks[1].mutable_election_id()->set_low(1);
+  p4serverv1::BulkWriteResponse rep;
+  auto status = bulk_write(chunks, &rep);
+  EXPECT_EQ(StatusCode::INVALID_ARGUMENT, status.error_code());
+
+  // the chunks preceding the invalid one have been applied
+  std::map<uint32_t, uint64_t> expected_entries{{0, 0}};
+  EXPECT_EQ(expected_entries, read_entries());
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
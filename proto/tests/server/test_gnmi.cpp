@@ -22,6 +22,8 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
@@ -33,6 +35,7 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <boost/optional.hpp>
@@ -40,6 +43,7 @@
 #include "gnmi/gnmi.grpc.pb.h"
 
 #include "gnmi.h"
+#include "gnmi_subscriptions.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -48,6 +52,13 @@ using grpc::ClientContext;
 using grpc::Status;
 using grpc::StatusCode;
 
+using pi::server::gNMIBufferedSink;
+using pi::server::gNMICachingDataSource;
+using pi::server::gNMIDataSource;
+using pi::server::gNMISubscription;
+using pi::server::gNMISubscriptionScheduler;
+using pi::server::gNMISubscriptionSink;
+
 namespace pi {
 namespace proto {
 namespace testing {
@@ -143,6 +154,311 @@ TEST_F(TestGNMIDummy, SubscribeErrorOnWrite) {
   EXPECT_EQ(StatusCode::UNIMPLEMENTED, status.error_code());
 }
 
+// In-memory data source for the gNMISubscriptionScheduler tests, which keeps
+// track of the number of reads for each xpath.
+class DummyDataSource : public gNMIDataSource {
+ public:
+  bool get_leaves(const std::string &xpath, Leaves *leaves) override {
+    std::lock_guard<std::mutex> lock(m);
+    reads[xpath]++;
+    for (const auto &p : values) {
+      if (p.first.compare(0, xpath.size(), xpath) != 0) continue;
+      Leaf leaf;
+      leaf.xpath = p.first;
+      leaf.path.add_elem()->set_name(p.first);
+      leaf.val.set_int_val(p.second);
+      leaves->push_back(std::move(leaf));
+    }
+    return true;
+  }
+
+  bool needs_polling(const std::string &xpath) const override {
+    (void)xpath;
+    return polled;
+  }
+
+  // simulates data for which notify_change is not called
+  void set_polled(bool v) { polled = v; }
+
+  void set(const std::string &xpath, int64_t v) {
+    std::lock_guard<std::mutex> lock(m);
+    values[xpath] = v;
+  }
+
+  int get_reads(const std::string &xpath) const {
+    std::lock_guard<std::mutex> lock(m);
+    auto it = reads.find(xpath);
+    return (it == reads.end()) ? 0 : it->second;
+  }
+
+ private:
+  mutable std::mutex m;
+  std::map<std::string, int64_t> values;
+  std::map<std::string, int> reads;
+  bool polled{false};
+};
+
+class DummySink : public gNMISubscriptionSink {
+ public:
+  void write(gnmi::SubscribeResponse &&response) override {
+    std::lock_guard<std::mutex> lock(m);
+    responses.push_back(std::move(response));
+    cv.notify_all();
+  }
+
+  // waits until at least n responses have been received
+  bool wait_for(size_t n, const std::chrono::milliseconds &max_wait) {
+    std::unique_lock<std::mutex> lock(m);
+    return cv.wait_for(
+        lock, max_wait, [this, n] { return responses.size() >= n; });
+  }
+
+  std::vector<gnmi::SubscribeResponse> get_responses() const {
+    std::lock_guard<std::mutex> lock(m);
+    return responses;
+  }
+
+ private:
+  mutable std::mutex m;
+  std::condition_variable cv;
+  std::vector<gnmi::SubscribeResponse> responses;
+};
+
+// Several SAMPLE subscriptions for the same path and with the same sample
+// interval should share the reads to the data source.
+TEST(TestGNMISubscriptionScheduler, SharedSample) {
+  const std::string xpath("/test:a");
+  DummyDataSource source;
+  source.set("/test:a/x", 1);
+  auto sink_1 = std::make_shared<DummySink>();
+  auto sink_2 = std::make_shared<DummySink>();
+  gnmi::Subscription gnmi_sub;
+  gnmi_sub.set_mode(gnmi::SAMPLE);
+  gnmi_sub.set_sample_interval(
+      std::chrono::nanoseconds(std::chrono::milliseconds(20)).count());
+
+  {
+    gNMISubscriptionScheduler scheduler(&source);
+    ASSERT_TRUE(scheduler.add_subscription(
+        std::make_shared<gNMISubscription>(gnmi_sub, xpath, sink_1)));
+    ASSERT_TRUE(scheduler.add_subscription(
+        std::make_shared<gNMISubscription>(gnmi_sub, xpath, sink_2)));
+    const std::chrono::milliseconds timeout(2000);
+    ASSERT_TRUE(sink_1->wait_for(10, timeout));
+    ASSERT_TRUE(sink_2->wait_for(10, timeout));
+  }  // scheduler stopped
+
+  auto num_responses = std::max(sink_1->get_responses().size(),
+                                sink_2->get_responses().size());
+  // one read for the initial updates of each subscription, then one read per
+  // sample time for both subscriptions (possibly one extra read if the
+  // subscriptions were created on both sides of a sample time)
+  EXPECT_LE(static_cast<size_t>(source.get_reads(xpath)), num_responses + 2);
+}
+
+// ON_CHANGE subscriptions should not poll the data source and should only
+// include the changed leaves.
+TEST(TestGNMISubscriptionScheduler, OnChange) {
+  const std::string xpath("/test:a");
+  DummyDataSource source;
+  source.set("/test:a/x", 1);
+  source.set("/test:a/y", 2);
+  auto sink = std::make_shared<DummySink>();
+  gnmi::Subscription gnmi_sub;
+  gnmi_sub.set_mode(gnmi::ON_CHANGE);
+  const std::chrono::milliseconds timeout(1000);
+  const std::chrono::milliseconds no_activity(200);
+
+  gNMISubscriptionScheduler scheduler(&source);
+  ASSERT_TRUE(scheduler.add_subscription(
+      std::make_shared<gNMISubscription>(gnmi_sub, xpath, sink)));
+  ASSERT_TRUE(sink->wait_for(1, timeout));
+  {
+    auto responses = sink->get_responses();
+    ASSERT_EQ(responses.size(), 1u);
+    EXPECT_EQ(responses[0].update().update_size(), 2);
+  }
+
+  // nothing is sent and the data source is not polled as long as there is no
+  // change
+  std::this_thread::sleep_for(no_activity);
+  auto reads = source.get_reads(xpath);
+  std::this_thread::sleep_for(no_activity);
+  EXPECT_EQ(source.get_reads(xpath), reads);
+  scheduler.notify_change("/other:");
+  std::this_thread::sleep_for(no_activity);
+  EXPECT_EQ(source.get_reads(xpath), reads);
+  EXPECT_EQ(sink->get_responses().size(), 1u);
+
+  source.set("/test:a/y", 3);
+  scheduler.notify_change("/test:");
+  ASSERT_TRUE(sink->wait_for(2, timeout));
+  EXPECT_EQ(source.get_reads(xpath), reads + 1);
+  auto responses = sink->get_responses();
+  ASSERT_EQ(responses.size(), 2u);
+  const auto &notification = responses[1].update();
+  ASSERT_EQ(notification.update_size(), 1);
+  EXPECT_EQ(notification.update(0).path().elem(0).name(), "/test:a/y");
+  EXPECT_EQ(notification.update(0).val().int_val(), 3);
+}
+
+// ON_CHANGE subscriptions for data which can change without notification (e.g.
+// operational state) are sampled, but only the changed leaves are sent.
+TEST(TestGNMISubscriptionScheduler, OnChangePolled) {
+  const std::string xpath("/test:a");
+  DummyDataSource source;
+  source.set_polled(true);
+  source.set("/test:a/x", 1);
+  source.set("/test:a/y", 2);
+  auto sink = std::make_shared<DummySink>();
+  gnmi::Subscription gnmi_sub;
+  gnmi_sub.set_mode(gnmi::ON_CHANGE);
+  const std::chrono::milliseconds poll_interval(20);
+  const std::chrono::milliseconds timeout(1000);
+
+  gNMISubscriptionScheduler scheduler(&source, poll_interval);
+  ASSERT_TRUE(scheduler.add_subscription(
+      std::make_shared<gNMISubscription>(gnmi_sub, xpath, sink)));
+  ASSERT_TRUE(sink->wait_for(1, timeout));
+
+  // the data source is polled, but nothing is sent as long as there is no
+  // change
+  auto reads = source.get_reads(xpath);
+  std::this_thread::sleep_for(10 * poll_interval);
+  EXPECT_GT(source.get_reads(xpath), reads);
+  EXPECT_EQ(sink->get_responses().size(), 1u);
+
+  // no call to notify_change
+  source.set("/test:a/y", 3);
+  ASSERT_TRUE(sink->wait_for(2, timeout));
+  auto responses = sink->get_responses();
+  ASSERT_EQ(responses.size(), 2u);
+  const auto &notification = responses[1].update();
+  ASSERT_EQ(notification.update_size(), 1);
+  EXPECT_EQ(notification.update(0).path().elem(0).name(), "/test:a/y");
+  EXPECT_EQ(notification.update(0).val().int_val(), 3);
+}
+
+// Buffered sink for which send blocks until release() is called, to emulate a
+// client which stopped reading from the stream.
+class StalledSink : public gNMIBufferedSink {
+ public:
+  explicit StalledSink(size_t max_pending)
+      : gNMIBufferedSink(max_pending) { }
+
+  ~StalledSink() {
+    release();
+    close();
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> lock(m);
+    released = true;
+    cv.notify_all();
+  }
+
+  bool wait_for_overflow(const std::chrono::milliseconds &max_wait) {
+    std::unique_lock<std::mutex> lock(m);
+    return cv.wait_for(lock, max_wait, [this] { return overflow_cb; });
+  }
+
+ private:
+  void send(const gnmi::SubscribeResponse &response) override {
+    (void)response;
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [this] { return released; });
+  }
+
+  void on_overflow() override {
+    std::lock_guard<std::mutex> lock(m);
+    overflow_cb = true;
+    cv.notify_all();
+  }
+
+  std::mutex m;
+  std::condition_variable cv;
+  bool released{false};
+  bool overflow_cb{false};
+};
+
+// A SAMPLE subscription with a short interval to a client which does not read
+// its stream should not make the pending notifications grow without bound.
+TEST(TestGNMISubscriptionScheduler, StalledSink) {
+  const std::string xpath("/test:a");
+  const size_t max_pending = 16;
+  DummyDataSource source;
+  source.set("/test:a/x", 1);
+  auto sink = std::make_shared<StalledSink>(max_pending);
+  gnmi::Subscription gnmi_sub;
+  gnmi_sub.set_mode(gnmi::SAMPLE);
+  gnmi_sub.set_sample_interval(
+      std::chrono::nanoseconds(std::chrono::milliseconds(1)).count());
+  const std::chrono::milliseconds timeout(2000);
+
+  gNMISubscriptionScheduler scheduler(&source);
+  auto sub = std::make_shared<gNMISubscription>(gnmi_sub, xpath, sink);
+  ASSERT_TRUE(scheduler.add_subscription(sub));
+  auto until = std::chrono::steady_clock::now() + timeout;
+  while (!sink->overflowed() && std::chrono::steady_clock::now() < until) {
+    EXPECT_LE(sink->pending(), max_pending);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_TRUE(sink->wait_for_overflow(timeout));
+  // pending notifications are dropped and new ones are ignored
+  EXPECT_EQ(sink->pending(), 0u);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(sink->pending(), 0u);
+  scheduler.remove_subscription(sub);
+}
+
+TEST(TestGNMICachingDataSource, CacheAndInvalidate) {
+  const std::string xpath("/test:a");
+  DummyDataSource source;
+  source.set("/test:a/x", 1);
+  gNMICachingDataSource cache(&source, std::chrono::hours(1));
+
+  auto get_value = [&cache, &xpath]() -> int64_t {
+    gNMIDataSource::Leaves leaves;
+    EXPECT_TRUE(cache.get_leaves(xpath, &leaves));
+    if (leaves.size() != 1) {
+      ADD_FAILURE() << "Expected exactly one leaf";
+      return -1;
+    }
+    return leaves.front().val.int_val();
+  };
+
+  EXPECT_EQ(get_value(), 1);
+  EXPECT_EQ(source.get_reads(xpath), 1);
+  source.set("/test:a/x", 2);
+  // stale value from the cache
+  EXPECT_EQ(get_value(), 1);
+  EXPECT_EQ(source.get_reads(xpath), 1);
+
+  cache.invalidate("/other:");
+  EXPECT_EQ(get_value(), 1);
+  EXPECT_EQ(source.get_reads(xpath), 1);
+
+  cache.invalidate("/test:a/x");
+  EXPECT_EQ(get_value(), 2);
+  EXPECT_EQ(source.get_reads(xpath), 2);
+}
+
+TEST(TestGNMICachingDataSource, Expiration) {
+  const std::string xpath("/test:a");
+  DummyDataSource source;
+  source.set("/test:a/x", 1);
+  gNMICachingDataSource cache(&source, std::chrono::milliseconds(50));
+
+  gNMIDataSource::Leaves leaves;
+  EXPECT_TRUE(cache.get_leaves(xpath, &leaves));
+  EXPECT_TRUE(cache.get_leaves(xpath, &leaves));
+  EXPECT_EQ(leaves.size(), 2u);
+  EXPECT_EQ(source.get_reads(xpath), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_TRUE(cache.get_leaves(xpath, &leaves));
+  EXPECT_EQ(source.get_reads(xpath), 2);
+}
+
 #ifdef WITH_SYSREPO
 
 extern "C" {
@@ -469,6 +785,53 @@ class SysrepoStateProvider {
   sr_subscription_ctx_t *subscription{nullptr};
 };
 
+// Provides the operational MTU of all interfaces. Changes to the value are not
+// notified by sysrepo, so ON_CHANGE subscriptions to it rely on polling.
+class SysrepoMtuStateProvider {
+ public:
+  explicit SysrepoMtuStateProvider(const std::string &app_name)
+      : app_name(app_name) { }
+
+  ~SysrepoMtuStateProvider() {
+    if (subscription != nullptr) {
+      sr_unsubscribe(session.get(), subscription);
+      subscription = nullptr;
+    }
+  }
+
+  bool subscribe() {
+    session.open(app_name);
+    int rc = sr_dp_get_items_subscribe(
+        session.get(), "/openconfig-interfaces:interfaces/interface/state/mtu",
+        provide_mtu, static_cast<void *>(this),
+        SR_SUBSCR_DEFAULT, &subscription);
+    return rc == SR_ERR_OK;
+  }
+
+  void set_mtu(uint16_t v) { mtu = v; }
+
+ private:
+  static int provide_mtu(const char *xpath, sr_val_t **values,
+                         size_t *values_cnt, uint64_t request_id,
+                         void *private_ctx) {
+    (void) request_id;
+    auto *provider = static_cast<SysrepoMtuStateProvider *>(private_ctx);
+    sr_val_t *v = nullptr;
+    int rc = sr_new_val(xpath, &v);
+    if (rc != SR_ERR_OK) return rc;
+    v->type = SR_UINT16_T;
+    v->data.uint16_val = provider->mtu;
+    *values = v;
+    *values_cnt = 1u;
+    return SR_ERR_OK;
+  }
+
+  std::string app_name;
+  SysrepoSession session;
+  sr_subscription_ctx_t *subscription{nullptr};
+  std::atomic<uint16_t> mtu{1500};
+};
+
 class GNMIPathBuilder {
  public:
   explicit GNMIPathBuilder(gnmi::Path *path)
@@ -757,6 +1120,50 @@ TEST_F(TestGNMISysrepo, GetLeaf) {
   EXPECT_TRUE(no_more_events());
 }
 
+// The cached data for a path without keys needs to be invalidated by a Set for
+// a specific list entry, even though the xpath of the cached data is not a
+// prefix of the modified xpath.
+TEST_F(TestGNMISysrepo, GetAfterSetNoKey) {
+  const std::string iface_name("eth0");
+  EXPECT_TRUE(create_iface(iface_name).ok());
+  check_create_iface_events(iface_name);
+
+  auto set_mtu = [this, &iface_name](unsigned int mtu) {
+    gnmi::SetRequest req;
+    auto *update = req.add_update();
+    GNMIPathBuilder pb(update->mutable_path());
+    pb.append("interfaces").append("interface", {{"name", iface_name}})
+        .append("config").append("mtu");
+    update->mutable_val()->set_uint_val(mtu);
+    gnmi::SetResponse rep;
+    ClientContext context;
+    EXPECT_TRUE(gnmi_stub->Set(&context, req, &rep).ok());
+    EXPECT_EQ(consume_events(1), 1u);
+  };
+
+  auto get_mtu = [this]() -> uint64_t {
+    gnmi::GetRequest req;
+    gnmi::GetResponse rep;
+    ClientContext context;
+    GNMIPathBuilder pb(req.add_path());
+    pb.append("interfaces").append("interface").append("config").append("mtu");
+    req.set_type(gnmi::GetRequest::ALL);
+    EXPECT_TRUE(gnmi_stub->Get(&context, req, &rep).ok());
+    if (rep.notification_size() != 1 ||
+        rep.notification(0).update_size() != 1) {
+      ADD_FAILURE() << "Expected exactly one update";
+      return 0;
+    }
+    return rep.notification(0).update(0).val().uint_val();
+  };
+
+  set_mtu(1500);
+  EXPECT_EQ(get_mtu(), 1500u);
+  set_mtu(800);
+  EXPECT_EQ(get_mtu(), 800u);
+  EXPECT_TRUE(no_more_events());
+}
+
 TEST_F(TestGNMISysrepo, GetContainer) {
   const std::string iface_name("eth0");
   EXPECT_TRUE(create_iface(iface_name).ok());
@@ -962,6 +1369,72 @@ class TestGNMISysrepoSubscribeStream : public TestGNMISysrepo {
   std::unique_ptr<StreamType> stream;
 };
 
+TEST_F(TestGNMISysrepoSubscribeStream, Poll) {
+  subList = req.mutable_subscribe();
+  subList->set_mode(gnmi::SubscriptionList::POLL);
+  sub = subList->add_subscription();
+  GNMIPathBuilder pb(sub->mutable_path());
+  pb.append("interfaces").append("interface", {{"name", iface_name}})
+      .append("config").append("mtu");
+
+  // initial updates
+  EXPECT_TRUE(stream->Write(req));
+  EXPECT_TRUE(stream->Read(&rep));
+  ASSERT_EQ(rep.update().update_size(), 1);
+  check_update();
+  EXPECT_TRUE(read_sync(stream.get()));
+
+  // each Poll message returns fresh values
+  gnmi::SubscribeRequest poll_req;
+  poll_req.mutable_poll();
+  for (unsigned int mtu : {800u, 1200u}) {
+    set_mtu(mtu);
+    EXPECT_TRUE(stream->Write(poll_req));
+    EXPECT_TRUE(stream->Read(&rep));
+    ASSERT_EQ(rep.update().update_size(), 1);
+    check_update(mtu);
+    EXPECT_TRUE(read_sync(stream.get()));
+  }
+}
+
+TEST_F(TestGNMISysrepo, PollWithoutSubscription) {
+  ClientContext context;
+  auto stream = gnmi_stub->Subscribe(&context);
+  gnmi::SubscribeRequest poll_req;
+  poll_req.mutable_poll();
+  EXPECT_TRUE(stream->Write(poll_req));
+  // the server may already have closed the stream
+  stream->WritesDone();
+  gnmi::SubscribeResponse rep;
+  EXPECT_FALSE(stream->Read(&rep));
+  auto status = stream->Finish();
+  EXPECT_EQ(status.error_code(), StatusCode::INVALID_ARGUMENT);
+}
+
+// a first POLL subscription list, even an empty one, cannot be replaced
+TEST_F(TestGNMISysrepo, PollSecondSubscriptionList) {
+  const std::string iface_name("eth0");
+  ClientContext context;
+  auto stream = gnmi_stub->Subscribe(&context);
+  gnmi::SubscribeRequest req;
+  req.mutable_subscribe()->set_mode(gnmi::SubscriptionList::POLL);
+  EXPECT_TRUE(stream->Write(req));
+  gnmi::SubscribeResponse rep;
+  EXPECT_TRUE(stream->Read(&rep));
+  EXPECT_TRUE(rep.sync_response());
+
+  GNMIPathBuilder pb(req.mutable_subscribe()->add_subscription()
+                     ->mutable_path());
+  pb.append("interfaces").append("interface", {{"name", iface_name}})
+      .append("config").append("mtu");
+  EXPECT_TRUE(stream->Write(req));
+  // the server may already have closed the stream
+  stream->WritesDone();
+  EXPECT_FALSE(stream->Read(&rep));
+  auto status = stream->Finish();
+  EXPECT_EQ(status.error_code(), StatusCode::INVALID_ARGUMENT);
+}
+
 class TestGNMISysrepoSubscribeStreamSample
     : public TestGNMISysrepoSubscribeStream {
  protected:
@@ -1137,6 +1610,49 @@ TEST_F(TestGNMISysrepoSubscribeStreamOnChange, Heartbeat) {
   check_update();
 }
 
+// Operational state is not notified by sysrepo: the scheduler samples the
+// ON_CHANGE subscriptions which include config false nodes.
+TEST_F(TestGNMISysrepoSubscribeStream, OnChangeOperationalState) {
+  SysrepoMtuStateProvider state_provider("mtu_state_provider");
+  ASSERT_TRUE(state_provider.subscribe());
+  state_provider.set_mtu(1500);
+
+  subList = req.mutable_subscribe();
+  subList->set_mode(gnmi::SubscriptionList::STREAM);
+  sub = subList->add_subscription();
+  GNMIPathBuilder pb(sub->mutable_path());
+  pb.append("interfaces").append("interface", {{"name", iface_name}})
+      .append("state").append("mtu");
+  sub->set_mode(gnmi::ON_CHANGE);
+
+  auto check_state_mtu = [this](unsigned int mtu) {
+    ASSERT_EQ(rep.response_case(), gnmi::SubscribeResponse::kUpdate);
+    const auto &notification = rep.update();
+    ASSERT_EQ(notification.update_size(), 1);
+    EXPECT_EQ(gNMI_path_to_XPath(notification.prefix(),
+                                 notification.update(0).path()),
+              "/openconfig-interfaces:interfaces/interface[name='" +
+              iface_name + "']/state/mtu");
+    EXPECT_EQ(notification.update(0).val().uint_val(), mtu);
+  };
+
+  EXPECT_TRUE(stream->Write(req));
+  EXPECT_TRUE(stream->Read(&rep));
+  check_state_mtu(1500);
+  EXPECT_TRUE(read_sync(stream.get()));
+
+  // the state is polled, but nothing is sent as long as it does not change
+  const milliseconds poll_timeout(500);
+  {
+    auto &f = ReadFuture(stream.get(), &rep);
+    ASSERT_EQ(f.wait_for(poll_timeout), std::future_status::timeout);
+    state_provider.set_mtu(9000);
+    ASSERT_EQ(f.wait_for(poll_timeout), std::future_status::ready);
+    ASSERT_TRUE(f.get());
+    check_state_mtu(9000);
+  }
+}
+
 #endif  // WITH_SYSREPO
 
 }  // namespace
@@ -60,6 +60,57 @@ TEST(TestServerConfig, GetAndSet) {
   }
 }
 
+TEST(TestServerConfig, InvalidSchedulingConfig) {
+  int device_id{1};
+  TestServer server;
+
+  auto channel = grpc::CreateChannel(
+      server.bind_addr(), grpc::InsecureChannelCredentials());
+  auto stub = p4serverv1::ServerConfig::NewStub(channel);
+
+  p4serverv1::SetRequest request;
+  request.set_device_id(device_id);
+  request.mutable_config()->mutable_scheduling()->add_classes()
+      ->set_priority_class(
+          static_cast<p4serverv1::SchedulingConfig::PriorityClass>(99));
+  ClientContext context;
+  p4serverv1::SetResponse response;
+  EXPECT_EQ(stub->Set(&context, request, &response).error_code(),
+            grpc::StatusCode::INVALID_ARGUMENT);
+}
+
+TEST(TestServerConfig, SchedulingStatsNoPipelineConfig) {
+  int device_id{1};
+  TestServer server;
+
+  auto channel = grpc::CreateChannel(
+      server.bind_addr(), grpc::InsecureChannelCredentials());
+  auto stub = p4serverv1::ServerConfig::NewStub(channel);
+
+  p4serverv1::GetSchedulingStatsRequest request;
+  request.set_device_id(device_id);
+  ClientContext context;
+  p4serverv1::GetSchedulingStatsResponse response;
+  EXPECT_EQ(stub->GetSchedulingStats(&context, request, &response).error_code(),
+            grpc::StatusCode::FAILED_PRECONDITION);
+}
+
+TEST(TestServerConfig, MemoryUsageNoPipelineConfig) {
+  int device_id{1};
+  TestServer server;
+
+  auto channel = grpc::CreateChannel(
+      server.bind_addr(), grpc::InsecureChannelCredentials());
+  auto stub = p4serverv1::ServerConfig::NewStub(channel);
+
+  p4serverv1::GetMemoryUsageRequest request;
+  request.set_device_id(device_id);
+  ClientContext context;
+  p4serverv1::GetMemoryUsageResponse response;
+  EXPECT_EQ(stub->GetMemoryUsage(&context, request, &response).error_code(),
+            grpc::StatusCode::FAILED_PRECONDITION);
+}
+
 }  // namespace testing
 }  // namespace proto
 }  // namespace pi
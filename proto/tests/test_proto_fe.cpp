@@ -32,12 +32,14 @@
 #include <cstring>  // std::memcmp
 #include <fstream>  // std::ifstream
 #include <functional>
+#include <future>
 #include <iterator>  // std::distance
 #include <memory>
 #include <mutex>
 #include <ostream>
 #include <queue>
 #include <regex>
+#include <set>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -50,6 +52,7 @@
 #include "PI/int/pi_int.h"
 #include "PI/p4info.h"
 #include "PI/pi.h"
+#include "PI/pi_counter.h"
 #include "PI/proto/util.h"
 
 #include "src/report_error.h"
@@ -103,6 +106,7 @@ using ::testing::IsEmpty;
 using ::testing::IsNull;
 using ::testing::Return;
 using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
 
 using pi::fe::proto::StatusOr;
 
@@ -1621,6 +1625,106 @@ TEST_P(ActionProfTest, DuplicateMemberIds) {
   EXPECT_EQ(create_group(&group), OneExpectedError(Code::INVALID_ARGUMENT));
 }
 
+TEST_P(ActionProfTest, UnsortedMemberIds) {
+  uint32_t group_id = 1000;
+  uint32_t member_id_1 = 1, member_id_2 = 2;
+  std::string adata(6, '\xcd');
+
+  EXPECT_CALL(*mock, action_prof_member_create(act_prof_id, _, _))
+      .Times(2);
+  auto member_1 = make_member(member_id_1, adata);
+  EXPECT_OK(create_member(&member_1));
+  auto mbr_h_1 = mock->get_action_prof_handle();
+  auto member_2 = make_member(member_id_2, adata);
+  EXPECT_OK(create_member(&member_2));
+  auto mbr_h_2 = mock->get_action_prof_handle();
+
+  auto group = make_group(group_id);
+  add_member_to_group(&group, member_id_2);
+  add_member_to_group(&group, member_id_1);
+  EXPECT_CALL(*mock, action_prof_group_create(act_prof_id, _, _));
+  if (GetParam() == PiActProfApiSupport_ADD_AND_REMOVE_MBR) {
+    EXPECT_CALL_GROUP_ADD_MEMBER(*mock, act_prof_id, _, mbr_h_1);
+    EXPECT_CALL_GROUP_ADD_MEMBER(*mock, act_prof_id, _, mbr_h_2);
+  } else {
+    EXPECT_CALL_GROUP_SET_MEMBERS(*mock, act_prof_id, _,
+                                  UnorderedElementsAre(mbr_h_1, mbr_h_2),
+                                  ElementsAre(true, true));
+  }
+  ASSERT_OK(create_group(&group));
+
+  // same membership, in a different order: nothing to add or remove
+  group.clear_members();
+  add_member_to_group(&group, member_id_1);
+  add_member_to_group(&group, member_id_2);
+  EXPECT_NO_CALL_GROUP_ADD_MEMBER(*mock);
+  EXPECT_NO_CALL_GROUP_REMOVE_MEMBER(*mock);
+  if (GetParam() != PiActProfApiSupport_ADD_AND_REMOVE_MBR) {
+    EXPECT_CALL_GROUP_SET_MEMBERS(*mock, act_prof_id, _,
+                                  UnorderedElementsAre(mbr_h_1, mbr_h_2),
+                                  ElementsAre(true, true));
+  }
+  ASSERT_OK(modify_group(&group));
+}
+
+TEST_P(ActionProfTest, MemoryUsage) {
+  uint32_t group_id = 1000;
+  uint32_t member_id_1 = 1, member_id_2 = 2;
+  std::string adata(6, '\xcd');
+
+  auto get_usage = [this]() {
+    p4::server::v1::MemoryUsage usage;
+    EXPECT_OK(mgr.memory_usage_get(&usage));
+    for (const auto &act_prof_usage : usage.action_profiles()) {
+      if (act_prof_usage.action_profile_id() == act_prof_id)
+        return act_prof_usage;
+    }
+    ADD_FAILURE() << "No memory usage for action profile";
+    return p4::server::v1::MemoryUsage::ActionProfileUsage();
+  };
+
+  auto usage = get_usage();
+  EXPECT_EQ(usage.num_members(), 0u);
+  EXPECT_EQ(usage.num_groups(), 0u);
+
+  EXPECT_CALL(*mock, action_prof_member_create(act_prof_id, _, _))
+      .Times(AtLeast(2));
+  auto member_1 = make_member(member_id_1, adata);
+  EXPECT_OK(create_member(&member_1));
+  auto member_2 = make_member(member_id_2, adata);
+  EXPECT_OK(create_member(&member_2));
+
+  // weighted member, which requires creating copies of member_2 using the
+  // stored action data
+  auto group = make_group(group_id);
+  add_member_to_group(&group, member_id_1);
+  add_member_to_group(&group, member_id_2, 3);
+  EXPECT_CALL(*mock, action_prof_group_create(act_prof_id, _, _));
+  if (GetParam() == PiActProfApiSupport_ADD_AND_REMOVE_MBR) {
+    EXPECT_CALL_GROUP_ADD_MEMBER(*mock, act_prof_id, _, _).Times(4);
+  } else {
+    EXPECT_CALL_GROUP_SET_MEMBERS(*mock, act_prof_id, _, SizeIs(4), _);
+  }
+  ASSERT_OK(create_group(&group));
+
+  usage = get_usage();
+  EXPECT_EQ(usage.num_members(), 2u);
+  EXPECT_EQ(usage.num_groups(), 1u);
+  EXPECT_GT(usage.action_data_bytes(), 0u);
+  EXPECT_GT(usage.bytes(), usage.action_data_bytes());
+
+  EXPECT_CALL(*mock, action_prof_group_delete(act_prof_id, _));
+  EXPECT_CALL(*mock, action_prof_member_delete(act_prof_id, _))
+      .Times(AtLeast(2));
+  ASSERT_OK(delete_group(&group));
+  EXPECT_OK(delete_member(&member_1));
+  EXPECT_OK(delete_member(&member_2));
+
+  usage = get_usage();
+  EXPECT_EQ(usage.num_members(), 0u);
+  EXPECT_EQ(usage.num_groups(), 0u);
+}
+
 TEST_P(ActionProfTest, MaxSizeModify) {
   DeviceMgr::Status status;
   auto act_prof_id = pi_p4info_act_prof_id_from_name(p4info, "ActProfWS");
@@ -2299,6 +2403,146 @@ INSTANTIATE_TEST_SUITE_P(
            PiActProfApiSupport_ADD_AND_REMOVE_MBR,
            PiActProfApiSupport_BOTH));
 
+class OneShotSharingTest : public MatchTableIndirectTest {
+ protected:
+  void SetUp() override {
+    MatchTableIndirectTest::SetUp();
+    p4::server::v1::Config config;
+    config.mutable_action_profile()->set_share_oneshot_groups(true);
+    ASSERT_OK(mgr.server_config_set(config));
+    params.emplace_back(6, '\x01');
+    params.emplace_back(6, '\x02');
+  }
+
+  // adds an entry which is expected to share the existing group grp_h
+  DeviceMgr::Status add_shared_entry(p4v1::TableEntry *entry,
+                                     pi_indirect_handle_t grp_h) {
+    EXPECT_CALL(*mock, action_prof_member_create(_, _, _)).Times(0);
+    EXPECT_CALL(*mock, action_prof_group_create(_, _, _)).Times(0);
+    EXPECT_NO_CALL_GROUP_ADD_MEMBER(*mock);
+    EXPECT_NO_CALL_GROUP_SET_MEMBERS(*mock);
+    EXPECT_CALL(*mock, table_entry_add(
+        t_id, _, CorrectTableEntryIndirect(grp_h), _));
+    return add_entry(entry);
+  }
+
+  // the order in which the entries are read is not specified
+  void check_read(const p4v1::TableEntry &entry_1,
+                  const p4v1::TableEntry &entry_2) {
+    EXPECT_CALL(*mock, table_entries_fetch(t_id, _));
+    EXPECT_CALL(*mock, action_prof_entries_fetch(act_prof_id, _));
+    p4v1::ReadResponse response;
+    ASSERT_OK(read_table_entries(t_id, &response));
+    const auto &entities = response.entities();
+    ASSERT_EQ(2, entities.size());
+    for (const auto &entity : entities) {
+      const auto &entry = entity.table_entry();
+      bool is_first = (entry.match(0).exact().value() ==
+                       entry_1.match(0).exact().value());
+      EXPECT_PROTO_EQ(entry, is_first ? entry_1 : entry_2);
+    }
+  }
+
+  std::vector<std::string> params;
+};
+
+TEST_P(OneShotSharingTest, InsertAndDelete) {
+  auto entry_1 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xdd", 4), params.begin(), params.end());
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_1, params.begin(), params.end()));
+  auto grp_h = mock->get_action_prof_handle();
+  auto entry_2 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xee", 4), params.begin(), params.end());
+  ASSERT_OK(add_shared_entry(&entry_2, grp_h));
+
+  // read-write symmetry
+  check_read(entry_1, entry_2);
+
+  // the group is still used by entry_2
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _)).Times(2);
+  EXPECT_CALL(*mock, action_prof_group_delete(_, _)).Times(0);
+  EXPECT_CALL(*mock, action_prof_member_delete(_, _)).Times(0);
+  ASSERT_OK(remove_entry(&entry_1));
+
+  EXPECT_CALL(*mock, action_prof_group_delete(act_prof_id, grp_h));
+  EXPECT_CALL(*mock, action_prof_member_delete(act_prof_id, _))
+      .Times(params.size());
+  ASSERT_OK(remove_entry(&entry_2));
+}
+
+TEST_P(OneShotSharingTest, Modify) {
+  auto entry_1 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xdd", 4), params.begin(), params.end());
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_1, params.begin(), params.end()));
+  auto grp_h = mock->get_action_prof_handle();
+  auto entry_2 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xee", 4), params.begin(), params.end());
+  ASSERT_OK(add_shared_entry(&entry_2, grp_h));
+
+  // modifying entry_1 to the same action set is a no-op for the group
+  EXPECT_CALL(*mock, table_entry_modify_wkey(
+      t_id, _, CorrectTableEntryIndirect(grp_h)));
+  EXPECT_CALL(*mock, action_prof_group_delete(_, _)).Times(0);
+  ASSERT_OK(modify_entry(&entry_1));
+
+  // entry_1 gets its own group, the shared group is kept for entry_2
+  params.pop_back();
+  EXPECT_CALL(*mock, action_prof_member_create(act_prof_id, _, _))
+      .Times(params.size());
+  EXPECT_CALL(*mock, action_prof_group_create(act_prof_id, params.size(), _));
+  if (GetParam() == PiActProfApiSupport_ADD_AND_REMOVE_MBR) {
+    EXPECT_CALL_GROUP_ADD_MEMBER(*mock, act_prof_id, _, _).Times(params.size());
+  } else {
+    EXPECT_CALL_GROUP_SET_MEMBERS(
+        *mock, act_prof_id, _, SizeIs(params.size()), SizeIs(params.size()));
+  }
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _));
+  entry_1 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xdd", 4), params.begin(), params.end());
+  ASSERT_OK(modify_entry(&entry_1));
+
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _));
+  EXPECT_CALL(*mock, action_prof_group_delete(act_prof_id, grp_h));
+  EXPECT_CALL(*mock, action_prof_member_delete(act_prof_id, _)).Times(2);
+  ASSERT_OK(remove_entry(&entry_2));
+}
+
+TEST_P(OneShotSharingTest, DifferentWatchKind) {
+  // the same watch port, but the client used different fields: the groups
+  // cannot be shared as reads must return the field used by the client
+  auto entry_1 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xdd", 4), params.begin(), params.end(),
+      1 /* weight */, 7 /* watch */);
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_1, params.begin(), params.end()));
+  auto entry_2 = make_indirect_entry_one_shot_new(
+      std::string("\xaa\xbb\xcc\xee", 4), params.begin(), params.end(),
+      1 /* weight */, std::string("\x07"));
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_2, params.begin(), params.end()));
+
+  check_read(entry_1, entry_2);
+}
+
+TEST_P(OneShotSharingTest, DifferentWeights) {
+  auto entry_1 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xdd", 4), params.begin(), params.end(), 1);
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_1, params.begin(), params.end(), 1));
+  auto entry_2 = make_indirect_entry_one_shot(
+      std::string("\xaa\xbb\xcc\xee", 4), params.begin(), params.end(), 2);
+  ASSERT_OK(add_indirect_entry_one_shot(
+      &entry_2, params.begin(), params.end(), 2));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ActionProfPiApis, OneShotSharingTest,
+    Values(PiActProfApiSupport_SET_MBRS,
+           PiActProfApiSupport_ADD_AND_REMOVE_MBR,
+           PiActProfApiSupport_BOTH));
+
 
 class ExactOneTest : public DeviceMgrTest {
  protected:
@@ -2378,6 +2622,485 @@ TEST_F(ExactOneTest, ZeroKeyAndDefaultEntry) {
 }
 
 
+class FetchCursorTest : public ExactOneTest {
+ protected:
+  void add_entries(size_t num_entries) {
+    EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(num_entries);
+    for (size_t i = 0; i < num_entries; i++) {
+      std::string mf(4, '\x00');
+      mf.back() = static_cast<char>(i);
+      auto entry = make_entry(mf, std::string(6, '\xcd'));
+      ASSERT_OK(add_entry(&entry));
+    }
+  }
+
+  // returns the size of each chunk, including the final empty one
+  std::vector<size_t> fetch_all(size_t max_entries,
+                                std::set<pi_entry_handle_t> *handles) {
+    std::vector<size_t> chunk_sizes;
+    pi_session_handle_t sess;
+    pi_session_init(&sess);
+    pi_table_fetch_cursor_t *cursor;
+    EXPECT_EQ(PI_STATUS_SUCCESS, pi_table_entries_fetch_begin(
+        sess, device_tgt, t_id, &cursor));
+    while (true) {
+      pi_table_fetch_res_t *res;
+      EXPECT_EQ(PI_STATUS_SUCCESS, pi_table_entries_fetch_next(
+          sess, cursor, max_entries, &res));
+      auto num_entries = pi_table_entries_num(res);
+      chunk_sizes.push_back(num_entries);
+      for (size_t i = 0; i < num_entries; i++) {
+        pi_table_ma_entry_t entry;
+        pi_entry_handle_t entry_handle;
+        pi_table_entries_next(res, &entry, &entry_handle);
+        handles->insert(entry_handle);
+      }
+      pi_table_entries_fetch_done(sess, res);
+      if (num_entries == 0) break;
+    }
+    EXPECT_EQ(PI_STATUS_SUCCESS, pi_table_entries_fetch_end(sess, cursor));
+    pi_session_cleanup(sess);
+    return chunk_sizes;
+  }
+};
+
+TEST_F(FetchCursorTest, Native) {
+  add_entries(5);
+  mock->set_fetch_cursor_support(true);
+  EXPECT_CALL(*mock, table_entries_fetch_begin(t_id, _));
+  EXPECT_CALL(*mock, table_entries_fetch_next(_, 2, _)).Times(4);
+  EXPECT_CALL(*mock, table_entries_fetch_end(_));
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(0);
+  std::set<pi_entry_handle_t> handles;
+  EXPECT_THAT(fetch_all(2, &handles), ElementsAre(2, 2, 1, 0));
+  EXPECT_EQ(handles.size(), 5u);
+}
+
+TEST_F(FetchCursorTest, Fallback) {
+  add_entries(5);
+  EXPECT_CALL(*mock, table_entries_fetch_begin(t_id, _));
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _));
+  EXPECT_CALL(*mock, table_entries_fetch_next(_, _, _)).Times(0);
+  EXPECT_CALL(*mock, table_entries_fetch_end(_)).Times(0);
+  std::set<pi_entry_handle_t> handles;
+  EXPECT_THAT(fetch_all(2, &handles), ElementsAre(2, 2, 1, 0));
+  EXPECT_EQ(handles.size(), 5u);
+}
+
+TEST_F(FetchCursorTest, ReadAll) {
+  add_entries(5);
+  mock->set_fetch_cursor_support(true);
+  EXPECT_CALL(*mock, table_entries_fetch_begin(t_id, _));
+  EXPECT_CALL(*mock, table_entries_fetch_next(_, _, _)).Times(AtLeast(1));
+  EXPECT_CALL(*mock, table_entries_fetch_end(_));
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(0);
+  p4v1::ReadResponse response;
+  ASSERT_OK(read_table_entries(t_id, &response));
+  EXPECT_EQ(response.entities_size(), 5);
+}
+
+
+class AsyncOpsTest : public ExactOneTest {
+ protected:
+  AsyncOpsTest() { pi_session_init(&sess); }
+
+  ~AsyncOpsTest() { pi_session_cleanup(sess); }
+
+  pi_session_handle_t sess;
+};
+
+TEST_F(AsyncOpsTest, TableFetch) {
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  auto entry = make_entry(std::string(4, '\xab'), std::string(6, '\xcd'));
+  ASSERT_OK(add_entry(&entry));
+
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _));
+  std::promise<size_t> num_entries;
+  auto cb = [](pi_dev_id_t, pi_p4_id_t, pi_status_t status,
+               pi_table_fetch_res_t *res, void *cookie) {
+    auto *promise = static_cast<std::promise<size_t> *>(cookie);
+    if (status != PI_STATUS_SUCCESS) {
+      promise->set_value(0);
+      return;
+    }
+    promise->set_value(pi_table_entries_num(res));
+    pi_table_entries_fetch_done(0, res);
+  };
+  ASSERT_EQ(PI_STATUS_SUCCESS, pi_table_entries_fetch_async(
+      sess, device_tgt, t_id, cb, &num_entries));
+  auto future = num_entries.get_future();
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds(5)));
+  EXPECT_EQ(future.get(), 1u);
+}
+
+// the mock only supports blocking syncs, so PI runs the sync in the async pool
+TEST_F(AsyncOpsTest, CounterHwSyncFallback) {
+  auto c_id = pi_p4info_counter_begin(p4info);
+  std::promise<pi_p4_id_t> synced;
+  auto cb = [](pi_dev_id_t, pi_p4_id_t counter_id, void *cookie) {
+    static_cast<std::promise<pi_p4_id_t> *>(cookie)->set_value(counter_id);
+  };
+  ASSERT_EQ(PI_STATUS_SUCCESS,
+            pi_counter_hw_sync(sess, device_tgt, c_id, cb, &synced));
+  auto future = synced.get_future();
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds(5)));
+  EXPECT_EQ(future.get(), c_id);
+}
+
+
+class ReadCacheTest : public ExactOneTest {
+ protected:
+  void enable_cache() {
+    p4::server::v1::Config config;
+    config.mutable_read_cache()->set_enabled(true);
+    ASSERT_OK(mgr.server_config_set(config));
+  }
+
+  void add_one_entry(char key) {
+    EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+    auto entry = make_entry(std::string(4, key), std::string(6, '\xcd'));
+    ASSERT_OK(add_entry(&entry));
+  }
+
+  p4v1::ReadRequest make_request(bool with_counter_data = false) const {
+    p4v1::ReadRequest request;
+    auto *table_entry = request.add_entities()->mutable_table_entry();
+    table_entry->set_table_id(t_id);
+    if (with_counter_data) table_entry->mutable_counter_data();
+    return request;
+  }
+
+  using Response = std::shared_ptr<const p4v1::ReadResponse>;
+};
+
+TEST_F(ReadCacheTest, Hit) {
+  enable_cache();
+  add_one_entry('\xab');
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _)).Times(1);
+  auto request = make_request();
+  Response response_1, response_2;
+  ASSERT_OK(mgr.read_cached(request, &response_1));
+  ASSERT_OK(mgr.read_cached(request, &response_2));
+  EXPECT_EQ(response_1->entities_size(), 1);
+  EXPECT_EQ(response_1, response_2);
+}
+
+TEST_F(ReadCacheTest, InvalidatedByWrite) {
+  enable_cache();
+  add_one_entry('\xab');
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _)).Times(2);
+  auto request = make_request();
+  Response response;
+  ASSERT_OK(mgr.read_cached(request, &response));
+  EXPECT_EQ(response->entities_size(), 1);
+  add_one_entry('\xac');
+  ASSERT_OK(mgr.read_cached(request, &response));
+  EXPECT_EQ(response->entities_size(), 2);
+}
+
+// all tables are invalidated by a write to any table
+TEST_F(ReadCacheTest, WildcardTable) {
+  enable_cache();
+  EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(AtLeast(1));
+  p4v1::ReadRequest request;
+  request.add_entities()->mutable_table_entry();
+  Response response;
+  ASSERT_OK(mgr.read_cached(request, &response));
+  EXPECT_EQ(response->entities_size(), 0);
+  add_one_entry('\xab');
+  ASSERT_OK(mgr.read_cached(request, &response));
+  EXPECT_EQ(response->entities_size(), 1);
+}
+
+TEST_F(ReadCacheTest, CounterDataNotCached) {
+  enable_cache();
+  add_one_entry('\xab');
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _)).Times(2);
+  auto request = make_request(true  /* with_counter_data */);
+  Response response;
+  ASSERT_OK(mgr.read_cached(request, &response));
+  ASSERT_OK(mgr.read_cached(request, &response));
+}
+
+TEST_F(ReadCacheTest, DisabledByDefault) {
+  add_one_entry('\xab');
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _)).Times(2);
+  auto request = make_request();
+  Response response;
+  ASSERT_OK(mgr.read_cached(request, &response));
+  ASSERT_OK(mgr.read_cached(request, &response));
+}
+
+class ChangeLogTest : public ExactOneTest {
+ protected:
+  using ReadChangesRequest = p4::server::v1::ReadChangesRequest;
+  using ReadChangesResponse = p4::server::v1::ReadChangesResponse;
+
+  void enable_log(uint32_t max_changes_per_table) {
+    p4::server::v1::Config config;
+    config.mutable_change_log()->set_max_changes_per_table(
+        max_changes_per_table);
+    ASSERT_OK(mgr.server_config_set(config));
+  }
+
+  p4v1::TableEntry make_entry_with_key(char key, char param = '\xcd') {
+    return make_entry(std::string(4, key), std::string(6, param));
+  }
+
+  DeviceMgr::Status read_changes(uint64_t since,
+                                 ReadChangesResponse *response) const {
+    ReadChangesRequest request;
+    request.add_table_ids(t_id);
+    request.set_since_generation(since);
+    return mgr.read_changes(request, response);
+  }
+
+  uint64_t current_generation() const {
+    ReadChangesResponse response;
+    EXPECT_OK(read_changes(0, &response));
+    return response.generation();
+  }
+};
+
+TEST_F(ChangeLogTest, InsertModifyDelete) {
+  enable_log(16);
+  auto since = current_generation();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(2);
+  auto entry_1 = make_entry_with_key('\xab');
+  auto entry_2 = make_entry_with_key('\xac');
+  ASSERT_OK(add_entry(&entry_1));
+  ASSERT_OK(add_entry(&entry_2));
+
+  ReadChangesResponse response;
+  ASSERT_OK(read_changes(since, &response));
+  EXPECT_FALSE(response.overflowed());
+  ASSERT_EQ(response.updates_size(), 2);
+  EXPECT_EQ(response.updates(0).type(), p4v1::Update::INSERT);
+  EXPECT_PROTO_EQ(response.updates(0).entity().table_entry(), entry_1);
+  EXPECT_EQ(response.updates(1).type(), p4v1::Update::INSERT);
+  EXPECT_PROTO_EQ(response.updates(1).entity().table_entry(), entry_2);
+
+  since = response.generation();
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _));
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _));
+  auto entry_1_new = make_entry_with_key('\xab', '\xef');
+  ASSERT_OK(modify_entry(&entry_1_new));
+  ASSERT_OK(remove_entry(&entry_2));
+  response.Clear();
+  ASSERT_OK(read_changes(since, &response));
+  ASSERT_EQ(response.updates_size(), 2);
+  EXPECT_EQ(response.updates(0).type(), p4v1::Update::MODIFY);
+  EXPECT_PROTO_EQ(response.updates(0).entity().table_entry(), entry_1_new);
+  EXPECT_EQ(response.updates(1).type(), p4v1::Update::DELETE);
+  EXPECT_FALSE(response.updates(1).entity().table_entry().has_action());
+
+  since = response.generation();
+  response.Clear();
+  ASSERT_OK(read_changes(since, &response));
+  EXPECT_EQ(response.updates_size(), 0);
+}
+
+// an entry inserted and modified since the generation is reported once, as an
+// INSERT
+TEST_F(ChangeLogTest, Coalesced) {
+  enable_log(16);
+  auto since = current_generation();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _));
+  auto entry = make_entry_with_key('\xab');
+  ASSERT_OK(add_entry(&entry));
+  entry = make_entry_with_key('\xab', '\xef');
+  ASSERT_OK(modify_entry(&entry));
+  ReadChangesResponse response;
+  ASSERT_OK(read_changes(since, &response));
+  ASSERT_EQ(response.updates_size(), 1);
+  EXPECT_EQ(response.updates(0).type(), p4v1::Update::INSERT);
+  EXPECT_PROTO_EQ(response.updates(0).entity().table_entry(), entry);
+}
+
+// the changes are coalesced even if the match is encoded differently
+TEST_F(ChangeLogTest, CoalescedPaddedMatchKey) {
+  enable_log(16);
+  auto since = current_generation();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _));
+  std::string mf_short("\xbb\xcc\xdd", 3);
+  std::string mf_padded = std::string(1, '\x00') + mf_short;
+  std::string adata(6, '\xcd');
+  auto entry = make_entry(mf_padded, adata);
+  ASSERT_OK(add_entry(&entry));
+  entry = make_entry(mf_short, adata);
+  ASSERT_OK(remove_entry(&entry));
+  ReadChangesResponse response;
+  ASSERT_OK(read_changes(since, &response));
+  ASSERT_EQ(response.updates_size(), 1);
+  EXPECT_EQ(response.updates(0).type(), p4v1::Update::DELETE);
+}
+
+TEST_F(ChangeLogTest, Overflow) {
+  enable_log(2);
+  auto since = current_generation();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(3);
+  for (char key = 1; key <= 3; key++) {
+    auto entry = make_entry_with_key(key);
+    ASSERT_OK(add_entry(&entry));
+  }
+  ReadChangesResponse response;
+  ASSERT_OK(read_changes(since, &response));
+  EXPECT_TRUE(response.overflowed());
+  EXPECT_EQ(response.updates_size(), 0);
+  // the last 2 changes are still available
+  response.Clear();
+  ASSERT_OK(read_changes(since + 1, &response));
+  EXPECT_FALSE(response.overflowed());
+  EXPECT_EQ(response.updates_size(), 2);
+}
+
+TEST_F(ChangeLogTest, Disabled) {
+  ReadChangesResponse response;
+  EXPECT_EQ(read_changes(0, &response).code(), Code::FAILED_PRECONDITION);
+}
+
+TEST_F(ChangeLogTest, FutureGeneration) {
+  enable_log(16);
+  ReadChangesResponse response;
+  EXPECT_EQ(read_changes(current_generation() + 1, &response).code(),
+            Code::OUT_OF_RANGE);
+}
+
+class CoalesceTest : public ExactOneTest {
+ protected:
+  void enable_coalescing() {
+    p4::server::v1::Config config;
+    config.mutable_write()->set_coalesce_updates(true);
+    ASSERT_OK(mgr.server_config_set(config));
+  }
+
+  void add_update(p4v1::WriteRequest *request, p4v1::Update::Type type,
+                  const p4v1::TableEntry &entry) {
+    auto update = request->add_updates();
+    update->set_type(type);
+    update->mutable_entity()->mutable_table_entry()->CopyFrom(entry);
+  }
+
+  const std::string mf{"\xaa\xbb\xcc\xdd", 4};
+  const std::string adata_1{std::string(6, '\xcd')};
+  const std::string adata_2{std::string(6, '\xef')};
+};
+
+TEST_F(CoalesceTest, InsertModify) {
+  enable_coalescing();
+  auto mk_matcher = CorrectMatchKey(t_id, mf);
+  EXPECT_CALL(*mock, table_entry_add(
+      t_id, mk_matcher, CorrectTableEntryDirect(a_id, adata_2), _));
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(0);
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf, adata_2));
+  EXPECT_OK(mgr.write(request));
+
+  p4v1::ReadResponse response;
+  ASSERT_OK(read_table_entries(t_id, &response));
+  ASSERT_EQ(response.entities_size(), 1);
+  EXPECT_TRUE(MessageDifferencer::Equals(
+      make_entry(mf, adata_2), response.entities(0).table_entry()));
+}
+
+TEST_F(CoalesceTest, InsertDelete) {
+  enable_coalescing();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(0);
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _)).Times(0);
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  add_update(&request, p4v1::Update::DELETE, make_entry(mf, adata_1));
+  EXPECT_OK(mgr.write(request));
+
+  p4v1::ReadResponse response;
+  ASSERT_OK(read_table_entries(t_id, &response));
+  EXPECT_EQ(response.entities_size(), 0);
+}
+
+TEST_F(CoalesceTest, InterleavedKeys) {
+  enable_coalescing();
+  std::string mf_other(4, '\x00');
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(2);
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(0);
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf_other, adata_1));
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf, adata_2));
+  EXPECT_OK(mgr.write(request));
+}
+
+// the folded update would have succeeded, but the INSERT on its own fails, so
+// the updates are executed one by one to report the correct statuses
+TEST_F(CoalesceTest, StatusesPreserved) {
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  auto entry = make_entry(mf, adata_1);
+  ASSERT_OK(add_entry(&entry));
+
+  enable_coalescing();
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(1);
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf, adata_2));
+  ExpectedErrors expected_errors;
+  expected_errors.push_back(Code::ALREADY_EXISTS);
+  expected_errors.push_back(Code::OK);
+  EXPECT_EQ(mgr.write(request), expected_errors);
+}
+
+TEST_F(CoalesceTest, InvalidUpdateInGroup) {
+  enable_coalescing();
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(0);
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  auto invalid_entry = make_entry(mf, adata_2);
+  invalid_entry.mutable_action()->mutable_action()->mutable_params(0)
+      ->set_param_id(0);
+  add_update(&request, p4v1::Update::MODIFY, invalid_entry);
+  ExpectedErrors expected_errors;
+  expected_errors.push_back(Code::OK);
+  expected_errors.push_back(Code::INVALID_ARGUMENT);
+  EXPECT_EQ(mgr.write(request), expected_errors);
+}
+
+// the DELETE refers to the same entry as the MODIFY updates, even though the
+// match field is encoded differently, so the last MODIFY cannot be folded with
+// the first one
+TEST_F(CoalesceTest, PaddedMatchKey) {
+  const std::string mf_padded = std::string(1, '\x00') + mf.substr(1);
+  const std::string mf_short = mf.substr(1);
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  auto entry = make_entry(mf_short, adata_1);
+  ASSERT_OK(add_entry(&entry));
+
+  enable_coalescing();
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(0);
+  EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _));
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf_padded, adata_2));
+  add_update(&request, p4v1::Update::DELETE, make_entry(mf_short, adata_2));
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf_padded, adata_1));
+  ExpectedErrors expected_errors;
+  expected_errors.push_back(Code::OK);
+  expected_errors.push_back(Code::OK);
+  expected_errors.push_back(Code::NOT_FOUND);
+  EXPECT_EQ(mgr.write(request), expected_errors);
+}
+
+TEST_F(CoalesceTest, DisabledByDefault) {
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _));
+  p4v1::WriteRequest request;
+  add_update(&request, p4v1::Update::INSERT, make_entry(mf, adata_1));
+  add_update(&request, p4v1::Update::MODIFY, make_entry(mf, adata_2));
+  EXPECT_OK(mgr.write(request));
+}
+
 class DirectMeterTest : public ExactOneTest {
  protected:
   DirectMeterTest()
@@ -4452,6 +5175,30 @@ TEST_F(IdleTimeoutTest, ModifyTTL) {
   EXPECT_OK(modify_entry(&entry));
 }
 
+// Notifications are generated from the latest state of the entry.
+TEST_F(IdleTimeoutTest, NotificationAfterModify) {
+  std::string mf(2, '\xab');
+  std::string adata(6, '\xcd');
+  auto entry = make_entry(mf, adata, defaultIdleTimeout);
+
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  EXPECT_OK(add_entry(&entry));
+  auto entry_handle = mock->get_table_entry_handle();
+
+  entry.set_idle_timeout_ns(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          2 * defaultIdleTimeout).count());
+  EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _));
+  EXPECT_OK(modify_entry(&entry));
+
+  EXPECT_EQ(mock->age_entry(t_id, entry_handle), PI_STATUS_SUCCESS);
+  auto notification = notification_receive();
+  ASSERT_NE(notification, boost::none);
+  ASSERT_EQ(notification->table_entry_size(), 1);
+  EXPECT_EQ(notification->table_entry(0).idle_timeout_ns(),
+            entry.idle_timeout_ns());
+}
+
 TEST_F(IdleTimeoutTest, ReadEntry) {
   std::string mf(2, '\xab');
   std::string adata(6, '\xcd');
@@ -4484,6 +5231,38 @@ TEST_F(IdleTimeoutTest, ReadEntry) {
   }
 }
 
+TEST_F(IdleTimeoutTest, ReadAllEntriesBulkTTL) {
+  std::string adata(6, '\xcd');
+  auto entry1 = make_entry(std::string(2, '\x01'), adata, defaultIdleTimeout);
+  auto entry2 = make_entry(std::string(2, '\x02'), adata, defaultIdleTimeout);
+  // ageing disabled for this one, no need to query the target
+  auto entry3 = make_entry(std::string(2, '\x03'), adata);
+
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(3);
+  EXPECT_OK(add_entry(&entry1));
+  EXPECT_OK(add_entry(&entry2));
+  EXPECT_OK(add_entry(&entry3));
+
+  p4v1::TableEntry wildcard;
+  wildcard.set_table_id(t_id);
+  wildcard.mutable_time_since_last_hit();
+
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _));
+  EXPECT_CALL(*mock, table_entries_get_remaining_ttl(t_id, 2, _, _));
+  EXPECT_CALL(*mock, table_entry_get_remaining_ttl(_, _, _)).Times(0);
+  p4v1::ReadResponse response;
+  auto status = read_table_entry(&wildcard, &response);
+  ASSERT_EQ(status.code(), Code::OK);
+  const auto &entities = response.entities();
+  ASSERT_EQ(3, entities.size());
+  for (const auto &entity : entities) {
+    const auto &table_entry = entity.table_entry();
+    ASSERT_TRUE(table_entry.has_time_since_last_hit());
+    EXPECT_LE(table_entry.time_since_last_hit().elapsed_ns(),
+              table_entry.idle_timeout_ns());
+  }
+}
+
 
 class StreamErrorTest : public DeviceMgrTest {
  protected:
@@ -20,6 +20,7 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
 #include <tuple>
 
 #include "src/common.h"
@@ -32,8 +33,12 @@ namespace {
 using ::testing::TestWithParam;
 using ::testing::Values;
 
+using ::pi::fe::proto::common::bytes_all_equal;
+using ::pi::fe::proto::common::bytes_within_mask;
 using ::pi::fe::proto::common::bytestring_p4rt_to_pi;
 using ::pi::fe::proto::common::bytestring_pi_to_p4rt;
+using ::pi::fe::proto::common::check_prefix_trailing_zeros;
+using ::pi::fe::proto::common::table_entry_key;
 
 class TestBytestringConversionP4RtToPi
     : public TestWithParam<std::tuple<int, std::string, std::string> > { };
@@ -47,6 +52,17 @@ TEST_P(TestBytestringConversionP4RtToPi, convert) {
   EXPECT_EQ(output.ValueOrDie(), expected_output);
 }
 
+TEST_P(TestBytestringConversionP4RtToPi, convert_in_place) {
+  auto nbits = std::get<0>(GetParam());
+  auto input = std::get<1>(GetParam());
+  auto expected_output = std::get<2>(GetParam());
+  // the destination buffer is not necessarily zero-initialized
+  std::string output(expected_output.size(), '\xab');
+  auto status = bytestring_p4rt_to_pi(input, nbits, &output[0]);
+  ASSERT_EQ(status.code(), ::google::rpc::Code::OK);
+  EXPECT_EQ(output, expected_output);
+}
+
 INSTANTIATE_TEST_SUITE_P(
     BytestringConversionsP4RtToPi, TestBytestringConversionP4RtToPi,
     Values(std::make_tuple(
@@ -73,12 +89,17 @@ TEST_P(TestBytestringConversionP4RtToPiErrors, convert) {
   auto input = std::get<1>(GetParam());
   auto output = bytestring_p4rt_to_pi(input, nbits);
   ASSERT_FALSE(output.ok());
+  std::string buffer((nbits + 7) / 8, 0);
+  auto status = bytestring_p4rt_to_pi(input, nbits, &buffer[0]);
+  EXPECT_EQ(status.code(), ::google::rpc::Code::INVALID_ARGUMENT);
 }
 
 INSTANTIATE_TEST_SUITE_P(
     BytestringConversionsP4RtToPiErrors, TestBytestringConversionP4RtToPiErrors,
     Values(std::make_tuple(16, std::string("\xab\x30\x64", 3)),
-           std::make_tuple(12, std::string("\xff\x30", 2)))
+           std::make_tuple(12, std::string("\xff\x30", 2)),
+           std::make_tuple(
+               128, std::string("\x01") + std::string(16, '\x00')))
 );
 
 class TestBytestringConversionPiToP4Rt
@@ -106,6 +127,92 @@ INSTANTIATE_TEST_SUITE_P(
                std::string("\x00\x64", 2), std::string("\x64", 1)))
 );
 
+// 128-bit values exercise the path processing 8 bytes at a time
+TEST(TestBytestringInPlace, AllEqual) {
+  for (size_t n : {3, 16, 19}) {
+    std::string zeros(n, '\x00');
+    EXPECT_TRUE(bytes_all_equal(zeros.data(), n, 0));
+    EXPECT_FALSE(bytes_all_equal(zeros.data(), n, '\xff'));
+    std::string ones(n, '\xff');
+    EXPECT_TRUE(bytes_all_equal(ones.data(), n, '\xff'));
+    for (size_t i = 0; i < n; i++) {
+      auto v = zeros;
+      v[i] = 1;
+      EXPECT_FALSE(bytes_all_equal(v.data(), n, 0));
+    }
+  }
+  EXPECT_TRUE(bytes_all_equal(nullptr, 0, 0));
+}
+
+TEST(TestBytestringInPlace, WithinMask) {
+  for (size_t n : {3, 16, 19}) {
+    std::string mask(n, '\xff');
+    mask[n - 1] = '\xf0';
+    std::string value(n, '\x5a');
+    value[n - 1] = '\x50';
+    EXPECT_TRUE(bytes_within_mask(value.data(), mask.data(), n));
+    value[n - 1] = '\x51';
+    EXPECT_FALSE(bytes_within_mask(value.data(), mask.data(), n));
+  }
+}
+
+TEST(TestBytestringInPlace, PrefixTrailingZeros) {
+  // 2001:db8::/32
+  std::string v6("\x20\x01\x0d\xb8", 4);
+  v6.append(12, '\x00');
+  EXPECT_TRUE(check_prefix_trailing_zeros(v6.data(), v6.size(), 32));
+  EXPECT_TRUE(check_prefix_trailing_zeros(v6.data(), v6.size(), 29));
+  EXPECT_FALSE(check_prefix_trailing_zeros(v6.data(), v6.size(), 28));
+  EXPECT_TRUE(check_prefix_trailing_zeros(v6.data(), v6.size(), 128));
+  v6[15] = 1;
+  EXPECT_FALSE(check_prefix_trailing_zeros(v6.data(), v6.size(), 127));
+  EXPECT_TRUE(check_prefix_trailing_zeros(v6.data(), v6.size(), 128));
+  EXPECT_TRUE(check_prefix_trailing_zeros(v6, 128));
+}
+
+TEST(TestTableEntryKey, Canonical) {
+  p4::v1::TableEntry entry_1;
+  entry_1.set_table_id(1);
+  {
+    auto *mf = entry_1.add_match();
+    mf->set_field_id(1);
+    mf->mutable_exact()->set_value(std::string("\x0a", 1));
+  }
+  {
+    auto *mf = entry_1.add_match();
+    mf->set_field_id(2);
+    mf->mutable_ternary()->set_value(std::string("\x00", 1));
+    mf->mutable_ternary()->set_mask(std::string("\x0f\xff", 2));
+  }
+  // fields in a different order, with leading zeros
+  p4::v1::TableEntry entry_2;
+  entry_2.set_table_id(1);
+  {
+    auto *mf = entry_2.add_match();
+    mf->set_field_id(2);
+    mf->mutable_ternary()->set_value(std::string("\x00\x00", 2));
+    mf->mutable_ternary()->set_mask(std::string("\x00\x0f\xff", 3));
+  }
+  {
+    auto *mf = entry_2.add_match();
+    mf->set_field_id(1);
+    mf->mutable_exact()->set_value(std::string("\x00\x0a", 2));
+  }
+  EXPECT_EQ(table_entry_key(entry_1), table_entry_key(entry_2));
+
+  auto entry_3 = entry_2;
+  entry_3.mutable_match(1)->mutable_exact()->set_value(
+      std::string("\x0a\x00", 2));
+  EXPECT_NE(table_entry_key(entry_1), table_entry_key(entry_3));
+  auto entry_4 = entry_2;
+  entry_4.set_priority(10);
+  EXPECT_NE(table_entry_key(entry_1), table_entry_key(entry_4));
+  // an empty bytestring is invalid and is not the same as zero
+  auto entry_5 = entry_2;
+  entry_5.mutable_match(0)->mutable_ternary()->set_value("");
+  EXPECT_NE(table_entry_key(entry_1), table_entry_key(entry_5));
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace proto
@@ -0,0 +1,149 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/dense_id_map.h"
+#include "src/small_vector.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::DenseIdMap;
+using pi::fe::proto::SmallVector;
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+
+TEST(DenseIdMapTest, InsertFindErase) {
+  DenseIdMap<uint32_t, std::string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.find(1), nullptr);
+
+  EXPECT_TRUE(map.insert(1, "a"));
+  EXPECT_FALSE(map.insert(1, "b"));
+  ASSERT_NE(map.find(1), nullptr);
+  EXPECT_EQ(*map.find(1), "a");
+  EXPECT_EQ(map.size(), 1u);
+
+  EXPECT_TRUE(map.erase(1));
+  EXPECT_FALSE(map.erase(1));
+  EXPECT_EQ(map.find(1), nullptr);
+  EXPECT_TRUE(map.empty());
+
+  // can re-use the same key
+  EXPECT_TRUE(map.insert(1, "c"));
+  EXPECT_EQ(*map.find(1), "c");
+}
+
+// Large and small keys can be mixed, the large ones end up in the hash map,
+// which is transparent to the user.
+TEST(DenseIdMapTest, SparseKeys) {
+  DenseIdMap<uint64_t, int> map;
+  std::map<uint64_t, int> expected;
+  uint64_t large_key = uint64_t(1) << 40;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(map.insert(i, i));
+    expected.emplace(i, i);
+    EXPECT_TRUE(map.insert(large_key + i, -i));
+    expected.emplace(large_key + i, -i);
+  }
+  EXPECT_EQ(map.size(), expected.size());
+  for (const auto &p : expected) {
+    ASSERT_NE(map.find(p.first), nullptr);
+    EXPECT_EQ(*map.find(p.first), p.second);
+  }
+  EXPECT_FALSE(map.insert(large_key, 0));
+
+  std::map<uint64_t, int> visited;
+  map.for_each([&visited](uint64_t k, int v) { visited.emplace(k, v); });
+  EXPECT_EQ(visited, expected);
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(map.erase(i));
+    EXPECT_TRUE(map.erase(large_key + i));
+  }
+  EXPECT_TRUE(map.empty());
+}
+
+// The memory usage of a map with dense keys should be close to the size of the
+// values.
+TEST(DenseIdMapTest, DenseMemoryUsage) {
+  DenseIdMap<uint32_t, uint32_t> map;
+  const size_t num_keys = 100000;
+  for (size_t i = 1; i <= num_keys; i++)
+    map.insert(static_cast<uint32_t>(i), 0);
+  EXPECT_LE(map.memory_usage(), 4 * num_keys * 2 * sizeof(uint32_t));
+}
+
+TEST(SmallVectorTest, Inline) {
+  SmallVector<uint64_t, 1> v;
+  EXPECT_TRUE(v.empty());
+  v.push_back(7);
+  EXPECT_THAT(v, ElementsAre(7));
+  EXPECT_EQ(v.heap_memory_usage(), 0u);
+  v.pop_back();
+  EXPECT_THAT(v, IsEmpty());
+}
+
+TEST(SmallVectorTest, Heap) {
+  SmallVector<uint64_t, 1> v;
+  for (uint64_t i = 0; i < 10; i++) v.push_back(i);
+  EXPECT_EQ(v.size(), 10u);
+  EXPECT_GT(v.heap_memory_usage(), 0u);
+  for (uint64_t i = 0; i < 10; i++) EXPECT_EQ(v.at(i), i);
+  EXPECT_EQ(v.front(), 0u);
+  EXPECT_EQ(v.back(), 9u);
+  EXPECT_THROW(v.at(10), std::out_of_range);
+
+  auto copy = v;
+  EXPECT_THAT(copy, ElementsAreArray(v.begin(), v.end()));
+  auto moved = std::move(copy);
+  EXPECT_THAT(moved, ElementsAreArray(v.begin(), v.end()));
+  EXPECT_TRUE(copy.empty());  // NOLINT(bugprone-use-after-move)
+}
+
+TEST(SmallVectorTest, InsertErase) {
+  SmallVector<int, 2> v;
+  v.insert(v.end(), 3);
+  v.insert(v.begin(), 1);
+  v.insert(v.begin() + 1, 2);
+  EXPECT_THAT(v, ElementsAre(1, 2, 3));
+  v.erase(v.begin(), v.begin() + 1);
+  EXPECT_THAT(v, ElementsAre(2, 3));
+  v.erase(v.begin() + 1, v.end());
+  EXPECT_THAT(v, ElementsAre(2));
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
@@ -23,6 +23,7 @@
 
 #include <algorithm>  // for std::reverse
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -50,6 +51,8 @@ using Code = ::google::rpc::Code;
 
 using ::testing::_;
 using ::testing::AllArgs;
+using ::testing::InSequence;
+using ::testing::Invoke;
 using ::testing::Return;
 using ::testing::StrEq;
 using ::testing::Truly;
@@ -386,6 +389,118 @@ TEST_F(DeviceMgrPacketIOMetadataTest, PacketOutMissingMetadata) {
 }
 
 
+class DeviceMgrPacketIOBatchTest : public DeviceMgrPacketIOMetadataTest {
+ protected:
+  // the metadata values and the payload are derived from i
+  p4v1::PacketOut make_packet_out(int i, std::string *expected) const {
+    p4v1::PacketOut packet_out;
+    auto payload = std::to_string(i);
+    packet_out.set_payload(payload);
+    BitPattern pattern;
+    for (int id = 0; id < num; id++) {
+      auto v = (i + id) % (1 << bitwidths[id]);
+      auto metadata = packet_out.add_metadata();
+      metadata->set_metadata_id(id + 1);
+      metadata->set_value(to_binary(v, bitwidths[id], false));
+      pattern.push_back(v, bitwidths[id]);
+    }
+    *expected = pattern.bits + payload;
+    return packet_out;
+  }
+};
+
+TEST_F(DeviceMgrPacketIOBatchTest, PacketOutBatch) {
+  const int num_packets = 3;
+  std::vector<p4v1::PacketOut> packets;
+  std::vector<const p4v1::PacketOut *> packet_ptrs;
+  std::vector<std::string> expected(num_packets);
+  for (int i = 0; i < num_packets; i++)
+    packets.push_back(make_packet_out(i, &expected[i]));
+  for (const auto &packet : packets) packet_ptrs.push_back(&packet);
+
+  std::vector<std::string> sent;
+  auto batch_fn = [&sent](const pi_packet_t *pkts, size_t num_pkts,
+                          size_t *num_sent) {
+    for (size_t i = 0; i < num_pkts; i++)
+      sent.emplace_back(pkts[i].pkt, pkts[i].size);
+    *num_sent = num_pkts;
+    return PI_STATUS_SUCCESS;
+  };
+  EXPECT_CALL(*mock, packetout_send_batch(_, num_packets, _))
+      .WillOnce(Invoke(batch_fn));
+  EXPECT_CALL(*mock, packetout_send(_, _)).Times(0);
+  EXPECT_OK(mgr.packet_out_send_batch(packet_ptrs));
+  EXPECT_EQ(sent, expected);
+}
+
+// the target does not support batching, packets are sent one at a time
+TEST_F(DeviceMgrPacketIOBatchTest, PacketOutBatchFallback) {
+  const int num_packets = 3;
+  std::vector<p4v1::PacketOut> packets;
+  std::vector<const p4v1::PacketOut *> packet_ptrs;
+  std::vector<std::string> expected(num_packets);
+  for (int i = 0; i < num_packets; i++)
+    packets.push_back(make_packet_out(i, &expected[i]));
+  for (const auto &packet : packets) packet_ptrs.push_back(&packet);
+
+  const std::string no_payload;
+  EXPECT_CALL(*mock, packetout_send_batch(_, num_packets, _));
+  {
+    InSequence s;
+    for (const auto &e : expected) {
+      EXPECT_CALL(*mock, packetout_send(_, _))
+          .With(AllArgs(Truly(PacketOutMatcher(e, no_payload))));
+    }
+  }
+  EXPECT_OK(mgr.packet_out_send_batch(packet_ptrs));
+}
+
+// packets which precede the invalid one are sent, the following ones are not
+TEST_F(DeviceMgrPacketIOBatchTest, PacketOutBatchInvalidPacket) {
+  std::string expected, unused;
+  auto packet_1 = make_packet_out(0, &expected);
+  auto packet_2 = make_packet_out(1, &unused);
+  packet_2.mutable_metadata(0)->set_metadata_id(num + 1);
+  auto packet_3 = make_packet_out(2, &unused);
+
+  const std::string no_payload;
+  EXPECT_CALL(*mock, packetout_send_batch(_, 1, _));
+  EXPECT_CALL(*mock, packetout_send(_, _))
+      .With(AllArgs(Truly(PacketOutMatcher(expected, no_payload))));
+  auto status = mgr.packet_out_send_batch({&packet_1, &packet_2, &packet_3});
+  EXPECT_EQ(status.code(), Code::INVALID_ARGUMENT);
+}
+
+// each thread uses its own buffers, so packets can be sent concurrently
+TEST_F(DeviceMgrPacketIOBatchTest, ConcurrentPacketOut) {
+  const int num_threads = 4;
+  const int num_packets = 100;
+  auto is_valid = [this](const std::tuple<const char *, size_t> &t) {
+    std::string packet(std::get<0>(t), std::get<1>(t));
+    // the header is 2 bytes, followed by the payload
+    std::string expected;
+    make_packet_out(std::stoi(packet.substr(2)), &expected);
+    return packet == expected;
+  };
+  EXPECT_CALL(*mock, packetout_send(_, _))
+      .With(AllArgs(Truly(is_valid)))
+      .Times(num_threads * num_packets);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([this, t, num_packets] {
+        for (int i = 0; i < num_packets; i++) {
+          std::string expected;
+          p4v1::StreamMessageRequest msg;
+          msg.mutable_packet()->CopyFrom(
+              make_packet_out(t * num_packets + i, &expected));
+          EXPECT_OK(mgr.stream_message_request_handle(msg));
+        }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+}
+
+
 using ErrorReportingLevel = p4::server::v1::StreamConfig::ErrorReportingLevel;
 using ::testing::WithParamInterface;
 using ::testing::Values;
@@ -475,6 +590,32 @@ TEST_P(PacketIOStreamErrorTest, PacketOutTargetError) {
   check_stream_error(packet, Code::UNKNOWN, false);
 }
 
+// the target reports an error for the batch but claims that all the packets
+// were sent; the error is reported for the last packet of the batch
+TEST_P(PacketIOStreamErrorTest, PacketOutBatchTargetErrorAllSent) {
+  const size_t num_packets = 3;
+  std::vector<p4v1::PacketOut> packets(num_packets, packet_out());
+  std::vector<const p4v1::PacketOut *> packet_ptrs;
+  for (const auto &packet : packets) packet_ptrs.push_back(&packet);
+
+  auto batch_fn = [](const pi_packet_t *, size_t num_pkts, size_t *num_sent) {
+    *num_sent = num_pkts;
+    return PI_STATUS_TARGET_ERROR;
+  };
+  EXPECT_CALL(*mock, packetout_send_batch(_, num_packets, _))
+      .WillOnce(Invoke(batch_fn));
+
+  p4v1::StreamError stream_error;
+  auto status = mgr.packet_out_send_batch(packet_ptrs, &stream_error);
+  EXPECT_EQ(status.code(), Code::UNKNOWN);
+  if (GetParam() == p4::server::v1::StreamConfig::DISABLED) {
+    EXPECT_EQ(stream_error.canonical_code(), Code::OK);
+  } else {
+    EXPECT_EQ(stream_error.canonical_code(), Code::UNKNOWN);
+    EXPECT_TRUE(stream_error.has_packet_out());
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     StreamErrorLevels, PacketIOStreamErrorTest,
     Values(p4::server::v1::StreamConfig::DISABLED,
@@ -0,0 +1,257 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "PI/frontends/proto/replication.h"
+
+#include "test_proto_fe_base.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::ReplicationPublisher;
+using pi::fe::proto::ReplicationSubscriber;
+
+using ::testing::_;
+using ::testing::AnyNumber;
+
+class ReplicationTest : public DeviceMgrUnittestBaseTest {
+ protected:
+  ReplicationTest()
+      : socket_path("/tmp/pi_replication_test_" + std::to_string(getpid()) +
+                    ".sock"),
+        publisher(std::make_shared<ReplicationPublisher>(socket_path)),
+        subscriber(socket_path) {
+    t_id = pi_p4info_table_id_from_name(p4info, "ExactOne");
+    a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+    c_id = pi_p4info_counter_id_from_name(p4info, "CounterA");
+  }
+
+  void SetUp() override {
+    DeviceMgrUnittestBaseTest::SetUp();
+    ASSERT_OK(publisher->start());
+    // the current state is read when the publisher is set
+    EXPECT_CALL(*mock, table_entries_fetch(_, _)).Times(AnyNumber());
+    EXPECT_CALL(*mock, action_prof_entries_fetch(_, _)).Times(AnyNumber());
+    mgr.replication_publisher_set(publisher);
+    EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _)).Times(AnyNumber());
+    EXPECT_CALL(*mock, table_entry_modify_wkey(t_id, _, _)).Times(AnyNumber());
+    EXPECT_CALL(*mock, table_entry_delete_wkey(t_id, _)).Times(AnyNumber());
+    EXPECT_CALL(*mock, counter_write(c_id, _, _)).Times(AnyNumber());
+  }
+
+  void TearDown() override {
+    stop_primary();
+    if (subscriber_thread.joinable()) {
+      subscriber.stop();
+      subscriber_thread.join();
+    }
+  }
+
+  void start_subscriber() {
+    subscriber_thread = std::thread([this] {
+        subscriber_status = subscriber.run(); });
+    ASSERT_TRUE(wait_for([this] { return subscriber.devices().size() == 1; }));
+  }
+
+  void stop_primary() {
+    mgr.replication_publisher_set(nullptr);
+    publisher.reset();
+  }
+
+  bool wait_for(const std::function<bool()> &predicate) const {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+      if (predicate()) return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return predicate();
+  }
+
+  int num_mirrored_updates() const {
+    p4v1::ForwardingPipelineConfig config;
+    p4v1::WriteRequest state;
+    auto status = subscriber.state_get(device_id, &config, &state);
+    return (status.code() == Code::OK) ? state.updates_size() : -1;
+  }
+
+  p4v1::TableEntry make_entry(const std::string &mf_v,
+                              const std::string &param_v) const {
+    p4v1::TableEntry table_entry;
+    table_entry.set_table_id(t_id);
+    auto mf = table_entry.add_match();
+    mf->set_field_id(pi_p4info_table_match_field_id_from_name(
+        p4info, t_id, "header_test.field32"));
+    mf->mutable_exact()->set_value(mf_v);
+    auto action = table_entry.mutable_action()->mutable_action();
+    action->set_action_id(a_id);
+    auto param = action->add_params();
+    param->set_param_id(
+        pi_p4info_action_param_id_from_name(p4info, a_id, "param"));
+    param->set_value(param_v);
+    return table_entry;
+  }
+
+  DeviceMgr::Status write_counter(int64_t index, int64_t packets) {
+    p4v1::WriteRequest request;
+    auto update = request.add_updates();
+    update->set_type(p4v1::Update::MODIFY);
+    auto counter_entry = update->mutable_entity()->mutable_counter_entry();
+    counter_entry->set_counter_id(c_id);
+    counter_entry->mutable_index()->set_index(index);
+    counter_entry->mutable_data()->set_packet_count(packets);
+    return mgr.write(request);
+  }
+
+  static constexpr std::chrono::milliseconds timeout{2000};
+
+  std::string socket_path;
+  std::shared_ptr<ReplicationPublisher> publisher;
+  ReplicationSubscriber subscriber;
+  std::thread subscriber_thread;
+  DeviceMgr::Status subscriber_status;
+  pi_p4_id_t t_id;
+  pi_p4_id_t a_id;
+  pi_p4_id_t c_id;
+};
+
+/* static */ constexpr std::chrono::milliseconds ReplicationTest::timeout;
+
+TEST_F(ReplicationTest, MirrorUpdates) {
+  start_subscriber();
+  const std::string mf_1("\x00\x00\x00\x01", 4);
+  const std::string mf_2("\x00\x00\x00\x02", 4);
+  const std::string mf_3("\x00\x00\x00\x03", 4);
+  const std::string adata_1(6, '\x01');
+  const std::string adata_2(6, '\x02');
+
+  // counter entries are replayed after table entries, even if written first
+  EXPECT_OK(write_counter(1, 99));
+  {
+    auto entry_1 = make_entry(mf_1, adata_1);
+    auto entry_2 = make_entry(mf_2, adata_1);
+    EXPECT_OK(add_entry(&entry_1));
+    EXPECT_OK(add_entry(&entry_2));
+  }
+  {
+    auto entry_1 = make_entry(mf_1, adata_2);
+    auto entry_2 = make_entry(mf_2, adata_1);
+    EXPECT_OK(modify_entry(&entry_1));
+    EXPECT_OK(remove_entry(&entry_2));
+  }
+  // only the successful updates are mirrored
+  {
+    p4v1::WriteRequest request;
+    auto update = request.add_updates();
+    update->set_type(p4v1::Update::INSERT);
+    update->mutable_entity()->mutable_table_entry()->CopyFrom(
+        make_entry(mf_1, adata_1));
+    update = request.add_updates();
+    update->set_type(p4v1::Update::INSERT);
+    update->mutable_entity()->mutable_table_entry()->CopyFrom(
+        make_entry(mf_3, adata_1));
+    auto status = mgr.write(request);
+    EXPECT_EQ(status.code(), Code::UNKNOWN);
+    EXPECT_EQ(status.details_size(), 2);
+  }
+
+  ASSERT_TRUE(wait_for([this] { return num_mirrored_updates() == 3; }));
+  p4v1::ForwardingPipelineConfig config;
+  p4v1::WriteRequest state;
+  ASSERT_OK(subscriber.state_get(device_id, &config, &state));
+  EXPECT_EQ(config.cookie().cookie(), cookie);
+  EXPECT_EQ(config.p4_device_config(), dummy_device_config);
+  ASSERT_EQ(state.updates_size(), 3);
+  {
+    const auto &update = state.updates(0);
+    EXPECT_EQ(update.type(), p4v1::Update::INSERT);
+    EXPECT_EQ(update.entity().table_entry().match(0).exact().value(), mf_1);
+    EXPECT_EQ(
+        update.entity().table_entry().action().action().params(0).value(),
+        adata_2);
+  }
+  {
+    const auto &update = state.updates(1);
+    EXPECT_EQ(update.type(), p4v1::Update::INSERT);
+    EXPECT_EQ(update.entity().table_entry().match(0).exact().value(), mf_3);
+  }
+  {
+    const auto &update = state.updates(2);
+    EXPECT_EQ(update.type(), p4v1::Update::MODIFY);
+    EXPECT_EQ(update.entity().counter_entry().data().packet_count(), 99);
+  }
+}
+
+TEST_F(ReplicationTest, Snapshot) {
+  const std::string mf("\xaa\xbb\xcc\xdd", 4);
+  const std::string adata(6, '\xcd');
+  auto entry = make_entry(mf, adata);
+  EXPECT_OK(add_entry(&entry));
+  // the standby connects after the entry was added and receives it as part of
+  // the initial snapshot
+  start_subscriber();
+  EXPECT_EQ(num_mirrored_updates(), 1);
+}
+
+TEST_F(ReplicationTest, Takeover) {
+  start_subscriber();
+  const std::string mf("\xaa\xbb\xcc\xdd", 4);
+  const std::string adata(6, '\xcd');
+  auto entry = make_entry(mf, adata);
+  EXPECT_OK(add_entry(&entry));
+  ASSERT_TRUE(wait_for([this] { return num_mirrored_updates() == 1; }));
+
+  stop_primary();
+  subscriber_thread.join();
+  EXPECT_OK(subscriber_status);
+
+  // We simulate a new server process, which does not know about the current
+  // config and forwarding state, by pushing a different device config.
+  EXPECT_CALL(*mock, table_idle_timeout_config_set(_, _)).Times(AnyNumber());
+  ASSERT_OK(set_pipeline_config(&p4info_proto, 0, "new device config"));
+  p4v1::ReadResponse response;
+  ASSERT_OK(read_table_entries(t_id, &response));
+  EXPECT_EQ(response.entities_size(), 0);
+
+  ASSERT_OK(subscriber.takeover(device_id, &mgr));
+  response.Clear();
+  ASSERT_OK(read_table_entries(t_id, &response));
+  ASSERT_EQ(response.entities_size(), 1);
+  EXPECT_EQ(response.entities(0).table_entry().match(0).exact().value(), mf);
+  p4v1::ForwardingPipelineConfig config;
+  ASSERT_OK(mgr.pipeline_config_get(
+      p4v1::GetForwardingPipelineConfigRequest::ALL, &config));
+  EXPECT_EQ(config.cookie().cookie(), cookie);
+  EXPECT_EQ(config.p4_device_config(), dummy_device_config);
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
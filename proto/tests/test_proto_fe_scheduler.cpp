@@ -0,0 +1,234 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "src/scheduler.h"
+
+#include "test_proto_fe_base.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::Scheduler;
+using SchedulingConfig = p4::server::v1::SchedulingConfig;
+using SchedulingStats = p4::server::v1::SchedulingStats;
+
+using ::testing::_;
+using ::testing::InvokeWithoutArgs;
+
+using Clock = std::chrono::steady_clock;
+
+bool wait_for(const std::atomic<bool> &flag,
+              std::chrono::milliseconds timeout) {
+  auto deadline = Clock::now() + timeout;
+  while (!flag && Clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return flag;
+}
+
+class SchedulerTest : public ::testing::Test {
+ protected:
+  static constexpr std::chrono::milliseconds timeout{200};
+
+  Scheduler scheduler;
+};
+
+/* static */ constexpr std::chrono::milliseconds SchedulerTest::timeout;
+
+TEST_F(SchedulerTest, Preempted) {
+  Scheduler::Ticket bulk(&scheduler, SchedulingConfig::BULK_WRITE);
+  EXPECT_FALSE(bulk.preempted());
+  {
+    Scheduler::Ticket read(&scheduler, SchedulingConfig::BULK_READ);
+    EXPECT_FALSE(bulk.preempted());
+  }
+  {
+    Scheduler::Ticket critical(&scheduler, SchedulingConfig::CONTROL_CRITICAL);
+    EXPECT_TRUE(bulk.preempted());
+  }
+  EXPECT_FALSE(bulk.preempted());
+}
+
+TEST_F(SchedulerTest, WaitForMoreUrgent) {
+  std::atomic<bool> admitted{false};
+  std::thread thread;
+  {
+    Scheduler::Ticket critical(&scheduler, SchedulingConfig::CONTROL_CRITICAL);
+    thread = std::thread([this, &admitted] {
+        Scheduler::Ticket small(&scheduler, SchedulingConfig::SMALL_WRITE);
+        admitted = true;
+    });
+    EXPECT_FALSE(wait_for(admitted, timeout));
+  }
+  EXPECT_TRUE(wait_for(admitted, timeout));
+  thread.join();
+}
+
+TEST_F(SchedulerTest, MaxPreemption) {
+  SchedulingConfig config;
+  config.set_max_preemption_ms(20);
+  ASSERT_OK(scheduler.set_config(config));
+  Scheduler::Ticket critical(&scheduler, SchedulingConfig::CONTROL_CRITICAL);
+  auto start = Clock::now();
+  Scheduler::Ticket small(&scheduler, SchedulingConfig::SMALL_WRITE);
+  EXPECT_GE(Clock::now() - start, std::chrono::milliseconds(20));
+}
+
+TEST_F(SchedulerTest, Ranks) {
+  SchedulingConfig config;
+  auto class_config = config.add_classes();
+  class_config->set_priority_class(SchedulingConfig::BULK_WRITE);
+  class_config->set_rank(SchedulingConfig::SMALL_WRITE);
+  ASSERT_OK(scheduler.set_config(config));
+  Scheduler::Ticket bulk(&scheduler, SchedulingConfig::BULK_WRITE);
+  Scheduler::Ticket small(&scheduler, SchedulingConfig::SMALL_WRITE);
+  EXPECT_FALSE(bulk.preempted());
+  Scheduler::Ticket critical(&scheduler, SchedulingConfig::CONTROL_CRITICAL);
+  EXPECT_TRUE(bulk.preempted());
+}
+
+TEST_F(SchedulerTest, Disabled) {
+  SchedulingConfig config;
+  config.set_disabled(true);
+  ASSERT_OK(scheduler.set_config(config));
+  Scheduler::Ticket critical(&scheduler, SchedulingConfig::CONTROL_CRITICAL);
+  Scheduler::Ticket bulk(&scheduler, SchedulingConfig::BULK_WRITE);
+  EXPECT_FALSE(bulk.preempted());
+}
+
+TEST_F(SchedulerTest, InvalidConfig) {
+  SchedulingConfig config;
+  config.add_classes()->set_priority_class(
+      static_cast<SchedulingConfig::PriorityClass>(99));
+  EXPECT_EQ(scheduler.set_config(config).code(), Code::INVALID_ARGUMENT);
+}
+
+class DeviceMgrSchedulingTest : public DeviceMgrUnittestBaseTest {
+ protected:
+  DeviceMgrSchedulingTest() {
+    t_id = pi_p4info_table_id_from_name(p4info, "ExactOne");
+    a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+    mf_id = pi_p4info_table_match_field_id_from_name(
+        p4info, t_id, "header_test.field32");
+    param_id = pi_p4info_action_param_id_from_name(p4info, a_id, "param");
+  }
+
+  p4v1::WriteRequest make_request(uint32_t start, uint32_t count) const {
+    p4v1::WriteRequest request;
+    for (uint32_t i = start; i < start + count; i++) {
+      auto update = request.add_updates();
+      update->set_type(p4v1::Update::INSERT);
+      auto entry = update->mutable_entity()->mutable_table_entry();
+      entry->set_table_id(t_id);
+      auto mf = entry->add_match();
+      mf->set_field_id(mf_id);
+      std::string v(4, '\x00');
+      for (int j = 0; j < 4; j++) v[3 - j] = static_cast<char>(i >> (j * 8));
+      mf->mutable_exact()->set_value(v);
+      auto action = entry->mutable_action()->mutable_action();
+      action->set_action_id(a_id);
+      auto param = action->add_params();
+      param->set_param_id(param_id);
+      param->set_value(std::string(6, '\x00'));
+    }
+    return request;
+  }
+
+  SchedulingStats::ClassStats stats_get(
+      SchedulingConfig::PriorityClass priority_class) const {
+    SchedulingStats stats;
+    EXPECT_OK(mgr.scheduling_stats_get(&stats));
+    return stats.classes(priority_class);
+  }
+
+  pi_p4_id_t t_id;
+  pi_p4_id_t a_id;
+  pi_p4_id_t mf_id;
+  pi_p4_id_t param_id;
+};
+
+// A small write to the same table is applied at the next chunk boundary of an
+// ongoing bulk write, instead of waiting for the bulk write to complete.
+TEST_F(DeviceMgrSchedulingTest, BulkWritePreempted) {
+  p4::server::v1::Config config;
+  config.mutable_scheduling()->set_bulk_write_chunk_size(8);
+  ASSERT_OK(mgr.server_config_set(config));
+
+  const int num_bulk_updates = 32;
+  auto bulk_request = make_request(0, num_bulk_updates);
+  auto small_request = make_request(1000, 1);
+
+  int num_adds = 0;
+  int small_write_position = -1;
+  auto bulk_write_thread_id = std::this_thread::get_id();
+  std::thread small_write_thread;
+  auto action = [&]() -> pi_status_t {
+    if (std::this_thread::get_id() != bulk_write_thread_id) {
+      small_write_position = num_adds++;
+      return PI_STATUS_SUCCESS;
+    }
+    if (num_adds++ == 0) {
+      small_write_thread = std::thread([this, &small_request] {
+          EXPECT_OK(mgr.write(small_request));
+      });
+      // wait for the small write to be scheduled
+      auto deadline = Clock::now() + std::chrono::seconds(1);
+      while (stats_get(SchedulingConfig::SMALL_WRITE).num_requests() == 0 &&
+             Clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    return PI_STATUS_SUCCESS;
+  };
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _))
+      .Times(num_bulk_updates + 1)
+      .WillRepeatedly(InvokeWithoutArgs(action));
+
+  EXPECT_OK(mgr.write(bulk_request));
+  small_write_thread.join();
+  EXPECT_EQ(small_write_position, 8);
+
+  auto bulk_stats = stats_get(SchedulingConfig::BULK_WRITE);
+  EXPECT_EQ(bulk_stats.num_requests(), 1u);
+  EXPECT_EQ(bulk_stats.num_preemptions(), 1u);
+  auto small_stats = stats_get(SchedulingConfig::SMALL_WRITE);
+  EXPECT_EQ(small_stats.num_requests(), 1u);
+  EXPECT_EQ(small_stats.num_preemptions(), 0u);
+}
+
+TEST_F(DeviceMgrSchedulingTest, InvalidConfig) {
+  p4::server::v1::Config config;
+  config.mutable_scheduling()->add_classes()->set_priority_class(
+      static_cast<SchedulingConfig::PriorityClass>(99));
+  EXPECT_EQ(mgr.server_config_set(config).code(), Code::INVALID_ARGUMENT);
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
@@ -77,6 +77,26 @@ class DeviceMgrSetPipelineConfigTest : public DeviceMgrBaseTest {
     config.unsafe_arena_release_p4info();
     return status;
   }
+
+  DeviceMgr::Status set_pipeline_config(
+      const p4v1::ForwardingPipelineConfig &config,
+      p4v1::SetForwardingPipelineConfigRequest_Action action) {
+    EXPECT_CALL(*mock, action_prof_api_support())
+        .Times(AnyNumber());
+    EXPECT_CALL(*mock, table_default_action_get_handle(_, _))
+        .Times(AnyNumber());
+    return mgr.pipeline_config_set(action, config);
+  }
+
+  int num_table_entries(pi_p4_id_t t_id) {
+    p4v1::ReadResponse response;
+    p4v1::Entity entity;
+    auto t_entry = entity.mutable_table_entry();
+    t_entry->set_table_id(t_id);
+    auto status = mgr.read_one(entity, &response);
+    EXPECT_EQ(status.code(), Code::OK);
+    return response.entities_size();
+  }
 };
 
 TEST_F(DeviceMgrSetPipelineConfigTest, Reconcile) {
@@ -151,6 +171,86 @@ TEST_F(DeviceMgrSetPipelineConfigTest, Reconcile) {
   }
 }
 
+// Pushing the same config again (e.g. when the controller reconnects) should
+// not trigger a device update and should preserve the forwarding state.
+TEST_F(DeviceMgrSetPipelineConfigTest, UnchangedConfig) {
+  constexpr const char *p4info_path = TESTDATADIR "/" "reconcile_1.p4info.txt";
+  p4v1::ForwardingPipelineConfig config;
+  config.mutable_p4info()->CopyFrom(read_p4info(p4info_path));
+  config.set_p4_device_config("device_config_v1");
+  config.mutable_cookie()->set_cookie(1);
+
+  pi_p4info_t *p4info;
+  pi::p4info::p4info_proto_reader(config.p4info(), &p4info);
+  auto t_id = pi_p4info_table_id_from_name(p4info, "T1");
+  auto a_id = pi_p4info_action_id_from_name(p4info, "actionA");
+  pi_destroy_config(p4info);
+
+  EXPECT_CALL(*mock, table_entries_fetch(t_id, _)).Times(AnyNumber());
+
+  ASSERT_OK(set_pipeline_config(
+      config,
+      p4v1::SetForwardingPipelineConfigRequest_Action_VERIFY_AND_COMMIT));
+
+  EXPECT_CALL(*mock, table_entry_add(t_id, _, _, _));
+  {
+    p4v1::TableEntry t_entry;
+    t_entry.set_table_id(t_id);
+    auto *mf = t_entry.add_match();
+    mf->set_field_id(1);
+    mf->mutable_exact()->set_value("\xab");
+    auto *action = t_entry.mutable_action()->mutable_action();
+    action->set_action_id(a_id);
+    auto param = action->add_params();
+    param->set_param_id(1);
+    param->set_value("\xab");
+    ASSERT_OK(add_entry(&t_entry));
+  }
+  ASSERT_EQ(num_table_entries(t_id), 1);
+
+  // the target is not queried for the default entry handles, which means that
+  // the frontend state was not rebuilt
+  EXPECT_CALL(*mock, table_default_action_get_handle(_, _)).Times(0);
+  config.mutable_cookie()->set_cookie(2);
+  ASSERT_OK(mgr.pipeline_config_set(
+      p4v1::SetForwardingPipelineConfigRequest_Action_VERIFY_AND_COMMIT,
+      config));
+  EXPECT_EQ(num_table_entries(t_id), 1);
+  ASSERT_OK(mgr.pipeline_config_set(
+      p4v1::SetForwardingPipelineConfigRequest_Action_VERIFY_AND_SAVE,
+      config));
+  ASSERT_OK(mgr.pipeline_config_set(
+      p4v1::SetForwardingPipelineConfigRequest_Action_COMMIT,
+      p4v1::ForwardingPipelineConfig()));
+  EXPECT_EQ(num_table_entries(t_id), 1);
+
+  {
+    p4v1::ForwardingPipelineConfig config_read;
+    ASSERT_OK(mgr.pipeline_config_get(
+        p4v1::GetForwardingPipelineConfigRequest_ResponseType_COOKIE_ONLY,
+        &config_read));
+    EXPECT_EQ(config_read.cookie().cookie(), 2u);
+  }
+
+  // a new device config means that the dataplane state is lost, even if the
+  // P4Info is unchanged
+  config.set_p4_device_config("device_config_v2");
+  ASSERT_OK(set_pipeline_config(
+      config,
+      p4v1::SetForwardingPipelineConfigRequest_Action_VERIFY_AND_COMMIT));
+  EXPECT_EQ(num_table_entries(t_id), 0);
+
+  {
+    p4v1::ForwardingPipelineConfig config_read;
+    ASSERT_OK(mgr.pipeline_config_get(
+        p4v1::GetForwardingPipelineConfigRequest_ResponseType_ALL,
+        &config_read));
+    EXPECT_EQ(config_read.p4_device_config(), "device_config_v2");
+    EXPECT_EQ(config_read.p4info().tables_size(),
+              config.p4info().tables_size());
+  }
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace proto
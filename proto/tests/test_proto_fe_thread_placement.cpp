@@ -0,0 +1,158 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <PI/frontends/proto/thread_placement.h>
+#include <PI/pi.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <string>
+#include <thread>
+
+#include "google/rpc/code.pb.h"
+
+#include "matchers.h"
+
+namespace pi {
+namespace proto {
+namespace testing {
+namespace {
+
+using pi::fe::proto::ThreadPlacement;
+using Code = ::google::rpc::Code;
+using ThreadConfig = p4::server::v1::ThreadConfig;
+
+std::string thread_name() {
+  char name[16];
+  EXPECT_EQ(pthread_getname_np(pthread_self(), name, sizeof(name)), 0);
+  return name;
+}
+
+cpu_set_t thread_cpus() {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  EXPECT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus), 0);
+  return cpus;
+}
+
+class ThreadPlacementTest : public ::testing::Test {
+ protected:
+  ThreadPlacementTest() {
+    // we pin threads to the first CPU we are allowed to run on
+    auto cpus = thread_cpus();
+    while (!CPU_ISSET(cpu, &cpus)) cpu++;
+  }
+
+  ~ThreadPlacementTest() {
+    EXPECT_OK(ThreadPlacement::configure(p4::server::v1::Config()));
+  }
+
+  // runs fn in a new thread which reports its start as the given class
+  template <typename Fn>
+  void run_in_thread(const char *thread_class, Fn fn) {
+    std::thread t([thread_class, &fn] {
+        pi_thread_start(thread_class);
+        fn();
+    });
+    t.join();
+  }
+
+  int cpu{0};
+};
+
+TEST_F(ThreadPlacementTest, NameAndAffinity) {
+  p4::server::v1::Config config;
+  auto &thread_config = (*config.mutable_threads())["digest"];
+  thread_config.set_name("learning");
+  thread_config.add_cpus(cpu);
+  ASSERT_OK(ThreadPlacement::configure(config));
+  run_in_thread("digest", [this] {
+      EXPECT_EQ(thread_name(), "learning");
+      auto cpus = thread_cpus();
+      EXPECT_EQ(CPU_COUNT(&cpus), 1);
+      EXPECT_TRUE(CPU_ISSET(cpu, &cpus));
+  });
+}
+
+TEST_F(ThreadPlacementTest, DefaultName) {
+  ASSERT_OK(ThreadPlacement::configure(p4::server::v1::Config()));
+  run_in_thread("idle_timeout", [] {
+      // truncated to 15 characters
+      EXPECT_EQ(thread_name(), "pi_idle_timeout");
+  });
+  run_in_thread("rpc_notifications", [] {
+      EXPECT_EQ(thread_name(), "pi_rpc_notifica");
+  });
+}
+
+TEST_F(ThreadPlacementTest, Scoped) {
+  p4::server::v1::Config config;
+  (*config.mutable_threads())["grpc"].add_cpus(cpu);
+  ASSERT_OK(ThreadPlacement::configure(config));
+  auto cpus_before = thread_cpus();
+  {
+    ThreadPlacement::Scoped placement("grpc");
+    std::thread t([this] {
+        auto cpus = thread_cpus();
+        EXPECT_EQ(CPU_COUNT(&cpus), 1);
+        EXPECT_TRUE(CPU_ISSET(cpu, &cpus));
+    });
+    t.join();
+  }
+  auto cpus_after = thread_cpus();
+  EXPECT_TRUE(CPU_EQUAL(&cpus_before, &cpus_after));
+}
+
+TEST_F(ThreadPlacementTest, InvalidConfig) {
+  {
+    p4::server::v1::Config config;
+    (*config.mutable_threads())["digest"].set_name("a_very_long_name");
+    EXPECT_EQ(ThreadPlacement::configure(config).code(),
+              Code::INVALID_ARGUMENT);
+  }
+  {
+    p4::server::v1::Config config;
+    (*config.mutable_threads())["digest"].add_cpus(CPU_SETSIZE);
+    EXPECT_EQ(ThreadPlacement::configure(config).code(),
+              Code::INVALID_ARGUMENT);
+  }
+  {
+    p4::server::v1::Config config;
+    (*config.mutable_threads())["digest"].set_priority(10);
+    EXPECT_EQ(ThreadPlacement::configure(config).code(),
+              Code::INVALID_ARGUMENT);
+  }
+  {
+    p4::server::v1::Config config;
+    auto &thread_config = (*config.mutable_threads())["digest"];
+    thread_config.set_policy(ThreadConfig::FIFO);
+    thread_config.set_priority(0);
+    EXPECT_EQ(ThreadPlacement::configure(config).code(),
+              Code::INVALID_ARGUMENT);
+  }
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace proto
+}  // namespace pi
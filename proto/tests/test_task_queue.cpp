@@ -20,6 +20,7 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <chrono>
 #include <future>
 #include <memory>
@@ -37,6 +38,8 @@ using pi::fe::proto::TaskIface;
 using pi::fe::proto::CancellableTask;
 using Clock = std::chrono::steady_clock;
 using TaskQueue = pi::fe::proto::TaskQueue<Clock>;
+using TaskQueueHandle = pi::fe::proto::TaskQueueHandle<Clock>;
+using TaskQueuePool = pi::fe::proto::TaskQueuePool<Clock>;
 
 class TaskQueueTest : public ::testing::Test {
  public:
@@ -171,6 +174,99 @@ TEST_F(TaskQueueTest, ExecuteTaskOrDrop) {
       std::unique_ptr<TaskIface>(new Task(promise, 99)), max_size), 0u);
 }
 
+TEST_F(TaskQueueTest, HandleExecuteTaskOrDrop) {
+  static constexpr size_t max_size = 10;
+  task_queue.stop();
+  TaskQueueHandle handle1(&task_queue);
+  TaskQueueHandle handle2(&task_queue);
+  std::promise<int> promise;
+  for (size_t i = 0; i < max_size; i++) {
+    EXPECT_EQ(handle1.execute_task_or_drop(
+        std::unique_ptr<TaskIface>(new Task(promise, 99)), max_size), 1u);
+  }
+  EXPECT_EQ(handle1.execute_task_or_drop(
+      std::unique_ptr<TaskIface>(new Task(promise, 99)), max_size), 0u);
+  // the limit is per handle
+  EXPECT_EQ(handle2.execute_task_or_drop(
+      std::unique_ptr<TaskIface>(new Task(promise, 99)), max_size), 1u);
+  handle1.purge();
+  EXPECT_EQ(handle1.execute_task_or_drop(
+      std::unique_ptr<TaskIface>(new Task(promise, 99)), max_size), 1u);
+}
+
+TEST_F(TaskQueueTest, Purge) {
+  TaskQueueHandle handle1(&task_queue);
+  TaskQueueHandle handle2(&task_queue);
+  std::promise<int> promise1;
+  std::promise<int> promise2;
+  auto future2 = promise2.get_future();
+  handle1.execute_task_in(std::unique_ptr<TaskIface>(new Task(promise1, 1)),
+                          std::chrono::milliseconds(100));
+  handle2.execute_task_in(std::unique_ptr<TaskIface>(new Task(promise2, 2)),
+                          std::chrono::milliseconds(100));
+  handle1.purge();
+  ASSERT_EQ(future2.wait_for(std::chrono::milliseconds(500)),
+            std::future_status::ready);
+  EXPECT_EQ(future2.get(), 2);
+  // promise1 would be satisfied by now if the task had not been purged
+  EXPECT_EQ(promise1.get_future().wait_for(std::chrono::milliseconds(0)),
+            std::future_status::timeout);
+}
+
+TEST_F(TaskQueueTest, PurgeWaitsForRunningTask) {
+  struct SlowTask : public TaskIface {
+    // NOLINTNEXTLINE(runtime/references)
+    SlowTask(std::promise<void> &started, std::atomic<bool> *done)
+        : started(started), done(done) { }
+
+    void operator()() override {
+      started.set_value();
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      *done = true;
+    }
+
+    std::promise<void> &started;
+    std::atomic<bool> *done;
+  };
+
+  std::promise<void> started;
+  std::atomic<bool> done{false};
+  TaskQueueHandle handle(&task_queue);
+  handle.execute_task(std::unique_ptr<TaskIface>(new SlowTask(started, &done)));
+  started.get_future().wait();
+  handle.purge();
+  EXPECT_TRUE(done);
+}
+
+TEST_F(TaskQueueTest, PurgePeriodicTask) {
+  std::vector<Clock::time_point> tps;
+  {
+    TaskQueueHandle handle(&task_queue);
+    handle.execute_periodic_task(
+        std::unique_ptr<TaskIface>(new PeriodicTask(&tps)),
+        std::chrono::milliseconds(50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  }
+  auto size = tps.size();
+  EXPECT_GT(size, 0u);
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  EXPECT_EQ(tps.size(), size);
+}
+
+TEST(TaskQueuePoolTest, SameKeySameQueue) {
+  TaskQueuePool pool("test", 4);
+  EXPECT_EQ(pool.get(1), pool.get(1));
+  EXPECT_EQ(pool.get(1), pool.get(5));
+  EXPECT_NE(pool.get(1), pool.get(2));
+  std::promise<int> promise;
+  auto future = promise.get_future();
+  TaskQueueHandle handle(pool.get(3));
+  handle.execute_task(std::unique_ptr<TaskIface>(new Task(promise, 99)));
+  ASSERT_EQ(future.wait_for(std::chrono::milliseconds(500)),
+            std::future_status::ready);
+  EXPECT_EQ(future.get(), 99);
+}
+
 }  // namespace
 }  // namespace testing
 }  // namespace proto
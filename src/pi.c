@@ -25,6 +25,7 @@
 #include "_assert.h"
 #include "cb_mgr.h"
 #include "device_map.h"
+#include "pi_async_int.h"
 #include "pi_learn_int.h"
 #include "pi_tables_int.h"
 #include "utils/logging.h"
@@ -43,7 +44,10 @@ static vector_t *device_arr = NULL;
 // returns a pointer offering direct access to shared state
 // these functions are for internal library use only (they are declared in
 // PI/int/pi_int.h)
-static pthread_mutex_t device_map_mutex;
+// pi_device_lock() takes the write lock, lookups which do not modify the
+// device state (e.g. pi_get_device_p4info(), which is called for every table
+// operation) only take the read lock
+static pthread_rwlock_t device_map_lock;
 
 typedef struct {
   int is_set;
@@ -57,23 +61,31 @@ typedef struct {
 static pi_direct_res_rpc_t direct_res_rpc[PI_RES_TYPE_MAX];
 
 static cb_mgr_t packet_cb_mgr;
-// protects access to registered packet-in CBs
-static pthread_mutex_t packet_cb_mutex;
+// protects access to registered packet-in CBs; notifications for different
+// devices only take the read lock and can be delivered concurrently
+static pthread_rwlock_t packet_cb_lock;
 
 static cb_mgr_t port_cb_mgr;
 // protects access to registered port event CBs
-static pthread_mutex_t port_cb_mutex;
+static pthread_rwlock_t port_cb_lock;
 
-// acquire device_map_mutex first
+// may be used before pi_init, hence the static initialization
+static PIThreadStartCb thread_start_cb = NULL;
+static void *thread_start_cookie = NULL;
+static pthread_mutex_t thread_start_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// acquire device_map_lock first
 pi_device_info_t *pi_get_device_info(pi_dev_id_t dev_id) {
   return (pi_device_info_t *)device_map_get(&device_map, dev_id);
 }
 
-void pi_device_lock() { pthread_mutex_lock(&device_map_mutex); }
+void pi_device_lock() { pthread_rwlock_wrlock(&device_map_lock); }
+
+void pi_device_unlock() { pthread_rwlock_unlock(&device_map_lock); }
 
-void pi_device_unlock() { pthread_mutex_unlock(&device_map_mutex); }
+static void pi_device_rdlock() { pthread_rwlock_rdlock(&device_map_lock); }
 
-// acquire device_map_mutex first
+// acquire device_map_lock first
 pi_device_info_t *pi_get_devices(size_t *nb) {
   *nb = vector_size(device_arr);
   return (pi_device_info_t *)vector_data(device_arr);
@@ -81,7 +93,7 @@ pi_device_info_t *pi_get_devices(size_t *nb) {
 
 const pi_p4info_t *pi_get_device_p4info(pi_dev_id_t dev_id) {
   const pi_p4info_t *p4info = NULL;
-  pi_device_lock();
+  pi_device_rdlock();
   pi_device_info_t *device_info = pi_get_device_info(dev_id);
   if (device_info != NULL) p4info = device_info->p4info;
   pi_device_unlock();
@@ -133,11 +145,11 @@ pi_status_t pi_init(size_t max_devices, pi_remote_addr_t *remote_addr) {
   pi_status_t status;
   // TODO(antonin): best place for this? I don't see another option
   register_std_direct_res();
-  if (pthread_mutex_init(&device_map_mutex, NULL))
+  if (pthread_rwlock_init(&device_map_lock, NULL))
     return PI_STATUS_PTHREAD_ERROR;
-  if (pthread_mutex_init(&packet_cb_mutex, NULL))
+  if (pthread_rwlock_init(&packet_cb_lock, NULL))
     return PI_STATUS_PTHREAD_ERROR;
-  if (pthread_mutex_init(&port_cb_mutex, NULL)) return PI_STATUS_PTHREAD_ERROR;
+  if (pthread_rwlock_init(&port_cb_lock, NULL)) return PI_STATUS_PTHREAD_ERROR;
   device_map_create(&device_map);
   device_arr = vector_create(sizeof(pi_device_info_t), 256);
   cb_mgr_init(&packet_cb_mgr);
@@ -164,7 +176,7 @@ pi_status_t pi_init(size_t max_devices, pi_remote_addr_t *remote_addr) {
   return PI_STATUS_SUCCESS;
 }
 
-// acquire device_map_mutex first
+// acquire device_map_lock first
 void pi_update_device_config(pi_dev_id_t dev_id, const pi_p4info_t *p4info) {
   pi_device_info_t *info = pi_get_device_info(dev_id);
   assert(info != NULL);
@@ -173,9 +185,22 @@ void pi_update_device_config(pi_dev_id_t dev_id, const pi_p4info_t *p4info) {
   info->p4info = p4info;
 }
 
-// acquire device_map_mutex first
+// device_map points to the entries of device_arr, which move when the vector
+// is resized or when an entry is removed; acquire device_map_lock first
+static void reindex_devices(size_t from) {
+  size_t num_devices = vector_size(device_arr);
+  for (size_t idx = from; idx < num_devices; idx++) {
+    pi_device_info_t *info = (pi_device_info_t *)vector_at(device_arr, idx);
+    _PI_ASSERT(device_map_remove(&device_map, info->dev_id));
+    _PI_ASSERT(device_map_add(&device_map, info->dev_id, info));
+  }
+}
+
+// acquire device_map_lock first
 void pi_create_device_config(pi_dev_id_t dev_id) {
+  void *data = vector_data(device_arr);
   vector_push_back_empty(device_arr);
+  if (vector_data(device_arr) != data) reindex_devices(0);
   pi_device_info_t *info = (pi_device_info_t *)vector_back(device_arr);
   _PI_ASSERT(device_map_add(&device_map, dev_id, info));
   info->dev_id = dev_id;
@@ -253,6 +278,9 @@ size_t pi_get_device_ids(pi_dev_id_t *dev_ids, size_t max_num_devices) {
 }
 
 pi_status_t pi_remove_device(pi_dev_id_t dev_id) {
+  // pending async operations may need the device lock
+  _PI_ASSERT(pi_async_remove_device(dev_id) == PI_STATUS_SUCCESS);
+
   pi_device_lock();
   pi_device_info_t *info = pi_get_device_info(dev_id);
   if (!info) {
@@ -262,16 +290,18 @@ pi_status_t pi_remove_device(pi_dev_id_t dev_id) {
 
   pi_status_t status = _pi_remove_device(dev_id);
 
-  vector_remove_e(device_arr, (void *)info);
+  size_t idx = (size_t)(info - (pi_device_info_t *)vector_data(device_arr));
   _PI_ASSERT(device_map_remove(&device_map, dev_id));
+  vector_remove_e(device_arr, (void *)info);
+  reindex_devices(idx);
 
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_wrlock(&packet_cb_lock);
   cb_mgr_rm(&packet_cb_mgr, dev_id);
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
 
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_wrlock(&port_cb_lock);
   cb_mgr_rm(&port_cb_mgr, dev_id);
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
 
   _PI_ASSERT(pi_learn_remove_device(dev_id) == PI_STATUS_SUCCESS);
   _PI_ASSERT(pi_table_remove_device(dev_id) == PI_STATUS_SUCCESS);
@@ -305,9 +335,11 @@ pi_status_t pi_destroy() {
   // DeviceMgr::destroy (and therefore pi_destroy) more than once.
   if (device_arr == NULL) return PI_STATUS_SUCCESS;
   pi_status_t status;
-  pthread_mutex_destroy(&device_map_mutex);
-  pthread_mutex_destroy(&packet_cb_mutex);
-  pthread_mutex_destroy(&port_cb_mutex);
+  status = pi_async_destroy();
+  if (status != PI_STATUS_SUCCESS) return status;
+  pthread_rwlock_destroy(&device_map_lock);
+  pthread_rwlock_destroy(&packet_cb_lock);
+  pthread_rwlock_destroy(&port_cb_lock);
   vector_destroy(device_arr);
   device_arr = NULL;
   device_map_destroy(&device_map);
@@ -372,30 +404,30 @@ pi_status_t pi_direct_res_get_fns(pi_res_type_id_t res_type,
 
 pi_status_t pi_packetin_register_cb(pi_dev_id_t dev_id, PIPacketInCb cb,
                                     void *cb_cookie) {
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_wrlock(&packet_cb_lock);
   cb_mgr_add(&packet_cb_mgr, dev_id, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_packetin_register_default_cb(PIPacketInCb cb, void *cb_cookie) {
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_wrlock(&packet_cb_lock);
   cb_mgr_set_default(&packet_cb_mgr, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_packetin_deregister_cb(pi_dev_id_t dev_id) {
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_wrlock(&packet_cb_lock);
   cb_mgr_rm(&packet_cb_mgr, dev_id);
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_packetin_deregister_default_cb() {
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_wrlock(&packet_cb_lock);
   cb_mgr_reset_default(&packet_cb_mgr);
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
@@ -404,59 +436,75 @@ pi_status_t pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
   return _pi_packetout_send(dev_id, pkt, size);
 }
 
+pi_status_t pi_packetout_send_batch(pi_dev_id_t dev_id, const pi_packet_t *pkts,
+                                    size_t num_pkts, size_t *num_sent) {
+  size_t sent = 0;
+  pi_status_t status =
+      _pi_packetout_send_batch(dev_id, pkts, num_pkts, &sent);
+  if (status == PI_STATUS_NOT_IMPLEMENTED_BY_TARGET) {
+    status = PI_STATUS_SUCCESS;
+    for (sent = 0; sent < num_pkts; sent++) {
+      status = _pi_packetout_send(dev_id, pkts[sent].pkt, pkts[sent].size);
+      if (status != PI_STATUS_SUCCESS) break;
+    }
+  }
+  if (num_sent) *num_sent = sent;
+  return status;
+}
+
 pi_status_t pi_packetin_receive(pi_dev_id_t dev_id, const char *pkt,
                                 size_t size) {
-  pthread_mutex_lock(&packet_cb_mutex);
+  pthread_rwlock_rdlock(&packet_cb_lock);
   const cb_data_t *cb_data = cb_mgr_get_or_default(&packet_cb_mgr, dev_id);
   if (cb_data) {
     ((PIPacketInCb)(cb_data->cb))(dev_id, pkt, size, cb_data->cookie);
-    pthread_mutex_unlock(&packet_cb_mutex);
+    pthread_rwlock_unlock(&packet_cb_lock);
     return PI_STATUS_SUCCESS;
   }
-  pthread_mutex_unlock(&packet_cb_mutex);
+  pthread_rwlock_unlock(&packet_cb_lock);
   return PI_STATUS_PACKETIN_NO_CB;
 }
 
 pi_status_t pi_port_status_register_cb(pi_dev_id_t dev_id, PIPortStatusCb cb,
                                        void *cb_cookie) {
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_wrlock(&port_cb_lock);
   cb_mgr_add(&port_cb_mgr, dev_id, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_port_status_register_default_cb(PIPortStatusCb cb,
                                                void *cb_cookie) {
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_wrlock(&port_cb_lock);
   cb_mgr_set_default(&port_cb_mgr, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_port_status_deregister_cb(pi_dev_id_t dev_id) {
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_wrlock(&port_cb_lock);
   cb_mgr_rm(&port_cb_mgr, dev_id);
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_port_status_deregister_default_cb() {
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_wrlock(&port_cb_lock);
   cb_mgr_reset_default(&port_cb_mgr);
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_port_status_event_notify(pi_dev_id_t dev_id, pi_port_t port,
                                         pi_port_status_t status) {
-  pthread_mutex_lock(&port_cb_mutex);
+  pthread_rwlock_rdlock(&port_cb_lock);
   const cb_data_t *cb_data = cb_mgr_get_or_default(&port_cb_mgr, dev_id);
   if (cb_data) {
     ((PIPortStatusCb)(cb_data->cb))(dev_id, port, status, cb_data->cookie);
-    pthread_mutex_unlock(&port_cb_mutex);
+    pthread_rwlock_unlock(&port_cb_lock);
     return PI_STATUS_SUCCESS;
   }
-  pthread_mutex_unlock(&port_cb_mutex);
+  pthread_rwlock_unlock(&port_cb_lock);
   return PI_STATUS_PORT_STATUS_EVENT_NO_CB;
 }
 
@@ -464,3 +512,19 @@ pi_status_t pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                pi_port_status_t *status) {
   return _pi_port_status_get(dev_id, port, status);
 }
+
+pi_status_t pi_thread_start_register_cb(PIThreadStartCb cb, void *cb_cookie) {
+  pthread_mutex_lock(&thread_start_mutex);
+  thread_start_cb = cb;
+  thread_start_cookie = cb_cookie;
+  pthread_mutex_unlock(&thread_start_mutex);
+  return PI_STATUS_SUCCESS;
+}
+
+void pi_thread_start(const char *thread_class) {
+  pthread_mutex_lock(&thread_start_mutex);
+  PIThreadStartCb cb = thread_start_cb;
+  void *cb_cookie = thread_start_cookie;
+  pthread_mutex_unlock(&thread_start_mutex);
+  if (cb) cb(thread_class, cb_cookie);
+}
@@ -20,6 +20,7 @@
 
 #include <PI/int/pi_int.h>
 #include <PI/int/serialize.h>
+#include <PI/pi_async.h>
 #include <PI/pi_tables.h>
 #include <PI/target/pi_act_prof_imp.h>
 
@@ -137,6 +138,40 @@ pi_status_t pi_act_prof_entries_fetch(pi_session_handle_t session_handle,
   return status;
 }
 
+typedef struct {
+  pi_session_handle_t session_handle;
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t act_prof_id;
+  PIActProfFetchCb cb;
+  void *cb_cookie;
+} act_prof_fetch_job_t;
+
+static void act_prof_fetch_job(pi_dev_id_t dev_id, void *cookie) {
+  act_prof_fetch_job_t *job = (act_prof_fetch_job_t *)cookie;
+  pi_act_prof_fetch_res_t *res = NULL;
+  pi_status_t status = pi_act_prof_entries_fetch(
+      job->session_handle, job->dev_tgt, job->act_prof_id, &res);
+  job->cb(dev_id, job->act_prof_id, status,
+          (status == PI_STATUS_SUCCESS) ? res : NULL, job->cb_cookie);
+  free(job);
+}
+
+pi_status_t pi_act_prof_entries_fetch_async(pi_session_handle_t session_handle,
+                                            pi_dev_tgt_t dev_tgt,
+                                            pi_p4_id_t act_prof_id,
+                                            PIActProfFetchCb cb,
+                                            void *cb_cookie) {
+  act_prof_fetch_job_t *job = malloc(sizeof(*job));
+  job->session_handle = session_handle;
+  job->dev_tgt = dev_tgt;
+  job->act_prof_id = act_prof_id;
+  job->cb = cb;
+  job->cb_cookie = cb_cookie;
+  pi_status_t status = pi_async_submit(dev_tgt.dev_id, act_prof_fetch_job, job);
+  if (status != PI_STATUS_SUCCESS) free(job);
+  return status;
+}
+
 pi_status_t pi_act_prof_mbr_fetch(pi_session_handle_t session_handle,
                                   pi_dev_id_t dev_id, pi_p4_id_t act_prof_id,
                                   pi_indirect_handle_t mbr_handle,
@@ -0,0 +1,242 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/pi.h>
+#include <PI/pi_async.h>
+
+#include "device_map.h"
+#include "pi_async_int.h"
+#include "vector.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Each device has a FIFO queue of jobs. A queue with pending jobs is in the
+// ready list, unless one of its jobs is currently running: a worker pops a
+// queue from the ready list, runs its first job and puts it back at the end of
+// the ready list if it has more jobs. This guarantees that jobs are executed in
+// order for a given device, while devices share the workers fairly.
+
+typedef struct job_s {
+  struct job_s *next;
+  PIAsyncFn fn;
+  void *cookie;
+} job_t;
+
+typedef struct dev_queue_s {
+  pi_dev_id_t dev_id;
+  job_t *head;
+  job_t *tail;
+  struct dev_queue_s *next_ready;
+  // true if the queue is in the ready list or if one of its jobs is running
+  bool scheduled;
+  uint64_t num_submitted;
+  uint64_t num_completed;
+} dev_queue_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  // signaled when a queue is added to the ready list or when stopping
+  pthread_cond_t work_cond;
+  // broadcast every time a job completes
+  pthread_cond_t done_cond;
+  bool init;
+  device_map_t queues;
+  dev_queue_t *ready_head;
+  dev_queue_t *ready_tail;
+  vector_t *threads;
+  size_t max_threads;
+  size_t num_idle;
+  bool stop;
+} pool_t;
+
+static pool_t pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                      .work_cond = PTHREAD_COND_INITIALIZER,
+                      .done_cond = PTHREAD_COND_INITIALIZER,
+                      .max_threads = PI_ASYNC_DEFAULT_MAX_THREADS};
+
+static void ready_push(dev_queue_t *q) {
+  q->next_ready = NULL;
+  if (pool.ready_tail)
+    pool.ready_tail->next_ready = q;
+  else
+    pool.ready_head = q;
+  pool.ready_tail = q;
+}
+
+static dev_queue_t *ready_pop() {
+  dev_queue_t *q = pool.ready_head;
+  pool.ready_head = q->next_ready;
+  if (!pool.ready_head) pool.ready_tail = NULL;
+  return q;
+}
+
+static void *worker_loop(void *arg) {
+  (void)arg;
+  pi_thread_start("async");
+  pthread_mutex_lock(&pool.lock);
+  while (true) {
+    while (!pool.ready_head && !pool.stop) {
+      pool.num_idle++;
+      pthread_cond_wait(&pool.work_cond, &pool.lock);
+      pool.num_idle--;
+    }
+    // pending jobs are always executed before stopping
+    if (!pool.ready_head) break;
+    dev_queue_t *q = ready_pop();
+    job_t *job = q->head;
+    q->head = job->next;
+    if (!q->head) q->tail = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    job->fn(q->dev_id, job->cookie);
+    free(job);
+
+    pthread_mutex_lock(&pool.lock);
+    q->num_completed++;
+    if (q->head)
+      ready_push(q);
+    else
+      q->scheduled = false;
+    pthread_cond_broadcast(&pool.done_cond);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return NULL;
+}
+
+// acquire pool.lock first
+static void init_if_needed() {
+  if (pool.init) return;
+  device_map_create(&pool.queues);
+  pool.threads = vector_create(sizeof(pthread_t), 4);
+  pool.init = true;
+}
+
+pi_status_t pi_async_set_max_threads(size_t max_threads) {
+  pthread_mutex_lock(&pool.lock);
+  pool.max_threads = (max_threads > 0) ? max_threads : 1;
+  pthread_mutex_unlock(&pool.lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_async_submit(pi_dev_id_t dev_id, PIAsyncFn fn, void *cookie) {
+  pthread_mutex_lock(&pool.lock);
+  init_if_needed();
+
+  size_t num_threads = vector_size(pool.threads);
+  // no new thread while stopping, the existing ones will run the job
+  if (pool.num_idle == 0 && num_threads < pool.max_threads && !pool.stop) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_loop, NULL)) {
+      if (num_threads == 0) {
+        pthread_mutex_unlock(&pool.lock);
+        return PI_STATUS_PTHREAD_ERROR;
+      }
+    } else {
+      vector_push_back(pool.threads, &thread);
+    }
+  }
+
+  dev_queue_t *q = device_map_get(&pool.queues, dev_id);
+  if (!q) {
+    q = calloc(1, sizeof(*q));
+    q->dev_id = dev_id;
+    device_map_add(&pool.queues, dev_id, q);
+  }
+  job_t *job = malloc(sizeof(*job));
+  job->next = NULL;
+  job->fn = fn;
+  job->cookie = cookie;
+  if (q->tail)
+    q->tail->next = job;
+  else
+    q->head = job;
+  q->tail = job;
+  q->num_submitted++;
+  if (!q->scheduled) {
+    q->scheduled = true;
+    ready_push(q);
+    pthread_cond_signal(&pool.work_cond);
+  }
+
+  pthread_mutex_unlock(&pool.lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_async_flush(pi_dev_id_t dev_id) {
+  pthread_mutex_lock(&pool.lock);
+  dev_queue_t *q = pool.init ? device_map_get(&pool.queues, dev_id) : NULL;
+  if (q) {
+    uint64_t num_submitted = q->num_submitted;
+    while (q->num_completed < num_submitted)
+      pthread_cond_wait(&pool.done_cond, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_async_remove_device(pi_dev_id_t dev_id) {
+  pthread_mutex_lock(&pool.lock);
+  dev_queue_t *q = pool.init ? device_map_get(&pool.queues, dev_id) : NULL;
+  if (q) {
+    // jobs may be submitted for the device while we wait
+    while (q->num_completed < q->num_submitted)
+      pthread_cond_wait(&pool.done_cond, &pool.lock);
+    device_map_remove(&pool.queues, dev_id);
+    free(q);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return PI_STATUS_SUCCESS;
+}
+
+static void free_queue(void *e, void *cookie) {
+  (void)cookie;
+  free(e);
+}
+
+pi_status_t pi_async_destroy() {
+  pthread_mutex_lock(&pool.lock);
+  if (!pool.init) {
+    pthread_mutex_unlock(&pool.lock);
+    return PI_STATUS_SUCCESS;
+  }
+  pool.stop = true;
+  pthread_cond_broadcast(&pool.work_cond);
+  pthread_mutex_unlock(&pool.lock);
+
+  // no thread can be added to the vector once stop is set
+  size_t num_threads = vector_size(pool.threads);
+  for (size_t i = 0; i < num_threads; i++)
+    pthread_join(*(pthread_t *)vector_at(pool.threads, i), NULL);
+
+  pthread_mutex_lock(&pool.lock);
+  device_map_for_each(&pool.queues, free_queue, NULL);
+  device_map_destroy(&pool.queues);
+  vector_destroy(pool.threads);
+  pool.threads = NULL;
+  pool.ready_head = NULL;
+  pool.ready_tail = NULL;
+  pool.init = false;
+  pool.stop = false;
+  pthread_mutex_unlock(&pool.lock);
+  return PI_STATUS_SUCCESS;
+}
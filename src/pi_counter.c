@@ -19,9 +19,12 @@
  */
 
 #include <PI/pi.h>
+#include <PI/pi_async.h>
 #include <PI/pi_counter.h>
 #include <PI/target/pi_counter_imp.h>
 
+#include <stdlib.h>
+
 static bool is_direct_counter(const pi_p4info_t *p4info,
                               pi_p4_id_t counter_id) {
   return (pi_p4info_counter_get_direct(p4info, counter_id) != PI_INVALID_ID);
@@ -73,9 +76,39 @@ pi_status_t pi_counter_write_direct(pi_session_handle_t session_handle,
                                   entry_handle, counter_data);
 }
 
+typedef struct {
+  pi_session_handle_t session_handle;
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t counter_id;
+  PICounterHwSyncCb cb;
+  void *cb_cookie;
+} hw_sync_job_t;
+
+static void hw_sync_job(pi_dev_id_t dev_id, void *cookie) {
+  hw_sync_job_t *job = (hw_sync_job_t *)cookie;
+  // the callback type does not let us report errors
+  _pi_counter_hw_sync(job->session_handle, job->dev_tgt, job->counter_id, NULL,
+                      NULL);
+  job->cb(dev_id, job->counter_id, job->cb_cookie);
+  free(job);
+}
+
 pi_status_t pi_counter_hw_sync(pi_session_handle_t session_handle,
                                pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                                PICounterHwSyncCb cb, void *cb_cookie) {
-  return _pi_counter_hw_sync(session_handle, dev_tgt, counter_id, cb,
-                             cb_cookie);
+  pi_status_t status =
+      _pi_counter_hw_sync(session_handle, dev_tgt, counter_id, cb, cb_cookie);
+  if (cb == NULL || status != PI_STATUS_NOT_IMPLEMENTED_BY_TARGET)
+    return status;
+
+  // the target only supports blocking syncs, run it in the async pool
+  hw_sync_job_t *job = malloc(sizeof(*job));
+  job->session_handle = session_handle;
+  job->dev_tgt = dev_tgt;
+  job->counter_id = counter_id;
+  job->cb = cb;
+  job->cb_cookie = cb_cookie;
+  status = pi_async_submit(dev_tgt.dev_id, hw_sync_job, job);
+  if (status != PI_STATUS_SUCCESS) free(job);
+  return status;
 }
@@ -29,16 +29,16 @@
 #include "cb_mgr.h"
 
 static cb_mgr_t cb_mgr;
-static pthread_mutex_t cb_mutex;
+static pthread_rwlock_t cb_lock;
 
 pi_status_t pi_learn_init() {
-  if (pthread_mutex_init(&cb_mutex, NULL)) return PI_STATUS_PTHREAD_ERROR;
+  if (pthread_rwlock_init(&cb_lock, NULL)) return PI_STATUS_PTHREAD_ERROR;
   cb_mgr_init(&cb_mgr);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_learn_destroy() {
-  if (pthread_mutex_destroy(&cb_mutex)) return PI_STATUS_PTHREAD_ERROR;
+  if (pthread_rwlock_destroy(&cb_lock)) return PI_STATUS_PTHREAD_ERROR;
   cb_mgr_destroy(&cb_mgr);
   return PI_STATUS_SUCCESS;
 }
@@ -54,30 +54,30 @@ pi_status_t pi_learn_remove_device(pi_dev_id_t dev_id) {
 
 pi_status_t pi_learn_register_cb(pi_dev_id_t dev_id, PILearnCb cb,
                                  void *cb_cookie) {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_add(&cb_mgr, dev_id, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_learn_register_default_cb(PILearnCb cb, void *cb_cookie) {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_set_default(&cb_mgr, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_learn_deregister_cb(pi_dev_id_t dev_id) {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_rm(&cb_mgr, dev_id);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_learn_deregister_default_cb() {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_reset_default(&cb_mgr);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
@@ -100,13 +100,13 @@ pi_status_t pi_learn_msg_done(pi_learn_msg_t *msg) {
 // called by backend
 pi_status_t pi_learn_new_msg(pi_learn_msg_t *msg) {
   pi_dev_id_t dev_id = msg->dev_tgt.dev_id;
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_rdlock(&cb_lock);
   const cb_data_t *cb_data = cb_mgr_get_or_default(&cb_mgr, dev_id);
   if (cb_data) {
     ((PILearnCb)(cb_data->cb))(msg, cb_data->cookie);
-    pthread_mutex_unlock(&cb_mutex);
+    pthread_rwlock_unlock(&cb_lock);
     return PI_STATUS_SUCCESS;
   }
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_LEARN_NO_MATCHING_CB;
 }
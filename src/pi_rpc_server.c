@@ -36,6 +36,7 @@
 #include <string.h>
 
 #include "_assert.h"
+#include "device_map.h"
 #include "pi_notifications_pub.h"
 
 typedef struct {
@@ -44,6 +45,21 @@ typedef struct {
   int s;
 } pi_rpc_state_t;
 
+// Table fetch cursors opened by clients. Clients only see an opaque id, which
+// is looked up in this map for every request. Ids come from a counter and are
+// never reused, so a stale id cannot refer to another cursor. The
+// device_map_t is used as a generic uint64 -> pointer map.
+typedef struct {
+  uint64_t id;
+  pi_session_handle_t sess;
+  // NULL if the cursor was already released because of an error, in which case
+  // the id stays valid until the client ends the cursor
+  pi_table_fetch_cursor_t *cursor;
+} rpc_cursor_t;
+
+static device_map_t cursors;
+static uint64_t next_cursor_id = 1;
+
 static char *rpc_addr = NULL;
 static char *notifications_addr = NULL;
 
@@ -301,10 +317,56 @@ static void __pi_remove_device(char *req) {
   send_status(status);
 }
 
+static pi_status_t cursor_end(rpc_cursor_t *rpc_cursor) {
+  pi_status_t status = PI_STATUS_SUCCESS;
+  if (rpc_cursor->cursor != NULL)
+    status = pi_table_entries_fetch_end(rpc_cursor->sess, rpc_cursor->cursor);
+  device_map_remove(&cursors, rpc_cursor->id);
+  free(rpc_cursor);
+  return status;
+}
+
+// returns NULL if the id is unknown or if the cursor belongs to a different
+// session
+static rpc_cursor_t *cursor_get(pi_session_handle_t sess, uint64_t id) {
+  rpc_cursor_t *rpc_cursor = device_map_get(&cursors, id);
+  if (rpc_cursor == NULL || rpc_cursor->sess != sess) return NULL;
+  return rpc_cursor;
+}
+
+typedef struct {
+  bool all_sessions;
+  pi_session_handle_t sess;
+  rpc_cursor_t **to_release;
+  size_t num_to_release;
+} cursors_release_ctx_t;
+
+static void collect_cursor(void *e, void *cookie) {
+  rpc_cursor_t *rpc_cursor = (rpc_cursor_t *)e;
+  cursors_release_ctx_t *ctx = (cursors_release_ctx_t *)cookie;
+  if (ctx->all_sessions || rpc_cursor->sess == ctx->sess)
+    ctx->to_release[ctx->num_to_release++] = rpc_cursor;
+}
+
+// releases the cursors that the client did not end (for one session or for
+// all of them), since the client is gone
+static void cursors_release(bool all_sessions, pi_session_handle_t sess) {
+  size_t count = device_map_count(&cursors);
+  if (count == 0) return;
+  cursors_release_ctx_t ctx = {all_sessions, sess, NULL, 0};
+  ctx.to_release = malloc(count * sizeof(*ctx.to_release));
+  // cannot remove from the map while iterating over it
+  device_map_for_each(&cursors, collect_cursor, &ctx);
+  for (size_t i = 0; i < ctx.num_to_release; i++)
+    cursor_end(ctx.to_release[i]);
+  free(ctx.to_release);
+}
+
 static void __pi_destroy(char *req) {
   printf("RPC: _pi_destroy\n");
 
   (void)req;
+  cursors_release(true, 0);
   send_status(_pi_destroy());
 }
 
@@ -336,6 +398,7 @@ static void __pi_session_cleanup(char *req) {
   pi_session_handle_t sess;
   req += retrieve_session_handle(req, &sess);
 
+  cursors_release(false, sess);
   send_status(_pi_session_cleanup(sess));
 }
 
@@ -633,6 +696,157 @@ static void __pi_table_entries_fetch(char *req) {
   assert((size_t)bytes == s);
 }
 
+static void __pi_table_entries_fetch_begin(char *req) {
+  printf("RPC: _pi_table_entries_fetch_begin\n");
+
+  pi_session_handle_t sess;
+  req += retrieve_session_handle(req, &sess);
+  pi_dev_tgt_t dev_tgt;
+  req += retrieve_dev_tgt(req, &dev_tgt);
+  pi_p4_id_t table_id;
+  req += retrieve_p4_id(req, &table_id);
+
+  pi_table_fetch_cursor_t *cursor = NULL;
+  pi_status_t status =
+      pi_table_entries_fetch_begin(sess, dev_tgt, table_id, &cursor);
+  uint64_t cursor_id = 0;
+  if (status == PI_STATUS_SUCCESS) {
+    rpc_cursor_t *rpc_cursor = malloc(sizeof(*rpc_cursor));
+    rpc_cursor->id = cursor_id = next_cursor_id++;
+    rpc_cursor->sess = sess;
+    rpc_cursor->cursor = cursor;
+    device_map_add(&cursors, cursor_id, rpc_cursor);
+  }
+
+  typedef struct __attribute__((packed)) {
+    rep_hdr_t hdr;
+    uint64_t cursor_id;
+  } rep_t;
+  rep_t rep;
+  char *rep_ = (char *)&rep;
+  rep_ += emit_rep_hdr(rep_, status);
+  rep_ += emit_uint64(rep_, cursor_id);
+
+  int bytes = nn_send(state.s, &rep, sizeof(rep), 0);
+  _PI_UNUSED(bytes);
+  assert(bytes == sizeof(rep));
+}
+
+static void __pi_table_entries_fetch_next(char *req) {
+  printf("RPC: _pi_table_entries_fetch_next\n");
+
+  pi_session_handle_t sess;
+  req += retrieve_session_handle(req, &sess);
+  uint64_t cursor_id;
+  req += retrieve_uint64(req, &cursor_id);
+  uint32_t max_entries;
+  req += retrieve_uint32(req, &max_entries);
+
+  rpc_cursor_t *rpc_cursor = cursor_get(sess, cursor_id);
+  if (rpc_cursor == NULL || rpc_cursor->cursor == NULL) {
+    send_status(PI_STATUS_INVALID_FETCH_CURSOR);
+    return;
+  }
+  pi_table_fetch_res_t *res;
+  pi_status_t status =
+      pi_table_entries_fetch_next(sess, rpc_cursor->cursor, max_entries, &res);
+
+  // The cursor cannot be used anymore, so we release the target resources
+  // right away instead of relying on the client to end it.
+  if (status != PI_STATUS_SUCCESS) {
+    pi_table_entries_fetch_end(sess, rpc_cursor->cursor);
+    rpc_cursor->cursor = NULL;
+    send_status(status);
+    return;
+  }
+
+  size_t s = 0;
+  s += sizeof(rep_hdr_t);
+  s += sizeof(uint32_t);  // num entries
+  s += sizeof(uint32_t);  // mkey nbytes
+  s += sizeof(uint32_t);  // entries_size (in bytes)
+  s += res->entries_size;
+
+  char *rep = nn_allocmsg(s, 0);
+  char *rep_ = rep;
+  rep_ += emit_rep_hdr(rep_, status);
+  rep_ += emit_uint32(rep_, res->num_entries);
+  rep_ += emit_uint32(rep_, res->mkey_nbytes);
+  rep_ += emit_uint32(rep_, res->entries_size);
+  memcpy(rep_, res->entries, res->entries_size);
+  rep_ += res->entries_size;
+
+  pi_table_entries_fetch_done(sess, res);
+
+  // make sure I have copied exactly the right amount
+  assert((size_t)(rep_ - rep) == s);
+
+  int bytes = nn_send(state.s, &rep, NN_MSG, 0);
+  _PI_UNUSED(bytes);
+  assert((size_t)bytes == s);
+}
+
+static void __pi_table_entries_fetch_end(char *req) {
+  printf("RPC: _pi_table_entries_fetch_end\n");
+
+  pi_session_handle_t sess;
+  req += retrieve_session_handle(req, &sess);
+  uint64_t cursor_id;
+  req += retrieve_uint64(req, &cursor_id);
+
+  rpc_cursor_t *rpc_cursor = cursor_get(sess, cursor_id);
+  if (rpc_cursor == NULL) {
+    send_status(PI_STATUS_INVALID_FETCH_CURSOR);
+    return;
+  }
+  send_status(cursor_end(rpc_cursor));
+}
+
+static void __pi_table_entries_get_remaining_ttl(char *req) {
+  printf("RPC: _pi_table_entries_get_remaining_ttl\n");
+
+  pi_session_handle_t sess;
+  req += retrieve_session_handle(req, &sess);
+  pi_dev_id_t dev_id;
+  req += retrieve_dev_id(req, &dev_id);
+  pi_p4_id_t table_id;
+  req += retrieve_p4_id(req, &table_id);
+  uint32_t num_entries;
+  req += retrieve_uint32(req, &num_entries);
+
+  pi_entry_handle_t *entry_handles =
+      malloc(num_entries * sizeof(*entry_handles));
+  uint64_t *ttls_ns = malloc(num_entries * sizeof(*ttls_ns));
+  for (size_t i = 0; i < num_entries; i++)
+    req += retrieve_entry_handle(req, &entry_handles[i]);
+
+  // falls back to _pi_table_entry_get_remaining_ttl if needed
+  pi_status_t status = pi_table_entries_get_remaining_ttl(
+      sess, dev_id, table_id, num_entries, entry_handles, ttls_ns);
+  free(entry_handles);
+
+  if (status != PI_STATUS_SUCCESS) {
+    free(ttls_ns);
+    send_status(status);
+    return;
+  }
+
+  size_t s = 0;
+  s += sizeof(rep_hdr_t);
+  s += num_entries * sizeof(uint64_t);
+
+  char *rep = nn_allocmsg(s, 0);
+  char *rep_ = rep;
+  rep_ += emit_rep_hdr(rep_, status);
+  for (size_t i = 0; i < num_entries; i++)
+    rep_ += emit_uint64(rep_, ttls_ns[i]);
+  free(ttls_ns);
+
+  int bytes = nn_send(state.s, &rep, NN_MSG, 0);
+  _PI_UNUSED(bytes);
+  assert((size_t)bytes == s);
+}
+
 static void send_indirect_handle(pi_status_t status, pi_indirect_handle_t h) {
   typedef struct __attribute__((packed)) {
     rep_hdr_t hdr;
@@ -1044,6 +1258,43 @@ static void __pi_packetout_send(char *req) {
   send_status(status);
 }
 
+static void __pi_packetout_send_batch(char *req) {
+  printf("RPC: _pi_packetout_send_batch\n");
+  pi_dev_id_t dev_id;
+  req += retrieve_dev_id(req, &dev_id);
+  uint32_t num_pkts;
+  req += retrieve_uint32(req, &num_pkts);
+
+  // packets point directly into the request message
+  pi_packet_t *pkts = malloc(num_pkts * sizeof(*pkts));
+  for (size_t i = 0; i < num_pkts; i++) {
+    uint32_t size;
+    req += retrieve_uint32(req, &size);
+    pkts[i].pkt = req;
+    pkts[i].size = size;
+    req += size;
+  }
+
+  // falls back to _pi_packetout_send if needed
+  size_t num_sent = 0;
+  pi_status_t status =
+      pi_packetout_send_batch(dev_id, pkts, num_pkts, &num_sent);
+  free(pkts);
+
+  typedef struct __attribute__((packed)) {
+    rep_hdr_t hdr;
+    uint32_t num_sent;
+  } rep_t;
+  rep_t rep;
+  char *rep_ = (char *)&rep;
+  rep_ += emit_rep_hdr(rep_, status);
+  rep_ += emit_uint32(rep_, num_sent);
+
+  int bytes = nn_send(state.s, &rep, sizeof(rep), 0);
+  _PI_UNUSED(bytes);
+  assert(bytes == sizeof(rep));
+}
+
 static void learn_cb(pi_learn_msg_t *msg, void *cb_cookie) {
   (void)cb_cookie;
   pi_notifications_pub_learn(msg);
@@ -1059,6 +1310,7 @@ static void packetin_cb(pi_dev_id_t dev_id, const char *pkt, size_t size,
 pi_status_t pi_rpc_server_run(const pi_remote_addr_t *remote_addr) {
   assert(!state.init);
   init_addrs(remote_addr);
+  device_map_create(&cursors);
   state.s = nn_socket(AF_SP, NN_REP);
   if (state.s < 0) return PI_STATUS_RPC_CONNECT_ERROR;
   if (nn_bind(state.s, rpc_addr) < 0) return PI_STATUS_RPC_CONNECT_ERROR;
@@ -1144,6 +1396,18 @@ pi_status_t pi_rpc_server_run(const pi_remote_addr_t *remote_addr) {
       case PI_RPC_TABLE_ENTRIES_FETCH:
         __pi_table_entries_fetch(req_);
         break;
+      case PI_RPC_TABLE_ENTRIES_GET_REMAINING_TTL:
+        __pi_table_entries_get_remaining_ttl(req_);
+        break;
+      case PI_RPC_TABLE_ENTRIES_FETCH_BEGIN:
+        __pi_table_entries_fetch_begin(req_);
+        break;
+      case PI_RPC_TABLE_ENTRIES_FETCH_NEXT:
+        __pi_table_entries_fetch_next(req_);
+        break;
+      case PI_RPC_TABLE_ENTRIES_FETCH_END:
+        __pi_table_entries_fetch_end(req_);
+        break;
 
       case PI_RPC_ACT_PROF_MBR_CREATE:
         __pi_act_prof_mbr_create(req_);
@@ -1203,6 +1467,9 @@ pi_status_t pi_rpc_server_run(const pi_remote_addr_t *remote_addr) {
       case PI_RPC_PACKETOUT_SEND:
         __pi_packetout_send(req_);
         break;
+      case PI_RPC_PACKETOUT_SEND_BATCH:
+        __pi_packetout_send_batch(req_);
+        break;
 
       default:
         assert(0);
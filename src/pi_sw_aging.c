@@ -0,0 +1,510 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <PI/target/pi_sw_aging.h>
+
+#include "vector.h"
+
+#include <Judy.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Every tracked entry is in one of the slots of the timer wheel (unless ageing
+// is disabled for it or its hit state is being queried by a sweep). Slot i
+// contains the entries whose deadline (last hit time + TTL) falls in a tick t
+// such that (t & slot_mask) == i. When a slot is swept, the entries whose
+// deadline has been reached are removed from the wheel, their hit state is
+// queried in batch and they are either re-inserted (hit) or reported as expired
+// (not hit). Entries whose deadline is more than one wheel rotation away are
+// left in place.
+
+typedef struct entry_s {
+  struct entry_s *prev;
+  struct entry_s *next;
+  pi_entry_handle_t handle;
+  uint64_t ttl_ns;
+  uint64_t deadline_ns;
+  uint64_t last_hit_state;
+  // incremented every time the TTL is changed, to detect entries which were
+  // modified (or removed and re-added) while a hit state query was in progress
+  uint64_t gen;
+  pi_p4_id_t table_id;
+  bool linked;
+  bool expired;
+} entry_t;
+
+typedef struct {
+  pi_p4_id_t table_id;
+  pi_entry_handle_t handle;
+  uint64_t gen;
+} candidate_t;
+
+struct pi_sw_aging_s {
+  pi_dev_id_t dev_id;
+  pi_sw_aging_config_t config;
+  pthread_mutex_t lock;
+  // table id -> (entry handle -> entry_t *)
+  Pvoid_t tables;
+  entry_t **slots;
+  size_t slot_mask;
+  // all ticks up to (and including) this one have been swept
+  uint64_t last_swept_tick;
+  uint64_t next_gen;
+  // only one sweep at a time, the lock is released while querying hit states
+  pthread_mutex_t sweep_lock;
+  pthread_t thread;
+  pthread_cond_t stop_cond;
+  bool thread_started;
+  bool stop;
+};
+
+static uint64_t default_clock(void *cookie) {
+  (void)cookie;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_ns(const pi_sw_aging_t *aging) {
+  return aging->config.clock_fn(aging->config.cookie);
+}
+
+static size_t round_up_pow2(size_t v) {
+  size_t r = 1;
+  while (r < v) r <<= 1;
+  return r;
+}
+
+static Pvoid_t *get_table(pi_sw_aging_t *aging, pi_p4_id_t table_id,
+                          bool create) {
+  PWord_t tPtr;
+  JLG(tPtr, aging->tables, (Word_t)table_id);
+  if (tPtr == NULL) {
+    if (!create) return NULL;
+    JLI(tPtr, aging->tables, (Word_t)table_id);
+    assert(tPtr != NULL);
+  }
+  return (Pvoid_t *)tPtr;
+}
+
+static entry_t *get_entry(pi_sw_aging_t *aging, pi_p4_id_t table_id,
+                          pi_entry_handle_t handle) {
+  Pvoid_t *table = get_table(aging, table_id, false);
+  if (table == NULL) return NULL;
+  PWord_t ePtr;
+  JLG(ePtr, *table, (Word_t)handle);
+  return (ePtr == NULL) ? NULL : (entry_t *)*ePtr;
+}
+
+static void wheel_unlink(pi_sw_aging_t *aging, entry_t *e) {
+  if (!e->linked) return;
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    size_t slot = (e->deadline_ns / aging->config.tick_ns) & aging->slot_mask;
+    assert(aging->slots[slot] == e);
+    aging->slots[slot] = e->next;
+  }
+  if (e->next) e->next->prev = e->prev;
+  e->prev = e->next = NULL;
+  e->linked = false;
+}
+
+static void wheel_link(pi_sw_aging_t *aging, entry_t *e) {
+  assert(!e->linked);
+  if (e->ttl_ns == 0) return;
+  uint64_t tick = e->deadline_ns / aging->config.tick_ns;
+  // never schedule in a slot which has already been swept for this rotation
+  if (tick <= aging->last_swept_tick) {
+    tick = aging->last_swept_tick + 1;
+    e->deadline_ns = tick * aging->config.tick_ns;
+  }
+  size_t slot = tick & aging->slot_mask;
+  e->prev = NULL;
+  e->next = aging->slots[slot];
+  if (e->next) e->next->prev = e;
+  aging->slots[slot] = e;
+  e->linked = true;
+}
+
+static void entry_reset(pi_sw_aging_t *aging, entry_t *e, uint64_t ttl_ns,
+                        uint64_t now) {
+  wheel_unlink(aging, e);
+  e->ttl_ns = ttl_ns;
+  e->deadline_ns = now + ttl_ns;
+  e->expired = false;
+  e->gen = aging->next_gen++;
+  wheel_link(aging, e);
+}
+
+static bool is_hit(const pi_sw_aging_t *aging, entry_t *e, uint64_t state) {
+  if (aging->config.hit_mode == PI_SW_AGING_HIT_BITS) return (state != 0);
+  if (state == e->last_hit_state) return false;
+  e->last_hit_state = state;
+  return true;
+}
+
+static int candidate_cmp(const void *c1, const void *c2) {
+  pi_p4_id_t t1 = ((const candidate_t *)c1)->table_id;
+  pi_p4_id_t t2 = ((const candidate_t *)c2)->table_id;
+  return (t1 > t2) - (t1 < t2);
+}
+
+pi_sw_aging_t *pi_sw_aging_create(pi_dev_id_t dev_id,
+                                  const pi_sw_aging_config_t *config) {
+  if (config->tick_ns == 0 || config->num_slots == 0 ||
+      config->hit_query_fn == NULL || config->expire_fn == NULL)
+    return NULL;
+  pi_sw_aging_t *aging = calloc(1, sizeof(*aging));
+  aging->dev_id = dev_id;
+  aging->config = *config;
+  if (aging->config.clock_fn == NULL) aging->config.clock_fn = default_clock;
+  size_t num_slots = round_up_pow2(config->num_slots);
+  aging->slots = calloc(num_slots, sizeof(*aging->slots));
+  aging->slot_mask = num_slots - 1;
+  aging->last_swept_tick = now_ns(aging) / config->tick_ns;
+  pthread_mutex_init(&aging->lock, NULL);
+  pthread_mutex_init(&aging->sweep_lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&aging->stop_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  return aging;
+}
+
+static void table_free(Pvoid_t *table) {
+  PWord_t ePtr;
+  Word_t handle = 0;
+  JLF(ePtr, *table, handle);
+  while (ePtr != NULL) {
+    free((entry_t *)*ePtr);
+    JLN(ePtr, *table, handle);
+  }
+  Word_t bytes_freed;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic warning "-Wsign-compare"
+  JLFA(bytes_freed, *table);
+#pragma GCC diagnostic pop
+  (void)bytes_freed;
+}
+
+void pi_sw_aging_destroy(pi_sw_aging_t *aging) {
+  if (aging->thread_started) {
+    pthread_mutex_lock(&aging->lock);
+    aging->stop = true;
+    pthread_cond_signal(&aging->stop_cond);
+    pthread_mutex_unlock(&aging->lock);
+    pthread_join(aging->thread, NULL);
+  }
+  PWord_t tPtr;
+  Word_t table_id = 0;
+  JLF(tPtr, aging->tables, table_id);
+  while (tPtr != NULL) {
+    table_free((Pvoid_t *)tPtr);
+    JLN(tPtr, aging->tables, table_id);
+  }
+  Word_t bytes_freed;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic warning "-Wsign-compare"
+  JLFA(bytes_freed, aging->tables);
+#pragma GCC diagnostic pop
+  (void)bytes_freed;
+  pthread_cond_destroy(&aging->stop_cond);
+  pthread_mutex_destroy(&aging->sweep_lock);
+  pthread_mutex_destroy(&aging->lock);
+  free(aging->slots);
+  free(aging);
+}
+
+static void *sweeper_loop(void *arg) {
+  pi_sw_aging_t *aging = (pi_sw_aging_t *)arg;
+  pthread_mutex_lock(&aging->lock);
+  while (!aging->stop) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t wakeup_ns = (uint64_t)ts.tv_nsec + aging->config.tick_ns;
+    ts.tv_sec += wakeup_ns / 1000000000u;
+    ts.tv_nsec = wakeup_ns % 1000000000u;
+    pthread_cond_timedwait(&aging->stop_cond, &aging->lock, &ts);
+    if (aging->stop) break;
+    pthread_mutex_unlock(&aging->lock);
+    pi_sw_aging_sweep(aging);
+    pthread_mutex_lock(&aging->lock);
+  }
+  pthread_mutex_unlock(&aging->lock);
+  return NULL;
+}
+
+pi_status_t pi_sw_aging_start(pi_sw_aging_t *aging) {
+  if (aging->thread_started) return PI_STATUS_SUCCESS;
+  if (pthread_create(&aging->thread, NULL, sweeper_loop, aging))
+    return PI_STATUS_PTHREAD_ERROR;
+  aging->thread_started = true;
+  return PI_STATUS_SUCCESS;
+}
+
+// Queries the hit states for the given candidates, which need to be sorted by
+// table id, with one call to hit_query_fn per table. Must be called without
+// holding the lock. For a given candidate, queried[i] is set to false if the
+// query failed.
+static void query_hit_states(pi_sw_aging_t *aging, const candidate_t *cs,
+                             size_t num_cs, pi_entry_handle_t *handles,
+                             uint64_t *states, bool *queried) {
+  for (size_t i = 0; i < num_cs; i++) handles[i] = cs[i].handle;
+  size_t first = 0;
+  while (first < num_cs) {
+    size_t last = first;
+    while (last < num_cs && cs[last].table_id == cs[first].table_id) last++;
+    pi_status_t status = aging->config.hit_query_fn(
+        aging->dev_id, cs[first].table_id, last - first, &handles[first],
+        &states[first], aging->config.cookie);
+    for (size_t i = first; i < last; i++)
+      queried[i] = (status == PI_STATUS_SUCCESS);
+    first = last;
+  }
+}
+
+pi_status_t pi_sw_aging_sweep(pi_sw_aging_t *aging) {
+  pthread_mutex_lock(&aging->sweep_lock);
+  pthread_mutex_lock(&aging->lock);
+
+  vector_t *candidates = vector_create(sizeof(candidate_t), 256);
+  uint64_t now = now_ns(aging);
+  // only sweep the slots for ticks which are fully elapsed, so that all
+  // entries scheduled for that tick are guaranteed to have reached their
+  // deadline
+  uint64_t end_tick = now / aging->config.tick_ns;
+  uint64_t start_tick = aging->last_swept_tick + 1;
+  // no need to visit a slot more than once
+  if (end_tick > start_tick + aging->slot_mask + 1)
+    start_tick = end_tick - aging->slot_mask - 1;
+  for (uint64_t tick = start_tick; tick < end_tick; tick++) {
+    entry_t *e = aging->slots[tick & aging->slot_mask];
+    while (e != NULL) {
+      entry_t *next = e->next;
+      if (e->deadline_ns <= now) {
+        wheel_unlink(aging, e);
+        candidate_t c = {e->table_id, e->handle, e->gen};
+        vector_push_back(candidates, &c);
+      }
+      e = next;
+    }
+  }
+  if (end_tick > 0 && end_tick - 1 > aging->last_swept_tick)
+    aging->last_swept_tick = end_tick - 1;
+
+  size_t num_cs = vector_size(candidates);
+  if (num_cs == 0) {
+    pthread_mutex_unlock(&aging->lock);
+    pthread_mutex_unlock(&aging->sweep_lock);
+    vector_destroy(candidates);
+    return PI_STATUS_SUCCESS;
+  }
+
+  candidate_t *cs = vector_data(candidates);
+  qsort(cs, num_cs, sizeof(*cs), candidate_cmp);
+  pi_entry_handle_t *handles = malloc(num_cs * sizeof(*handles));
+  uint64_t *states = malloc(num_cs * sizeof(*states));
+  bool *queried = malloc(num_cs * sizeof(*queried));
+
+  pthread_mutex_unlock(&aging->lock);
+  query_hit_states(aging, cs, num_cs, handles, states, queried);
+  pthread_mutex_lock(&aging->lock);
+
+  // expired entries are reported in place in the candidates array
+  size_t num_expired = 0;
+  now = now_ns(aging);
+  for (size_t i = 0; i < num_cs; i++) {
+    entry_t *e = get_entry(aging, cs[i].table_id, cs[i].handle);
+    // removed or modified in the meantime
+    if (e == NULL || e->gen != cs[i].gen || e->linked) continue;
+    if (!queried[i]) {
+      // try again at the next tick
+      wheel_link(aging, e);
+      continue;
+    }
+    if (is_hit(aging, e, states[i])) {
+      e->deadline_ns = now + e->ttl_ns;
+      e->expired = false;
+    } else if (e->deadline_ns <= now) {
+      // if the entry is still idle, it will be reported again after another
+      // TTL
+      e->deadline_ns = now + e->ttl_ns;
+      e->expired = true;
+      cs[num_expired++] = cs[i];
+    }
+    wheel_link(aging, e);
+  }
+
+  pthread_mutex_unlock(&aging->lock);
+
+  for (size_t i = 0; i < num_expired; i++) {
+    aging->config.expire_fn(aging->dev_id, cs[i].table_id, cs[i].handle,
+                            aging->config.cookie);
+  }
+
+  pthread_mutex_unlock(&aging->sweep_lock);
+
+  free(handles);
+  free(states);
+  free(queried);
+  vector_destroy(candidates);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_sw_aging_entry_add(pi_sw_aging_t *aging, pi_p4_id_t table_id,
+                                  pi_entry_handle_t entry_handle,
+                                  uint64_t ttl_ns) {
+  pthread_mutex_lock(&aging->lock);
+  Pvoid_t *table = get_table(aging, table_id, true);
+  PWord_t ePtr;
+  JLI(ePtr, *table, (Word_t)entry_handle);
+  assert(ePtr != NULL);
+  entry_t *e = (entry_t *)*ePtr;
+  if (e == NULL) {
+    e = calloc(1, sizeof(*e));
+    e->handle = entry_handle;
+    e->table_id = table_id;
+    *ePtr = (Word_t)e;
+  }
+  entry_reset(aging, e, ttl_ns, now_ns(aging));
+  pthread_mutex_unlock(&aging->lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_sw_aging_entry_set_ttl(pi_sw_aging_t *aging,
+                                      pi_p4_id_t table_id,
+                                      pi_entry_handle_t entry_handle,
+                                      uint64_t ttl_ns) {
+  pthread_mutex_lock(&aging->lock);
+  entry_t *e = get_entry(aging, table_id, entry_handle);
+  if (e == NULL) {
+    pthread_mutex_unlock(&aging->lock);
+    return PI_STATUS_TARGET_ERROR;
+  }
+  entry_reset(aging, e, ttl_ns, now_ns(aging));
+  pthread_mutex_unlock(&aging->lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_sw_aging_entry_remove(pi_sw_aging_t *aging,
+                                     pi_p4_id_t table_id,
+                                     pi_entry_handle_t entry_handle) {
+  pthread_mutex_lock(&aging->lock);
+  Pvoid_t *table = get_table(aging, table_id, false);
+  entry_t *e = get_entry(aging, table_id, entry_handle);
+  if (e == NULL) {
+    pthread_mutex_unlock(&aging->lock);
+    return PI_STATUS_TARGET_ERROR;
+  }
+  wheel_unlink(aging, e);
+  int rc;
+  JLD(rc, *table, (Word_t)entry_handle);
+  assert(rc == 1);
+  free(e);
+  pthread_mutex_unlock(&aging->lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_sw_aging_table_clear(pi_sw_aging_t *aging,
+                                    pi_p4_id_t table_id) {
+  pthread_mutex_lock(&aging->lock);
+  Pvoid_t *table = get_table(aging, table_id, false);
+  if (table == NULL) {
+    pthread_mutex_unlock(&aging->lock);
+    return PI_STATUS_SUCCESS;
+  }
+  PWord_t ePtr;
+  Word_t handle = 0;
+  JLF(ePtr, *table, handle);
+  while (ePtr != NULL) {
+    wheel_unlink(aging, (entry_t *)*ePtr);
+    JLN(ePtr, *table, handle);
+  }
+  table_free(table);
+  int rc;
+  JLD(rc, aging->tables, (Word_t)table_id);
+  assert(rc == 1);
+  pthread_mutex_unlock(&aging->lock);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_sw_aging_entries_get_remaining_ttl(
+    pi_sw_aging_t *aging, pi_p4_id_t table_id, size_t num_entries,
+    const pi_entry_handle_t *entry_handles, uint64_t *ttls_ns) {
+  if (num_entries == 0) return PI_STATUS_SUCCESS;
+  pi_status_t status = PI_STATUS_SUCCESS;
+  uint64_t *gens = malloc(num_entries * sizeof(*gens));
+  uint64_t *states = malloc(num_entries * sizeof(*states));
+
+  pthread_mutex_lock(&aging->lock);
+  for (size_t i = 0; i < num_entries; i++) {
+    entry_t *e = get_entry(aging, table_id, entry_handles[i]);
+    if (e == NULL) {
+      pthread_mutex_unlock(&aging->lock);
+      status = PI_STATUS_TARGET_ERROR;
+      goto exit;
+    }
+    gens[i] = e->gen;
+  }
+  pthread_mutex_unlock(&aging->lock);
+
+  status = aging->config.hit_query_fn(aging->dev_id, table_id, num_entries,
+                                      entry_handles, states,
+                                      aging->config.cookie);
+  if (status != PI_STATUS_SUCCESS) goto exit;
+
+  pthread_mutex_lock(&aging->lock);
+  uint64_t now = now_ns(aging);
+  for (size_t i = 0; i < num_entries; i++) {
+    entry_t *e = get_entry(aging, table_id, entry_handles[i]);
+    if (e == NULL) {
+      pthread_mutex_unlock(&aging->lock);
+      status = PI_STATUS_TARGET_ERROR;
+      goto exit;
+    }
+    // if the entry is being processed by a sweep, it is not in the wheel; the
+    // sweep will notice that the deadline has been pushed back and will not
+    // report the entry
+    if (e->gen == gens[i] && e->ttl_ns != 0 && is_hit(aging, e, states[i])) {
+      bool linked = e->linked;
+      wheel_unlink(aging, e);
+      e->deadline_ns = now + e->ttl_ns;
+      e->expired = false;
+      if (linked) wheel_link(aging, e);
+    }
+    if (e->ttl_ns == 0 || e->expired || e->deadline_ns <= now)
+      ttls_ns[i] = 0;
+    else
+      ttls_ns[i] = e->deadline_ns - now;
+  }
+  pthread_mutex_unlock(&aging->lock);
+
+exit:
+  free(gens);
+  free(states);
+  return status;
+}
@@ -21,6 +21,7 @@
 #include <PI/int/pi_int.h>
 #include <PI/int/serialize.h>
 #include <PI/pi.h>
+#include <PI/pi_async.h>
 #include <PI/pi_tables.h>
 #include <PI/target/pi_tables_imp.h>
 #include "cb_mgr.h"
@@ -32,16 +33,16 @@
 
 // for idle timeout
 static cb_mgr_t cb_mgr;
-static pthread_mutex_t cb_mutex;
+static pthread_rwlock_t cb_lock;
 
 pi_status_t pi_table_init() {
-  if (pthread_mutex_init(&cb_mutex, NULL)) return PI_STATUS_PTHREAD_ERROR;
+  if (pthread_rwlock_init(&cb_lock, NULL)) return PI_STATUS_PTHREAD_ERROR;
   cb_mgr_init(&cb_mgr);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_table_destroy() {
-  if (pthread_mutex_destroy(&cb_mutex)) return PI_STATUS_PTHREAD_ERROR;
+  if (pthread_rwlock_destroy(&cb_lock)) return PI_STATUS_PTHREAD_ERROR;
   cb_mgr_destroy(&cb_mgr);
   return PI_STATUS_SUCCESS;
 }
@@ -214,6 +215,7 @@ static void prepare_fetch_res(pi_dev_id_t dev_id, pi_p4_id_t table_id,
   res->table_id = table_id;
   res->idx = 0;
   res->curr = 0;
+  res->borrowed = false;
 
   // we allocate one big memory block for all the structures owned by
   // pi_table_fetch_rest; we use contiguous memory for all the data relative to
@@ -308,10 +310,139 @@ pi_status_t pi_table_entries_fetch_wkey(pi_session_handle_t session_handle,
   return status;
 }
 
+typedef struct {
+  pi_session_handle_t session_handle;
+  pi_dev_tgt_t dev_tgt;
+  pi_p4_id_t table_id;
+  PITableFetchCb cb;
+  void *cb_cookie;
+} table_fetch_job_t;
+
+static void table_fetch_job(pi_dev_id_t dev_id, void *cookie) {
+  table_fetch_job_t *job = (table_fetch_job_t *)cookie;
+  pi_table_fetch_res_t *res = NULL;
+  pi_status_t status = pi_table_entries_fetch(
+      job->session_handle, job->dev_tgt, job->table_id, &res);
+  job->cb(dev_id, job->table_id, status,
+          (status == PI_STATUS_SUCCESS) ? res : NULL, job->cb_cookie);
+  free(job);
+}
+
+pi_status_t pi_table_entries_fetch_async(pi_session_handle_t session_handle,
+                                         pi_dev_tgt_t dev_tgt,
+                                         pi_p4_id_t table_id, PITableFetchCb cb,
+                                         void *cb_cookie) {
+  table_fetch_job_t *job = malloc(sizeof(*job));
+  job->session_handle = session_handle;
+  job->dev_tgt = dev_tgt;
+  job->table_id = table_id;
+  job->cb = cb;
+  job->cb_cookie = cb_cookie;
+  pi_status_t status = pi_async_submit(dev_tgt.dev_id, table_fetch_job, job);
+  if (status != PI_STATUS_SUCCESS) free(job);
+  return status;
+}
+
+pi_status_t pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                         pi_dev_tgt_t dev_tgt,
+                                         pi_p4_id_t table_id,
+                                         pi_table_fetch_cursor_t **cursor) {
+  pi_table_fetch_cursor_t *cursor_ = calloc(1, sizeof(*cursor_));
+  cursor_->dev_tgt = dev_tgt;
+  cursor_->table_id = table_id;
+  pi_status_t status =
+      _pi_table_entries_fetch_begin(session_handle, dev_tgt, table_id, cursor_);
+  if (status == PI_STATUS_NOT_IMPLEMENTED_BY_TARGET) {
+    pi_table_fetch_res_t *full_res = malloc(sizeof(pi_table_fetch_res_t));
+    status =
+        _pi_table_entries_fetch(session_handle, dev_tgt, table_id, full_res);
+    if (status == PI_STATUS_SUCCESS) {
+      cursor_->full_res = full_res;
+      cursor_->num_remaining = full_res->num_entries;
+      cursor_->offset = 0;
+    } else {
+      free(full_res);
+    }
+  }
+  if (status != PI_STATUS_SUCCESS) {
+    free(cursor_);
+    return status;
+  }
+
+  *cursor = cursor_;
+  return PI_STATUS_SUCCESS;
+}
+
+// Returns the next chunk of entries from a table fetched as a whole, for
+// targets which do not support the cursor API.
+static void fetch_next_from_full_res(pi_table_fetch_cursor_t *cursor,
+                                     size_t max_entries,
+                                     pi_table_fetch_res_t *res) {
+  const pi_table_fetch_res_t *full_res = cursor->full_res;
+  res->num_entries = (max_entries < cursor->num_remaining)
+                         ? max_entries
+                         : cursor->num_remaining;
+  res->mkey_nbytes = full_res->mkey_nbytes;
+  res->entries = full_res->entries + cursor->offset;
+  res->entries_size = full_res->entries_size - cursor->offset;
+  prepare_fetch_res(cursor->dev_tgt.dev_id, cursor->table_id, res);
+  res->borrowed = true;
+
+  // entries have a variable size, we need to go through the chunk once to
+  // find out where the next one starts
+  pi_table_ma_entry_t entry;
+  pi_entry_handle_t entry_handle;
+  for (size_t i = 0; i < res->num_entries; i++)
+    pi_table_entries_next(res, &entry, &entry_handle);
+  res->entries_size = res->curr;
+  res->idx = 0;
+  res->curr = 0;
+
+  cursor->num_remaining -= res->num_entries;
+  cursor->offset += res->entries_size;
+}
+
+pi_status_t pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor,
+                                        size_t max_entries,
+                                        pi_table_fetch_res_t **res) {
+  pi_table_fetch_res_t *res_ = malloc(sizeof(pi_table_fetch_res_t));
+  if (cursor->full_res) {
+    fetch_next_from_full_res(cursor, max_entries, res_);
+  } else {
+    pi_status_t status =
+        _pi_table_entries_fetch_next(session_handle, cursor, max_entries, res_);
+    if (status != PI_STATUS_SUCCESS) {
+      free(res_);
+      return status;
+    }
+    assert(res_->num_entries <= max_entries);
+    prepare_fetch_res(cursor->dev_tgt.dev_id, cursor->table_id, res_);
+  }
+
+  *res = res_;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                       pi_table_fetch_cursor_t *cursor) {
+  pi_status_t status;
+  if (cursor->full_res) {
+    status = _pi_table_entries_fetch_done(session_handle, cursor->full_res);
+    free(cursor->full_res);
+  } else {
+    status = _pi_table_entries_fetch_end(session_handle, cursor);
+  }
+  free(cursor);
+  return status;
+}
+
 pi_status_t pi_table_entries_fetch_done(pi_session_handle_t session_handle,
                                         pi_table_fetch_res_t *res) {
-  pi_status_t status = _pi_table_entries_fetch_done(session_handle, res);
-  if (status != PI_STATUS_SUCCESS) return status;
+  if (!res->borrowed) {
+    pi_status_t status = _pi_table_entries_fetch_done(session_handle, res);
+    if (status != PI_STATUS_SUCCESS) return status;
+  }
 
   if (res->data) free(res->data);
   free(res);
@@ -438,16 +569,16 @@ pi_status_t pi_table_idle_timeout_config_set(
 pi_status_t pi_table_idle_timeout_register_cb(pi_dev_id_t dev_id,
                                               PIIdleTimeoutCb cb,
                                               void *cb_cookie) {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_add(&cb_mgr, dev_id, (GenericFnPtr)cb, cb_cookie);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
 pi_status_t pi_table_idle_timeout_deregister_cb(pi_dev_id_t dev_id) {
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_wrlock(&cb_lock);
   cb_mgr_rm(&cb_mgr, dev_id);
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_SUCCESS;
 }
 
@@ -456,22 +587,23 @@ pi_status_t pi_table_idle_timeout_notify(pi_dev_id_t dev_id,
                                          pi_match_key_t *match_key,
                                          pi_entry_handle_t entry_handle) {
   match_key->p4info = pi_get_device_p4info(dev_id);
-  pthread_mutex_lock(&cb_mutex);
+  pthread_rwlock_rdlock(&cb_lock);
   const cb_data_t *cb_data = cb_mgr_get(&cb_mgr, dev_id);
   if (cb_data) {
     ((PIIdleTimeoutCb)(cb_data->cb))(dev_id, table_id, match_key, entry_handle,
                                      cb_data->cookie);
-    pthread_mutex_unlock(&cb_mutex);
+    pthread_rwlock_unlock(&cb_lock);
     return PI_STATUS_SUCCESS;
   }
   const cb_data_t *default_cb_data = cb_mgr_get_default(&cb_mgr);
   if (default_cb_data->cb) {
     ((PIIdleTimeoutCb)(default_cb_data->cb))(dev_id, table_id, match_key,
-                                             entry_handle, cb_data->cookie);
-    pthread_mutex_unlock(&cb_mutex);
+                                             entry_handle,
+                                             default_cb_data->cookie);
+    pthread_rwlock_unlock(&cb_lock);
     return PI_STATUS_SUCCESS;
   }
-  pthread_mutex_unlock(&cb_mutex);
+  pthread_rwlock_unlock(&cb_lock);
   return PI_STATUS_IDLE_TIMEOUT_NO_MATCHING_CB;
 }
 
@@ -487,3 +619,22 @@ pi_status_t pi_table_entry_get_remaining_ttl(pi_session_handle_t session_handle,
   return _pi_table_entry_get_remaining_ttl(session_handle, dev_id, table_id,
                                            entry_handle, ttl_ns);
 }
+
+pi_status_t pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns) {
+  const pi_p4info_t *p4info = pi_get_device_p4info(dev_id);
+  if (!p4info) return PI_STATUS_DEV_NOT_ASSIGNED;
+  if (!pi_p4info_table_supports_idle_timeout(p4info, table_id))
+    return PI_STATUS_TABLE_NO_IDLE_TIMEOUT;
+  pi_status_t status = _pi_table_entries_get_remaining_ttl(
+      session_handle, dev_id, table_id, num_entries, entry_handles, ttls_ns);
+  if (status != PI_STATUS_NOT_IMPLEMENTED_BY_TARGET) return status;
+  for (size_t i = 0; i < num_entries; i++) {
+    status = _pi_table_entry_get_remaining_ttl(
+        session_handle, dev_id, table_id, entry_handles[i], &ttls_ns[i]);
+    if (status != PI_STATUS_SUCCESS) return status;
+  }
+  return PI_STATUS_SUCCESS;
+}
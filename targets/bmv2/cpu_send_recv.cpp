@@ -120,6 +120,7 @@ CpuSendRecv::recv_loop() {
   int current_max_fd;
 
   struct timeval timeout;
+  pi_thread_start("bmv2_cpu_recv");
   while (1) {
     timeout.tv_sec = 0;
     timeout.tv_usec = 100000;
@@ -181,4 +182,22 @@ CpuSendRecv::send_pkt(pi_dev_id_t dev_id, const char *pkt, size_t size) {
   return -2;
 }
 
+int
+CpuSendRecv::send_pkts(pi_dev_id_t dev_id, const pi_packet_t *pkts,
+                       size_t num_pkts, size_t *num_sent) {
+  *num_sent = 0;
+  for (const auto &device : devices) {
+    if (device.dev_id != dev_id) continue;
+    for (; *num_sent < num_pkts; (*num_sent)++) {
+      const auto &pkt = pkts[*num_sent];
+      auto rc = pcap_sendpacket(
+          device.pcap, reinterpret_cast<const unsigned char *>(pkt.pkt),
+          static_cast<int>(pkt.size));
+      if (rc != 0) return rc;
+    }
+    return 0;
+  }
+  return -2;
+}
+
 }  // namespace pibmv2
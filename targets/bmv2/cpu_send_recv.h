@@ -42,6 +42,10 @@ class CpuSendRecv {
   int remove_device(pi_dev_id_t dev_id);
 
   int send_pkt(pi_dev_id_t dev_id, const char *pkt, size_t size);
+  // the device is looked up once for the whole batch; stops at the first
+  // packet which cannot be sent
+  int send_pkts(pi_dev_id_t dev_id, const pi_packet_t *pkts, size_t num_pkts,
+                size_t *num_sent);
 
  private:
   struct OneDevice {
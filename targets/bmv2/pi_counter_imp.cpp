@@ -24,7 +24,6 @@
 
 #include <iostream>
 #include <string>
-#include <thread>
 
 #include "common.h"
 #include "conn_mgr.h"
@@ -228,9 +227,12 @@ pi_status_t _pi_counter_hw_sync(pi_session_handle_t session_handle,
                                 pi_dev_tgt_t dev_tgt, pi_p4_id_t counter_id,
                                 PICounterHwSyncCb cb, void *cb_cookie) {
   (void)session_handle;
-  if (!cb) return PI_STATUS_SUCCESS;
-  std::thread cb_thread(cb, dev_tgt.dev_id, counter_id, cb_cookie);
-  cb_thread.detach();
+  (void)dev_tgt;
+  (void)counter_id;
+  (void)cb_cookie;
+  // nothing to sync, counters are always read directly from bmv2; PI takes
+  // care of invoking the callback asynchronously
+  if (cb) return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET;
   return PI_STATUS_SUCCESS;
 }
 
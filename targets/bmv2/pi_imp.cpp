@@ -166,6 +166,14 @@ pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
   return PI_STATUS_SUCCESS;
 }
 
+pi_status_t _pi_packetout_send_batch(pi_dev_id_t dev_id,
+                                     const pi_packet_t *pkts, size_t num_pkts,
+                                     size_t *num_sent) {
+  if (cpu_send_recv->send_pkts(dev_id, pkts, num_pkts, num_sent) != 0)
+    return PI_STATUS_PACKETOUT_SEND_ERROR;
+  return PI_STATUS_SUCCESS;
+}
+
 pi_status_t _pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                 pi_port_status_t *status) {
   (void)dev_id;
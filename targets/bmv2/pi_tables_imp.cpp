@@ -26,6 +26,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <string>
 #include <vector>
@@ -360,6 +361,146 @@ pi_status_t retrieve_entry_wkey(pi_dev_id_t dev_id, pi_p4_id_t table_id,
   return PI_STATUS_SUCCESS;
 }
 
+// Serializes the entries in the [first, last) range in the format expected by
+// pi_table_entries_next.
+void serialize_entries(const pi_p4info_t *p4info, pi_p4_id_t table_id,
+                       std::vector<BmMtEntry>::const_iterator first,
+                       std::vector<BmMtEntry>::const_iterator last,
+                       pi_table_fetch_res_t *res) {
+  auto num_entries = static_cast<size_t>(std::distance(first, last));
+  res->num_entries = num_entries;
+
+  size_t data_size = 0u;
+
+  data_size += num_entries * sizeof(s_pi_entry_handle_t);
+  // TODO(antonin): really needed of table type is enough?
+  data_size += num_entries * sizeof(s_pi_action_entry_type_t);
+  data_size += num_entries * sizeof(uint32_t);  // for priority
+  data_size += num_entries * sizeof(uint32_t);  // for properties
+  data_size += num_entries * sizeof(uint32_t);  // for direct resources
+
+  res->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
+  data_size += num_entries * res->mkey_nbytes;
+
+  size_t num_actions;
+  auto action_ids = pi_p4info_table_get_actions(p4info, table_id, &num_actions);
+  auto action_map = pibmv2::ADataSize::compute_action_sizes(p4info, action_ids,
+                                                            num_actions);
+
+  for (auto it = first; it != last; ++it) {
+    const auto &e = *it;
+    switch (e.action_entry.action_type) {
+      case BmActionEntryType::NONE:
+        break;
+      case BmActionEntryType::ACTION_DATA:
+        data_size += action_map.at(e.action_entry.action_name).s;
+        data_size += sizeof(s_pi_p4_id_t);  // action id
+        data_size += sizeof(uint32_t);  // action data nbytes
+        break;
+      case BmActionEntryType::MBR_HANDLE:
+      case BmActionEntryType::GRP_HANDLE:
+        data_size += sizeof(s_pi_indirect_handle_t);
+        break;
+    }
+  }
+
+  char *data = new char[data_size];
+  // in some cases, we do not use the whole buffer
+  std::fill(data, data + data_size, 0);
+  res->entries_size = data_size;
+  res->entries = data;
+
+  for (auto it = first; it != last; ++it) {
+    const auto &e = *it;
+    data += emit_entry_handle(data, e.entry_handle);
+    const auto &options = e.options;
+    // TODO(antonin): temporary hack; for match types which do not require a
+    // priority, bmv2 actually returns -1 instead of not setting the field, but
+    // the PI tends to expect 0, which is a problem for looking up entry state
+    // in the PI software. A more robust solution may be to ignore this value in
+    // the PI based on the key match type.
+    if (options.__isset.priority && options.priority != -1) {
+      data += emit_uint32(data, PriorityInverter::bm_to_pi(options.priority));
+    } else {
+      data += emit_uint32(data, 0);
+    }
+    for (const auto &p : e.match_key) {
+      switch (p.type) {
+        case BmMatchParamType::type::EXACT:
+          std::memcpy(data, p.exact.key.data(), p.exact.key.size());
+          data += p.exact.key.size();
+          break;
+        case BmMatchParamType::type::LPM:
+          std::memcpy(data, p.lpm.key.data(), p.lpm.key.size());
+          data += p.lpm.key.size();
+          data += emit_uint32(data, p.lpm.prefix_length);
+          break;
+        case BmMatchParamType::type::TERNARY:
+          std::memcpy(data, p.ternary.key.data(), p.ternary.key.size());
+          data += p.ternary.key.size();
+          std::memcpy(data, p.ternary.mask.data(), p.ternary.mask.size());
+          data += p.ternary.mask.size();
+          break;
+        case BmMatchParamType::type::VALID:
+          *data = p.valid.key;
+          data++;
+          break;
+        case BmMatchParamType::type::RANGE:
+          std::memcpy(data, p.range.start.data(), p.range.start.size());
+          data += p.range.start.size();
+          std::memcpy(data, p.range.end_.data(), p.range.end_.size());
+          data += p.range.end_.size();
+          break;
+      }
+    }
+
+    const auto &action_entry = e.action_entry;
+
+    switch (action_entry.action_type) {
+      case BmActionEntryType::NONE:
+        data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_NONE);
+        break;
+      case BmActionEntryType::ACTION_DATA:
+        {
+          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_DATA);
+          const auto &adata_size = action_map.at(action_entry.action_name);
+          data += emit_p4_id(data, adata_size.id);
+          data += emit_uint32(data, adata_size.s);
+          data = pibmv2::dump_action_data(p4info, data, adata_size.id,
+                                          action_entry.action_data);
+        }
+        break;
+      case BmActionEntryType::MBR_HANDLE:
+        {
+          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_INDIRECT);
+          auto indirect_handle =
+              static_cast<pi_indirect_handle_t>(action_entry.mbr_handle);
+          data += emit_indirect_handle(data, indirect_handle);
+        }
+        break;
+      case BmActionEntryType::GRP_HANDLE:
+        {
+          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_INDIRECT);
+          auto indirect_handle =
+              static_cast<pi_indirect_handle_t>(action_entry.mbr_handle);
+          indirect_handle = pibmv2::IndirectHMgr::make_grp_h(indirect_handle);
+          data += emit_indirect_handle(data, indirect_handle);
+        }
+        break;
+    }
+
+    data += emit_uint32(data, 0);  // properties
+    data += emit_uint32(data, 0);  // TODO(antonin): direct resources
+  }
+}
+
+// bmv2 does not support retrieving table entries by chunks; however we only
+// need to serialize (and therefore duplicate) one chunk at a time.
+struct FetchCursorState {
+  std::vector<BmMtEntry> entries;
+  size_t next{0};
+};
+
 }  // namespace
 
 
@@ -681,129 +822,64 @@ pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
     return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ito.code);
   }
 
-  res->num_entries = entries.size();
-
-  size_t data_size = 0u;
+  serialize_entries(p4info, table_id, entries.cbegin(), entries.cend(), res);
+  return PI_STATUS_SUCCESS;
+}
 
-  data_size += entries.size() * sizeof(s_pi_entry_handle_t);
-  // TODO(antonin): really needed of table type is enough?
-  data_size += entries.size() * sizeof(s_pi_action_entry_type_t);
-  data_size += entries.size() * sizeof(uint32_t);  // for priority
-  data_size += entries.size() * sizeof(uint32_t);  // for properties
-  data_size += entries.size() * sizeof(uint32_t);  // for direct resources
+pi_status_t _pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                          pi_dev_tgt_t dev_tgt,
+                                          pi_p4_id_t table_id,
+                                          pi_table_fetch_cursor_t *cursor) {
+  (void) session_handle;
 
-  res->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
-  data_size += entries.size() * res->mkey_nbytes;
+  pibmv2::device_info_t *d_info = pibmv2::get_device_info(dev_tgt.dev_id);
+  assert(d_info->assigned);
+  const pi_p4info_t *p4info = d_info->p4info;
 
-  size_t num_actions;
-  auto action_ids = pi_p4info_table_get_actions(p4info, table_id, &num_actions);
-  auto action_map = pibmv2::ADataSize::compute_action_sizes(p4info, action_ids,
-                                                            num_actions);
+  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
 
-  for (const auto &e : entries) {
-    switch (e.action_entry.action_type) {
-      case BmActionEntryType::NONE:
-        break;
-      case BmActionEntryType::ACTION_DATA:
-        data_size += action_map.at(e.action_entry.action_name).s;
-        data_size += sizeof(s_pi_p4_id_t);  // action id
-        data_size += sizeof(uint32_t);  // action data nbytes
-        break;
-      case BmActionEntryType::MBR_HANDLE:
-      case BmActionEntryType::GRP_HANDLE:
-        data_size += sizeof(s_pi_indirect_handle_t);
-        break;
-    }
+  auto *state = new FetchCursorState();
+  try {
+    conn_mgr_client(pibmv2::conn_mgr_state, dev_tgt.dev_id).c
+        ->bm_mt_get_entries(state->entries, 0, t_name);
+  } catch (InvalidTableOperation &ito) {
+    const char *what =
+        _TableOperationErrorCode_VALUES_TO_NAMES.find(ito.code)->second;
+    std::cout << "Invalid table (" << t_name << ") operation ("
+              << ito.code << "): " << what << std::endl;
+    delete state;
+    return static_cast<pi_status_t>(PI_STATUS_TARGET_ERROR + ito.code);
   }
 
-  char *data = new char[data_size];
-  // in some cases, we do not use the whole buffer
-  std::fill(data, data + data_size, 0);
-  res->entries_size = data_size;
-  res->entries = data;
+  cursor->target_state = state;
+  return PI_STATUS_SUCCESS;
+}
 
-  for (const auto &e : entries) {
-    data += emit_entry_handle(data, e.entry_handle);
-    const auto &options = e.options;
-    // TODO(antonin): temporary hack; for match types which do not require a
-    // priority, bmv2 actually returns -1 instead of not setting the field, but
-    // the PI tends to expect 0, which is a problem for looking up entry state
-    // in the PI software. A more robust solution may be to ignore this value in
-    // the PI based on the key match type.
-    if (options.__isset.priority && options.priority != -1) {
-      data += emit_uint32(data, PriorityInverter::bm_to_pi(options.priority));
-    } else {
-      data += emit_uint32(data, 0);
-    }
-    for (const auto &p : e.match_key) {
-      switch (p.type) {
-        case BmMatchParamType::type::EXACT:
-          std::memcpy(data, p.exact.key.data(), p.exact.key.size());
-          data += p.exact.key.size();
-          break;
-        case BmMatchParamType::type::LPM:
-          std::memcpy(data, p.lpm.key.data(), p.lpm.key.size());
-          data += p.lpm.key.size();
-          data += emit_uint32(data, p.lpm.prefix_length);
-          break;
-        case BmMatchParamType::type::TERNARY:
-          std::memcpy(data, p.ternary.key.data(), p.ternary.key.size());
-          data += p.ternary.key.size();
-          std::memcpy(data, p.ternary.mask.data(), p.ternary.mask.size());
-          data += p.ternary.mask.size();
-          break;
-        case BmMatchParamType::type::VALID:
-          *data = p.valid.key;
-          data++;
-          break;
-        case BmMatchParamType::type::RANGE:
-          std::memcpy(data, p.range.start.data(), p.range.start.size());
-          data += p.range.start.size();
-          std::memcpy(data, p.range.end_.data(), p.range.end_.size());
-          data += p.range.end_.size();
-          break;
-      }
-    }
+pi_status_t _pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                         pi_table_fetch_cursor_t *cursor,
+                                         size_t max_entries,
+                                         pi_table_fetch_res_t *res) {
+  (void) session_handle;
 
-    const auto &action_entry = e.action_entry;
+  pibmv2::device_info_t *d_info =
+      pibmv2::get_device_info(cursor->dev_tgt.dev_id);
+  assert(d_info->assigned);
+  const pi_p4info_t *p4info = d_info->p4info;
 
-    switch (action_entry.action_type) {
-      case BmActionEntryType::NONE:
-        data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_NONE);
-        break;
-      case BmActionEntryType::ACTION_DATA:
-        {
-          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_DATA);
-          const auto &adata_size = action_map.at(action_entry.action_name);
-          data += emit_p4_id(data, adata_size.id);
-          data += emit_uint32(data, adata_size.s);
-          data = pibmv2::dump_action_data(p4info, data, adata_size.id,
-                                          action_entry.action_data);
-        }
-        break;
-      case BmActionEntryType::MBR_HANDLE:
-        {
-          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_INDIRECT);
-          auto indirect_handle =
-              static_cast<pi_indirect_handle_t>(action_entry.mbr_handle);
-          data += emit_indirect_handle(data, indirect_handle);
-        }
-        break;
-      case BmActionEntryType::GRP_HANDLE:
-        {
-          data += emit_action_entry_type(data, PI_ACTION_ENTRY_TYPE_INDIRECT);
-          auto indirect_handle =
-              static_cast<pi_indirect_handle_t>(action_entry.mbr_handle);
-          indirect_handle = pibmv2::IndirectHMgr::make_grp_h(indirect_handle);
-          data += emit_indirect_handle(data, indirect_handle);
-        }
-        break;
-    }
+  auto *state = static_cast<FetchCursorState *>(cursor->target_state);
+  const auto &entries = state->entries;
+  auto num_entries = std::min(max_entries, entries.size() - state->next);
+  auto first = entries.cbegin() + state->next;
+  serialize_entries(p4info, cursor->table_id, first, first + num_entries, res);
+  state->next += num_entries;
+  return PI_STATUS_SUCCESS;
+}
 
-    data += emit_uint32(data, 0);  // properties
-    data += emit_uint32(data, 0);  // TODO(antonin): direct resources
-  }
+pi_status_t _pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor) {
+  (void) session_handle;
 
+  delete static_cast<FetchCursorState *>(cursor->target_state);
   return PI_STATUS_SUCCESS;
 }
 
@@ -864,4 +940,17 @@ pi_status_t _pi_table_entry_get_remaining_ttl(
   return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET;
 }
 
+pi_status_t _pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns) {
+  (void)session_handle;
+  (void)dev_id;
+  (void)table_id;
+  (void)num_entries;
+  (void)entry_handles;
+  (void)ttls_ns;
+  return PI_STATUS_NOT_IMPLEMENTED_BY_TARGET;
+}
+
 }
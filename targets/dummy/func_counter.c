@@ -22,51 +22,176 @@
 
 #include <Judy.h>
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-typedef struct {
+// Each thread increments its own array, so that target calls made from
+// different threads (e.g. for different devices) do not contend on a shared
+// lock. The arrays are merged when the counters are read. Judy arrays are not
+// thread-safe, so each array has its own lock, which is only contended when the
+// counters are being read. When a thread exits, its counts are merged into
+// exited_counts and its array is freed, so that memory does not grow with
+// thread churn (e.g. in the gRPC sync server thread pool).
+typedef struct func_counter_s {
+  pthread_mutex_t mutex;
   Pvoid_t array;
+  struct func_counter_s *next;
 } func_counter_t;
 
-static func_counter_t func_counter;
+static func_counter_t *func_counters = NULL;
+// counts for the threads which have exited
+static Pvoid_t exited_counts = (Pvoid_t)NULL;
+// protects the list of arrays and exited_counts, not the per-thread arrays
+// themselves
+static pthread_mutex_t func_counters_mutex = PTHREAD_MUTEX_INITIALIZER;
+// incremented by func_counter_destroy to invalidate the thread-local pointers;
+// read without holding func_counters_mutex, hence the atomic accesses
+static int generation = 0;
 
-void func_counter_init() { func_counter.array = (Pvoid_t)NULL; }
+static __thread func_counter_t *local_counter = NULL;
+static __thread int local_generation = -1;
+
+static pthread_key_t counter_key;
+static pthread_once_t counter_key_once = PTHREAD_ONCE_INIT;
+
+static void free_array(Pvoid_t *array) {
+  Word_t bytes_freed = 0;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic warning "-Wsign-compare"
+  JSLFA(bytes_freed, *array);
+#pragma GCC diagnostic pop
+  (void)bytes_freed;
+}
+
+// adds all the counts in src to dst
+static void merge_array(Pvoid_t *dst, Pvoid_t src) {
+  Word_t *PValue, *PMerged;
+  uint8_t index[128];  // max function name must be 128 bytes
+  index[0] = 0;
+  JSLF(PValue, src, index);
+  while (PValue != NULL) {
+    JSLI(PMerged, *dst, index);
+    *PMerged += *PValue;
+    JSLN(PValue, src, index);
+  }
+}
+
+// called when a thread which has incremented a counter exits
+static void counter_thread_exit(void *arg) {
+  func_counter_t *counter = arg;
+  pthread_mutex_lock(&func_counters_mutex);
+  // the counter was already freed by func_counter_destroy
+  if (local_generation != __atomic_load_n(&generation, __ATOMIC_RELAXED)) {
+    pthread_mutex_unlock(&func_counters_mutex);
+    return;
+  }
+  for (func_counter_t **it = &func_counters; *it != NULL; it = &(*it)->next) {
+    if (*it != counter) continue;
+    *it = counter->next;
+    break;
+  }
+  // no need to lock counter->mutex, as readers hold func_counters_mutex
+  merge_array(&exited_counts, counter->array);
+  pthread_mutex_unlock(&func_counters_mutex);
+  free_array(&counter->array);
+  pthread_mutex_destroy(&counter->mutex);
+  free(counter);
+  local_counter = NULL;
+}
+
+static void create_counter_key() {
+  pthread_key_create(&counter_key, counter_thread_exit);
+}
+
+void func_counter_init() {}
+
+static func_counter_t *get_local_counter() {
+  if (local_counter != NULL &&
+      local_generation == __atomic_load_n(&generation, __ATOMIC_ACQUIRE))
+    return local_counter;
+  pthread_once(&counter_key_once, create_counter_key);
+  func_counter_t *counter = malloc(sizeof(*counter));
+  pthread_mutex_init(&counter->mutex, NULL);
+  counter->array = (Pvoid_t)NULL;
+  pthread_mutex_lock(&func_counters_mutex);
+  counter->next = func_counters;
+  func_counters = counter;
+  local_generation = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&func_counters_mutex);
+  local_counter = counter;
+  pthread_setspecific(counter_key, counter);
+  return counter;
+}
 
 void func_counter_increment(const char *func_name) {
 #ifdef DEBUG
   printf("%s\n", func_name);
 #endif
+  func_counter_t *counter = get_local_counter();
   Word_t *PValue;
-  JSLI(PValue, func_counter.array, (const uint8_t *)func_name);
+  pthread_mutex_lock(&counter->mutex);
+  JSLI(PValue, counter->array, (const uint8_t *)func_name);
   (*PValue)++;
+  pthread_mutex_unlock(&counter->mutex);
 }
 
 int func_counter_get(const char *func_name) {
+  int count = -1;
   Word_t *PValue;
-  JSLG(PValue, func_counter.array, (const uint8_t *)func_name);
-  return (PValue == NULL) ? -1 : (int)*PValue;
+  pthread_mutex_lock(&func_counters_mutex);
+  JSLG(PValue, exited_counts, (const uint8_t *)func_name);
+  if (PValue != NULL) count = (int)*PValue;
+  for (func_counter_t *counter = func_counters; counter != NULL;
+       counter = counter->next) {
+    pthread_mutex_lock(&counter->mutex);
+    JSLG(PValue, counter->array, (const uint8_t *)func_name);
+    if (PValue != NULL)
+      count = (count == -1) ? (int)*PValue : count + (int)*PValue;
+    pthread_mutex_unlock(&counter->mutex);
+  }
+  pthread_mutex_unlock(&func_counters_mutex);
+  return count;
 }
 
 int func_counter_dump_to_file(const char *path) {
   FILE *f = fopen(path, "w");
   if (f == NULL) return 1;
+  Pvoid_t merged = (Pvoid_t)NULL;
   Word_t *PValue;
   uint8_t index[128];  // max function name must be 128 bytes
+  pthread_mutex_lock(&func_counters_mutex);
+  merge_array(&merged, exited_counts);
+  for (func_counter_t *counter = func_counters; counter != NULL;
+       counter = counter->next) {
+    pthread_mutex_lock(&counter->mutex);
+    merge_array(&merged, counter->array);
+    pthread_mutex_unlock(&counter->mutex);
+  }
+  pthread_mutex_unlock(&func_counters_mutex);
   index[0] = 0;
-  JSLF(PValue, func_counter.array, index);
+  JSLF(PValue, merged, index);
   while (PValue != NULL) {
     fprintf(f, "%s : %d\n", (char *)index, (int)*PValue);
-    JSLN(PValue, func_counter.array, index);
+    JSLN(PValue, merged, index);
   }
+  free_array(&merged);
   fclose(f);
   return 0;
 }
 
+// must not be called concurrently with func_counter_increment, as the arrays
+// are freed
 void func_counter_destroy() {
-  Word_t bytes_freed = 0;
-#pragma GCC diagnostic push
-#pragma GCC diagnostic warning "-Wsign-compare"
-  JSLFA(bytes_freed, func_counter.array);
-#pragma GCC diagnostic pop
-  (void)bytes_freed;
+  pthread_mutex_lock(&func_counters_mutex);
+  while (func_counters != NULL) {
+    func_counter_t *counter = func_counters;
+    func_counters = counter->next;
+    free_array(&counter->array);
+    pthread_mutex_destroy(&counter->mutex);
+    free(counter);
+  }
+  free_array(&exited_counts);
+  __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&func_counters_mutex);
 }
@@ -21,10 +21,23 @@
 #include "PI/target/pi_act_prof_imp.h"
 #include "PI/pi.h"
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include "func_counter.h"
 
+// The P4Runtime frontend maps member and group handles back to their
+// P4Runtime ids, so the handles we return need to be unique.
+static pi_indirect_handle_t next_handle = 0;
+static pthread_mutex_t next_handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pi_indirect_handle_t new_handle() {
+  pthread_mutex_lock(&next_handle_mutex);
+  pi_indirect_handle_t h = next_handle++;
+  pthread_mutex_unlock(&next_handle_mutex);
+  return h;
+}
+
 pi_status_t _pi_act_prof_mbr_create(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt,
                                     pi_p4_id_t act_prof_id,
@@ -34,7 +47,7 @@ pi_status_t _pi_act_prof_mbr_create(pi_session_handle_t session_handle,
   (void)dev_tgt;
   (void)act_prof_id;
   (void)action_data;
-  (void)mbr_handle;
+  *mbr_handle = new_handle();
   func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
@@ -71,7 +84,7 @@ pi_status_t _pi_act_prof_grp_create(pi_session_handle_t session_handle,
   (void)dev_tgt;
   (void)act_prof_id;
   (void)max_size;
-  (void)grp_handle;
+  *grp_handle = new_handle();
   func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
@@ -22,6 +22,7 @@
 #include "PI/pi.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "func_counter.h"
 
@@ -191,6 +192,38 @@ pi_status_t _pi_table_entries_fetch_done(pi_session_handle_t session_handle,
   return PI_STATUS_SUCCESS;
 }
 
+pi_status_t _pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                          pi_dev_tgt_t dev_tgt,
+                                          pi_p4_id_t table_id,
+                                          pi_table_fetch_cursor_t *cursor) {
+  (void)session_handle;
+  (void)dev_tgt;
+  (void)table_id;
+  (void)cursor;
+  func_counter_increment(__func__);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t _pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                         pi_table_fetch_cursor_t *cursor,
+                                         size_t max_entries,
+                                         pi_table_fetch_res_t *res) {
+  (void)session_handle;
+  (void)cursor;
+  (void)max_entries;
+  (void)res;
+  func_counter_increment(__func__);
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t _pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor) {
+  (void)session_handle;
+  (void)cursor;
+  func_counter_increment(__func__);
+  return PI_STATUS_SUCCESS;
+}
+
 pi_status_t _pi_table_idle_timeout_config_set(
     pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
     const pi_idle_timeout_config_t *config) {
@@ -213,3 +246,16 @@ pi_status_t _pi_table_entry_get_remaining_ttl(
   func_counter_increment(__func__);
   return PI_STATUS_SUCCESS;
 }
+
+pi_status_t _pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns) {
+  (void)session_handle;
+  (void)dev_id;
+  (void)table_id;
+  (void)entry_handles;
+  memset(ttls_ns, 0, num_entries * sizeof(*ttls_ns));
+  func_counter_increment(__func__);
+  return PI_STATUS_SUCCESS;
+}
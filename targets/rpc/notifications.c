@@ -20,6 +20,7 @@
 
 #include <PI/int/rpc_common.h>
 #include <PI/int/serialize.h>
+#include <PI/pi.h>
 #include <PI/target/pi_imp.h>
 #include <PI/target/pi_learn_imp.h>
 
@@ -77,6 +78,7 @@ static void handle_PKT(char *msg) {
 
 static void *receive_loop(void *arg) {
   (void)arg;
+  pi_thread_start("rpc_notifications");
   while (1) {
     char *msg = NULL;
     if (nn_recv(pub_socket, &msg, NN_MSG, 0) <= 0) {
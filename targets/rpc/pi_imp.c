@@ -353,6 +353,51 @@ pi_status_t _pi_packetout_send(pi_dev_id_t dev_id, const char *pkt,
   return wait_for_status(req_id);
 }
 
+// the whole batch is sent to the server as a single message, which saves one
+// round-trip per packet
+pi_status_t _pi_packetout_send_batch(pi_dev_id_t dev_id,
+                                     const pi_packet_t *pkts, size_t num_pkts,
+                                     size_t *num_sent) {
+  if (!state.init) return PI_STATUS_RPC_NOT_INIT;
+
+  size_t s = 0;
+  s += sizeof(req_hdr_t);
+  s += sizeof(s_pi_dev_id_t);
+  s += sizeof(uint32_t);  // num_pkts
+  for (size_t i = 0; i < num_pkts; i++) {
+    s += sizeof(uint32_t);
+    s += pkts[i].size;
+  }
+
+  char *req = nn_allocmsg(s, 0);
+  char *req_ = req;
+  pi_rpc_id_t req_id = state.req_id++;
+  req_ += emit_req_hdr(req_, req_id, PI_RPC_PACKETOUT_SEND_BATCH);
+  req_ += emit_dev_id(req_, dev_id);
+  req_ += emit_uint32(req_, num_pkts);
+  for (size_t i = 0; i < num_pkts; i++) {
+    req_ += emit_uint32(req_, pkts[i].size);
+    memcpy(req_, pkts[i].pkt, pkts[i].size);
+    req_ += pkts[i].size;
+  }
+
+  int rc = nn_send(state.s, &req, NN_MSG, 0);
+  if ((size_t)rc != s) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  typedef struct __attribute__((packed)) {
+    rep_hdr_t hdr;
+    uint32_t num_sent;
+  } rep_t;
+  rep_t rep;
+  rc = nn_recv(state.s, &rep, sizeof(rep), 0);
+  if (rc != sizeof(rep)) return PI_STATUS_RPC_TRANSPORT_ERROR;
+  pi_status_t status = retrieve_rep_hdr((char *)&rep, req_id);
+  uint32_t num_sent_;
+  retrieve_uint32((char *)&rep.num_sent, &num_sent_);
+  *num_sent = num_sent_;
+  return status;
+}
+
 pi_status_t _pi_port_status_get(pi_dev_id_t dev_id, pi_port_t port,
                                 pi_port_status_t *status) {
   (void)dev_id;
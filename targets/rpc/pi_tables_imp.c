@@ -336,6 +336,21 @@ pi_status_t _pi_table_entry_modify_wkey(pi_session_handle_t session_handle,
   return wait_for_status(req_id);
 }
 
+// num entries | mkey nbytes | entries size | entries
+static void retrieve_table_fetch_res(const char *rep,
+                                     pi_table_fetch_res_t *res) {
+  uint32_t tmp32;
+  rep += retrieve_uint32(rep, &tmp32);
+  res->num_entries = tmp32;
+  rep += retrieve_uint32(rep, &tmp32);
+  res->mkey_nbytes = tmp32;
+  rep += retrieve_uint32(rep, &tmp32);
+  res->entries_size = tmp32;
+
+  res->entries = malloc(res->entries_size);
+  memcpy(res->entries, rep, res->entries_size);
+}
+
 pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
                                     pi_dev_tgt_t dev_tgt, pi_p4_id_t table_id,
                                     pi_table_fetch_res_t *res) {
@@ -370,21 +385,116 @@ pi_status_t _pi_table_entries_fetch(pi_session_handle_t session_handle,
   }
   rep_ += sizeof(rep_hdr_t);
 
-  uint32_t tmp32;
-  rep_ += retrieve_uint32(rep_, &tmp32);
-  res->num_entries = tmp32;
-  rep_ += retrieve_uint32(rep_, &tmp32);
-  res->mkey_nbytes = tmp32;
-  rep_ += retrieve_uint32(rep_, &tmp32);
-  res->entries_size = tmp32;
+  retrieve_table_fetch_res(rep_, res);
 
-  res->entries = malloc(res->entries_size);
-  memcpy(res->entries, rep_, res->entries_size);
+  nn_freemsg(rep);
+  return status;
+}
+
+// The cursor is maintained by the server, which uses the fallback provided by
+// pi_table_entries_fetch_begin if its target does not support cursors.
+pi_status_t _pi_table_entries_fetch_begin(pi_session_handle_t session_handle,
+                                          pi_dev_tgt_t dev_tgt,
+                                          pi_p4_id_t table_id,
+                                          pi_table_fetch_cursor_t *cursor) {
+  if (!state.init) return PI_STATUS_RPC_NOT_INIT;
+
+  typedef struct __attribute__((packed)) {
+    req_hdr_t hdr;
+    s_pi_session_handle_t sess;
+    s_pi_dev_tgt_t dev_tgt;
+    s_pi_p4_id_t table_id;
+  } req_t;
+  req_t req;
+  char *req_ = (char *)&req;
+  pi_rpc_id_t req_id = state.req_id++;
+  req_ += emit_req_hdr(req_, req_id, PI_RPC_TABLE_ENTRIES_FETCH_BEGIN);
+  req_ += emit_session_handle(req_, session_handle);
+  req_ += emit_dev_tgt(req_, dev_tgt);
+  req_ += emit_p4_id(req_, table_id);
+
+  int rc = nn_send(state.s, &req, sizeof(req), 0);
+  if (rc != sizeof(req)) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  typedef struct __attribute__((packed)) {
+    rep_hdr_t hdr;
+    uint64_t cursor_id;
+  } rep_t;
+  rep_t rep;
+  rc = nn_recv(state.s, &rep, sizeof(rep), 0);
+  if (rc != sizeof(rep)) return PI_STATUS_RPC_TRANSPORT_ERROR;
+  pi_status_t status = retrieve_rep_hdr((char *)&rep, req_id);
+  if (status != PI_STATUS_SUCCESS) return status;
+
+  uint64_t cursor_id;
+  retrieve_uint64((char *)&rep.cursor_id, &cursor_id);
+  cursor->target_state = (void *)(uintptr_t)cursor_id;
+  return PI_STATUS_SUCCESS;
+}
+
+pi_status_t _pi_table_entries_fetch_next(pi_session_handle_t session_handle,
+                                         pi_table_fetch_cursor_t *cursor,
+                                         size_t max_entries,
+                                         pi_table_fetch_res_t *res) {
+  if (!state.init) return PI_STATUS_RPC_NOT_INIT;
+
+  typedef struct __attribute__((packed)) {
+    req_hdr_t hdr;
+    s_pi_session_handle_t sess;
+    uint64_t cursor_id;
+    uint32_t max_entries;
+  } req_t;
+  req_t req;
+  char *req_ = (char *)&req;
+  pi_rpc_id_t req_id = state.req_id++;
+  req_ += emit_req_hdr(req_, req_id, PI_RPC_TABLE_ENTRIES_FETCH_NEXT);
+  req_ += emit_session_handle(req_, session_handle);
+  req_ += emit_uint64(req_, (uintptr_t)cursor->target_state);
+  req_ += emit_uint32(req_, max_entries);
+
+  int rc = nn_send(state.s, &req, sizeof(req), 0);
+  if (rc != sizeof(req)) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  char *rep = NULL;
+  int bytes = nn_recv(state.s, &rep, NN_MSG, 0);
+  if (bytes <= 0) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  char *rep_ = rep;
+  pi_status_t status = retrieve_rep_hdr(rep_, req_id);
+  if (status != PI_STATUS_SUCCESS) {
+    nn_freemsg(rep);
+    return status;
+  }
+  rep_ += sizeof(rep_hdr_t);
+
+  retrieve_table_fetch_res(rep_, res);
 
   nn_freemsg(rep);
   return status;
 }
 
+pi_status_t _pi_table_entries_fetch_end(pi_session_handle_t session_handle,
+                                        pi_table_fetch_cursor_t *cursor) {
+  if (!state.init) return PI_STATUS_RPC_NOT_INIT;
+
+  typedef struct __attribute__((packed)) {
+    req_hdr_t hdr;
+    s_pi_session_handle_t sess;
+    uint64_t cursor_id;
+  } req_t;
+  req_t req;
+  char *req_ = (char *)&req;
+  pi_rpc_id_t req_id = state.req_id++;
+  req_ += emit_req_hdr(req_, req_id, PI_RPC_TABLE_ENTRIES_FETCH_END);
+  req_ += emit_session_handle(req_, session_handle);
+  req_ += emit_uint64(req_, (uintptr_t)cursor->target_state);
+
+  int rc = nn_send(state.s, &req, sizeof(req), 0);
+  if (rc != sizeof(req)) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  return wait_for_status(req_id);
+}
+
 pi_status_t _pi_table_entries_fetch_one(pi_session_handle_t session_handle,
                                         pi_dev_id_t dev_id, pi_p4_id_t table_id,
                                         pi_entry_handle_t entry_handle,
@@ -437,3 +547,50 @@ pi_status_t _pi_table_entry_get_remaining_ttl(
   (void)ttl_ns;
   return PI_STATUS_RPC_NOT_IMPLEMENTED;
 }
+
+pi_status_t _pi_table_entries_get_remaining_ttl(
+    pi_session_handle_t session_handle, pi_dev_id_t dev_id, pi_p4_id_t table_id,
+    size_t num_entries, const pi_entry_handle_t *entry_handles,
+    uint64_t *ttls_ns) {
+  if (!state.init) return PI_STATUS_RPC_NOT_INIT;
+
+  size_t s = 0;
+  s += sizeof(req_hdr_t);
+  s += sizeof(s_pi_session_handle_t);
+  s += sizeof(s_pi_dev_id_t);
+  s += sizeof(s_pi_p4_id_t);
+  s += sizeof(uint32_t);  // num entries
+  s += num_entries * sizeof(s_pi_entry_handle_t);
+
+  char *req = nn_allocmsg(s, 0);
+  char *req_ = req;
+  pi_rpc_id_t req_id = state.req_id++;
+  req_ += emit_req_hdr(req_, req_id, PI_RPC_TABLE_ENTRIES_GET_REMAINING_TTL);
+  req_ += emit_session_handle(req_, session_handle);
+  req_ += emit_dev_id(req_, dev_id);
+  req_ += emit_p4_id(req_, table_id);
+  req_ += emit_uint32(req_, num_entries);
+  for (size_t i = 0; i < num_entries; i++)
+    req_ += emit_entry_handle(req_, entry_handles[i]);
+
+  int rc = nn_send(state.s, &req, NN_MSG, 0);
+  if ((size_t)rc != s) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  char *rep = NULL;
+  int bytes = nn_recv(state.s, &rep, NN_MSG, 0);
+  if (bytes <= 0) return PI_STATUS_RPC_TRANSPORT_ERROR;
+
+  char *rep_ = rep;
+  pi_status_t status = retrieve_rep_hdr(rep_, req_id);
+  if (status != PI_STATUS_SUCCESS) {
+    nn_freemsg(rep);
+    return status;
+  }
+  rep_ += sizeof(rep_hdr_t);
+
+  for (size_t i = 0; i < num_entries; i++)
+    rep_ += retrieve_uint64(rep_, &ttls_ns[i]);
+
+  nn_freemsg(rep);
+  return PI_STATUS_SUCCESS;
+}
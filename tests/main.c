@@ -28,6 +28,8 @@ extern void test_bmv2_json_reader();
 extern void test_getnetv();
 extern void test_p4info();
 extern void test_frontends_generic();
+extern void test_sw_aging();
+extern void test_async();
 
 static void run() {
 #ifdef TEST_BMV2_JSON_READER
@@ -42,6 +44,12 @@ static void run() {
 #ifdef TEST_FRONTENDS_GENERIC
   test_frontends_generic();
 #endif
+#ifdef TEST_SW_AGING
+  test_sw_aging();
+#endif
+#ifdef TEST_ASYNC
+  test_async();
+#endif
 }
 
 int main(int argc, const char *argv[]) {
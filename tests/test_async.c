@@ -0,0 +1,148 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "PI/pi_async.h"
+#include "pi_async_int.h"
+
+#include "unity/unity_fixture.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_JOBS 256
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int done[MAX_JOBS];
+static size_t num_done;
+static int num_running[2];
+static int max_running[2];
+static bool gate_open;
+
+static void sleep_us(long us) {
+  struct timespec ts = {0, us * 1000};
+  nanosleep(&ts, NULL);
+}
+
+static void record_job(pi_dev_id_t dev_id, void *cookie) {
+  pthread_mutex_lock(&lock);
+  if (++num_running[dev_id] > max_running[dev_id])
+    max_running[dev_id] = num_running[dev_id];
+  pthread_mutex_unlock(&lock);
+  sleep_us(100);
+  pthread_mutex_lock(&lock);
+  num_running[dev_id]--;
+  done[num_done++] = *(int *)cookie;
+  pthread_mutex_unlock(&lock);
+}
+
+static void wait_gate_job(pi_dev_id_t dev_id, void *cookie) {
+  (void)dev_id;
+  (void)cookie;
+  pthread_mutex_lock(&lock);
+  while (!gate_open) pthread_cond_wait(&cond, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+static void open_gate_job(pi_dev_id_t dev_id, void *cookie) {
+  (void)dev_id;
+  (void)cookie;
+  pthread_mutex_lock(&lock);
+  gate_open = true;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+static int ids[MAX_JOBS];
+
+TEST_GROUP(Async);
+
+TEST_SETUP(Async) {
+  num_done = 0;
+  memset(num_running, 0, sizeof(num_running));
+  memset(max_running, 0, sizeof(max_running));
+  gate_open = false;
+  for (int i = 0; i < MAX_JOBS; i++) ids[i] = i;
+}
+
+TEST_TEAR_DOWN(Async) { pi_async_destroy(); }
+
+TEST(Async, InOrder) {
+  const size_t num_jobs = 64;
+  for (size_t i = 0; i < num_jobs; i++)
+    TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS,
+                          pi_async_submit(0, record_job, &ids[i]));
+  pi_async_flush(0);
+  TEST_ASSERT_EQUAL_UINT(num_jobs, num_done);
+  for (size_t i = 0; i < num_jobs; i++) TEST_ASSERT_EQUAL_INT(i, done[i]);
+  // at most one job in-flight per device
+  TEST_ASSERT_EQUAL_INT(1, max_running[0]);
+}
+
+TEST(Async, DevicesIndependent) {
+  // the job for device 0 can only complete once the job for device 1 has run
+  pi_async_submit(0, wait_gate_job, NULL);
+  pi_async_submit(1, open_gate_job, NULL);
+  pi_async_flush(1);
+  pi_async_flush(0);
+  TEST_ASSERT_TRUE(gate_open);
+}
+
+TEST(Async, MaxThreads) {
+  pi_async_set_max_threads(1);
+  for (size_t i = 0; i < 16; i++) {
+    pi_async_submit(0, record_job, &ids[i]);
+    pi_async_submit(1, record_job, &ids[i]);
+  }
+  pi_async_flush(0);
+  pi_async_flush(1);
+  TEST_ASSERT_EQUAL_UINT(32, num_done);
+  pi_async_set_max_threads(PI_ASYNC_DEFAULT_MAX_THREADS);
+}
+
+TEST(Async, RemoveDevice) {
+  for (size_t i = 0; i < 16; i++) pi_async_submit(0, record_job, &ids[i]);
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS, pi_async_remove_device(0));
+  TEST_ASSERT_EQUAL_UINT(16, num_done);
+  // unknown device
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS, pi_async_flush(0));
+}
+
+TEST(Async, DestroyRunsPendingJobs) {
+  for (size_t i = 0; i < 16; i++) pi_async_submit(0, record_job, &ids[i]);
+  pi_async_destroy();
+  TEST_ASSERT_EQUAL_UINT(16, num_done);
+  // the pool can be used again
+  pi_async_submit(0, record_job, &ids[16]);
+  pi_async_flush(0);
+  TEST_ASSERT_EQUAL_UINT(17, num_done);
+}
+
+TEST_GROUP_RUNNER(Async) {
+  RUN_TEST_CASE(Async, InOrder);
+  RUN_TEST_CASE(Async, DevicesIndependent);
+  RUN_TEST_CASE(Async, MaxThreads);
+  RUN_TEST_CASE(Async, RemoveDevice);
+  RUN_TEST_CASE(Async, DestroyRunsPendingJobs);
+}
+
+void test_async() { RUN_TEST_GROUP(Async); }
@@ -0,0 +1,250 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include "PI/target/pi_sw_aging.h"
+
+#include "unity/unity_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_HANDLES 4096
+#define TICK_NS 1000u
+
+static pi_sw_aging_t *aging;
+static pi_sw_aging_config_t config;
+
+// fake clock and fake target hit state
+static uint64_t fake_now_ns;
+static uint64_t hit_states[MAX_HANDLES];
+static size_t num_queries;
+static size_t num_expired;
+static pi_entry_handle_t expired[MAX_HANDLES];
+
+static const pi_p4_id_t t1 = 1;
+static const pi_p4_id_t t2 = 2;
+
+static uint64_t fake_clock(void *cookie) {
+  (void)cookie;
+  return fake_now_ns;
+}
+
+static pi_status_t hit_query(pi_dev_id_t dev_id, pi_p4_id_t table_id,
+                             size_t num_entries,
+                             const pi_entry_handle_t *entry_handles,
+                             uint64_t *states, void *cookie) {
+  (void)dev_id;
+  (void)table_id;
+  (void)cookie;
+  num_queries++;
+  for (size_t i = 0; i < num_entries; i++) {
+    states[i] = hit_states[entry_handles[i]];
+    // hit bits are cleared on read
+    if (config.hit_mode == PI_SW_AGING_HIT_BITS)
+      hit_states[entry_handles[i]] = 0;
+  }
+  return PI_STATUS_SUCCESS;
+}
+
+static void expire(pi_dev_id_t dev_id, pi_p4_id_t table_id,
+                   pi_entry_handle_t entry_handle, void *cookie) {
+  (void)dev_id;
+  (void)table_id;
+  (void)cookie;
+  expired[num_expired++] = entry_handle;
+}
+
+static void advance_and_sweep(uint64_t ns) {
+  fake_now_ns += ns;
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS, pi_sw_aging_sweep(aging));
+}
+
+static void reset_counts() {
+  num_queries = 0;
+  num_expired = 0;
+}
+
+static void create(pi_sw_aging_hit_mode_t hit_mode, size_t num_slots) {
+  memset(&config, 0, sizeof(config));
+  config.tick_ns = TICK_NS;
+  config.num_slots = num_slots;
+  config.hit_mode = hit_mode;
+  config.hit_query_fn = hit_query;
+  config.expire_fn = expire;
+  config.clock_fn = fake_clock;
+  aging = pi_sw_aging_create(0, &config);
+  TEST_ASSERT_NOT_NULL(aging);
+}
+
+TEST_GROUP(SwAging);
+
+TEST_SETUP(SwAging) {
+  fake_now_ns = 1000 * TICK_NS;
+  memset(hit_states, 0, sizeof(hit_states));
+  reset_counts();
+  create(PI_SW_AGING_HIT_BITS, 64);
+}
+
+TEST_TEAR_DOWN(SwAging) { pi_sw_aging_destroy(aging); }
+
+TEST(SwAging, Expire) {
+  const pi_entry_handle_t h = 1;
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS,
+                        pi_sw_aging_entry_add(aging, t1, h, 10 * TICK_NS));
+  advance_and_sweep(5 * TICK_NS);
+  // hit state is only queried for entries which are about to expire
+  TEST_ASSERT_EQUAL_UINT(0, num_queries);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(7 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_queries);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+  TEST_ASSERT_EQUAL_UINT64(h, expired[0]);
+  // reported again if still idle after another TTL
+  reset_counts();
+  advance_and_sweep(5 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(7 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+}
+
+TEST(SwAging, HitRefreshes) {
+  const pi_entry_handle_t h = 1;
+  pi_sw_aging_entry_add(aging, t1, h, 10 * TICK_NS);
+  hit_states[h] = 1;
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_queries);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(2, num_queries);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+}
+
+TEST(SwAging, Counters) {
+  pi_sw_aging_destroy(aging);
+  create(PI_SW_AGING_COUNTERS, 64);
+  const pi_entry_handle_t h = 1;
+  pi_sw_aging_entry_add(aging, t1, h, 10 * TICK_NS);
+  hit_states[h] = 3;
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  // counter value did not change
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+}
+
+TEST(SwAging, BatchedQueries) {
+  const size_t num_entries_1 = 1000, num_entries_2 = 500;
+  for (size_t i = 0; i < num_entries_1; i++)
+    pi_sw_aging_entry_add(aging, t1, i, 10 * TICK_NS);
+  for (size_t i = 0; i < num_entries_2; i++)
+    pi_sw_aging_entry_add(aging, t2, num_entries_1 + i, 10 * TICK_NS);
+  advance_and_sweep(12 * TICK_NS);
+  // one query per table
+  TEST_ASSERT_EQUAL_UINT(2, num_queries);
+  TEST_ASSERT_EQUAL_UINT(num_entries_1 + num_entries_2, num_expired);
+}
+
+TEST(SwAging, LongTTL) {
+  // TTL is larger than a full rotation of the 64-slot wheel
+  const pi_entry_handle_t h = 1;
+  pi_sw_aging_entry_add(aging, t1, h, 200 * TICK_NS);
+  for (int i = 0; i < 19; i++) advance_and_sweep(10 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_queries);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+}
+
+TEST(SwAging, RemoveAndModify) {
+  const pi_entry_handle_t h1 = 1, h2 = 2;
+  pi_sw_aging_entry_add(aging, t1, h1, 10 * TICK_NS);
+  pi_sw_aging_entry_add(aging, t1, h2, 10 * TICK_NS);
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS,
+                        pi_sw_aging_entry_remove(aging, t1, h1));
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_TARGET_ERROR,
+                        pi_sw_aging_entry_remove(aging, t1, h1));
+  advance_and_sweep(5 * TICK_NS);
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS,
+                        pi_sw_aging_entry_set_ttl(aging, t1, h2, 20 * TICK_NS));
+  advance_and_sweep(10 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+  TEST_ASSERT_EQUAL_UINT64(h2, expired[0]);
+  // ageing disabled
+  reset_counts();
+  pi_sw_aging_entry_set_ttl(aging, t1, h2, 0);
+  advance_and_sweep(100 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_queries);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+}
+
+TEST(SwAging, TableClear) {
+  for (size_t i = 0; i < 16; i++)
+    pi_sw_aging_entry_add(aging, t1, i, 10 * TICK_NS);
+  pi_sw_aging_entry_add(aging, t2, 16, 10 * TICK_NS);
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS, pi_sw_aging_table_clear(aging, t1));
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+  TEST_ASSERT_EQUAL_UINT64(16, expired[0]);
+}
+
+TEST(SwAging, RemainingTTL) {
+  const pi_entry_handle_t hs[2] = {1, 2};
+  uint64_t ttls[2];
+  pi_sw_aging_entry_add(aging, t1, hs[0], 100 * TICK_NS);
+  pi_sw_aging_entry_add(aging, t1, hs[1], 0);
+  advance_and_sweep(40 * TICK_NS);
+  TEST_ASSERT_EQUAL_INT(PI_STATUS_SUCCESS,
+                        pi_sw_aging_entries_get_remaining_ttl(aging, t1, 2, hs,
+                                                              ttls));
+  TEST_ASSERT_EQUAL_UINT(1, num_queries);
+  TEST_ASSERT_EQUAL_UINT64(60 * TICK_NS, ttls[0]);
+  TEST_ASSERT_EQUAL_UINT64(0, ttls[1]);
+  // a hit resets the remaining TTL
+  hit_states[hs[0]] = 1;
+  pi_sw_aging_entries_get_remaining_ttl(aging, t1, 1, hs, ttls);
+  TEST_ASSERT_EQUAL_UINT64(100 * TICK_NS, ttls[0]);
+  // the deadline was pushed back in the wheel as well
+  advance_and_sweep(90 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(0, num_expired);
+  advance_and_sweep(12 * TICK_NS);
+  TEST_ASSERT_EQUAL_UINT(1, num_expired);
+  pi_sw_aging_entries_get_remaining_ttl(aging, t1, 1, hs, ttls);
+  TEST_ASSERT_EQUAL_UINT64(0, ttls[0]);
+  // unknown entry
+  const pi_entry_handle_t bad_h = 99;
+  TEST_ASSERT_EQUAL_INT(
+      PI_STATUS_TARGET_ERROR,
+      pi_sw_aging_entries_get_remaining_ttl(aging, t1, 1, &bad_h, ttls));
+}
+
+TEST_GROUP_RUNNER(SwAging) {
+  RUN_TEST_CASE(SwAging, Expire);
+  RUN_TEST_CASE(SwAging, HitRefreshes);
+  RUN_TEST_CASE(SwAging, Counters);
+  RUN_TEST_CASE(SwAging, BatchedQueries);
+  RUN_TEST_CASE(SwAging, LongTTL);
+  RUN_TEST_CASE(SwAging, RemoveAndModify);
+  RUN_TEST_CASE(SwAging, TableClear);
+  RUN_TEST_CASE(SwAging, RemainingTTL);
+}
+
+void test_sw_aging() { RUN_TEST_GROUP(SwAging); }